@@ -0,0 +1,134 @@
+/* ast.c - node arena of the syntax tree and its dump */
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "front.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define AST_HAVE_MMAP 1
+#include <sys/mman.h>
+#endif
+
+/* What a dump calls each kind */
+static const char *const kindNames[AST_KIND_COUNT] = {
+    [AST_BLOCK] = "block", [AST_DECL] = "decl", [AST_ASSIGN] = "assign", [AST_IF] = "if",
+    [AST_WHILE] = "while", [AST_FOR] = "for", [AST_BREAK] = "break", [AST_CONTINUE] = "continue",
+    [AST_BINARY] = "binary", [AST_NOT] = "not", [AST_NAME] = "name", [AST_INT] = "int",
+    [AST_FLOAT] = "float", [AST_BOOL] = "bool", [AST_CHAR] = "char", [AST_STRING] = "string",
+    [AST_CONST] = "const", [AST_INDEX] = "index",
+};
+
+/* How many of kids[] are subtrees for each kind; the rest may hold other numbers */
+static const int kidCounts[AST_KIND_COUNT] = {
+    [AST_BLOCK] = 1, [AST_DECL] = 2, [AST_ASSIGN] = 2, [AST_IF] = 3, [AST_WHILE] = 2, [AST_FOR] = 4,
+    [AST_BINARY] = 2, [AST_NOT] = 1, [AST_INDEX] = 1,
+};
+
+/* Spelling of every keyword, for the type of a node */
+static const char *const keywordSpellings[UNREGISTERED_SYMBOL + 1] = {
+#define KEYWORD(token, spelling) [token] = spelling,
+#include "keywords.def"
+#undef KEYWORD
+};
+
+void astInit(Ast *ast, size_t maxNodes) {
+    memset(ast, 0, sizeof(*ast));
+    if (maxNodes > UINT32_MAX)
+        maxNodes = UINT32_MAX;
+#ifdef AST_HAVE_MMAP
+    /* Reserve room for every node the file can need up front; pages are only backed once the parser
+       reaches them, and nodes never move */
+    if (maxNodes > 1) {
+        void *base = mmap(NULL, maxNodes * sizeof(AstNode), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base != MAP_FAILED) {
+#ifdef MADV_HUGEPAGE
+            madvise(base, maxNodes * sizeof(AstNode), MADV_HUGEPAGE);
+#endif
+            ast->nodes = base;
+            ast->cap = (uint32_t) maxNodes;
+            ast->count = 1;     /* node 0, AST_NONE, is already zero */
+            ast->mapped = 1;
+        }
+    }
+#endif
+}
+
+void astFree(Ast *ast) {
+#ifdef AST_HAVE_MMAP
+    if (ast->mapped)
+        munmap(ast->nodes, (size_t) ast->cap * sizeof(AstNode));
+    else
+#endif
+        free(ast->nodes);
+    memset(ast, 0, sizeof(*ast));
+}
+
+int astGrow(Ast *ast) {
+    uint32_t cap = ast->cap ? ast->cap * 2 : 1024;
+    AstNode *nodes;
+
+    if (ast->mapped || cap <= ast->cap || (nodes = realloc(ast->nodes, (size_t) cap * sizeof(*nodes))) == NULL)
+        return -1;
+    if (ast->count == 0) {
+        /* Node 0 is AST_NONE */
+        memset(&nodes[0], 0, sizeof(*nodes));
+        ast->count = 1;
+    }
+    ast->nodes = nodes;
+    ast->cap = cap;
+    return 0;
+}
+
+/* A node waiting to be dumped */
+typedef struct {
+    AstRef ref;
+    int depth;
+} Pending;
+
+void astDump(const Ast *ast, AstRef root, const uint16_t *source, Sink *out) {
+    Pending *stack = NULL;
+    size_t depth = 0, cap = 0;
+
+    /* Pre-order without recursion, so a tree as deep as the parser accepts can be dumped: a node is
+       printed when popped, then its next statement and its kids (last first) are pushed */
+    if (root != AST_NONE) {
+        if ((stack = malloc(64 * sizeof(*stack))) == NULL)
+            return;
+        cap = 64;
+        stack[depth++] = (Pending) {root, 0};
+    }
+    while (depth > 0) {
+        Pending top = stack[--depth];
+        const AstNode *node = &ast->nodes[top.ref];
+        const uint16_t *text = source + node->offset;
+        size_t length = node->length;
+        uint16_t value[VM_FORMAT_MAX];
+        int k;
+
+        if (node->kind == AST_CONST) {
+            /* Its value rather than the expression it replaced */
+            Value v;
+            uint64_t bits = astBits(node);
+            v.type = node->type;
+            memcpy(&v.as, &bits, sizeof(bits));
+            text = value;
+            length = vmFormat(&v, value);
+        }
+        sinkNode(out, top.depth, kindNames[node->kind], node->type != 0 ? keywordSpellings[node->type] : NULL,
+                 text, length);
+        if (depth + 5 > cap) {
+            Pending *grown = realloc(stack, cap * 2 * sizeof(*stack));
+            if (grown == NULL)
+                break;
+            stack = grown;
+            cap *= 2;
+        }
+        if (node->next != AST_NONE)
+            stack[depth++] = (Pending) {node->next, top.depth};
+        for (k = kidCounts[node->kind] - 1; k >= 0; k--)
+            if (node->kids[k] != AST_NONE)
+                stack[depth++] = (Pending) {node->kids[k], top.depth + 1};
+    }
+    free(stack);
+}
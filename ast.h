@@ -0,0 +1,114 @@
+/* ast.h - the syntax tree the parser builds, one arena of nodes per analyzed file
+ *
+ * Nodes live in a single array and refer to each other by 32-bit index rather than by pointer, so a node
+ * is 32 bytes. The array is a bump arena: every token makes at most one node, so room for the whole file is
+ * reserved as address space up front, nodes are handed out in order and never move, and the tree goes with
+ * one munmap. Where nothing can be mapped the array grows by realloc instead, which indexes survive.
+ * Names and literals are not copied: a node keeps where its token sits in the source, and a number literal
+ * also the value the lexer read from it.
+ */
+#ifndef AST_H
+#define AST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sink.h"
+
+/* Index of a node in its Ast; AST_NONE (node 0 is never handed out) stands for no node */
+typedef uint32_t AstRef;
+#define AST_NONE 0
+
+/* Node kinds, with what op and kids hold for each */
+#define AST_BLOCK 1     /* kids[0]: first statement, the others follow through next */
+#define AST_DECL 2      /* op: type keyword token; source: the name; kids[0]: initial value or AST_NONE;
+                           kids[1]: for an array, its length (an AST_INT), else AST_NONE */
+#define AST_ASSIGN 3    /* source: the name; kids[0]: the value; kids[1]: for an element of an array, its index */
+#define AST_IF 4        /* kids[0]: condition; kids[1]: then block; kids[2]: else block or AST_NONE */
+#define AST_WHILE 5     /* kids[0]: condition; kids[1]: body */
+#define AST_FOR 6       /* kids[0]: first assignment; kids[1]: condition; kids[2]: step assignment; kids[3]: body */
+#define AST_BREAK 7
+#define AST_CONTINUE 8
+#define AST_BINARY 9    /* op: operator token; kids[0], kids[1]: operands */
+#define AST_NOT 10      /* kids[0]: operand */
+#define AST_NAME 11     /* source: the identifier */
+#define AST_INT 12      /* source: the digits; kids[0..1]: the bits of its value, an int64_t, as the lexer read it */
+#define AST_FLOAT 13    /* source: the digits and ','; kids[0..1]: the bits of its value, read as a double */
+#define AST_BOOL 14     /* op: TRUE_VAL or FALSE_VAL */
+#define AST_CHAR 15     /* source: the character between the quotes */
+#define AST_STRING 16   /* source: the text between the quotes */
+#define AST_CONST 17    /* a value worked out by the optimizer (opt.c); type: its TYPE_; kids[0..1]: the bits of its
+                           Value payload (vm.h); source: the expression it replaced */
+#define AST_INDEX 18    /* an element of an array; source: the array's name; kids[0]: the index */
+#define AST_KIND_COUNT 19
+
+/* Once checked, kids[AST_VAR] of an AST_DECL, AST_ASSIGN, AST_NAME or AST_INDEX numbers the variable it names
+   (see symtab.h) */
+#define AST_VAR 3
+
+typedef struct {
+    uint8_t kind;       /* One of the AST_ kinds */
+    uint8_t op;         /* Token code the kind needs, see above */
+    uint8_t type;       /* TYPE_ token of the value, once checked; the declared type of an AST_DECL */
+    uint8_t unused;
+    uint32_t offset;    /* Code unit index of the node's token in the source */
+    uint32_t length;    /* ... and its length in code units */
+    AstRef next;        /* Following statement in the same block */
+    AstRef kids[4];
+} AstNode;
+
+typedef struct {
+    AstNode *nodes;
+    uint32_t count;     /* nodes handed out, counting the unused node 0 */
+    uint32_t cap;
+    int mapped;         /* 1 if nodes is a reservation from mmap, 0 if from malloc */
+} Ast;
+
+/* astInit - an empty tree with room reserved for maxNodes nodes (node 0 included) where memory can be mapped */
+void astInit(Ast *ast, size_t maxNodes);
+
+/* astFree - release every node of the tree at once */
+void astFree(Ast *ast);
+
+/* astGrow - make room for more nodes; returns -1 when memory, the reservation or the 32-bit index space runs out */
+int astGrow(Ast *ast);
+
+/* astNew - a new node with no kids; returns AST_NONE when it cannot be had */
+static inline AstRef astNew(Ast *ast, int kind, int op, size_t offset, size_t length) {
+    AstNode *node;
+
+    if (ast->count == ast->cap && astGrow(ast) != 0)
+        return AST_NONE;
+    node = &ast->nodes[ast->count];
+    node->kind = (uint8_t) kind;
+    node->op = (uint8_t) op;
+    node->type = node->unused = 0;
+    node->offset = (uint32_t) offset;
+    node->length = (uint32_t) length;
+    node->next = node->kids[0] = node->kids[1] = node->kids[2] = node->kids[3] = AST_NONE;
+    return ast->count++;
+}
+
+/* astBits - the payload of an AST_CONST, AST_INT or AST_FLOAT node */
+static inline uint64_t astBits(const AstNode *node) {
+    return (uint64_t) node->kids[0] | (uint64_t) node->kids[1] << 32;
+}
+
+/* astSetPayload - make bits the payload of node, whatever its kind */
+static inline void astSetPayload(AstNode *node, uint64_t bits) {
+    node->kids[0] = (AstRef) bits;
+    node->kids[1] = (AstRef) (bits >> 32);
+}
+
+/* astSetBits - make node an AST_CONST holding bits */
+static inline void astSetBits(AstNode *node, uint64_t bits) {
+    node->kind = AST_CONST;
+    node->op = 0;
+    astSetPayload(node, bits);
+    node->kids[2] = node->kids[3] = AST_NONE;
+}
+
+/* astDump - write the tree under root to out, one node per line, indented by depth; source is the analyzed text */
+void astDump(const Ast *ast, AstRef root, const uint16_t *source, Sink *out);
+
+#endif
@@ -0,0 +1,866 @@
+/* bench.c - microbenchmarks for the TR-701 front end
+ *
+ * Usage: tr_bench [NAME...]   (no names runs every benchmark)
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <time.h>
+#include <locale.h>
+
+#include "cache.h"
+#include "front.h"
+#include "kernel.h"
+#include "literal.h"
+#include "scan.h"
+
+/* A named benchmark */
+typedef struct {
+    const char *name;
+    void (*run)();
+} Benchmark;
+
+/* Results go here so the compiler cannot drop the measured work */
+static volatile long sink;
+
+/* Benchmarks that stopped on an error; any makes the exit status 1 */
+static int failures;
+
+/* now - monotonic time in seconds */
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+/* report - print one measurement as nanoseconds per operation */
+static void report(const char *what, double seconds, long operations) {
+    printf("  %-28s %8.2f ns/op  (%ld ops in %.3f s)\n", what, seconds * 1e9 / (double) operations, operations, seconds);
+}
+
+/* fail - print why a benchmark stopped instead of a measurement, and count it */
+static void fail(const char *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    failures++;
+}
+
+/************************************************************************************/
+
+#define KEYWORD_ROUNDS 2000000
+
+/* Lexemes as they show up in TR-701 code: mostly identifiers, with keywords in between */
+static const wchar_t *const lexemeMix[] = {
+    L"x", L"sayı", L"karakter", L"tam", L"flag", L"toplam", L"mantık", L"yazı_1", L"i", L"sum",
+    L"madem", L"total", L"değer", L"iken", L"sayaç", L"harf", L"küsurat", L"a", L"test", L"doğru",
+};
+#define LEXEME_MIX_COUNT ((int) (sizeof(lexemeMix) / sizeof(lexemeMix[0])))
+
+/* unitsOf - lexemeMix[i] as the UTF-16 code units the lexer slices out of a source file */
+static const uint16_t *unitsOf(int i) {
+    static uint16_t units[LEXEME_MIX_COUNT][16];
+    int j;
+    for (j = 0; lexemeMix[i][j] != 0; j++)
+        units[i][j] = (uint16_t) lexemeMix[i][j];
+    return units[i];
+}
+
+/* chainKeyword - the wcscmp chain lookup(KEYWORD_MODE) started out as, kept as the baseline */
+static int chainKeyword(const wchar_t *lexeme) {
+    if (wcscmp(lexeme, L"tam") == 0) return TYPE_INT;
+    else if (wcscmp(lexeme, L"küsurat") == 0) return TYPE_FLOAT;
+    else if (wcscmp(lexeme, L"dev") == 0) return TYPE_DOUBLE;
+    else if (wcscmp(lexeme, L"hane") == 0) return TYPE_CHAR;
+    else if (wcscmp(lexeme, L"tümce") == 0) return TYPE_STRING;
+    else if (wcscmp(lexeme, L"mantık") == 0) return TYPE_BOOL;
+    else if (wcscmp(lexeme, L"doğru") == 0) return TRUE_VAL;
+    else if (wcscmp(lexeme, L"yanlış") == 0) return FALSE_VAL;
+    else if (wcscmp(lexeme, L"madem") == 0) return IF_CODE;
+    else if (wcscmp(lexeme, L"şayet") == 0) return ELSE_CODE;
+    else if (wcscmp(lexeme, L"iken") == 0) return WHILE_CODE;
+    else if (wcscmp(lexeme, L"sayaç") == 0) return FOR_CODE;
+    else if (wcscmp(lexeme, L"çık") == 0) return BREAK_CODE;
+    else if (wcscmp(lexeme, L"atla") == 0) return CONTINUE_CODE;
+    return IDENT;
+}
+
+/* benchKeywords - lookup(KEYWORD_MODE) against the old wcscmp chain on the same lexemes */
+static void benchKeywords() {
+    static Context contexts[LEXEME_MIX_COUNT];
+    Sink quiet;
+    double start;
+    long total = 0;
+    int round, i;
+
+    sinkInit(&quiet, NULL, SINK_TEXT);
+    for (i = 0; i < LEXEME_MIX_COUNT; i++) {
+        initContext(&contexts[i], &quiet, TRACE_SILENT);
+        contexts[i].lexeme = unitsOf(i);
+        contexts[i].lexLen = (int) wcslen(lexemeMix[i]);
+        if (lookup(&contexts[i], KEYWORD_MODE) != chainKeyword(lexemeMix[i])) {
+            fail("  mismatch on %ls\n", lexemeMix[i]);
+            return;
+        }
+    }
+
+    start = now();
+    for (round = 0; round < KEYWORD_ROUNDS; round++)
+        for (i = 0; i < LEXEME_MIX_COUNT; i++)
+            total += chainKeyword(lexemeMix[i]);
+    report("wcscmp chain", now() - start, (long) KEYWORD_ROUNDS * LEXEME_MIX_COUNT);
+
+    start = now();
+    for (round = 0; round < KEYWORD_ROUNDS; round++)
+        for (i = 0; i < LEXEME_MIX_COUNT; i++)
+            total += lookup(&contexts[i], KEYWORD_MODE);
+    report("scanner table lookup()", now() - start, (long) KEYWORD_ROUNDS * LEXEME_MIX_COUNT);
+    sink = total;
+}
+
+/************************************************************************************/
+
+#define SCAN_UNITS (8 << 20)
+#define SCAN_ROUNDS 8
+
+/* fillScanInput - code-like text: indentation and blank runs of random length, a '$' comment every so often */
+static void fillScanInput(uint16_t *units, size_t len) {
+    static const uint16_t blanks[] = {' ', ' ', ' ', ' ', '\t', '\n', '\r'};
+    static const uint16_t text[] = {'a', 'x', 0x0131, 0x015F, '<', '.', '1', ',', '(', 0x00E7};
+    size_t i = 0;
+
+    srand(701);
+    while (i < len) {
+        int run = rand() % 48, word = 1 + rand() % 12;
+        while (run-- > 0 && i < len)
+            units[i++] = blanks[rand() % 7];
+        if (rand() % 8 == 0 && i < len)
+            units[i++] = '$';
+        while (word-- > 0 && i < len)
+            units[i++] = text[rand() % 10];
+    }
+}
+
+/* benchScan - every kernel set against the scalar one: same answers, then time to walk the input */
+static void benchScan() {
+    uint16_t *units = malloc(SCAN_UNITS * sizeof(*units));
+    const ScanKernels *kernels;
+    int count, k, round;
+    size_t pos;
+
+    if (units == NULL)
+        return;
+    fillScanInput(units, SCAN_UNITS);
+    kernels = scanKernels(&count);
+
+    for (k = 1; k < count; k++) {
+        for (pos = 0; pos < SCAN_UNITS; pos += 1 + (size_t) rand() % 37) {
+            if (kernels[k].skipBlanks(units, pos, SCAN_UNITS) != kernels[0].skipBlanks(units, pos, SCAN_UNITS) ||
+                kernels[k].findDollar(units, pos, SCAN_UNITS) != kernels[0].findDollar(units, pos, SCAN_UNITS)) {
+                fail("  %s disagrees with scalar at %zu\n", kernels[k].name, pos);
+                free(units);
+                return;
+            }
+        }
+    }
+
+    for (k = 0; k < count; k++) {
+        char label[64];
+        double start = now();
+        long steps = 0;
+
+        for (round = 0; round < SCAN_ROUNDS; round++)
+            for (pos = 0; pos < SCAN_UNITS; pos++, steps++)
+                pos = kernels[k].skipBlanks(units, pos, SCAN_UNITS);
+        snprintf(label, sizeof(label), "%s blanks (per unit)", kernels[k].name);
+        report(label, now() - start, (long) SCAN_UNITS * SCAN_ROUNDS);
+
+        start = now();
+        for (round = 0; round < SCAN_ROUNDS; round++)
+            for (pos = 0; pos < SCAN_UNITS; pos++, steps++)
+                pos = kernels[k].findDollar(units, pos, SCAN_UNITS);
+        snprintf(label, sizeof(label), "%s dollar (per unit)", kernels[k].name);
+        report(label, now() - start, (long) SCAN_UNITS * SCAN_ROUNDS);
+        sink = steps;
+    }
+    free(units);
+}
+
+/************************************************************************************/
+
+#define LITERAL_COUNT 4096
+#define LITERAL_ROUNDS 200
+#define LITERAL_UNITS 32
+
+/* Literals as they show up in TR-701 code, with a few long ones */
+static const char *const literalShapes[] = {
+    "5,5", "0,1", "3,14159", "100,0", "0,000125", "2,5", "12345,678", "0,3333333333333333", "1,0",
+    "9007199254740993,0", "6,02214076", "0,75", "271828182845904523536,0287", "42,0",
+};
+#define LITERAL_SHAPE_COUNT ((int) (sizeof(literalShapes) / sizeof(literalShapes[0])))
+
+/* strtodLiteral - the copy through the locale's decimal point into strtod that literal values started out as,
+   kept as the baseline */
+static double strtodLiteral(const uint16_t *units, size_t len) {
+    char point = localeconv()->decimal_point[0], text[LITERAL_UNITS + 1];
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        text[i] = units[i] == ',' ? point : (char) units[i];
+    text[i] = '\0';
+    return strtod(text, NULL);
+}
+
+/* benchLiterals - literalDouble against strtod, and literalInt against the checked digit at a time loop it replaced,
+   on the same literals */
+static void benchLiterals() {
+    static uint16_t units[LITERAL_COUNT][LITERAL_UNITS];
+    static size_t lengths[LITERAL_COUNT];
+    double start, d, total = 0;
+    int64_t n, sum = 0;
+    int round, i;
+    size_t j;
+
+    for (i = 0; i < LITERAL_COUNT; i++) {
+        const char *shape = literalShapes[i % LITERAL_SHAPE_COUNT];
+        /* The same shape with other digits */
+        for (j = 0; shape[j] != '\0'; j++)
+            units[i][j] = shape[j] == ',' ? ',' : (uint16_t) ('0' + (j == 0 ? shape[0] - '0' : rand() % 10));
+        lengths[i] = j;
+        if (literalDouble(units[i], lengths[i], &d) != 0 || d != strtodLiteral(units[i], lengths[i])) {
+            fail("  literalDouble disagrees with strtod on literal %d\n", i);
+            return;
+        }
+    }
+
+    start = now();
+    for (round = 0; round < LITERAL_ROUNDS; round++)
+        for (i = 0; i < LITERAL_COUNT; i++)
+            total += strtodLiteral(units[i], lengths[i]);
+    report("küsurat by strtod", now() - start, (long) LITERAL_ROUNDS * LITERAL_COUNT);
+
+    start = now();
+    for (round = 0; round < LITERAL_ROUNDS; round++)
+        for (i = 0; i < LITERAL_COUNT; i++) {
+            literalDouble(units[i], lengths[i], &d);
+            total += d;
+        }
+    report("küsurat by literalDouble", now() - start, (long) LITERAL_ROUNDS * LITERAL_COUNT);
+
+    /* The whole-number digits of the same literals, at most 18 of them */
+    for (i = 0; i < LITERAL_COUNT; i++) {
+        for (j = 0; j < lengths[i] && j < 18 && units[i][j] != ','; j++)
+            ;
+        lengths[i] = j;
+    }
+    start = now();
+    for (round = 0; round < LITERAL_ROUNDS; round++)
+        for (i = 0; i < LITERAL_COUNT; i++) {
+            uint64_t digits = 0;
+            for (j = 0; j < lengths[i]; j++) {
+                unsigned digit = (unsigned) (units[i][j] - '0');
+                if (digits > (uint64_t) (INT64_MAX - digit) / 10)
+                    break;
+                digits = digits * 10 + digit;
+            }
+            sum += (int64_t) digits;
+        }
+    report("tam a digit at a time", now() - start, (long) LITERAL_ROUNDS * LITERAL_COUNT);
+
+    start = now();
+    for (round = 0; round < LITERAL_ROUNDS; round++)
+        for (i = 0; i < LITERAL_COUNT; i++) {
+            literalInt(units[i], lengths[i], &n);
+            sum += n;
+        }
+    report("tam by literalInt", now() - start, (long) LITERAL_ROUNDS * LITERAL_COUNT);
+    sink = (long) total + (long) sum;
+}
+
+/************************************************************************************/
+
+#define TRACE_LINES 2000000
+
+/* benchTrace - token trace lines to /dev/null: one fprintf each against the buffered sink flushed once */
+static void benchTrace() {
+    FILE *null = fopen("/dev/null", "w");
+    const uint16_t *units[LEXEME_MIX_COUNT];
+    Sink out;
+    double start;
+    long i;
+
+    if (null == NULL)
+        return;
+    for (i = 0; i < LEXEME_MIX_COUNT; i++)
+        units[i] = unitsOf((int) i);
+    start = now();
+    for (i = 0; i < TRACE_LINES; i++)
+        fprintf(null, "Next token is: %d, Next lexeme is: %ls\n", IDENT, lexemeMix[i % LEXEME_MIX_COUNT]);
+    fflush(null);
+    report("fprintf per line", now() - start, TRACE_LINES);
+
+    sinkInit(&out, null, SINK_TEXT);
+    start = now();
+    for (i = 0; i < TRACE_LINES; i++) {
+        sinkToken(&out, IDENT, units[i % LEXEME_MIX_COUNT], wcslen(lexemeMix[i % LEXEME_MIX_COUNT]), (size_t) i);
+    }
+    sinkFlush(&out);
+    report("sink, one flush", now() - start, TRACE_LINES);
+
+    sinkInit(&out, null, SINK_BINARY);
+    sinkBeginFile(&out, "bench");
+    start = now();
+    for (i = 0; i < TRACE_LINES; i++) {
+        sinkToken(&out, IDENT, units[i % LEXEME_MIX_COUNT], wcslen(lexemeMix[i % LEXEME_MIX_COUNT]), (size_t) i);
+    }
+    sinkSummary(&out, "bench", ANALYSIS_OK, NULL);
+    sinkFlush(&out);
+    report("sink, binary records", now() - start, TRACE_LINES);
+    sinkFree(&out);
+    fclose(null);
+}
+
+/************************************************************************************/
+
+/* About 330 MB of UTF-16: large enough that the threaded pipeline has something to overlap */
+#define PIPELINE_STATEMENTS 4000000
+#define PIPELINE_ROUNDS 3
+#define PIPELINE_FILE "tr_bench_pipeline.in"
+
+/* Declarations of the variables the statements use */
+static const char pipelinePrelude[] = "tam x. tam y. tam i. küsurat oran. küsurat toplam. mantık bayrak.\n";
+
+/* Statements that parse and check, so the whole file is lexed, parsed and checked in every round */
+static const char *const pipelineSource[] = {
+    "tam sayı_%d <<< (x + 47) * y ^ 2 - 5 %% 3.\n",
+    "oran <<< 3,25 / (toplam + 1).\n",
+    "$ yorum satırı $ bayrak <<< doğru.\n",
+    "madem (x <= 10 && y > 3) { x <<< x + 1. }\n",
+    "iken (i < 100) { i <<< i + 1. }\n",
+};
+
+/* putUnit - append one UTF-16 code unit, low byte first */
+static void putUnit(FILE *fp, uint32_t unit) {
+    fputc((int) (unit & 0xFF), fp);
+    fputc((int) (unit >> 8 & 0xFF), fp);
+}
+
+/* putSource - append UTF-8 text to a source file as UTF-16LE, without going through the locale;
+   returns 0, or -1 if it is not valid UTF-8 */
+static int putSource(FILE *fp, const char *line) {
+    const unsigned char *p = (const unsigned char *) line;
+
+    while (*p != '\0') {
+        uint32_t c = *p++;
+        int more = c < 0x80 ? 0 : c >= 0xC2 && c < 0xE0 ? 1 : c >= 0xE0 && c < 0xF0 ? 2 : c >= 0xF0 && c < 0xF5 ? 3 : -1;
+        uint32_t least = more == 1 ? 0x80 : more == 2 ? 0x800 : 0x10000;
+
+        if (more < 0)
+            return -1;
+        if (more > 0)
+            c &= 0x3F >> more;
+        for (; more > 0; more--, p++) {
+            if ((*p & 0xC0) != 0x80)
+                return -1;
+            c = c << 6 | (*p & 0x3F);
+        }
+        if (c >= 0x80 && (c < least || c > 0x10FFFF || (c >= 0xD800 && c < 0xE000)))
+            return -1;
+        if (c >= 0x10000) {
+            putUnit(fp, 0xD800 + ((c - 0x10000) >> 10));
+            c = 0xDC00 + (c & 0x3FF);
+        }
+        putUnit(fp, c);
+    }
+    return 0;
+}
+
+/* writePipelineFile - write that many of the statements as a UTF-16LE file with a BOM; returns 0 on success */
+static int writePipelineFile(const char *path, int statements) {
+    FILE *fp = fopen(path, "wb");
+    int i, status = 0;
+
+    if (fp == NULL)
+        return -1;
+    fputc(0xFF, fp);
+    fputc(0xFE, fp);
+    status |= putSource(fp, pipelinePrelude);
+    for (i = 0; i < statements; i++) {
+        char line[128];
+        snprintf(line, sizeof(line), pipelineSource[i % 5], i);
+        status |= putSource(fp, line);
+    }
+    return fclose(fp) != 0 || status != 0 ? -1 : 0;
+}
+
+/* benchPipeline - lexing on demand, into the token buffer first, and on a thread of its own, on one large file */
+static void benchPipeline() {
+    static const struct { const char *name; int pipeline; } modes[] = {
+        {"stream", PIPELINE_STREAM},
+        {"buffered", PIPELINE_BUFFERED},
+        {"threaded", PIPELINE_THREADED},
+    };
+    Context context;
+    Sink quiet;
+    int m, round;
+
+    if (writePipelineFile(PIPELINE_FILE, PIPELINE_STATEMENTS) != 0) {
+        fail("  cannot write %s\n", PIPELINE_FILE);
+        return;
+    }
+    sinkInit(&quiet, NULL, SINK_TEXT);
+    for (m = 0; m < 3; m++) {
+        char label[64];
+        double start = now();
+        long tokens = 0;
+        for (round = 0; round < PIPELINE_ROUNDS; round++) {
+            if (analyzeFile(&context, PIPELINE_FILE, &quiet, TRACE_SILENT, modes[m].pipeline, 0) != ANALYSIS_OK) {
+                fail("  %s: %ls\n", modes[m].name, context.errMsg);
+                remove(PIPELINE_FILE);
+                return;
+            }
+            tokens += (long) context.in.len / 4;
+        }
+        snprintf(label, sizeof(label), "%s (per statement)", modes[m].name);
+        report(label, now() - start, (long) PIPELINE_STATEMENTS * PIPELINE_ROUNDS);
+        sink = tokens;
+    }
+    remove(PIPELINE_FILE);
+}
+
+/************************************************************************************/
+
+#define EXPRESSION_REPEATS 1000000
+#define EXPRESSION_ROUNDS 3
+#define EXPRESSION_FILE "tr_bench_expression.in"
+
+/* One statement holding a single huge expression: prefix, the repeat EXPRESSION_REPEATS times, last, then suffix */
+typedef struct {
+    const char *name;
+    const char *prefix;     /* declarations of the names used, then the start of the statement */
+    const char *repeat;
+    const char *last;       /* the final operand, followed by a ")" for every "(" in the repeats */
+    const char *suffix;
+} ExpressionShape;
+
+static const ExpressionShape expressionShapes[] = {
+    /* Twelve operands and every infix operator per repeat: wide and shallow */
+    {"wide", "tam a. tam b. tam c. tam d. tam e. tam f. tam g. tam h. tam i. tam j. tam k. tam l. mantık w <<< ",
+     "a + b * c - d / e % f ^ g < h && i >= j || k =? l !? doğru && ", "doğru", ".\n"},
+    /* Right-grouping "^" chain: each operand nests one level deeper */
+    {"power chain", "tam x. tam p <<< ", "x ^ ", "x", ".\n"},
+    /* Parentheses only */
+    {"nested parens", "madem ", "(", "doğru", " { }\n"},
+    /* "!" and a parenthesis per level */
+    {"nested not", "mantık y. iken (", "!(", "y", ") { }\n"},
+};
+#define EXPRESSION_SHAPE_COUNT ((int) (sizeof(expressionShapes) / sizeof(expressionShapes[0])))
+
+/* writeExpressionFile - write one shape as a UTF-16LE file with a BOM, closing what it opened; returns 0 on success */
+static int writeExpressionFile(const char *path, const ExpressionShape *shape) {
+    FILE *fp = fopen(path, "wb");
+    int i, status = 0, nested = strchr(shape->repeat, '(') != NULL;
+
+    if (fp == NULL)
+        return -1;
+    fputc(0xFF, fp);
+    fputc(0xFE, fp);
+    status |= putSource(fp, shape->prefix);
+    for (i = 0; i < EXPRESSION_REPEATS; i++)
+        status |= putSource(fp, shape->repeat);
+    status |= putSource(fp, shape->last);
+    for (i = 0; nested && i < EXPRESSION_REPEATS; i++)
+        status |= putSource(fp, ")");
+    status |= putSource(fp, shape->suffix);
+    return fclose(fp) != 0 || status != 0 ? -1 : 0;
+}
+
+/* benchExpressions - the expression parser on very wide and very deeply nested expressions */
+static void benchExpressions() {
+    Context context;
+    Sink quiet;
+    int s, round;
+
+    sinkInit(&quiet, NULL, SINK_TEXT);
+    for (s = 0; s < EXPRESSION_SHAPE_COUNT; s++) {
+        char label[64];
+        double start;
+        if (writeExpressionFile(EXPRESSION_FILE, &expressionShapes[s]) != 0) {
+            fail("  cannot write %s\n", EXPRESSION_FILE);
+            return;
+        }
+        start = now();
+        for (round = 0; round < EXPRESSION_ROUNDS; round++) {
+            if (analyzeFile(&context, EXPRESSION_FILE, &quiet, TRACE_SILENT, PIPELINE_STREAM, 0) != ANALYSIS_OK) {
+                fail("  %s: %ls\n", expressionShapes[s].name, context.errMsg);
+                remove(EXPRESSION_FILE);
+                return;
+            }
+        }
+        snprintf(label, sizeof(label), "%s (per repeat)", expressionShapes[s].name);
+        report(label, now() - start, (long) EXPRESSION_REPEATS * EXPRESSION_ROUNDS);
+    }
+    remove(EXPRESSION_FILE);
+}
+
+/************************************************************************************/
+
+#define SYMBOLS_FILE "tr_bench_symbols.in"
+
+/* writeSymbolsFile - declare count variables, then assign each one from two others; returns 0 on success */
+static int writeSymbolsFile(const char *path, long count) {
+    FILE *fp = fopen(path, "wb");
+    long i;
+    int status = 0;
+
+    if (fp == NULL)
+        return -1;
+    fputc(0xFF, fp);
+    fputc(0xFE, fp);
+    for (i = 0; i < count; i++) {
+        char line[128];
+        snprintf(line, sizeof(line), "tam değer_%ld <<< %ld.\n", i, i);
+        status |= putSource(fp, line);
+    }
+    for (i = 0; i < count; i++) {
+        char line[128];
+        snprintf(line, sizeof(line), "değer_%ld <<< değer_%ld + değer_%ld.\n", i, i * 7 % count, i * 13 % count);
+        status |= putSource(fp, line);
+    }
+    return fclose(fp) != 0 || status != 0 ? -1 : 0;
+}
+
+/* benchSymbols - checking cost per statement as the number of variables grows; flat if lookups are O(1) */
+static void benchSymbols() {
+    static const long counts[] = {10000, 100000, 1000000};
+    Context context;
+    Sink quiet;
+    int c;
+
+    sinkInit(&quiet, NULL, SINK_TEXT);
+    for (c = 0; c < 3; c++) {
+        char label[64];
+        double start;
+        if (writeSymbolsFile(SYMBOLS_FILE, counts[c]) != 0) {
+            fail("  cannot write %s\n", SYMBOLS_FILE);
+            return;
+        }
+        start = now();
+        if (analyzeFile(&context, SYMBOLS_FILE, &quiet, TRACE_SILENT, PIPELINE_STREAM, 0) != ANALYSIS_OK) {
+            fail("  %ld variables: %ls\n", counts[c], context.errMsg);
+            remove(SYMBOLS_FILE);
+            return;
+        }
+        snprintf(label, sizeof(label), "%ld variables (per statement)", counts[c]);
+        report(label, now() - start, counts[c] * 2);
+    }
+    remove(SYMBOLS_FILE);
+}
+
+/************************************************************************************/
+
+#define RUN_ITERATIONS 20000000
+#define RUN_FILE "tr_bench_run.in"
+
+/* A loop run RUN_ITERATIONS times; source is a printf format with a %d for the count */
+typedef struct {
+    const char *name;
+    const char *source;
+} RunProgram;
+
+static const RunProgram runPrograms[] = {
+    {"tam sum", "tam toplam. tam i.\nsayaç (i <<< 0. i < %d. i <<< i + 1) { toplam <<< toplam + i %% 7. }\n"},
+    {"dev mix", "dev x <<< 1. tam i.\nsayaç (i <<< 0. i < %d. i <<< i + 1) { x <<< x * 0,5 + i / 3. }\n"},
+    {"while branches", "tam n. tam k.\niken (n < %d) { n <<< n + 1. madem (n %% 3 =? 0) { atla. } k <<< k + 2. }\n"},
+};
+#define RUN_PROGRAM_COUNT ((int) (sizeof(runPrograms) / sizeof(runPrograms[0])))
+
+/* timeRun - write the program in format for RUN_ITERATIONS, then analyze, compile and run it with the given
+   ANALYZE_ flags, reporting the time per iteration under label; returns 0, or -1 if it did not pass */
+static int timeRun(const char *label, const char *format, int actions, Sink *quiet) {
+    Context context;
+    char source[512];
+    FILE *fp = fopen(RUN_FILE, "wb");
+    double start;
+    int status;
+
+    if (fp == NULL) {
+        fail("  cannot write %s\n", RUN_FILE);
+        return -1;
+    }
+    fputc(0xFF, fp);
+    fputc(0xFE, fp);
+    snprintf(source, sizeof(source), format, RUN_ITERATIONS);
+    status = putSource(fp, source);
+    if (fclose(fp) != 0 || status != 0) {
+        fail("  %s: cannot write the program to %s\n", label, RUN_FILE);
+        remove(RUN_FILE);
+        return -1;
+    }
+    start = now();
+    if (analyzeFile(&context, RUN_FILE, quiet, TRACE_SILENT, PIPELINE_STREAM, ANALYZE_RUN | actions) != ANALYSIS_OK) {
+        fail("  %s: %ls\n", label, context.errMsg);
+        remove(RUN_FILE);
+        return -1;
+    }
+    report(label, now() - start, RUN_ITERATIONS);
+    quiet->len = 0;
+    remove(RUN_FILE);
+    return 0;
+}
+
+/* benchRun - compiling and running small loops on the virtual machine */
+static void benchRun() {
+    Sink quiet;
+    int p;
+
+    sinkInit(&quiet, NULL, SINK_TEXT);
+    for (p = 0; p < RUN_PROGRAM_COUNT; p++) {
+        char label[64];
+        snprintf(label, sizeof(label), "%s (per iteration)", runPrograms[p].name);
+        if (timeRun(label, runPrograms[p].source, 0, &quiet) != 0)
+            break;
+    }
+    sinkFree(&quiet);
+}
+
+/* Loops with constant, repeated and loop-invariant expressions for the passes of opt.c to take out */
+static const RunProgram optimizePrograms[] = {
+    {"invariant", "tam a <<< 12. tam b <<< 5. tam s. tam i.\n"
+                  "sayaç (i <<< 0. i < %d. i <<< i + 1) { s <<< s + (a * b + a - b) * i + (a + b) * (a - b). }\n"},
+    {"common", "tam a. tam b. tam c. tam i.\n"
+               "sayaç (i <<< 0. i < %d. i <<< i + 1) { a <<< (i * 3 + 1) * (i - 2). b <<< (i * 3 + 1) * (i - 2) + a.\n"
+               "c <<< c + b - (i * 3 + 1) * (i - 2). }\n"},
+    {"constant", "dev x. tam i.\n"
+                 "sayaç (i <<< 0. i < %d. i <<< i + 1) { madem (2 ^ 10 > 1000 && doğru) { x <<< x + 3,5 * 2 - 1 / 4,0. } }\n"},
+};
+#define OPTIMIZE_PROGRAM_COUNT ((int) (sizeof(optimizePrograms) / sizeof(optimizePrograms[0])))
+
+/* benchOptimize - the loops above run as written and after the passes of opt.c (-O) */
+static void benchOptimize() {
+    Sink quiet;
+    int p;
+
+    sinkInit(&quiet, NULL, SINK_TEXT);
+    for (p = 0; p < OPTIMIZE_PROGRAM_COUNT; p++) {
+        char label[64];
+        snprintf(label, sizeof(label), "%s as written", optimizePrograms[p].name);
+        if (timeRun(label, optimizePrograms[p].source, 0, &quiet) != 0)
+            break;
+        snprintf(label, sizeof(label), "%s with -O", optimizePrograms[p].name);
+        if (timeRun(label, optimizePrograms[p].source, ANALYZE_OPTIMIZE, &quiet) != 0)
+            break;
+    }
+    sinkFree(&quiet);
+}
+
+/* Numeric loops, one per type, for the typed instructions of the virtual machine */
+static const RunProgram typedPrograms[] = {
+    {"tam", "tam s. tam i.\n"
+            "sayaç (i <<< 0. i < %d. i <<< i + 1) { s <<< (s + i * 3 - i / 5 + i %% 11 + (i %% 4) ^ 2) %% 100003. }\n"},
+    {"küsurat", "küsurat x <<< 1. tam i.\n"
+                "sayaç (i <<< 0. i < %d. i <<< i + 1) { x <<< x * 0,75 + 1,5 - x / 4. }\n"},
+    {"dev", "dev x <<< 1. dev y <<< 2. tam i.\n"
+            "sayaç (i <<< 0. i < %d. i <<< i + 1) { x <<< x * 0,5 + y - i. madem (x > y) { y <<< y + 1. } }\n"},
+};
+#define TYPED_PROGRAM_COUNT ((int) (sizeof(typedPrograms) / sizeof(typedPrograms[0])))
+
+/* benchTyped - the loops above on the instructions that look at the type of their operands and on the typed ones */
+static void benchTyped() {
+    Sink quiet;
+    int p;
+
+    sinkInit(&quiet, NULL, SINK_TEXT);
+    for (p = 0; p < TYPED_PROGRAM_COUNT; p++) {
+        char label[64];
+        snprintf(label, sizeof(label), "%s generic", typedPrograms[p].name);
+        if (timeRun(label, typedPrograms[p].source, ANALYZE_GENERIC, &quiet) != 0)
+            break;
+        snprintf(label, sizeof(label), "%s typed", typedPrograms[p].name);
+        if (timeRun(label, typedPrograms[p].source, 0, &quiet) != 0)
+            break;
+    }
+    sinkFree(&quiet);
+}
+
+/************************************************************************************/
+
+#define ARRAY_ELEMENTS 4096
+#define ARRAY_ROUNDS 20000
+
+/* Element loops, each over RUN_ITERATIONS elements in all: first as a sayaç loop the compiler hands to the
+   element kernels, then the same work as an iken loop that runs on the instructions, one element at a time */
+static const RunProgram arrayPrograms[] = {
+    {"dev map kernels", "dev a[1000]. dev b[1000]. dev c[1000]. tam i. tam r.\n"
+                        "sayaç (r <<< 0. r < %d / 1000. r <<< r + 1) {\n"
+                        "sayaç (i <<< 0. i < 1000. i <<< i + 1) { a[i] <<< b[i] + c[i]. } }\n"},
+    {"dev map instructions", "dev a[1000]. dev b[1000]. dev c[1000]. tam i. tam r.\n"
+                             "sayaç (r <<< 0. r < %d / 1000. r <<< r + 1) {\n"
+                             "i <<< 0. iken (i < 1000) { a[i] <<< b[i] + c[i]. i <<< i + 1. } }\n"},
+    {"tam sum kernels", "tam a[1000]. tam s. tam i. tam r.\n"
+                        "sayaç (r <<< 0. r < %d / 1000. r <<< r + 1) {\n"
+                        "sayaç (i <<< 0. i < 1000. i <<< i + 1) { s <<< s + a[i]. } }\n"},
+    {"tam sum instructions", "tam a[1000]. tam s. tam i. tam r.\n"
+                             "sayaç (r <<< 0. r < %d / 1000. r <<< r + 1) {\n"
+                             "i <<< 0. iken (i < 1000) { s <<< s + a[i]. i <<< i + 1. } }\n"},
+};
+#define ARRAY_PROGRAM_COUNT ((int) (sizeof(arrayPrograms) / sizeof(arrayPrograms[0])))
+
+/* benchArray - every element kernel set against the scalar one: same answers, then time per element; then the
+   element loops above */
+static void benchArray() {
+    double *x = malloc(ARRAY_ELEMENTS * sizeof(*x)), *y = malloc(ARRAY_ELEMENTS * sizeof(*y));
+    double *t = malloc(ARRAY_ELEMENTS * sizeof(*t)), *expected = malloc(ARRAY_ELEMENTS * sizeof(*expected));
+    int64_t *n = malloc(ARRAY_ELEMENTS * sizeof(*n));
+    const ElementKernels *kernels;
+    Sink quiet;
+    int count, k, p, round;
+    size_t j;
+
+    if (x == NULL || y == NULL || t == NULL || expected == NULL || n == NULL)
+        goto done;
+    kernels = elementKernels(&count);
+    for (j = 0; j < ARRAY_ELEMENTS; j++) {
+        x[j] = rand() / 7.0;
+        y[j] = rand() / 3.0 - 1e9;
+        n[j] = (int64_t) rand() << 31 | rand();
+    }
+    kernels[0].mapDouble(MULT_OP, expected, x, 0, y, 0, ARRAY_ELEMENTS);
+    for (k = 1; k < count; k++) {
+        kernels[k].mapDouble(MULT_OP, t, x, 0, y, 0, ARRAY_ELEMENTS);
+        if (memcmp(t, expected, ARRAY_ELEMENTS * sizeof(*t)) != 0 ||
+            kernels[k].sumInt(n, ARRAY_ELEMENTS, 5) != kernels[0].sumInt(n, ARRAY_ELEMENTS, 5)) {
+            fail("  %s disagrees with scalar\n", kernels[k].name);
+            goto done;
+        }
+    }
+
+    for (k = 0; k < count; k++) {
+        char label[64];
+        double start = now();
+        int64_t s = 0;
+
+        for (round = 0; round < ARRAY_ROUNDS; round++)
+            kernels[k].mapDouble(ADD_OP, t, x, 0, t, 0, ARRAY_ELEMENTS);
+        snprintf(label, sizeof(label), "%s dev map (per element)", kernels[k].name);
+        report(label, now() - start, (long) ARRAY_ELEMENTS * ARRAY_ROUNDS);
+
+        start = now();
+        for (round = 0; round < ARRAY_ROUNDS; round++)
+            s = kernels[k].sumInt(n, ARRAY_ELEMENTS, s);
+        snprintf(label, sizeof(label), "%s tam sum (per element)", kernels[k].name);
+        report(label, now() - start, (long) ARRAY_ELEMENTS * ARRAY_ROUNDS);
+        sink = (long) s + (long) t[0];
+    }
+
+    sinkInit(&quiet, NULL, SINK_TEXT);
+    for (p = 0; p < ARRAY_PROGRAM_COUNT; p++) {
+        char label[64];
+        snprintf(label, sizeof(label), "%s (per element)", arrayPrograms[p].name);
+        if (timeRun(label, arrayPrograms[p].source, 0, &quiet) != 0)
+            break;
+    }
+    sinkFree(&quiet);
+done:
+    free(x);
+    free(y);
+    free(t);
+    free(expected);
+    free(n);
+}
+
+/************************************************************************************/
+
+#define CACHE_STATEMENTS 20000
+#define CACHE_ROUNDS 50
+#define CACHE_FILE "tr_bench_cache.in"
+
+/* benchCache - starting a run of the pipeline statements from the source every time, and from the cache file */
+static void benchCache() {
+    static const struct { const char *name; int actions; } modes[] = {
+        {"compiled every run", ANALYZE_RUN},
+        {"run from the cache", ANALYZE_RUN | ANALYZE_CACHE},
+    };
+    Context context;
+    Sink quiet;
+    char *cache = pathWithExtension(CACHE_FILE, CACHE_EXTENSION);
+    int m, round;
+
+    if (cache == NULL || writePipelineFile(CACHE_FILE, CACHE_STATEMENTS) != 0) {
+        fail("  cannot write %s\n", CACHE_FILE);
+        free(cache);
+        return;
+    }
+    sinkInit(&quiet, NULL, SINK_TEXT);
+    for (m = 0; m < 2; m++) {
+        char label[64];
+        double start = 0;
+        /* Round -1 is not timed: it writes the cache file */
+        for (round = -1; round < CACHE_ROUNDS; round++) {
+            if (round == 0)
+                start = now();
+            if (analyzeFile(&context, CACHE_FILE, &quiet, TRACE_SILENT, PIPELINE_STREAM, modes[m].actions) != ANALYSIS_OK) {
+                fail("  %s: %ls\n", modes[m].name, context.errMsg);
+                break;
+            }
+            quiet.len = 0;
+        }
+        if (round < CACHE_ROUNDS)
+            break;
+        snprintf(label, sizeof(label), "%s (per statement)", modes[m].name);
+        report(label, now() - start, (long) CACHE_STATEMENTS * CACHE_ROUNDS);
+    }
+    sinkFree(&quiet);
+    remove(CACHE_FILE);
+    remove(cache);
+    free(cache);
+}
+
+/************************************************************************************/
+
+static const Benchmark benchmarks[] = {
+    {"keywords", benchKeywords},
+    {"scan", benchScan},
+    {"literals", benchLiterals},
+    {"trace", benchTrace},
+    {"pipeline", benchPipeline},
+    {"expressions", benchExpressions},
+    {"symbols", benchSymbols},
+    {"run", benchRun},
+    {"optimize", benchOptimize},
+    {"typed", benchTyped},
+    {"array", benchArray},
+    {"cache", benchCache},
+};
+#define BENCHMARK_COUNT ((int) (sizeof(benchmarks) / sizeof(benchmarks[0])))
+
+int main(int argc, char **argv) {
+    int i, j, ran = 0;
+
+    setlocale(LC_ALL, "");
+
+    for (i = 0; i < BENCHMARK_COUNT; i++) {
+        int selected = argc < 2;
+        for (j = 1; j < argc; j++)
+            selected |= strcmp(argv[j], benchmarks[i].name) == 0;
+        if (selected) {
+            printf("%s\n", benchmarks[i].name);
+            benchmarks[i].run();
+            ran++;
+        }
+    }
+    if (ran == 0) {
+        fprintf(stderr, "Unknown benchmark; available:");
+        for (i = 0; i < BENCHMARK_COUNT; i++)
+            fprintf(stderr, " %s", benchmarks[i].name);
+        fprintf(stderr, "\n");
+        return 1;
+    }
+    return failures == 0 ? 0 : 1;
+}
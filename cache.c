@@ -0,0 +1,209 @@
+/* cache.c - writing compiled programs to .trc files and mapping them back, see cache.h */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "front.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CACHE_HAVE_MMAP 1
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/* Compile flags that change the code, and so must match between the file and the run */
+#define CACHE_ACTIONS (ANALYZE_OPTIMIZE | ANALYZE_GENERIC)
+
+/* Multiplier of cacheHash, from the golden ratio */
+#define HASH_MULTIPLIER 0x9E3779B97F4A7C15u
+
+uint64_t cacheHash(const void *data, size_t size) {
+    const unsigned char *bytes = data;
+    uint64_t hash = (uint64_t) size * HASH_MULTIPLIER, word = 0;
+
+    for (; size >= 8; bytes += 8, size -= 8) {
+        memcpy(&word, bytes, 8);
+        hash = (hash ^ word) * HASH_MULTIPLIER;
+        hash ^= hash >> 29;
+    }
+    word = 0;
+    memcpy(&word, bytes, size);
+    hash = (hash ^ word) * HASH_MULTIPLIER;
+    return hash ^ hash >> 32;
+}
+
+/* align - size rounded up to the next section boundary */
+static size_t align(size_t size) {
+    return (size + CACHE_ALIGN - 1) & ~(size_t) (CACHE_ALIGN - 1);
+}
+
+/* section - whether count items of size bytes at offset lie inside a file of fileSize bytes, aligned */
+static int section(size_t fileSize, uint32_t offset, uint32_t count, size_t size) {
+    return offset % CACHE_ALIGN == 0 && offset >= sizeof(CacheHeader) && offset <= fileSize &&
+           count <= (fileSize - offset) / size;
+}
+
+/* readFile - the whole file at path in memory, mapped where that can be done */
+static int readFile(Cache *cache, const char *path) {
+    FILE *fp;
+    long size;
+
+    memset(cache, 0, sizeof(*cache));
+#ifdef CACHE_HAVE_MMAP
+    {
+        int fd = open(path, O_RDONLY);
+        struct stat st;
+        if (fd < 0)
+            return -1;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= (off_t) sizeof(CacheHeader)) {
+            void *base = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (base != MAP_FAILED) {
+                close(fd);
+                cache->base = base;
+                cache->size = (size_t) st.st_size;
+                cache->mapped = 1;
+                return 0;
+            }
+        }
+        close(fd);
+    }
+#endif
+    if ((fp = fopen(path, "rb")) == NULL)
+        return -1;
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < (long) sizeof(CacheHeader) ||
+        fseek(fp, 0, SEEK_SET) != 0 || (cache->base = malloc((size_t) size)) == NULL) {
+        fclose(fp);
+        return -1;
+    }
+    cache->size = (size_t) size;
+    if (fread(cache->base, 1, cache->size, fp) != cache->size) {
+        fclose(fp);
+        cacheClose(cache);
+        return -1;
+    }
+    fclose(fp);
+    return 0;
+}
+
+int cacheLoad(Cache *cache, const char *path, const uint16_t *units, size_t len, int actions, Bytecode *bc) {
+    const CacheHeader *header;
+    unsigned char *base;
+
+    if (readFile(cache, path) != 0)
+        return -1;
+    base = cache->base;
+    header = cache->base;
+    if (memcmp(header->magic, CACHE_MAGIC, 4) != 0 || header->version != CACHE_VERSION ||
+        header->byteOrder != CACHE_BYTE_ORDER || header->opcodeCount != OPCODE_COUNT ||
+        header->valueSize != sizeof(Value) || header->actions != (uint32_t) (actions & CACHE_ACTIONS) ||
+        header->sourceUnits != len || header->codeLen == 0 ||
+        !section(cache->size, header->codeOffset, header->codeLen, 1) ||
+        !section(cache->size, header->constantOffset, header->constantCount, sizeof(Value)) ||
+        !section(cache->size, header->textOffset, header->textLen, sizeof(uint16_t)) ||
+        !section(cache->size, header->variableOffset, header->variableCount, sizeof(Variable)) ||
+        !section(cache->size, header->siteOffset, header->siteCount, sizeof(Site)) ||
+        !section(cache->size, header->kernelOffset, header->kernelCount, sizeof(Kernel)) ||
+        base[header->codeOffset + header->codeLen - 1] != OP_HALT ||
+        header->sourceHash != cacheHash(units, len * sizeof(*units)) ||
+        header->payloadHash != cacheHash(base + sizeof(CacheHeader), cache->size - sizeof(CacheHeader))) {
+        cacheClose(cache);
+        return -1;
+    }
+    memset(bc, 0, sizeof(*bc));
+    bc->code = base + header->codeOffset;
+    bc->codeLen = header->codeLen;
+    bc->constants = (Value *) (base + header->constantOffset);
+    bc->constantCount = header->constantCount;
+    bc->text = (uint16_t *) (base + header->textOffset);
+    bc->textLen = header->textLen;
+    bc->variables = (Variable *) (base + header->variableOffset);
+    bc->variableCount = header->variableCount;
+    bc->sites = (Site *) (base + header->siteOffset);
+    bc->siteCount = header->siteCount;
+    bc->kernels = (Kernel *) (base + header->kernelOffset);
+    bc->kernelCount = header->kernelCount;
+    bc->maxStack = header->maxStack;
+    return 0;
+}
+
+void cacheClose(Cache *cache) {
+#ifdef CACHE_HAVE_MMAP
+    if (cache->mapped) {
+        munmap(cache->base, cache->size);
+    } else
+#endif
+    {
+        free(cache->base);
+    }
+    memset(cache, 0, sizeof(*cache));
+}
+
+/* place - copy a section into the file image at *offset and move *offset past it, aligned */
+static uint32_t place(unsigned char *image, size_t *offset, const void *items, size_t bytes) {
+    uint32_t at = (uint32_t) *offset;
+
+    if (bytes > 0)
+        memcpy(image + at, items, bytes);
+    *offset = align(*offset + bytes);
+    return at;
+}
+
+int cacheStore(const char *path, const uint16_t *units, size_t len, int actions, const Bytecode *bc) {
+    size_t size = align(sizeof(CacheHeader)) + align(bc->codeLen) + align(bc->constantCount * sizeof(Value)) +
+                  align(bc->textLen * sizeof(uint16_t)) + align(bc->variableCount * sizeof(Variable)) +
+                  align(bc->siteCount * sizeof(Site)) + align(bc->kernelCount * sizeof(Kernel));
+    size_t offset = align(sizeof(CacheHeader));
+    unsigned char *image;
+    CacheHeader *header;
+    char *temporary;
+    FILE *fp;
+    int status = -1;
+
+    if (size > UINT32_MAX || (image = calloc(1, size)) == NULL)
+        return -1;
+    header = (CacheHeader *) image;
+    memcpy(header->magic, CACHE_MAGIC, 4);
+    header->version = CACHE_VERSION;
+    header->byteOrder = CACHE_BYTE_ORDER;
+    header->opcodeCount = OPCODE_COUNT;
+    header->valueSize = sizeof(Value);
+    header->actions = (uint32_t) (actions & CACHE_ACTIONS);
+    header->maxStack = bc->maxStack;
+    header->sourceUnits = len;
+    header->sourceHash = cacheHash(units, len * sizeof(*units));
+    header->codeLen = bc->codeLen;
+    header->codeOffset = place(image, &offset, bc->code, bc->codeLen);
+    header->constantCount = bc->constantCount;
+    header->constantOffset = place(image, &offset, bc->constants, bc->constantCount * sizeof(Value));
+    header->textLen = bc->textLen;
+    header->textOffset = place(image, &offset, bc->text, bc->textLen * sizeof(uint16_t));
+    header->variableCount = bc->variableCount;
+    header->variableOffset = place(image, &offset, bc->variables, bc->variableCount * sizeof(Variable));
+    header->siteCount = bc->siteCount;
+    header->siteOffset = place(image, &offset, bc->sites, bc->siteCount * sizeof(Site));
+    header->kernelCount = bc->kernelCount;
+    header->kernelOffset = place(image, &offset, bc->kernels, bc->kernelCount * sizeof(Kernel));
+    header->payloadHash = cacheHash(image + sizeof(CacheHeader), size - sizeof(CacheHeader));
+
+    /* Written beside the old file and renamed over it, so a run that maps the cache meanwhile sees the old
+       file or the new one, never half of one */
+    if ((temporary = malloc(strlen(path) + 5)) != NULL) {
+        strcpy(temporary, path);
+        strcat(temporary, ".tmp");
+        if ((fp = fopen(temporary, "wb")) != NULL) {
+            status = fwrite(image, 1, size, fp) == size ? 0 : -1;
+            if (fclose(fp) != 0)
+                status = -1;
+            if (status == 0)
+                status = rename(temporary, path) == 0 ? 0 : -1;
+            if (status != 0)
+                remove(temporary);
+        }
+        free(temporary);
+    }
+    free(image);
+    return status;
+}
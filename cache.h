@@ -0,0 +1,76 @@
+/* cache.h - compiled programs kept next to their source (-b), so that a later run of the same source skips
+ * lexing, parsing, checking and compiling and goes straight to the virtual machine
+ *
+ * File layout, in the byte order of the machine that wrote it: a CacheHeader, then the sections of a
+ * Bytecode (vm.h), each at an offset from the start of the file that is a multiple of CACHE_ALIGN:
+ *   code        codeLen bytes of instructions
+ *   constants   constantCount Values
+ *   text        textLen UTF-16 code units: tümce constants and the names of the variables
+ *   variables   variableCount Variables
+ *   sites       siteCount Sites
+ *   kernels     kernelCount Kernels, of the OP_ARRAY_LOOP instructions
+ * Nothing in it is a pointer, so a mapping of the file runs as it is, wherever it lands. A file is used only
+ * when its version, byte order, opcode table and compile flags are the reader's own, when it holds the hash of
+ * the source being run, and when its sections are whole; anything else is a miss, and the run rewrites it.
+ */
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vm.h"
+
+/* Extension of the cache file written next to each source, in place of the source's own */
+#define CACHE_EXTENSION ".trc"
+
+#define CACHE_MAGIC "TRC1"
+#define CACHE_VERSION 2
+
+/* Stored as written, so a file from a machine of the other byte order reads back as something else */
+#define CACHE_BYTE_ORDER 0x01020304u
+
+/* Alignment of every section, enough for a Value */
+#define CACHE_ALIGN 16
+
+typedef struct {
+    char magic[4];          /* CACHE_MAGIC */
+    uint32_t version;       /* CACHE_VERSION */
+    uint32_t byteOrder;     /* CACHE_BYTE_ORDER */
+    uint16_t opcodeCount;   /* OPCODE_COUNT of the writer */
+    uint16_t valueSize;     /* sizeof(Value) of the writer */
+    uint32_t actions;       /* ANALYZE_OPTIMIZE and ANALYZE_GENERIC as the program was compiled */
+    uint32_t maxStack;
+    uint64_t sourceUnits;   /* code units of the source, BOM included */
+    uint64_t sourceHash;    /* cacheHash of them */
+    uint64_t payloadHash;   /* cacheHash of everything after the header */
+    uint32_t codeOffset, codeLen;
+    uint32_t constantOffset, constantCount;
+    uint32_t textOffset, textLen;
+    uint32_t variableOffset, variableCount;
+    uint32_t siteOffset, siteCount;
+    uint32_t kernelOffset, kernelCount;
+} CacheHeader;
+
+/* A cache file in memory */
+typedef struct {
+    void *base;             /* mapping or heap block holding the whole file */
+    size_t size;
+    int mapped;             /* 1 if base comes from mmap, 0 if from malloc */
+} Cache;
+
+/* cacheHash - a 64-bit hash of size bytes, eight at a time; tells a changed source from the one compiled */
+uint64_t cacheHash(const void *data, size_t size);
+
+/* cacheLoad - open the cache file at path and point bc into it, if it holds the program compiled with actions
+   from the len code units at units; returns 0, or -1 on a miss. bc stays valid until cacheClose */
+int cacheLoad(Cache *cache, const char *path, const uint16_t *units, size_t len, int actions, Bytecode *bc);
+
+/* cacheClose - release the memory behind a loaded cache file */
+void cacheClose(Cache *cache);
+
+/* cacheStore - write bc, compiled with actions from the len code units at units, to the cache file at path,
+   replacing it whole; returns 0, or -1 if it cannot be written */
+int cacheStore(const char *path, const uint16_t *units, size_t len, int actions, const Bytecode *bc);
+
+#endif
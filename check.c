@@ -0,0 +1,368 @@
+/* check.c - static checks of a parsed program: names declared before use, values of the declared type
+ *
+ * Runs over the syntax tree once the parser has accepted the file. Every expression node gets the TYPE_ token
+ * of its value; every name, declaration and assignment gets the number of the variable it refers to (AST_VAR).
+ * Numeric values widen from tam to küsurat to dev, never back. The first problem found is raised through
+ * error(), like a syntax error.
+ */
+#include <stdarg.h>
+#include <stdlib.h>
+#include <wchar.h>
+
+#include "front.h"
+#include "symtab.h"
+
+/* Name of every type, for messages */
+static const wchar_t *const typeNames[UNREGISTERED_SYMBOL + 1] = {
+#define KEYWORD(token, spelling) [token] = L"" spelling,
+#include "keywords.def"
+#undef KEYWORD
+};
+
+/* Identifiers and operators are quoted in messages up to this many characters */
+#define QUOTE_MAX 40
+
+/* Smallest dev that a küsurat rounds to infinity: the largest küsurat and half a unit in its last place */
+#define FLOAT_OVERFLOW 0x1.ffffffp127
+
+/* An expression node waiting for its kids to be checked */
+typedef struct {
+    AstRef ref;
+    int kidsDone;
+} Pending;
+
+typedef struct {
+    Context *ctx;
+    Ast *ast;
+    SymbolTable symbols;
+    Pending *stack;     /* expression walk, on the heap like the parser's */
+    size_t stackCap;
+    int loops;          /* loops around the statement being checked */
+} Checker;
+
+static void checkBlock(Checker *ck, AstRef block);
+
+/* isNumeric - whether values of type take part in arithmetic */
+static int isNumeric(int type) {
+    return type == TYPE_INT || type == TYPE_FLOAT || type == TYPE_DOUBLE;
+}
+
+/* assignable - whether a variable of type target can hold a value of type value */
+static int assignable(int target, int value) {
+    /* TYPE_INT < TYPE_FLOAT < TYPE_DOUBLE: a value only ever widens */
+    return target == value || (isNumeric(target) && isNumeric(value) && value <= target);
+}
+
+/* nodeText - the source text of a node as a wide string, cut at QUOTE_MAX characters */
+static const wchar_t *nodeText(const Checker *ck, AstRef ref, wchar_t *buf) {
+    const AstNode *node = &ck->ast->nodes[ref];
+    size_t i, n = node->length < QUOTE_MAX ? node->length : QUOTE_MAX;
+
+    for (i = 0; i < n; i++)
+        buf[i] = (wchar_t) ck->ctx->in.units[node->offset + i];
+    buf[n] = L'\0';
+    return buf;
+}
+
+/* fail - raise a checking error built from a format */
+static void fail(Checker *ck, const wchar_t *format, ...) {
+    wchar_t message[200];
+    va_list args;
+
+    va_start(args, format);
+    if (vswprintf(message, sizeof(message) / sizeof(message[0]), format, args) < 0)
+        wcscpy(message, L"Type error.");
+    va_end(args);
+    error(ck->ctx, message);
+}
+
+/* variable - the binding a name node refers to; raises an error and returns SYMTAB_NONE if it is undeclared */
+static uint32_t variable(Checker *ck, AstRef ref) {
+    AstNode *node = &ck->ast->nodes[ref];
+    uint32_t symbol = symtabIntern(&ck->symbols, node->offset, node->length);
+    uint32_t binding;
+    wchar_t name[QUOTE_MAX + 1];
+
+    if (symbol == SYMTAB_NONE) {
+        fail(ck, L"Not enough memory to check the program.");
+        return SYMTAB_NONE;
+    }
+    if ((binding = symtabLookup(&ck->symbols, symbol)) == SYMTAB_NONE) {
+        fail(ck, L"\"%ls\" is used before it is declared.", nodeText(ck, ref, name));
+        return SYMTAB_NONE;
+    }
+    node->kids[AST_VAR] = binding;
+    return binding;
+}
+
+/* typeOperator - the type of an operator node from the types of its operands, or 0 after raising an error */
+static int typeOperator(Checker *ck, AstRef ref) {
+    const AstNode *node = &ck->ast->nodes[ref];
+    int left = ck->ast->nodes[node->kids[0]].type;
+    int right = node->kind == AST_BINARY ? ck->ast->nodes[node->kids[1]].type : 0;
+    wchar_t op[QUOTE_MAX + 1];
+
+    if (node->kind == AST_NOT) {
+        if (left == TYPE_BOOL)
+            return TYPE_BOOL;
+        fail(ck, L"\"!\" needs a mantık operand, not %ls.", typeNames[left]);
+        return 0;
+    }
+    switch (node->op) {
+        case ADD_OP: case SUB_OP: case MULT_OP: case DIV_OP: case MOD_OP: case POWER_OP:
+            if (isNumeric(left) && isNumeric(right))
+                return left > right ? left : right;
+            break;
+        case LT_OP: case LE_OP: case GT_OP: case GE_OP:
+            if (isNumeric(left) && isNumeric(right))
+                return TYPE_BOOL;
+            break;
+        case EQUALITY_OP: case NOT_EQUALITY_OP:
+            if (left == right || (isNumeric(left) && isNumeric(right)))
+                return TYPE_BOOL;
+            fail(ck, L"\"%ls\" cannot compare a %ls value with a %ls value.", nodeText(ck, ref, op), typeNames[left], typeNames[right]);
+            return 0;
+        case AND_OP: case OR_OP:
+            if (left == TYPE_BOOL && right == TYPE_BOOL)
+                return TYPE_BOOL;
+            fail(ck, L"\"%ls\" needs mantık operands, not %ls and %ls.", nodeText(ck, ref, op), typeNames[left], typeNames[right]);
+            return 0;
+    }
+    fail(ck, L"\"%ls\" needs numeric operands, not %ls and %ls.", nodeText(ck, ref, op), typeNames[left], typeNames[right]);
+    return 0;
+}
+
+/* checkIndex - check that the variable of binding, named by node ref, is an array and that index, already typed,
+   is tam; returns 0, or -1 after raising an error */
+static int checkIndex(Checker *ck, AstRef ref, uint32_t binding, AstRef index) {
+    int type = ck->ast->nodes[index].type;
+    wchar_t name[QUOTE_MAX + 1];
+
+    if (ck->symbols.bindings[binding].length == 0) {
+        fail(ck, L"\"%ls\" is not an array and has no elements.", nodeText(ck, ref, name));
+        return -1;
+    }
+    if (type != TYPE_INT) {
+        fail(ck, L"The index of an element of \"%ls\" must be tam, not %ls.", nodeText(ck, ref, name), typeNames[type]);
+        return -1;
+    }
+    return 0;
+}
+
+/* checkExpr - type every node of the expression under root, kids before parents and left to right, without
+   recursion; returns the type of the whole, or 0 after raising an error */
+static int checkExpr(Checker *ck, AstRef root) {
+    size_t depth = 0;
+    wchar_t name[QUOTE_MAX + 1];
+
+    if (ck->stackCap == 0) {
+        if ((ck->stack = malloc(64 * sizeof(*ck->stack))) == NULL) {
+            fail(ck, L"Not enough memory to check the program.");
+            return 0;
+        }
+        ck->stackCap = 64;
+    }
+    ck->stack[depth++] = (Pending) {root, 0};
+    while (depth > 0) {
+        Pending top = ck->stack[--depth];
+        AstNode *node = &ck->ast->nodes[top.ref];
+        int type = 0;
+
+        if ((node->kind == AST_BINARY || node->kind == AST_NOT || node->kind == AST_INDEX) && !top.kidsDone) {
+            if (depth + 3 > ck->stackCap) {
+                Pending *grown = realloc(ck->stack, ck->stackCap * 2 * sizeof(*grown));
+                if (grown == NULL) {
+                    fail(ck, L"Not enough memory to check the program.");
+                    return 0;
+                }
+                ck->stack = grown;
+                ck->stackCap *= 2;
+            }
+            ck->stack[depth++] = (Pending) {top.ref, 1};
+            if (node->kind == AST_BINARY)
+                ck->stack[depth++] = (Pending) {node->kids[1], 0};
+            ck->stack[depth++] = (Pending) {node->kids[0], 0};
+            continue;
+        }
+        switch (node->kind) {
+            case AST_NAME: {
+                uint32_t binding = variable(ck, top.ref);
+                if (binding != SYMTAB_NONE && ck->symbols.bindings[binding].length != 0)
+                    fail(ck, L"\"%ls\" is an array; use one element of it, as %ls[i].", nodeText(ck, top.ref, name), name);
+                else if (binding != SYMTAB_NONE)
+                    type = ck->symbols.bindings[binding].type;
+                break;
+            }
+            case AST_INDEX: {
+                uint32_t binding = variable(ck, top.ref);
+                if (binding != SYMTAB_NONE && checkIndex(ck, top.ref, binding, node->kids[0]) == 0)
+                    type = ck->symbols.bindings[binding].type;
+                break;
+            }
+            case AST_INT: type = TYPE_INT; break;
+            case AST_FLOAT:
+                /* A literal that would round past the largest küsurat is a dev one, which no küsurat can hold */
+                type = literalValue(ck->ctx, node, TYPE_DOUBLE).as.d >= FLOAT_OVERFLOW ? TYPE_DOUBLE : TYPE_FLOAT;
+                break;
+            case AST_BOOL: type = TYPE_BOOL; break;
+            case AST_CHAR: type = TYPE_CHAR; break;
+            case AST_STRING: type = TYPE_STRING; break;
+            default: type = typeOperator(ck, top.ref); break;
+        }
+        if (type == 0)
+            return 0;
+        ck->ast->nodes[top.ref].type = (uint8_t) type;
+    }
+    return ck->ast->nodes[root].type;
+}
+
+/* checkValue - check the value given to a variable of type target; name is the variable's node, for messages */
+static void checkValue(Checker *ck, AstRef name, int target, AstRef value) {
+    int type = checkExpr(ck, value);
+    wchar_t text[QUOTE_MAX + 1];
+
+    if (type == TYPE_DOUBLE && target == TYPE_FLOAT && ck->ast->nodes[value].kind == AST_FLOAT)
+        fail(ck, L"\"%ls\" is declared küsurat, and this literal is too large for küsurat; declare it dev.",
+             nodeText(ck, name, text));
+    else if (type != 0 && !assignable(target, type))
+        fail(ck, L"\"%ls\" is declared %ls and cannot hold a %ls value.", nodeText(ck, name, text), typeNames[target], typeNames[type]);
+}
+
+/* checkCondition - check that the condition of an if, while or for statement is mantık */
+static void checkCondition(Checker *ck, AstRef stmt, AstRef cond) {
+    int type = checkExpr(ck, cond);
+    wchar_t keyword[QUOTE_MAX + 1];
+
+    if (type != 0 && type != TYPE_BOOL)
+        fail(ck, L"The condition of \"%ls\" must be mantık, not %ls.", nodeText(ck, stmt, keyword), typeNames[type]);
+}
+
+/* checkAssign - check an assignment: the variable first, then the index of the element if there is one, then
+   the new value */
+static void checkAssign(Checker *ck, AstRef ref) {
+    uint32_t binding = variable(ck, ref);
+    AstNode *node = &ck->ast->nodes[ref];
+    wchar_t name[QUOTE_MAX + 1];
+
+    if (binding == SYMTAB_NONE)
+        return;
+    if (node->kids[1] != AST_NONE) {
+        if (checkExpr(ck, node->kids[1]) == 0 || checkIndex(ck, ref, binding, node->kids[1]) != 0)
+            return;
+    } else if (ck->symbols.bindings[binding].length != 0) {
+        fail(ck, L"\"%ls\" is an array; give a value to one element of it, as %ls[i].", nodeText(ck, ref, name), name);
+        return;
+    }
+    node = &ck->ast->nodes[ref];
+    node->type = (uint8_t) ck->symbols.bindings[binding].type;
+    checkValue(ck, ref, node->type, node->kids[0]);
+}
+
+/* arrayLength - the number of elements the length node of an array declaration gives, or 0 after raising an
+   error */
+static uint32_t arrayLength(Checker *ck, AstRef ref) {
+    AstNode *node = &ck->ast->nodes[ref];
+    Value v;
+
+    node->type = TYPE_INT;
+    v = literalValue(ck->ctx, node, TYPE_INT);
+    if (v.as.i > UINT32_MAX) {
+        fail(ck, L"An array can have at most %lu elements.", (unsigned long) UINT32_MAX);
+        return 0;
+    }
+    if (v.as.i == 0) {
+        fail(ck, L"An array needs at least one element.");
+        return 0;
+    }
+    return (uint32_t) v.as.i;
+}
+
+/* checkDecl - check a declaration: its initial value or the length of the array, then the new name, which the value
+   cannot see yet */
+static void checkDecl(Checker *ck, AstRef ref) {
+    AstNode *node = &ck->ast->nodes[ref];
+    uint32_t symbol, binding, length = 0;
+    wchar_t name[QUOTE_MAX + 1];
+
+    node->type = node->op;
+    if (node->kids[0] != AST_NONE)
+        checkValue(ck, ref, node->op, node->kids[0]);
+    else if (node->kids[1] != AST_NONE)
+        length = arrayLength(ck, node->kids[1]);
+    if (ck->ctx->errorRaised)
+        return;
+    symbol = symtabIntern(&ck->symbols, node->offset, node->length);
+    binding = symbol == SYMTAB_NONE ? SYMTAB_NONE : symtabDeclare(&ck->symbols, symbol, node->op);
+    if (binding == SYMTAB_REDECLARED)
+        fail(ck, L"\"%ls\" is already declared in this block.", nodeText(ck, ref, name));
+    else if (binding == SYMTAB_NONE)
+        fail(ck, L"Not enough memory to check the program.");
+    else {
+        ck->symbols.bindings[binding].length = length;
+        ck->ast->nodes[ref].kids[AST_VAR] = binding;
+    }
+}
+
+/* checkStatement - check one statement and everything in it */
+static void checkStatement(Checker *ck, AstRef ref) {
+    const AstNode *node = &ck->ast->nodes[ref];
+    wchar_t keyword[QUOTE_MAX + 1];
+
+    switch (node->kind) {
+        case AST_DECL:
+            checkDecl(ck, ref);
+            break;
+        case AST_ASSIGN:
+            checkAssign(ck, ref);
+            break;
+        case AST_IF:
+            checkCondition(ck, ref, node->kids[0]);
+            checkBlock(ck, node->kids[1]);
+            if (node->kids[2] != AST_NONE)
+                checkBlock(ck, node->kids[2]);
+            break;
+        case AST_WHILE:
+            checkCondition(ck, ref, node->kids[0]);
+            ck->loops++;
+            checkBlock(ck, node->kids[1]);
+            ck->loops--;
+            break;
+        case AST_FOR:
+            checkAssign(ck, node->kids[0]);
+            checkCondition(ck, ref, node->kids[1]);
+            checkAssign(ck, node->kids[2]);
+            ck->loops++;
+            checkBlock(ck, node->kids[3]);
+            ck->loops--;
+            break;
+        case AST_BREAK:
+        case AST_CONTINUE:
+            if (ck->loops == 0)
+                fail(ck, L"\"%ls\" can only be used inside a loop.", nodeText(ck, ref, keyword));
+            break;
+    }
+}
+
+/* checkBlock - check the statements of a block in a scope of their own */
+static void checkBlock(Checker *ck, AstRef block) {
+    AstRef stmt;
+
+    if (symtabEnter(&ck->symbols) != 0) {
+        fail(ck, L"Not enough memory to check the program.");
+        return;
+    }
+    for (stmt = ck->ast->nodes[block].kids[0]; stmt != AST_NONE && !ck->ctx->errorRaised; stmt = ck->ast->nodes[stmt].next)
+        checkStatement(ck, stmt);
+    symtabLeave(&ck->symbols);
+}
+
+/* checkProgram - a function to check the names and types of the program parsed into ctx->ast */
+void checkProgram(Context *ctx) {
+    Checker ck = {.ctx = ctx, .ast = &ctx->ast};
+
+    symtabInit(&ck.symbols, ctx->in.units);
+    checkBlock(&ck, ctx->root);
+    ctx->variables = ck.symbols.bindingCount;
+    free(ck.stack);
+    symtabFree(&ck.symbols);
+}
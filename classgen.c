@@ -0,0 +1,60 @@
+/* classgen.c - build-time generator of charclass.h, the character class table behind getChar()
+ *
+ * Each code unit from U+0000 to U+017F (Basic Latin, Latin-1 and Latin Extended-A, which hold
+ * the whole Turkish alphabet) gets one byte: its character class in the low bits, plus flags for
+ * whitespace and for characters that may continue an identifier. Everything above the table is
+ * UNKNOWN, so classification is one load and does not depend on the locale.
+ */
+#include <stdio.h>
+
+#include "front.h"
+
+#define TABLE_SIZE 0x180
+
+/* Letters of the Turkish alphabet outside ASCII, as UTF-8 */
+static const char turkishLetters[] = "ÇçĞğİıÖöŞşÜü";
+
+int main(int argc, char **argv) {
+    unsigned char table[TABLE_SIZE];
+    const unsigned char *s;
+    unsigned c;
+
+    if (argc > 1 && freopen(argv[1], "w", stdout) == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    for (c = 0; c < TABLE_SIZE; c++) {
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+            table[c] = LETTER | CHAR_IDENT;
+        else if (c >= '0' && c <= '9')
+            table[c] = DIGIT | CHAR_IDENT;
+        else if (c == '$')
+            table[c] = COMMENT;
+        else if (c == '_')
+            table[c] = UNKNOWN | CHAR_IDENT;
+        else if (c == ' ' || (c >= '\t' && c <= '\r'))
+            table[c] = UNKNOWN | CHAR_SPACE;
+        else
+            table[c] = UNKNOWN;
+    }
+    /* The Turkish letters are all two-byte UTF-8 sequences inside the table */
+    for (s = (const unsigned char *) turkishLetters; *s; s += 2) {
+        c = (unsigned) (s[0] & 0x1F) << 6 | (s[1] & 0x3F);
+        table[c] = LETTER | CHAR_IDENT;
+    }
+
+    printf("/* charclass.h - generated by classgen; do not edit */\n");
+    printf("#ifndef CHARCLASS_H\n#define CHARCLASS_H\n\n");
+    printf("#define CHAR_TABLE_SIZE 0x%X\n\n", TABLE_SIZE);
+    printf("/* Character class and CHAR_SPACE / CHAR_IDENT flags of every code unit below CHAR_TABLE_SIZE */\n");
+    printf("static const unsigned char charTable[CHAR_TABLE_SIZE] = {");
+    for (c = 0; c < TABLE_SIZE; c++)
+        printf("%s0x%02X,", c % 16 ? " " : "\n    ", table[c]);
+    printf("\n};\n\n");
+    printf("/* charInfo - class and flags of code unit c; code units past the table are UNKNOWN */\n");
+    printf("static inline int charInfo(wint_t c) {\n");
+    printf("    return c < CHAR_TABLE_SIZE ? charTable[c] : UNKNOWN;\n");
+    printf("}\n\n#endif\n");
+    return fclose(stdout) == 0 ? 0 : 1;
+}
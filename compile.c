@@ -0,0 +1,814 @@
+/* compile.c - translation of a checked syntax tree into bytecode (vm.h), and running the result
+ *
+ * Statements are compiled in source order, so variables get their slots in the order check.c numbered them.
+ * Operands are widened where the checker let a narrower type in, so the machine only ever combines two
+ * values of the same type. Loops are laid out with the condition after the body: one conditional jump per
+ * iteration instead of a conditional and an unconditional one.
+ */
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "cache.h"
+#include "front.h"
+#include "vm.h"
+
+/* How many values each instruction pushes (or pops, if negative) */
+static const signed char stackEffects[OPCODE_COUNT] = {
+#define OPCODE(name, operandBytes, stackEffect) [name] = stackEffect,
+#include "opcodes.def"
+#undef OPCODE
+};
+
+/* Instruction of each arithmetic and comparison operator token */
+const uint8_t operatorCodes[UNREGISTERED_SYMBOL + 1] = {
+    [ADD_OP] = OP_ADD, [SUB_OP] = OP_SUB, [MULT_OP] = OP_MUL, [DIV_OP] = OP_DIV, [MOD_OP] = OP_MOD,
+    [POWER_OP] = OP_POW, [EQUALITY_OP] = OP_EQ, [NOT_EQUALITY_OP] = OP_NE, [LT_OP] = OP_LT, [LE_OP] = OP_LE,
+    [GT_OP] = OP_GT, [GE_OP] = OP_GE,
+};
+
+/* First of the three typed instructions of each arithmetic and comparison operator token, see opcodes.def */
+static const uint8_t typedCodes[UNREGISTERED_SYMBOL + 1] = {
+    [ADD_OP] = OP_ADD_I, [SUB_OP] = OP_SUB_I, [MULT_OP] = OP_MUL_I, [DIV_OP] = OP_DIV_I, [MOD_OP] = OP_MOD_I,
+    [POWER_OP] = OP_POW_I, [EQUALITY_OP] = OP_EQ_I, [NOT_EQUALITY_OP] = OP_NE_I, [LT_OP] = OP_LT_I,
+    [LE_OP] = OP_LE_I, [GT_OP] = OP_GT_I, [GE_OP] = OP_GE_I,
+};
+
+/* Name of every type, for the report of a run */
+static const char *const typeSpellings[UNREGISTERED_SYMBOL + 1] = {
+#define KEYWORD(token, spelling) [token] = spelling,
+#include "keywords.def"
+#undef KEYWORD
+};
+
+/* An expression node being compiled: its kids are done up to stage, and its value must end up of type want */
+typedef struct {
+    AstRef ref;
+    uint8_t want;
+    uint8_t stage;
+    uint32_t jump;      /* operand of the short-circuit jump of "&&" and "||" */
+} Pending;
+
+typedef struct {
+    Context *ctx;
+    const Ast *ast;
+    Bytecode *bc;
+    Pending *stack;     /* expression walk */
+    size_t stackCap;
+    uint32_t depth;     /* values the code so far leaves on the machine's stack */
+    uint32_t *breaks;   /* operands of "çık" jumps waiting for the end of their loop */
+    uint32_t breakCount, breakCap;
+    uint32_t *continues; /* ... and of "atla" jumps waiting for the condition or step of theirs */
+    uint32_t continueCount, continueCap;
+    int blocks;         /* blocks around the statement being compiled */
+    int generic;        /* emit the instructions that look at the type of their operands, not the typed ones */
+    wchar_t *message;   /* why compiling failed */
+    size_t messageSize;
+    int failed;
+} Compiler;
+
+static void compileBlock(Compiler *cm, AstRef block);
+
+/* fail - stop compiling with a message built from a format */
+static void fail(Compiler *cm, const wchar_t *format, ...) {
+    va_list args;
+
+    if (cm->failed)
+        return;
+    cm->failed = 1;
+    va_start(args, format);
+    if (vswprintf(cm->message, cm->messageSize, format, args) < 0)
+        wcsncpy(cm->message, L"The program cannot be compiled.", cm->messageSize);
+    va_end(args);
+}
+
+/* grow - make room for need elements in a growable array; fails the compiler when memory runs out */
+static int grow(Compiler *cm, void **items, uint32_t *cap, size_t need, size_t size) {
+    void *grown;
+    size_t newCap;
+
+    if (need <= *cap)
+        return 0;
+    for (newCap = *cap ? *cap : 64; newCap < need; newCap *= 2)
+        ;
+    if (newCap > UINT32_MAX || (grown = realloc(*items, newCap * size)) == NULL) {
+        fail(cm, L"Not enough memory to compile the program.");
+        return -1;
+    }
+    *items = grown;
+    *cap = (uint32_t) newCap;
+    return 0;
+}
+
+/* emit - append one instruction without an operand */
+static void emit(Compiler *cm, int op) {
+    Bytecode *bc = cm->bc;
+
+    if (cm->failed || grow(cm, (void **) &bc->code, &bc->codeCap, (size_t) bc->codeLen + 5, 1) != 0)
+        return;
+    bc->code[bc->codeLen++] = (uint8_t) op;
+    cm->depth += stackEffects[op];
+    if (cm->depth > bc->maxStack)
+        bc->maxStack = cm->depth;
+}
+
+/* emitOperand - append one instruction with its operand; returns where the operand sits */
+static uint32_t emitOperand(Compiler *cm, int op, uint32_t operand) {
+    Bytecode *bc = cm->bc;
+
+    emit(cm, op);
+    if (cm->failed)
+        return 0;
+    memcpy(bc->code + bc->codeLen, &operand, 4);
+    bc->codeLen += 4;
+    return bc->codeLen - 4;
+}
+
+/* patchJump - point the jump whose operand is at at to the end of the code so far */
+static void patchJump(Compiler *cm, uint32_t at) {
+    int32_t offset;
+
+    if (cm->failed)
+        return;
+    offset = (int32_t) (cm->bc->codeLen - (at + 4));
+    memcpy(cm->bc->code + at, &offset, 4);
+}
+
+/* emitJumpTo - append a jump back to target */
+static void emitJumpTo(Compiler *cm, int op, uint32_t target) {
+    uint32_t at = emitOperand(cm, op, 0);
+    int32_t offset;
+
+    if (cm->failed)
+        return;
+    offset = (int32_t) target - (int32_t) (at + 4);
+    memcpy(cm->bc->code + at, &offset, 4);
+}
+
+/* addConstant - put value into the constant pool; returns its index */
+static uint32_t addConstant(Compiler *cm, Value value) {
+    Bytecode *bc = cm->bc;
+
+    if (cm->failed || grow(cm, (void **) &bc->constants, &bc->constantCap, (size_t) bc->constantCount + 1, sizeof(Value)) != 0)
+        return 0;
+    bc->constants[bc->constantCount] = value;
+    return bc->constantCount++;
+}
+
+/* emitConstant - append an instruction pushing value */
+static void emitConstant(Compiler *cm, Value value) {
+    uint32_t index = addConstant(cm, value);
+
+    if (!cm->failed)
+        emitOperand(cm, OP_CONST, index);
+}
+
+/* addSite - note that the next instruction can fail, and which source position to blame */
+static void addSite(Compiler *cm, uint32_t source) {
+    Bytecode *bc = cm->bc;
+
+    if (cm->failed || grow(cm, (void **) &bc->sites, &bc->siteCap, (size_t) bc->siteCount + 1, sizeof(Site)) != 0)
+        return;
+    bc->sites[bc->siteCount++] = (Site) {bc->codeLen, source};
+}
+
+/* addStatement - note that the code of a statement (or of a loop's condition or step) at source starts here */
+static void addStatement(Compiler *cm, uint32_t source) {
+    Bytecode *bc = cm->bc;
+
+    if (cm->failed || grow(cm, (void **) &bc->statements, &bc->statementCap, (size_t) bc->statementCount + 1, sizeof(Site)) != 0)
+        return;
+    bc->statements[bc->statementCount++] = (Site) {bc->codeLen, source};
+}
+
+/* addRegion - open the region of the madem or loop at node where its code starts; returns its index, for
+   closeRegion */
+static uint32_t addRegion(Compiler *cm, const AstNode *node) {
+    Bytecode *bc = cm->bc;
+
+    if (cm->failed || grow(cm, (void **) &bc->regions, &bc->regionCap, (size_t) bc->regionCount + 1, sizeof(Region)) != 0)
+        return 0;
+    bc->regions[bc->regionCount] = (Region) {bc->codeLen, bc->codeLen, bc->codeLen, node->offset, (uint8_t) node->kind};
+    return bc->regionCount++;
+}
+
+/* closeRegion - end region at the code so far, with its deciding jump at branch */
+static void closeRegion(Compiler *cm, uint32_t region, uint32_t branch) {
+    if (cm->failed)
+        return;
+    cm->bc->regions[region].branch = branch;
+    cm->bc->regions[region].end = cm->bc->codeLen;
+}
+
+/* addText - copy length code units of the source at offset into the program's text; returns where they went */
+static uint32_t addText(Compiler *cm, uint32_t offset, uint32_t length) {
+    Bytecode *bc = cm->bc;
+
+    if (cm->failed || grow(cm, (void **) &bc->text, &bc->textCap, (size_t) bc->textLen + length, sizeof(uint16_t)) != 0)
+        return 0;
+    memcpy(bc->text + bc->textLen, cm->ctx->in.units + offset, length * sizeof(uint16_t));
+    bc->textLen += length;
+    return bc->textLen - length;
+}
+
+/* pushJump - remember the operand of a "çık" or "atla" jump until its target is known */
+static void pushJump(Compiler *cm, uint32_t **jumps, uint32_t *count, uint32_t *cap, uint32_t at) {
+    if (cm->failed || grow(cm, (void **) jumps, cap, (size_t) *count + 1, sizeof(**jumps)) != 0)
+        return;
+    (*jumps)[(*count)++] = at;
+}
+
+/* patchJumps - point every jump remembered since mark at the end of the code so far */
+static void patchJumps(Compiler *cm, const uint32_t *jumps, uint32_t *count, uint32_t mark) {
+    while (*count > mark)
+        patchJump(cm, jumps[--*count]);
+}
+
+/* zeroValue - what a variable of type holds before anything is given to it */
+static Value zeroValue(int type) {
+    Value v;
+
+    memset(&v, 0, sizeof(v));
+    v.type = (uint8_t) type;
+    return v;
+}
+
+/* literalValue - the value of a literal or AST_CONST node other than a tümce, in its own type except that a
+   küsurat literal wanted as dev keeps the dev precision the lexer read it to */
+Value literalValue(const Context *ctx, const AstNode *node, int want) {
+    uint64_t bits = astBits(node);
+    Value v;
+
+    memset(&v, 0, sizeof(v));
+    v.type = node->type;
+    switch (node->kind) {
+        case AST_INT: case AST_CONST:
+            memcpy(&v.as, &bits, sizeof(bits));
+            break;
+        case AST_FLOAT:
+            memcpy(&v.as.d, &bits, sizeof(bits));
+            /* One that would round past the largest küsurat the checker typed dev, so it is never narrowed */
+            if (want == TYPE_DOUBLE || node->type == TYPE_DOUBLE)
+                v.type = TYPE_DOUBLE;
+            else
+                v.as.f = (float) v.as.d;
+            break;
+        case AST_BOOL:
+            v.as.b = node->op == TRUE_VAL;
+            break;
+        case AST_CHAR:
+            v.as.c = ctx->in.units[node->offset];
+            break;
+    }
+    return v;
+}
+
+/* operandType - the type both operands of a binary node are brought to before they are combined */
+int operandType(const Ast *ast, const AstNode *node) {
+    int left = ast->nodes[node->kids[0]].type, right = ast->nodes[node->kids[1]].type;
+
+    switch (node->op) {
+        case AND_OP: case OR_OP:
+            return TYPE_BOOL;
+        case ADD_OP: case SUB_OP: case MULT_OP: case DIV_OP: case MOD_OP: case POWER_OP:
+            return node->type;
+    }
+    /* A comparison: numbers meet at the wider type, anything else is compared as it is */
+    if (left >= TYPE_INT && left <= TYPE_DOUBLE && right >= TYPE_INT && right <= TYPE_DOUBLE)
+        return left > right ? left : right;
+    return left;
+}
+
+/* compileLeaf - push the value of a name or literal; returns the type it was pushed as */
+static int compileLeaf(Compiler *cm, const AstNode *node, int want) {
+    Value v;
+
+    if (node->kind == AST_NAME) {
+        emitOperand(cm, OP_LOAD, node->kids[AST_VAR]);
+        return node->type;
+    }
+    if (node->kind == AST_STRING) {
+        memset(&v, 0, sizeof(v));
+        v.type = TYPE_STRING;
+        v.as.s.start = addText(cm, node->offset, node->length);
+        v.as.s.length = node->length;
+    } else {
+        v = literalValue(cm->ctx, node, want);
+        /* Widen a worked-out value here rather than at every run */
+        if (node->kind == AST_CONST && v.type != want)
+            vmWiden(&v, want);
+    }
+    emitConstant(cm, v);
+    return v.type;
+}
+
+/* operatorCode - the instruction for an arithmetic or comparison operator on two values of type operands */
+static int operatorCode(const Compiler *cm, int op, int operands) {
+    if (cm->generic || operands < TYPE_INT || operands > TYPE_DOUBLE)
+        return operatorCodes[op];
+    return typedCodes[op] + (operands - TYPE_INT);
+}
+
+/* emitWiden - convert the number on top of the stack from type to want */
+static void emitWiden(Compiler *cm, int type, int want) {
+    if (cm->generic)
+        emitOperand(cm, OP_WIDEN, want);
+    else if (type == TYPE_INT)
+        emit(cm, want == TYPE_FLOAT ? OP_WIDEN_I_F : OP_WIDEN_I_D);
+    else
+        emit(cm, OP_WIDEN_F_D);
+}
+
+/* compileExpr - push the value of the expression under root as a want value, without recursion: kids are
+   compiled left to right before their parent, and the short-circuit jump of "&&" and "||" goes between them */
+static void compileExpr(Compiler *cm, AstRef root, int want) {
+    size_t depth = 0;
+
+    if (cm->stackCap == 0) {
+        if ((cm->stack = malloc(64 * sizeof(*cm->stack))) == NULL) {
+            fail(cm, L"Not enough memory to compile the program.");
+            return;
+        }
+        cm->stackCap = 64;
+    }
+    cm->stack[depth++] = (Pending) {root, (uint8_t) want, 0, 0};
+    while (depth > 0 && !cm->failed) {
+        Pending *top = &cm->stack[depth - 1];
+        const AstNode *node = &cm->ast->nodes[top->ref];
+        int type = node->type;
+
+        if (depth + 1 > cm->stackCap) {
+            Pending *grown = realloc(cm->stack, cm->stackCap * 2 * sizeof(*grown));
+            if (grown == NULL) {
+                fail(cm, L"Not enough memory to compile the program.");
+                return;
+            }
+            cm->stack = grown;
+            cm->stackCap *= 2;
+            top = &cm->stack[depth - 1];
+        }
+        if (node->kind == AST_NOT) {
+            if (top->stage++ == 0) {
+                cm->stack[depth++] = (Pending) {node->kids[0], TYPE_BOOL, 0, 0};
+                continue;
+            }
+            emit(cm, OP_NOT);
+        } else if (node->kind == AST_INDEX) {
+            if (top->stage++ == 0) {
+                cm->stack[depth++] = (Pending) {node->kids[0], TYPE_INT, 0, 0};
+                continue;
+            }
+            addSite(cm, node->offset);
+            emitOperand(cm, OP_LOAD_ELEMENT, node->kids[AST_VAR]);
+        } else if (node->kind == AST_BINARY) {
+            int operands = operandType(cm->ast, node), shortCircuit = node->op == AND_OP || node->op == OR_OP;
+            if (top->stage == 0) {
+                top->stage = 1;
+                cm->stack[depth++] = (Pending) {node->kids[0], (uint8_t) operands, 0, 0};
+                continue;
+            }
+            if (top->stage == 1) {
+                top->stage = 2;
+                if (shortCircuit)
+                    top->jump = emitOperand(cm, node->op == AND_OP ? OP_JUMP_FALSE_OR_POP : OP_JUMP_TRUE_OR_POP, 0);
+                cm->stack[depth++] = (Pending) {node->kids[1], (uint8_t) operands, 0, 0};
+                continue;
+            }
+            if (shortCircuit) {
+                patchJump(cm, top->jump);
+            } else {
+                if (node->op == DIV_OP || node->op == MOD_OP || node->op == POWER_OP)
+                    addSite(cm, node->offset);
+                emit(cm, operatorCode(cm, node->op, operands));
+            }
+        } else {
+            type = compileLeaf(cm, node, top->want);
+        }
+        if (type != top->want)
+            emitWiden(cm, type, top->want);
+        depth--;
+    }
+}
+
+/* compileDecl - store the initial value of a declared variable, its zero value if it has none; the elements of
+   an array start out zero, and are set to zero again when a declaration in a block runs again */
+static void compileDecl(Compiler *cm, const AstNode *node) {
+    Bytecode *bc = cm->bc;
+    uint32_t var = node->kids[AST_VAR];
+
+    if (grow(cm, (void **) &bc->variables, &bc->variableCap, (size_t) var + 1, sizeof(Variable)) != 0)
+        return;
+    while (bc->variableCount <= var)
+        memset(&bc->variables[bc->variableCount++], 0, sizeof(Variable));
+    bc->variables[var].name = addText(cm, node->offset, node->length);
+    bc->variables[var].length = node->length;
+    bc->variables[var].type = node->op;
+    /* Temporaries the optimizer adds have no name and are never reported */
+    bc->variables[var].global = cm->blocks == 1 && node->length > 0;
+
+    if (node->kids[1] != AST_NONE) {
+        /* The checker made sure the length fits */
+        bc->variables[var].count = (uint32_t) literalValue(cm->ctx, &cm->ast->nodes[node->kids[1]], TYPE_INT).as.i;
+        if (cm->blocks > 1)
+            emitOperand(cm, OP_CLEAR_ARRAY, var);
+        return;
+    }
+    if (node->kids[0] != AST_NONE)
+        compileExpr(cm, node->kids[0], node->op);
+    else
+        emitConstant(cm, zeroValue(node->op));
+    emitOperand(cm, OP_STORE, var);
+}
+
+/* compileAssign - store a new value in a variable, or in an element of an array: its index first, then the
+   value, which the store checks the index of */
+static void compileAssign(Compiler *cm, AstRef ref) {
+    const AstNode *node = &cm->ast->nodes[ref];
+
+    if (node->kids[1] != AST_NONE) {
+        compileExpr(cm, node->kids[1], TYPE_INT);
+        compileExpr(cm, node->kids[0], node->type);
+        addSite(cm, node->offset);
+        emitOperand(cm, OP_STORE_ELEMENT, node->kids[AST_VAR]);
+        return;
+    }
+    compileExpr(cm, node->kids[0], node->type);
+    emitOperand(cm, OP_STORE, node->kids[AST_VAR]);
+}
+
+/* isTrue - whether the condition at ref is the constant doğru, as the optimizer leaves "iken (doğru)" */
+static int isTrue(const Ast *ast, AstRef ref) {
+    const AstNode *node = &ast->nodes[ref];
+    return (node->kind == AST_BOOL && node->op == TRUE_VAL) || (node->kind == AST_CONST && astBits(node) != 0);
+}
+
+/* compileLoop - the body, then whatever comes before the condition (the step of "sayaç"), then the condition
+   jumping back to the body; "atla" goes to the step or the condition, "çık" past the loop. The jump back closes
+   region */
+static void compileLoop(Compiler *cm, uint32_t region, AstRef cond, AstRef step, AstRef body) {
+    uint32_t breaks = cm->breakCount, continues = cm->continueCount;
+    uint32_t entry = emitOperand(cm, OP_JUMP, 0), top = cm->bc->codeLen, back;
+
+    compileBlock(cm, body);
+    patchJumps(cm, cm->continues, &cm->continueCount, continues);
+    if (step != AST_NONE) {
+        addStatement(cm, cm->ast->nodes[step].offset);
+        compileAssign(cm, step);
+    }
+    patchJump(cm, entry);
+    addStatement(cm, cm->ast->nodes[cond].offset);
+    if (isTrue(cm->ast, cond)) {
+        back = cm->bc->codeLen;
+        emitJumpTo(cm, OP_JUMP, top);
+    } else {
+        compileExpr(cm, cond, TYPE_BOOL);
+        back = cm->bc->codeLen;
+        emitJumpTo(cm, OP_JUMP_TRUE, top);
+    }
+    patchJumps(cm, cm->breaks, &cm->breakCount, breaks);
+    closeRegion(cm, region, back);
+}
+
+/* isName - whether node reads the variable var */
+static int isName(const AstNode *node, uint32_t var) {
+    return node->kind == AST_NAME && node->kids[AST_VAR] == var;
+}
+
+/* isOne - whether node is the tam constant 1 */
+static int isOne(const Compiler *cm, const AstNode *node) {
+    return (node->kind == AST_INT || node->kind == AST_CONST) && node->type == TYPE_INT &&
+           literalValue(cm->ctx, node, TYPE_INT).as.i == 1;
+}
+
+/* elementAt - whether node reads an element of an array of type at the index counter, putting its slot in *slot */
+static int elementAt(const Compiler *cm, const AstNode *node, uint32_t counter, int type, uint32_t *slot) {
+    if (node->kind != AST_INDEX || node->type != type || !isName(&cm->ast->nodes[node->kids[0]], counter))
+        return 0;
+    *slot = node->kids[AST_VAR];
+    return 1;
+}
+
+/* kernelOperand - an operand of a map from node: an element at the index counter, a variable of type other
+   than counter, or a constant, widened to type here; returns 0, or -1 if node is none of these */
+static int kernelOperand(Compiler *cm, const AstNode *node, uint32_t counter, int type, KernelOperand *operand) {
+    Value v;
+
+    if (elementAt(cm, node, counter, type, &operand->index)) {
+        operand->kind = KERNEL_ARRAY;
+        return 0;
+    }
+    if (node->kind == AST_NAME && node->type == type && node->kids[AST_VAR] != counter) {
+        operand->kind = KERNEL_SCALAR;
+        operand->index = node->kids[AST_VAR];
+        return 0;
+    }
+    if (node->kind == AST_INT || node->kind == AST_FLOAT || node->kind == AST_BOOL || node->kind == AST_CONST) {
+        v = literalValue(cm->ctx, node, type);
+        if (v.type != type)
+            vmWiden(&v, type);
+        operand->kind = KERNEL_CONSTANT;
+        operand->index = addConstant(cm, v);
+        return 0;
+    }
+    return -1;
+}
+
+/* arrayKernel - the kernel doing what the statement at ref does for one value of counter, if it is a map or a sum
+   over elements at the index counter; returns 0, or -1 if it is neither:
+       a[i] <<< x op y    op +, -, * or (but for tam) /, x and y each an element b[i], a variable or a constant
+       a[i] <<< x         x any of those, for mantık arrays too
+       s <<< s + b[i]     s a variable other than i
+       s <<< s + b[i] * c[i]
+   Every operand is of the elements' type, but for the constants, which are widened to it */
+static int arrayKernel(Compiler *cm, AstRef ref, uint32_t counter, Kernel *kernel) {
+    const AstNode *nodes = cm->ast->nodes, *stmt = &nodes[ref], *value = &nodes[stmt->kids[0]];
+    int type = stmt->type, numeric = type >= TYPE_INT && type <= TYPE_DOUBLE;
+
+    memset(kernel, 0, sizeof(*kernel));
+    kernel->type = (uint8_t) type;
+    kernel->counter = counter;
+    kernel->target = stmt->kids[AST_VAR];
+    if (stmt->kind != AST_ASSIGN || stmt->kids[AST_VAR] == counter)
+        return -1;
+    if (stmt->kids[1] != AST_NONE) {
+        if (!isName(&nodes[stmt->kids[1]], counter))
+            return -1;
+        kernel->shape = KERNEL_MAP;
+        if (value->kind == AST_BINARY && numeric && value->type == type &&
+            (value->op == ADD_OP || value->op == SUB_OP || value->op == MULT_OP || (value->op == DIV_OP && type != TYPE_INT))) {
+            kernel->op = value->op;
+            return kernelOperand(cm, &nodes[value->kids[0]], counter, type, &kernel->left) == 0 &&
+                   kernelOperand(cm, &nodes[value->kids[1]], counter, type, &kernel->right) == 0 ? 0 : -1;
+        }
+        if (type != TYPE_INT && type != TYPE_FLOAT && type != TYPE_DOUBLE && type != TYPE_BOOL)
+            return -1;
+        kernel->op = 0;
+        if (kernelOperand(cm, value, counter, type, &kernel->left) != 0)
+            return -1;
+        kernel->right = kernel->left;
+        return 0;
+    }
+    if (!numeric || value->kind != AST_BINARY || value->op != ADD_OP || value->type != type || !isName(&nodes[value->kids[0]], kernel->target))
+        return -1;
+    value = &nodes[value->kids[1]];
+    if (elementAt(cm, value, counter, type, &kernel->left.index)) {
+        kernel->shape = KERNEL_SUM;
+        kernel->right = kernel->left;
+        return 0;
+    }
+    kernel->shape = KERNEL_DOT;
+    return value->kind == AST_BINARY && value->op == MULT_OP && value->type == type &&
+           elementAt(cm, &nodes[value->kids[0]], counter, type, &kernel->left.index) &&
+           elementAt(cm, &nodes[value->kids[1]], counter, type, &kernel->right.index) ? 0 : -1;
+}
+
+/* compileArrayLoop - a sayaç loop whose body is one statement arrayKernel takes, counting up by 1 while the
+   counter is below a constant or a variable the body does not assign, as its first assignment and one
+   OP_ARRAY_LOOP, which runs the whole loop; returns 0, or -1 with nothing emitted if the loop is not of that
+   form. The bound is read once, as the body cannot change it */
+static int compileArrayLoop(Compiler *cm, AstRef ref, uint32_t region) {
+    const AstNode *nodes = cm->ast->nodes, *node = &nodes[ref];
+    const AstNode *init = &nodes[node->kids[0]], *cond = &nodes[node->kids[1]], *step = &nodes[node->kids[2]];
+    const AstNode *body = &nodes[node->kids[3]], *bound, *increment;
+    uint32_t counter = init->kids[AST_VAR], constants = cm->bc->constantCount, at;
+    Kernel kernel;
+
+    if (init->type != TYPE_INT || init->kids[1] != AST_NONE || cond->kind != AST_BINARY || cond->op != LT_OP ||
+        !isName(&nodes[cond->kids[0]], counter) || step->kids[AST_VAR] != counter || step->kids[1] != AST_NONE ||
+        body->kind != AST_BLOCK || body->kids[0] == AST_NONE || nodes[body->kids[0]].next != AST_NONE)
+        return -1;
+    bound = &nodes[cond->kids[1]];
+    increment = &nodes[step->kids[0]];
+    if (bound->type != TYPE_INT || !(bound->kind == AST_INT || bound->kind == AST_CONST || bound->kind == AST_NAME) ||
+        increment->kind != AST_BINARY || increment->op != ADD_OP || !isName(&nodes[increment->kids[0]], counter) ||
+        !isOne(cm, &nodes[increment->kids[1]]))
+        return -1;
+    if (arrayKernel(cm, body->kids[0], counter, &kernel) != 0 ||
+        (bound->kind == AST_NAME && (bound->kids[AST_VAR] == counter ||
+                                     (kernel.shape != KERNEL_MAP && bound->kids[AST_VAR] == kernel.target)))) {
+        /* Take back the constants the operands added */
+        cm->bc->constantCount = constants;
+        return -1;
+    }
+    if (grow(cm, (void **) &cm->bc->kernels, &cm->bc->kernelCap, (size_t) cm->bc->kernelCount + 1, sizeof(Kernel)) != 0)
+        return 0;
+    cm->bc->kernels[cm->bc->kernelCount] = kernel;
+    compileAssign(cm, node->kids[0]);
+    addStatement(cm, cond->offset);
+    compileExpr(cm, cond->kids[1], TYPE_INT);
+    addStatement(cm, nodes[body->kids[0]].offset);
+    addSite(cm, nodes[body->kids[0]].offset);
+    at = emitOperand(cm, OP_ARRAY_LOOP, cm->bc->kernelCount++);
+    closeRegion(cm, region, at - 1);
+    return 0;
+}
+
+/* compileStatement - one statement and everything in it */
+static void compileStatement(Compiler *cm, AstRef ref) {
+    const AstNode *node = &cm->ast->nodes[ref];
+    uint32_t skip, end, region;
+
+    if (node->kind != AST_BLOCK)
+        addStatement(cm, node->offset);
+    switch (node->kind) {
+        case AST_DECL:
+            compileDecl(cm, node);
+            break;
+        case AST_ASSIGN:
+            compileAssign(cm, ref);
+            break;
+        case AST_IF:
+            region = addRegion(cm, node);
+            compileExpr(cm, node->kids[0], TYPE_BOOL);
+            skip = emitOperand(cm, OP_JUMP_FALSE, 0);
+            compileBlock(cm, node->kids[1]);
+            if (node->kids[2] != AST_NONE) {
+                end = emitOperand(cm, OP_JUMP, 0);
+                patchJump(cm, skip);
+                compileBlock(cm, node->kids[2]);
+                patchJump(cm, end);
+            } else {
+                patchJump(cm, skip);
+            }
+            /* The jump's opcode comes just before its operand */
+            closeRegion(cm, region, skip - 1);
+            break;
+        case AST_WHILE:
+            compileLoop(cm, addRegion(cm, node), node->kids[0], AST_NONE, node->kids[1]);
+            break;
+        case AST_FOR:
+            region = addRegion(cm, node);
+            if (!cm->generic && compileArrayLoop(cm, ref, region) == 0)
+                break;
+            compileAssign(cm, node->kids[0]);
+            compileLoop(cm, region, node->kids[1], node->kids[2], node->kids[3]);
+            break;
+        case AST_BREAK:
+            pushJump(cm, &cm->breaks, &cm->breakCount, &cm->breakCap, emitOperand(cm, OP_JUMP, 0));
+            break;
+        case AST_CONTINUE:
+            pushJump(cm, &cm->continues, &cm->continueCount, &cm->continueCap, emitOperand(cm, OP_JUMP, 0));
+            break;
+        case AST_BLOCK:
+            /* What is left of a statement the optimizer took apart */
+            compileBlock(cm, ref);
+            break;
+    }
+}
+
+/* compileBlock - the statements of a block in order */
+static void compileBlock(Compiler *cm, AstRef block) {
+    AstRef stmt;
+
+    cm->blocks++;
+    for (stmt = cm->ast->nodes[block].kids[0]; stmt != AST_NONE && !cm->failed; stmt = cm->ast->nodes[stmt].next)
+        compileStatement(cm, stmt);
+    cm->blocks--;
+}
+
+/* compileProgram - a function to compile the checked program in ctx->ast into bc, with the typed instructions
+   unless generic is set; returns 0, or -1 with the reason in message (size wide characters) */
+int compileProgram(Context *ctx, Bytecode *bc, int generic, wchar_t *message, size_t size) {
+    Compiler cm = {.ctx = ctx, .ast = &ctx->ast, .bc = bc};
+
+    memset(bc, 0, sizeof(*bc));
+    cm.generic = generic;
+    cm.message = message;
+    cm.messageSize = size;
+    compileBlock(&cm, ctx->root);
+    emit(&cm, OP_HALT);
+    free(cm.stack);
+    free(cm.breaks);
+    free(cm.continues);
+    if (cm.failed) {
+        bytecodeFree(bc);
+        return -1;
+    }
+    return 0;
+}
+
+/************************************************************************************/
+
+/* reportArray - write the final elements of an array to out, as "[1; 2; 3]": the decimal comma rules out ',' */
+static void reportArray(const Variable *var, const Value *v, const uint16_t *name, Sink *out) {
+    char type[32];
+    uint16_t *text;
+    size_t n = 0, j;
+
+    snprintf(type, sizeof(type), "%s[%" PRIu32 "]", typeSpellings[var->type], var->count);
+    if ((text = malloc(((size_t) var->count * (VM_FORMAT_MAX + 2) + 2) * sizeof(*text))) == NULL) {
+        out->failed = 1;
+        return;
+    }
+    text[n++] = '[';
+    for (j = 0; j < var->count; j++) {
+        Value element = vmElement(v->as.elements, var->type, j);
+        if (j > 0) {
+            text[n++] = ';';
+            text[n++] = ' ';
+        }
+        n += vmFormat(&element, text + n);
+    }
+    text[n++] = ']';
+    sinkVariable(out, type, name, var->length, text, n, 0);
+    free(text);
+}
+
+/* reportVariables - write the final value of every variable declared outside a block to out */
+static void reportVariables(const Bytecode *bc, const Value *slots, Sink *out) {
+    uint16_t local[VM_FORMAT_MAX];
+    const uint16_t *text;
+    uint32_t i;
+
+    for (i = 0; i < bc->variableCount; i++) {
+        const Variable *var = &bc->variables[i];
+        const Value *v = &slots[i];
+        size_t n = 0;
+        int quote = 0;
+
+        if (!var->global)
+            continue;
+        if (var->count > 0) {
+            reportArray(var, v, bc->text + var->name, out);
+            continue;
+        }
+        if (v->type == TYPE_STRING) {
+            text = bc->text + v->as.s.start;
+            n = v->as.s.length;
+            quote = '"';
+        } else {
+            n = vmFormat(v, local);
+            text = local;
+            quote = v->type == TYPE_CHAR ? '\'' : 0;
+        }
+        sinkVariable(out, typeSpellings[var->type], bc->text + var->name, var->length, text, n, quote);
+    }
+}
+
+/* stopped - put why the program did not run to its end into ctx->errMsg */
+static void stopped(Context *ctx, const wchar_t *message) {
+    swprintf(ctx->errMsg, sizeof(ctx->errMsg) / sizeof(ctx->errMsg[0]), L"The program stopped.\nReason: %ls", message);
+    if (ctx->traceLevel > TRACE_SILENT)
+        sinkVerdict(ctx->out, ctx->errMsg);
+}
+
+/* runBytecode - a function to run a program compiled from the source in ctx, then report its variables to
+   ctx->out; profiled (profileProgram) unless profile, the path of that source, is NULL. Returns 0, or -1 with
+   the reason the program stopped in ctx->errMsg */
+int runBytecode(Context *ctx, const Bytecode *bc, const char *profile) {
+    Value *slots;
+    void *arrays;
+    wchar_t message[200];
+    uint32_t where;
+    LineTable lines;
+    int status;
+
+    if ((slots = malloc(((size_t) bc->variableCount + 1) * sizeof(*slots))) == NULL ||
+        vmInitSlots(bc, slots, &arrays) != VM_OK) {
+        free(slots);
+        stopped(ctx, L"Not enough memory to run the program.");
+        return -1;
+    }
+    if (profile != NULL)
+        status = profileProgram(ctx, bc, slots, &where, profile);
+    else
+        status = vmRun(bc, slots, &where);
+    if (status == VM_OK)
+        reportVariables(bc, slots, ctx->out);
+    free(arrays);
+    free(slots);
+    if (status != VM_OK) {
+        if (readerLines(&ctx->in, &lines) != 0) {
+            stopped(ctx, L"Not enough memory to run the program.");
+            return -1;
+        }
+        swprintf(message, sizeof(message) / sizeof(message[0]), L"Line %lu: %ls", (unsigned long) lineOf(&lines, where),
+                 vmMessage(status));
+        freeLines(&lines);
+        stopped(ctx, message);
+        return -1;
+    }
+    return 0;
+}
+
+/* runProgram - a function to compile the checked program in ctx as the ANALYZE_ flags in actions say (generic:
+   see compileProgram), keep the result in the cache file at cache unless that is NULL, and run it (runBytecode,
+   with profile); returns 0, or -1 with the reason the program stopped in ctx->errMsg */
+int runProgram(Context *ctx, int actions, const char *cache, const char *profile) {
+    Bytecode bc;
+    wchar_t message[200];
+    int status;
+
+    if (compileProgram(ctx, &bc, (actions & ANALYZE_GENERIC) != 0, message, sizeof(message) / sizeof(message[0])) != 0) {
+        stopped(ctx, message);
+        return -1;
+    }
+    /* A cache that cannot be written only means the next run compiles again */
+    if (cache != NULL)
+        cacheStore(cache, ctx->in.units, ctx->in.len, actions, &bc);
+    status = runBytecode(ctx, &bc, profile);
+    bytecodeFree(&bc);
+    return status;
+}
@@ -0,0 +1,234 @@
+/* dfagen.c - build-time generator of dfa.h, the table-driven scanner behind lex()
+ *
+ * The token set is described once: the fixed spellings in operators.def and keywords.def, and
+ * three rules written out below (identifiers, numbers with a ',' decimal part, and any other single
+ * character as UNREGISTERED_SYMBOL). Each of these is a small deterministic automaton; the scanner
+ * is their product, built here by following every code unit from the start state. A spelling beats
+ * a rule on the same text, so keywords are never identifiers. Code units that move every state the
+ * same way share a column, which keeps the transition table a few kilobytes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "front.h"
+#include "charclass.h"
+
+/* Code units CHAR_TABLE_SIZE and above all behave like the symbol at index CHAR_TABLE_SIZE */
+#define SYMBOLS (CHAR_TABLE_SIZE + 1)
+#define MAX_UNITS 32
+#define MAX_NODES 512
+#define MAX_STATES 1024
+
+typedef struct {
+    int token;
+    const char *spelling;   /* UTF-8 */
+} Spelling;
+
+static const Spelling spellings[] = {
+#define OPERATOR(token, spelling) {token, spelling},
+#include "operators.def"
+#undef OPERATOR
+#define KEYWORD(token, spelling) {token, spelling},
+#include "keywords.def"
+#undef KEYWORD
+};
+
+#define SPELLING_COUNT ((int) (sizeof(spellings) / sizeof(spellings[0])))
+
+/* Trie of the spellings: node 0 is the root */
+static int trieChild[MAX_NODES][SYMBOLS];
+static int trieToken[MAX_NODES];
+static int trieNodes = 1;
+
+/* Rule automata; state 0 is the start, -1 is dead */
+#define IDENT_IN 1          /* inside an identifier */
+#define NUMBER_INT 1        /* digits */
+#define NUMBER_FP 2         /* digits ',' digits */
+#define OTHER_DONE 1        /* one character taken */
+
+/* A scanner state: where each automaton is, -1 once it cannot match any more */
+typedef struct {
+    int trie, ident, number, other;
+} State;
+
+static State states[MAX_STATES];
+static int stateCount;
+static int next[MAX_STATES][SYMBOLS];
+
+/* decodeUtf8 - turn a UTF-8 spelling into UTF-16 code units (spellings stay in the BMP) */
+static int decodeUtf8(const char *text, unsigned *units) {
+    const unsigned char *s = (const unsigned char *) text;
+    int len = 0;
+
+    while (*s) {
+        unsigned cp;
+        if (*s < 0x80) {
+            cp = *s++;
+        } else if ((*s & 0xE0) == 0xC0 && (s[1] & 0xC0) == 0x80) {
+            cp = (unsigned) (s[0] & 0x1F) << 6 | (s[1] & 0x3F);
+            s += 2;
+        } else if ((*s & 0xF0) == 0xE0 && (s[1] & 0xC0) == 0x80 && (s[2] & 0xC0) == 0x80) {
+            cp = (unsigned) (s[0] & 0x0F) << 12 | (unsigned) (s[1] & 0x3F) << 6 | (s[2] & 0x3F);
+            s += 3;
+        } else {
+            return -1;
+        }
+        if (len == MAX_UNITS)
+            return -1;
+        units[len++] = cp;
+    }
+    return len;
+}
+
+/* addSpelling - thread one spelling through the trie; returns 0, or -1 if it cannot be scanned */
+static int addSpelling(const Spelling *sp) {
+    unsigned units[MAX_UNITS];
+    int len = decodeUtf8(sp->spelling, units), node = 0, i;
+
+    if (len <= 0)
+        return -1;
+    for (i = 0; i < len; i++) {
+        if (units[i] >= CHAR_TABLE_SIZE || (charInfo(units[i]) & CHAR_SPACE))
+            return -1;
+        if (trieChild[node][units[i]] == 0) {
+            if (trieNodes == MAX_NODES)
+                return -1;
+            trieChild[node][units[i]] = trieNodes++;
+        }
+        node = trieChild[node][units[i]];
+    }
+    if (trieToken[node] != 0)
+        return -1;
+    trieToken[node] = sp->token;
+    return 0;
+}
+
+/* step - where each automaton goes on symbol c */
+static State step(State s, unsigned c) {
+    int info = charInfo(c < CHAR_TABLE_SIZE ? c : 0xFFFF);
+    int cls = info & CHAR_CLASS_MASK;
+    State t;
+
+    t.trie = s.trie >= 0 && c < CHAR_TABLE_SIZE && trieChild[s.trie][c] != 0 ? trieChild[s.trie][c] : -1;
+
+    /* <identifier> -> LETTER { LETTER | DIGIT | '_' } */
+    if (s.ident == 0)
+        t.ident = cls == LETTER ? IDENT_IN : -1;
+    else
+        t.ident = s.ident == IDENT_IN && (info & CHAR_IDENT) ? IDENT_IN : -1;
+
+    /* <number> -> DIGIT { DIGIT } [ ',' { DIGIT } ] */
+    if (s.number == 0 || s.number == NUMBER_INT)
+        t.number = cls == DIGIT ? NUMBER_INT : s.number == NUMBER_INT && c == ',' ? NUMBER_FP : -1;
+    else
+        t.number = s.number == NUMBER_FP && cls == DIGIT ? NUMBER_FP : -1;
+
+    /* Any other character that is not a blank is one UNREGISTERED_SYMBOL */
+    t.other = s.other == 0 && !(info & CHAR_SPACE) ? OTHER_DONE : -1;
+    return t;
+}
+
+/* accepts - the token a state accepts: a spelling first, then a rule, then a lone character; 0 if none */
+static int accepts(State s) {
+    if (s.trie >= 0 && trieToken[s.trie] != 0)
+        return trieToken[s.trie];
+    if (s.ident == IDENT_IN)
+        return IDENT;
+    if (s.number == NUMBER_INT)
+        return INT_LIT;
+    if (s.number == NUMBER_FP)
+        return FP_LIT;
+    if (s.other == OTHER_DONE)
+        return UNREGISTERED_SYMBOL;
+    return 0;
+}
+
+/* stateOf - the number of state s, adding it if it is new; 0 is the dead state */
+static int stateOf(State s) {
+    int i;
+    if (s.trie < 0 && s.ident < 0 && s.number < 0 && s.other < 0)
+        return 0;
+    for (i = 1; i < stateCount; i++)
+        if (memcmp(&states[i], &s, sizeof(s)) == 0)
+            return i;
+    if (stateCount == MAX_STATES) {
+        fprintf(stderr, "dfagen: more than %d states; raise MAX_STATES\n", MAX_STATES);
+        exit(1);
+    }
+    states[stateCount] = s;
+    return stateCount++;
+}
+
+int main(int argc, char **argv) {
+    static int classOf[SYMBOLS];
+    int representative[SYMBOLS];
+    int classes = 0, i, j;
+    unsigned c;
+    State start = {0, 0, 0, 0};
+
+    if (argc > 1 && freopen(argv[1], "w", stdout) == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    for (i = 0; i < SPELLING_COUNT; i++) {
+        if (addSpelling(&spellings[i]) != 0) {
+            fprintf(stderr, "dfagen: cannot scan \"%s\" (token %d): empty, duplicate, blank or outside the table\n",
+                    spellings[i].spelling, spellings[i].token);
+            return 1;
+        }
+    }
+
+    /* State 0 is dead, state 1 the start; every new state is expanded in turn */
+    stateCount = 1;
+    stateOf(start);
+    for (i = 1; i < stateCount; i++)
+        for (c = 0; c < SYMBOLS; c++)
+            next[i][c] = stateOf(step(states[i], c));
+
+    /* Symbols with identical columns share a class */
+    for (c = 0; c < SYMBOLS; c++) {
+        for (j = 0; j < classes; j++) {
+            for (i = 1; i < stateCount && next[i][c] == next[i][representative[j]]; i++)
+                ;
+            if (i == stateCount)
+                break;
+        }
+        if (j == classes)
+            representative[classes++] = (int) c;
+        classOf[c] = j;
+    }
+    if (stateCount > 255 || classes > 255) {
+        fprintf(stderr, "dfagen: %d states, %d classes do not fit in a byte\n", stateCount, classes);
+        return 1;
+    }
+
+    printf("/* dfa.h - generated by dfagen from operators.def and keywords.def; do not edit */\n");
+    printf("#ifndef DFA_H\n#define DFA_H\n\n");
+    printf("#define DFA_DEAD 0\n#define DFA_START 1\n");
+    printf("#define DFA_STATES %d\n#define DFA_CLASSES %d\n\n", stateCount, classes);
+    printf("/* Column of every code unit below CHAR_TABLE_SIZE, then the column of all the others */\n");
+    printf("static const unsigned char dfaClassTable[CHAR_TABLE_SIZE + 1] = {");
+    for (c = 0; c < SYMBOLS; c++)
+        printf("%s%d,", c % 16 ? " " : "\n    ", classOf[c]);
+    printf("\n};\n\n");
+    printf("/* dfaClass - the column of code unit c */\n");
+    printf("static inline int dfaClass(unsigned c) {\n");
+    printf("    return dfaClassTable[c < CHAR_TABLE_SIZE ? c : CHAR_TABLE_SIZE];\n}\n\n");
+    printf("/* Next state from each state on each column; DFA_DEAD ends the token */\n");
+    printf("static const unsigned char dfaNext[DFA_STATES][DFA_CLASSES] = {\n");
+    for (i = 0; i < stateCount; i++) {
+        printf("    {");
+        for (j = 0; j < classes; j++)
+            printf("%s%d", j ? ", " : "", i == 0 ? 0 : next[i][representative[j]]);
+        printf("},\n");
+    }
+    printf("};\n\n");
+    printf("/* Token code a state accepts, or 0 */\n");
+    printf("static const signed char dfaAccept[DFA_STATES] = {");
+    for (i = 0; i < stateCount; i++)
+        printf("%s%d,", i % 16 ? " " : "\n    ", i == 0 ? 0 : accepts(states[i]));
+    printf("\n};\n\n#endif\n");
+    return fclose(stdout) == 0 ? 0 : 1;
+}
@@ -1,1056 +1,1073 @@
 /* front.c - a lexical analyzer system for simple arithmetic expressions */
 #include <stdio.h>
-#include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
 #include <wchar.h>
-#include <locale.h>
+#include <pthread.h>
 
-/***  Global Declarations  ***/
+#include "cache.h"
+#include "front.h"
+#include "literal.h"
+#include "charclass.h"
+#include "dfa.h"
 
-/* Variables */
-int charClass;
-wchar_t lexeme[100];
-wchar_t nextChar;
-int lexLen;
-int token;
-int nextToken;
-FILE *in_fp;
-wchar_t errMsg[256] = L"No errors found. This source code belongs to TR-701";
+/***  Global Declarations  ***/
 
 /* Functions */
-void addChar();
-void getChar();
-void getNonBlank();
-int lex();
-int lookup(int compareMode);
-void error(const wchar_t *message);
-
-void program();
-void statementList();
-void statement();
-void controlStatement();
-
-void expr();
-void factor();
-void term();
-void power();
-
-void boolExpr();
-void boolOr();
-void boolAnd();
-void boolEq();
-void boolRel();
-void boolArithExpr();
-void boolArithTerm();
-void boolArithPower();
-void boolArithNot();
-void boolArithFactor();
-
-void charLit();
-void stringLit();
-
-void ifStmt();
-void whileStmt();
-void forStmt();
-void declStmt();
-void assignStmt();
-
-/* Character classes */
-#define DIGIT 0
-#define LETTER 1
-#define UNKNOWN 2
-#define COMMENT 3
-
-/* Token codes */
-#define INT_LIT 10
-#define FP_LIT 11
-#define IDENT 12
-#define TYPE_INT 13
-#define TYPE_FLOAT 14
-#define TYPE_DOUBLE 15
-#define TYPE_CHAR 16
-#define TYPE_STRING 17
-#define TYPE_BOOL 18
-#define TRUE_VAL 19
-#define FALSE_VAL 20
-#define ASSIGN_OP 30
-#define EQUALITY_OP 31
-#define NOT_EQUALITY_OP 32
-#define LE_OP 33
-#define GE_OP 34
-#define LT_OP 35
-#define GT_OP 36
-#define NOT_OP 37
-#define AND_OP 38
-#define OR_OP 39
-#define ADD_OP 40
-#define SUB_OP 41
-#define MULT_OP 42
-#define DIV_OP 43
-#define POWER_OP 44
-#define MOD_OP 45
-#define IF_CODE 60
-#define ELSE_CODE 61
-#define WHILE_CODE 62
-#define FOR_CODE 63
-#define BREAK_CODE 64
-#define CONTINUE_CODE 65
-#define LEFT_PAREN 80
-#define RIGHT_PAREN 81
-#define LEFT_CURLY 82
-#define RIGHT_CURLY 83
-#define LEFT_SQUARE 84
-#define RIGHT_SQUARE 85
-#define EOS 90
-#define COMMA 91
-#define APOSTROPHE 92
-#define QUOTE 93
-#define UNDERSCORE 94
-#define COMMENT_SYMB 95
-#define UNREGISTERED_SYMBOL 99
-
-/* Extras */
-#define TURKISH_LETTER_MODE 4
-#define OPERATOR_MODE 5
-#define KEYWORD_MODE 6
+AstRef statementList(Context *ctx);
+AstRef statement(Context *ctx);
+AstRef controlStatement(Context *ctx);
+
+AstRef expr(Context *ctx);
+AstRef boolExpr(Context *ctx);
+static AstRef operatorExpr(Context *ctx, int boolean);
+
+AstRef charLit(Context *ctx);
+AstRef stringLit(Context *ctx);
+AstRef arrayLength(Context *ctx);
+static AstRef element(Context *ctx, AstRef node);
+
+AstRef ifStmt(Context *ctx);
+AstRef whileStmt(Context *ctx);
+AstRef forStmt(Context *ctx);
+AstRef declStmt(Context *ctx);
+AstRef assignStmt(Context *ctx);
+
+static AstRef newNode(Context *ctx, int kind, int op);
+static void setKid(Context *ctx, AstRef node, int k, AstRef kid);
+
+static int scanToken(Context *ctx);
+static int readLiteral(Context *ctx, int token, size_t end);
+static void nextBufferedToken(Context *ctx);
+static void nextRingToken(Context *ctx);
+static void *lexerThread(void *arg);
+
+/* Tracing; building with TR_NO_TRACE compiles it out of the lexer and every grammar function */
+#ifdef TR_NO_TRACE
+#define TRACE_ENTER(ctx, name) ((void) 0)
+#define TRACE_EXIT(ctx, name) ((void) 0)
+#define TRACE_TOKEN(ctx) ((void) 0)
+#else
+#define TRACE_ENTER(ctx, name) \
+    do { if ((ctx)->traceLevel >= TRACE_FULL) sinkProduction((ctx)->out, 1, name); } while (0)
+#define TRACE_EXIT(ctx, name) \
+    do { if ((ctx)->traceLevel >= TRACE_FULL) sinkProduction((ctx)->out, 0, name); } while (0)
+#define TRACE_TOKEN(ctx) \
+    do { if ((ctx)->traceLevel >= TRACE_TOKENS) \
+        sinkToken((ctx)->out, (ctx)->nextToken, (ctx)->lexeme, (size_t) (ctx)->lexLen, (ctx)->tokenOffset); } while (0)
+#endif
+
+/* What the trace shows as the lexeme of the end of input */
+static const uint16_t eofLexeme[] = {'E', 'O', 'F'};
 
 /************************************************************************************/
 
-/* main driver */
-int main() {
-    int fileNumber;
-    char filename[256];  // Buffer to store the constructed filename
+/* newNode - a function to add a tree node for the current token, with its value if it is a number literal; once
+   an error is raised nothing is built */
+static AstRef newNode(Context *ctx, int kind, int op) {
+    AstRef node;
 
-    setlocale(LC_ALL, "");
+    if (ctx->errorRaised)
+        return AST_NONE;
+    if ((node = astNew(&ctx->ast, kind, op, ctx->tokenOffset, (size_t) ctx->lexLen)) == AST_NONE)
+        error(ctx, L"The syntax tree does not fit in memory.");
+    else if (kind == AST_INT || kind == AST_FLOAT)
+        astSetPayload(&ctx->ast.nodes[node], ctx->literal);
+    return node;
+}
 
-    // Get file number from user
-    printf("Enter the file number (between 1 and 4): ");
-    if (scanf("%d", &fileNumber) != 1) {
-        printf("Error reading file number.\n");
-        return 1;
-    }
+/* setKid - a function to make kid the k-th kid of node, unless node was never built */
+static void setKid(Context *ctx, AstRef node, int k, AstRef kid) {
+    if (node != AST_NONE)
+        ctx->ast.nodes[node].kids[k] = kid;
+}
 
-    // Construct filename based on number
-    snprintf(filename, sizeof(filename), "front%d.in", fileNumber);
+/* initContext - a function to reset ctx to the state of a file that has not been read yet, tracing to out */
+void initContext(Context *ctx, Sink *out, int traceLevel) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->out = out;
+    ctx->traceLevel = traceLevel;
+    wcscpy(ctx->errMsg, L"No errors found. This source code belongs to TR-701");
+}
 
-    if ((in_fp = fopen(filename, "rb")) == NULL) {
-        perror("File is not in the executable's directory or cannot be opened");
-        return 1;
-    } else {
-        unsigned char bom[2];
-        if (fread(bom, 1, 2, in_fp) != 2 || bom[0] != 0xFF || bom[1] != 0xFE) {
-            printf("%s is not in UTF-16LE format.\n", filename);
-            fclose(in_fp);
-            return 1;
+/* analyzeFile - a function to run the lexer and parser over the source file at path, writing the trace to out;
+   actions (ANALYZE_ flags) says what else to do with the program once it is accepted */
+int analyzeFile(Context *ctx, const char *path, Sink *out, int traceLevel, int pipeline, int actions) {
+    TokenBuffer tokens;
+    Context lexer;
+    pthread_t thread;
+    size_t start;
+    char *cache = NULL;
+    int status = ANALYSIS_OK;
+
+    initContext(ctx, out, traceLevel);
+    if (readerOpen(&ctx->in, path) != 0)
+        return ANALYSIS_OPEN_FAILED;
+    if (!readerSkipBOM(&ctx->in)) {
+        readerClose(&ctx->in);
+        return ANALYSIS_NOT_UTF16;
+    }
+
+    /* The cache stands in for everything up to the run, so it is only read when nothing but the run is asked
+       for; any run keeps it up to date. A profiled run compiles afresh, for what the profiler needs and the
+       cache does not keep */
+    if ((actions & ANALYZE_CACHE) && (actions & ANALYZE_RUN))
+        cache = pathWithExtension(path, CACHE_EXTENSION);
+    if (cache != NULL && traceLevel == TRACE_SILENT &&
+        !(actions & (ANALYZE_DUMP_AST | ANALYZE_DUMP_PASSES | ANALYZE_TRANSLATE | ANALYZE_PROFILE))) {
+        Cache cached;
+        Bytecode bc;
+        if (cacheLoad(&cached, cache, ctx->in.units, ctx->in.len, actions, &bc) == 0) {
+            status = runBytecode(ctx, &bc, NULL) != 0 ? ANALYSIS_RUN_FAILED : ANALYSIS_OK;
+            cacheClose(&cached);
+            free(cache);
+            readerClose(&ctx->in);
+            return status;
         }
+    }
 
-        getChar();
-        lex();
-        program();
+    /* A node per token at most, and a token per code unit at most; as many again for the passes of opt.c */
+    astInit(&ctx->ast, (ctx->in.len + 1) * (actions & ANALYZE_OPTIMIZE ? 2 : 1) + 1);
 
-        fclose(in_fp);
+    start = ctx->in.pos;
+    getChar(ctx);
+    if (pipeline == PIPELINE_BUFFERED && tokenize(ctx, &tokens) != 0) {
+        /* No memory for the token buffer (or offsets past 32 bits): lex on demand from the start instead */
+        ctx->in.pos = start;
+        getChar(ctx);
     }
-    return 0;
+    if (pipeline == PIPELINE_THREADED && ctx->in.len <= UINT32_MAX && (ctx->ring = ringCreate()) != NULL) {
+        /* The lexer thread works on its own copy of the state; the parser only reads the ring */
+        lexer = *ctx;
+        if (pthread_create(&thread, NULL, lexerThread, &lexer) != 0) {
+            ringDestroy(ctx->ring);
+            ctx->ring = NULL;
+        }
+    }
+    lex(ctx);
+    program(ctx);
+
+    if (ctx->tokens != NULL)
+        tokenBufferFree(ctx->tokens);
+    if (ctx->ring != NULL) {
+        /* After an error the parser stops early; the lexer stops at its next batch */
+        ringStop(ctx->ring);
+        pthread_join(thread, NULL);
+        ringDestroy(ctx->ring);
+    }
+    if (!ctx->errorRaised && (actions & ANALYZE_OPTIMIZE))
+        optimizeProgram(ctx, actions & ANALYZE_DUMP_PASSES);
+    if (!ctx->errorRaised && (actions & ANALYZE_DUMP_AST))
+        astDump(&ctx->ast, ctx->root, ctx->in.units, out);
+    if (!ctx->errorRaised && (actions & ANALYZE_TRANSLATE) && translateProgram(ctx, path) != 0)
+        status = ANALYSIS_RUN_FAILED;
+    if (!ctx->errorRaised && status == ANALYSIS_OK && (actions & ANALYZE_RUN) &&
+        runProgram(ctx, actions, cache, actions & ANALYZE_PROFILE ? path : NULL) != 0)
+        status = ANALYSIS_RUN_FAILED;
+
+    /* The tree and the expression stack go in one free each, however many nodes there were */
+    free(cache);
+    astFree(&ctx->ast);
+    free(ctx->exprStack);
+    ctx->exprStack = NULL;
+    readerClose(&ctx->in);
+    return ctx->errorRaised ? ANALYSIS_REJECTED : status;
 }
 
+/* pathWithExtension - path with the extension of its file name (if any) replaced by extension, in a new string
+   the caller frees; NULL when memory runs out */
+char *pathWithExtension(const char *path, const char *extension) {
+    const char *base = strrchr(path, '/'), *dot;
+    size_t stem;
+    char *result;
 
-/************************************************************************************/
+    base = base != NULL ? base + 1 : path;
+    dot = strrchr(base, '.');
+    stem = dot != NULL && dot != base ? (size_t) (dot - path) : strlen(path);
+    if ((result = malloc(stem + strlen(extension) + 1)) == NULL)
+        return NULL;
+    memcpy(result, path, stem);
+    strcpy(result + stem, extension);
+    return result;
+}
+
+/* tokenize - a function to lex the whole input into buf, which the parser then reads through lex() */
+int tokenize(Context *ctx, TokenBuffer *buf) {
+    if (ctx->in.len > UINT32_MAX || tokenBufferInit(buf, ctx->in.len / 3) != 0)
+        return -1;
+    ctx->tokens = buf;
+    do {
+        scanToken(ctx);
+        if (tokenBufferPush(buf, ctx->nextToken, ctx->tokenOffset, ctx->nextToken != EOF ? (size_t) ctx->lexLen : 0) != 0 ||
+            ((ctx->nextToken == INT_LIT || ctx->nextToken == FP_LIT) && tokenBufferPushValue(buf, ctx->literal) != 0)) {
+            tokenBufferFree(buf);
+            ctx->tokens = NULL;
+            return -1;
+        }
+    } while (ctx->nextToken != EOF);
+    ctx->tokenIndex = ctx->valueIndex = 0;
+    return 0;
+}
+
+/* lexerThread - a function to scan the whole input into the ring, for PIPELINE_THREADED */
+static void *lexerThread(void *arg) {
+    Context *lexer = arg;
+    do {
+        scanToken(lexer);
+        if (ringPush(lexer->ring, lexer->nextToken, lexer->tokenOffset, lexer->nextToken != EOF ? (size_t) lexer->lexLen : 0,
+                     lexer->literal) != 0)
+            break;
+    } while (lexer->nextToken != EOF);
+    ringFlush(lexer->ring);
+    return NULL;
+}
 
 /* error - a universal error handling function */
-void error(const wchar_t *message) {
-    static int errorRaised = 0; // Flag to track if an error has already been raised
-    if (!errorRaised) {
-        errorRaised = 1; // Set the flag to indicate an error has been raised
-        wcsncpy(errMsg, L"This language doesn't belong to TR-701.\nReason: ", 255);
-        wcscat(errMsg, message);
-        errMsg[255] = L'\0';
-        fclose(in_fp);
-        nextToken = EOF;
+void error(Context *ctx, const wchar_t *message) {
+    if (!ctx->errorRaised) {
+        ctx->errorRaised = 1; // Set the flag to indicate an error has been raised
+        wcsncpy(ctx->errMsg, L"This language doesn't belong to TR-701.\nReason: ", 255);
+        wcscat(ctx->errMsg, message);
+        ctx->errMsg[255] = L'\0';
+        readerStop(&ctx->in);
+        ctx->nextToken = EOF;
     }
 }
 
-/* lookup - a function to lookup reserved keywords and symbols, returning the nextToken */
-int lookup(int compareMode) {
-    if (compareMode == OPERATOR_MODE) {
-        switch (nextChar) {
-            case '=':
-                addChar();
-                getChar();
-                if (nextChar == '?') {
-                    addChar();
-                    nextToken = EQUALITY_OP;
-                } else {
-                    ungetwc(nextChar, in_fp);
-                    nextToken = UNREGISTERED_SYMBOL;
-                }
-                break;
-            case '<':
-                /* "<" is LT, "<=" is LE, "<<<" is ASSIGN_OP */
-                addChar();
-                getChar();
-                if (nextChar == '=') {
-                    addChar();
-                    nextToken = LE_OP;
-                } else if (nextChar == '<') {
-                    wchar_t temp = nextChar;
-                    addChar();
-                    getChar();
-                    if (nextChar == '<') {
-                        addChar();
-                        nextToken = ASSIGN_OP;
-                    } else {
-                        ungetwc(nextChar, in_fp);
-                        ungetwc(temp, in_fp);
-                        lexeme[1] = 0;
-                        nextToken = LT_OP;
-                    }
-                } else {
-                    ungetwc(nextChar, in_fp);
-                    nextToken = LT_OP;
-                }
-                break;
-            case '>':
-                addChar();
-                getChar();
-                if (nextChar == '=') {
-                    addChar();
-                    nextToken = GE_OP;
-                } else {
-                    ungetwc(nextChar, in_fp);
-                    nextToken = GT_OP;
-                }
-                break;
-            case '!':
-                addChar();
-                getChar();
-                if (nextChar == '?') {
-                    addChar();
-                    nextToken = NOT_EQUALITY_OP;
-                } else {
-                    ungetwc(nextChar, in_fp);
-                    nextToken = NOT_OP;
-                }
-                break;
-            case '&':
-                addChar();
-                getChar();
-                if (nextChar == '&') {
-                    addChar();
-                    nextToken = AND_OP;
-                } else {
-                    ungetwc(nextChar, in_fp);
-                    nextToken = UNREGISTERED_SYMBOL;
-                }
-                break;
-            case '|':
-                addChar();
-                getChar();
-                if (nextChar == '|') {
-                    addChar();
-                    nextToken = OR_OP;
-                } else {
-                    ungetwc(nextChar, in_fp);
-                    nextToken = UNREGISTERED_SYMBOL;
-                }
-                break;
-            case '+':
-                addChar();
-                nextToken = ADD_OP;
-                break;
-            case '-':
-                addChar();
-                nextToken = SUB_OP;
-                break;
-            case '*':
-                addChar();
-                nextToken = MULT_OP;
-                break;
-            case '/':
-                addChar();
-                nextToken = DIV_OP;
-                break;
-            case '^':
-                addChar();
-                nextToken = POWER_OP;
-                break;
-            case '%':
-                addChar();
-                nextToken = MOD_OP;
-                break;
-            case '(':
-                addChar();
-                nextToken = LEFT_PAREN;
-                break;
-            case ')':
-                addChar();
-                nextToken = RIGHT_PAREN;
-                break;
-            case '{':
-                addChar();
-                nextToken = LEFT_CURLY;
-                break;
-            case '}':
-                addChar();
-                nextToken = RIGHT_CURLY;
-                break;
-            case '[':
-                addChar();
-                nextToken = LEFT_SQUARE;
-                break;
-            case ']':
-                addChar();
-                nextToken = RIGHT_SQUARE;
-                break;
-            case '.':
-                addChar();
-                nextToken = EOS;
-                break;
-            case ',':
-                addChar();
-                nextToken = COMMA;
-                break;
-            case '\'':
-                addChar();
-                nextToken = APOSTROPHE;
-                break;
-            case '"':
-                addChar();
-                nextToken = QUOTE;
-                break;
-            case '_':
-                addChar();
-                nextToken = UNDERSCORE;
-                break;
-            case '$':
-                addChar();
-                nextToken = COMMENT_SYMB;
-                break;
-            default:
-                addChar();
-                nextToken = UNREGISTERED_SYMBOL;
-                break;
-        }
-
-    } else if (compareMode == KEYWORD_MODE) {
-        if (wcscmp(lexeme, L"tam") == 0) {
-            nextToken = TYPE_INT;
-        } else if (wcscmp(lexeme, L"küsurat") == 0) {
-            nextToken = TYPE_FLOAT;
-        } else if (wcscmp(lexeme, L"dev") == 0) {
-            nextToken = TYPE_DOUBLE;
-        } else if (wcscmp(lexeme, L"hane") == 0) {
-            nextToken = TYPE_CHAR;
-        } else if (wcscmp(lexeme, L"tümce") == 0) {
-            nextToken = TYPE_STRING;
-        } else if (wcscmp(lexeme, L"mantık") == 0) {
-            nextToken = TYPE_BOOL;
-        } else if (wcscmp(lexeme, L"doğru") == 0) {
-            nextToken = TRUE_VAL;
-        } else if (wcscmp(lexeme, L"yanlış") == 0) {
-            nextToken = FALSE_VAL;
-        } else if (wcscmp(lexeme, L"madem") == 0) {
-            nextToken = IF_CODE;
-        } else if (wcscmp(lexeme, L"şayet") == 0) {
-            nextToken = ELSE_CODE;
-        } else if (wcscmp(lexeme, L"iken") == 0) {
-            nextToken = WHILE_CODE;
-        } else if (wcscmp(lexeme, L"sayaç") == 0) {
-            nextToken = FOR_CODE;
-        } else if (wcscmp(lexeme, L"çık") == 0) {
-            nextToken = BREAK_CODE;
-        } else if (wcscmp(lexeme, L"atla") == 0) {
-            nextToken = CONTINUE_CODE;
-        } else {
-            nextToken = IDENT;
+/* lexError - a function to report an error found by the lexer; when the lexer runs ahead of the parser (token
+   buffer or ring) it travels with the token it belongs to and is raised when the parser gets there, so errors
+   still come in source order. The parser stops at the first one, so only that one is kept */
+static void lexError(Context *ctx, const wchar_t *message) {
+    if (ctx->tokens != NULL) {
+        if (ctx->tokens->error == NULL) {
+            ctx->tokens->error = message;
+            ctx->tokens->errorAt = ctx->tokens->count;
         }
-
-    } else if (compareMode == TURKISH_LETTER_MODE) {
-        switch (nextChar) {
-            case L'Ç':
-                return 1;
-            case L'ç':
-                return 1;
-            case L'ı':
-                return 1;
-            case L'İ':
-                return 1;
-            case L'ö':
-                return 1;
-            case L'Ö':
-                return 1;
-            case L'Ü':
-                return 1;
-            case L'ü':
-                return 1;
-            case L'Ş':
-                return 1;
-            case L'ş':
-                return 1;
-            case L'Ğ':
-                return 1;
-            case L'ğ':
-                return 1;
-            default:
-                return 0;
+    } else if (ctx->ring != NULL) {
+        if (ctx->ring->error == NULL) {
+            ctx->ring->error = message;
+            ringPush(ctx->ring, TOKEN_KIND_ERROR, ctx->tokenOffset, 0, 0);
         }
     } else {
-        printf("Invalid compare mode for lookup function.\n");
-        fclose(in_fp);
-        return 0;
+        error(ctx, message);
     }
-    return nextToken;
 }
 
-/* addChar - a function to add nextChar to lexeme */
-void addChar() {
-    if (lexLen <= 98) {
-        lexeme[lexLen++] = nextChar;
-        lexeme[lexLen] = 0;
-    }
-    else {
-        printf("Lexeme is too long.\n");
-        fclose(in_fp);
+/* lookup - a function to lookup reserved keywords and symbols, returning the nextToken; the lexeme is run
+   through the scanner table and the token it accepts for the whole lexeme is the answer */
+int lookup(Context *ctx, int compareMode) {
+    int state = DFA_START, i;
+
+    if (compareMode != OPERATOR_MODE && compareMode != KEYWORD_MODE) {
+        sinkMessage(ctx->out, "Invalid compare mode for lookup function.");
+        readerStop(&ctx->in);
+        return 0;
     }
+    for (i = 0; i < ctx->lexLen && state != DFA_DEAD; i++)
+        state = dfaNext[state][dfaClass(ctx->lexeme[i])];
+    if (state != DFA_DEAD && dfaAccept[state] != 0)
+        ctx->nextToken = dfaAccept[state];
+    else
+        ctx->nextToken = compareMode == KEYWORD_MODE ? IDENT : UNREGISTERED_SYMBOL;
+    return ctx->nextToken;
 }
 
 /* getChar - a function to get the next character of input and determine its character class */
-void getChar() {
-    unsigned char bytes[2];
+void getChar(Context *ctx) {
+    ctx->nextChar = readerNext(&ctx->in);
 
-    if (fread(bytes, 1, 2, in_fp) == 2) {
-        nextChar = bytes[1] << 8 | bytes[0];
+    if (ctx->nextChar != WEOF)
+        ctx->charClass = charInfo(ctx->nextChar) & CHAR_CLASS_MASK;
+    else
+        ctx->charClass = EOF;
+}
+
+/* getNonBlank - a function to skip whitespace until nextChar is a non-whitespace character */
+void getNonBlank(Context *ctx) {
+    if (charInfo(ctx->nextChar) & CHAR_SPACE) {
+        /* The rest of the run is skipped in vector-sized steps, then getChar reads the first non-blank */
+        readerSkipBlanks(&ctx->in);
+        getChar(ctx);
+    }
+}
+
+/* lex - a function to move to the next token, from the token buffer if there is one, and trace it */
+int lex(Context *ctx) {
+    if (ctx->tokens != NULL)
+        nextBufferedToken(ctx);
+    else if (ctx->ring != NULL)
+        nextRingToken(ctx);
+    else
+        scanToken(ctx);
+    TRACE_TOKEN(ctx);
+    return ctx->nextToken;
+}
+
+/* nextBufferedToken - a function to load the token at tokenIndex; after an error every token is EOF */
+static void nextBufferedToken(Context *ctx) {
+    const TokenBuffer *buf = ctx->tokens;
+    size_t i = ctx->tokenIndex;
+    int stopped = ctx->errorRaised || i >= buf->count;
+
+    if (!stopped) {
+        ctx->tokenIndex++;
+        if (buf->error != NULL && i == buf->errorAt)
+            error(ctx, buf->error);
+    }
+    if (stopped || ctx->errorRaised || buf->kind[i] == TOKEN_KIND_EOF) {
+        /* Where the lexer stopped; once the parser has stopped, the end of input */
+        ctx->nextToken = EOF;
+        ctx->tokenOffset = stopped ? ctx->in.len : buf->offset[i];
+        ctx->lexeme = eofLexeme;
+        ctx->lexLen = 3;
     } else {
-        nextChar = WEOF;
+        ctx->nextToken = buf->kind[i];
+        ctx->tokenOffset = buf->offset[i];
+        ctx->lexeme = ctx->in.units + buf->offset[i];
+        ctx->lexLen = (int) buf->length[i];
+        if (ctx->nextToken == INT_LIT || ctx->nextToken == FP_LIT)
+            ctx->literal = buf->values[ctx->valueIndex++];
     }
+}
+
+/* nextRingToken - a function to take the next token the lexer thread has produced; after an error or EOF every token is EOF */
+static void nextRingToken(Context *ctx) {
+    TokenRing *ring = ctx->ring;
+    int stopped = ctx->errorRaised || ring->drained;
+    size_t slot = 0;
 
-    if (nextChar != WEOF) {
-        if (isalpha(nextChar) || lookup(TURKISH_LETTER_MODE))
-            charClass = LETTER;
-        else if (isdigit(nextChar))
-            charClass = DIGIT;
-        else if (nextChar == L'$')
-            charClass = COMMENT;
-        else
-            charClass = UNKNOWN;
+    if (!stopped) {
+        slot = ringPop(ring);
+        if (ring->kind[slot] == TOKEN_KIND_ERROR)
+            error(ctx, ring->error);
+        else if (ring->kind[slot] == TOKEN_KIND_EOF)
+            ring->drained = 1;
+    }
+    if (stopped || ctx->errorRaised || ring->kind[slot] == TOKEN_KIND_EOF) {
+        ctx->nextToken = EOF;
+        ctx->tokenOffset = stopped ? ctx->in.len : ring->offset[slot];
+        ctx->lexeme = eofLexeme;
+        ctx->lexLen = 3;
     } else {
-        charClass = EOF;
+        ctx->nextToken = ring->kind[slot];
+        ctx->tokenOffset = ring->offset[slot];
+        ctx->lexeme = ctx->in.units + ring->offset[slot];
+        ctx->lexLen = (int) ring->length[slot];
+        ctx->literal = ring->value[slot];
     }
 }
 
-/* getNonBlank - a function to call getChar until it returns a non-whitespace character */
-void getNonBlank() {
-    while (iswspace(nextChar))
-        getChar();
+/* scanToken - a simple lexical analyzer: read the next token from the input
+   The scanner table (dfa.h, generated from operators.def and keywords.def) is followed from the
+   first character as far as it goes; the token is the longest prefix it accepted on the way. */
+static int scanToken(Context *ctx) {
+    const uint16_t *units = ctx->in.units;
+    size_t pos, end;
+    int state = DFA_START, token = UNREGISTERED_SYMBOL;
+
+    getNonBlank(ctx);
+    if (ctx->charClass == EOF) {
+        ctx->tokenOffset = ctx->in.len;
+        ctx->nextToken = EOF;
+        ctx->lexeme = eofLexeme;
+        ctx->lexLen = 3;
+        return EOF;
+    }
+
+    /* nextChar is the first unit of the token */
+    ctx->tokenOffset = pos = ctx->in.pos - 1;
+    end = pos + 1;
+    while (pos < ctx->in.len && (state = dfaNext[state][dfaClass(units[pos])]) != DFA_DEAD) {
+        pos++;
+        if (dfaAccept[state] != 0) {
+            token = dfaAccept[state];
+            end = pos;
+        }
+    }
+    ctx->in.pos = end;
+
+    if (token == COMMENT_SYMB) {
+        /* Jump over the comment body straight to the closing '$' (or the end of input) */
+        readerSkipToDollar(&ctx->in);
+        getChar(ctx);
+        if (ctx->charClass == EOF) {
+            lexError(ctx, L"Comments must be opened and closed with '$'.");
+            ctx->nextToken = EOF;
+            ctx->lexeme = eofLexeme;
+            ctx->lexLen = 3;
+            return EOF;
+        }
+        /* Skip the closing comment symbol '$' */
+        getChar(ctx);
+        /* Continue lexing after the comment*/
+        return scanToken(ctx);
+    }
+
+    if ((token == INT_LIT || token == FP_LIT) && readLiteral(ctx, token, end) != 0) {
+        /* Lexing on demand, the error has stopped everything */
+        ctx->lexeme = eofLexeme;
+        ctx->lexLen = 3;
+        return EOF;
+    }
+    ctx->nextToken = token;
+    ctx->lexeme = units + ctx->tokenOffset;
+    ctx->lexLen = (int) (end - ctx->tokenOffset);
+    getChar(ctx);
+    return token;
 }
 
-/* lex - a simple lexical analyzer for arithmetic expressions */
-int lex() {
-    lexLen = 0;
-    getNonBlank();
-    switch (charClass) {
-        case LETTER:
-            addChar();
-            getChar();
-            while (charClass == LETTER || charClass == DIGIT || nextChar == '_') {
-                addChar();
-                getChar();
-            }
-            lookup(KEYWORD_MODE);
-            break;
-        case DIGIT:
-            addChar();
-            getChar();
-            while (charClass == DIGIT) {
-                addChar();
-                getChar();
-            }
-            if (nextChar == ',') {
-                addChar();
-                getChar();
-                while (charClass == DIGIT) {
-                    addChar();
-                    getChar();
-                }
-                nextToken = FP_LIT;
-            }
-            else
-                nextToken = INT_LIT;
-            break;
-        case UNKNOWN:
-            lookup(OPERATOR_MODE);
-            getChar();
-            break;
-        case COMMENT:
-            do {
-                getChar();
-            } while (charClass != COMMENT && charClass != EOF);
-            if (charClass == EOF) {
-                error(L"Comments must be opened and closed with '$'.");
-            } else {
-                /* Skip the closing comment symbol '$' */
-                getChar();
-                /* Continue lexing after the comment*/
-                return lex();
-            }
-        case EOF:
-            nextToken = EOF;
-            lexeme[0] = 'E';
-            lexeme[1] = 'O';
-            lexeme[2] = 'F';
-            lexeme[3] = 0;
-            break;
+/* readLiteral - a function to work out the value of the number literal from tokenOffset up to end into literal,
+   once, so that nothing after the lexer reads its digits again; returns -1 if that raised the error at once */
+static int readLiteral(Context *ctx, int token, size_t end) {
+    const uint16_t *digits = ctx->in.units + ctx->tokenOffset;
+    size_t len = end - ctx->tokenOffset;
+    int64_t i = 0;
+    double d = 0;
+
+    if (token == INT_LIT ? literalInt(digits, len, &i) != 0 : literalDouble(digits, len, &d) != 0) {
+        lexError(ctx, token == INT_LIT ? L"A tam literal cannot be larger than 9223372036854775807."
+                                       : L"A küsurat literal is too large even for dev.");
+        if (ctx->errorRaised)
+            return -1;
     }
-    wprintf(L"Next token is: %d, Next lexeme is: %ls\n", nextToken, lexeme);
-    return nextToken;
+    if (token == INT_LIT)
+        memcpy(&ctx->literal, &i, sizeof(i));
+    else
+        memcpy(&ctx->literal, &d, sizeof(d));
+    return 0;
 }
 
 /* Funtion program
 <program> -> <statementList>
+An accepted program is then checked for undeclared names and mistyped values (check.c).
 */
-void program() {
-    printf("Enter <program>\n");
-    statementList();
-    if (nextToken != EOF) {
-        error(L"Wrong use of closing curly brace. Expected EOF.");
+void program(Context *ctx) {
+    TRACE_ENTER(ctx, "program");
+    ctx->root = statementList(ctx);
+    if (ctx->nextToken != EOF) {
+        error(ctx, L"Wrong use of closing curly brace. Expected EOF.");
     } else
-        printf("Exit <program>\n");
-    wprintf(errMsg);
+        TRACE_EXIT(ctx, "program");
+    if (!ctx->errorRaised)
+        checkProgram(ctx);
+    if (ctx->traceLevel > TRACE_SILENT)
+        sinkVerdict(ctx->out, ctx->errMsg);
 }
 
 /* Function statementList
 <statementList> -> {(<statement> '.' | <controlStatement>)}
 */
-void statementList() {
-    printf("Enter <statementList>\n");
-    while (nextToken != EOF && nextToken != RIGHT_CURLY) {
-        if (nextToken != IF_CODE && nextToken != WHILE_CODE && nextToken != FOR_CODE) {
-            statement();
-            if (nextToken == EOS) {
-                lex();
+AstRef statementList(Context *ctx) {
+    AstRef block, last = AST_NONE, stmt;
+
+    TRACE_ENTER(ctx, "statementList");
+    /* A block has no text of its own; it sits where its first statement starts */
+    if ((block = newNode(ctx, AST_BLOCK, 0)) != AST_NONE)
+        ctx->ast.nodes[block].length = 0;
+    while (ctx->nextToken != EOF && ctx->nextToken != RIGHT_CURLY) {
+        if (ctx->nextToken != IF_CODE && ctx->nextToken != WHILE_CODE && ctx->nextToken != FOR_CODE) {
+            stmt = statement(ctx);
+            if (ctx->nextToken == EOS) {
+                lex(ctx);
             } else {
-                error(L"Expected a '.' after a statement.");
+                error(ctx, L"Expected a '.' after a statement.");
             }
         } else {
-            controlStatement();
+            stmt = controlStatement(ctx);
+        }
+        if (stmt != AST_NONE && !ctx->errorRaised) {
+            if (last == AST_NONE)
+                setKid(ctx, block, 0, stmt);
+            else
+                ctx->ast.nodes[last].next = stmt;
+            last = stmt;
         }
     }
-    printf("Exit <statementList>\n");
+    TRACE_EXIT(ctx, "statementList");
+    return block;
 }
 
 /* Function statement
 <statement> -> "atla" | "çık" | <declStmt> | <assignStmt>
 */
-void statement() {
-    printf("Enter <statement>\n");
-    if (nextToken == CONTINUE_CODE) {
-        lex();
-    } else if (nextToken == BREAK_CODE) {
-        lex();
-    } else if (nextToken == TYPE_INT || nextToken == TYPE_BOOL || nextToken == TYPE_CHAR || nextToken == TYPE_FLOAT ||
-               nextToken == TYPE_DOUBLE || nextToken == TYPE_STRING) {
-        declStmt();
-    } else if (nextToken == IDENT) {
-        assignStmt();
-    } else if (nextToken == TRUE_VAL || nextToken == FALSE_VAL || nextToken == NOT_OP || nextToken == LEFT_PAREN ||
-               nextToken == INT_LIT || nextToken == FP_LIT) {
-        error(L"Expressions are not allowed as standalone statements. Use them in control statements or assignments.");
+AstRef statement(Context *ctx) {
+    AstRef node = AST_NONE;
+
+    TRACE_ENTER(ctx, "statement");
+    if (ctx->nextToken == CONTINUE_CODE) {
+        node = newNode(ctx, AST_CONTINUE, 0);
+        lex(ctx);
+    } else if (ctx->nextToken == BREAK_CODE) {
+        node = newNode(ctx, AST_BREAK, 0);
+        lex(ctx);
+    } else if (ctx->nextToken == TYPE_INT || ctx->nextToken == TYPE_BOOL || ctx->nextToken == TYPE_CHAR || ctx->nextToken == TYPE_FLOAT ||
+               ctx->nextToken == TYPE_DOUBLE || ctx->nextToken == TYPE_STRING) {
+        node = declStmt(ctx);
+    } else if (ctx->nextToken == IDENT) {
+        node = assignStmt(ctx);
+    } else if (ctx->nextToken == TRUE_VAL || ctx->nextToken == FALSE_VAL || ctx->nextToken == NOT_OP || ctx->nextToken == LEFT_PAREN ||
+               ctx->nextToken == INT_LIT || ctx->nextToken == FP_LIT) {
+        error(ctx, L"Expressions are not allowed as standalone statements. Use them in control statements or assignments.");
     } else {
-        error(L"Illegal statement.");
+        error(ctx, L"Illegal statement.");
     }
-    printf("Exit <statement>\n");
+    TRACE_EXIT(ctx, "statement");
+    return node;
 }
 
 /* Function controlStatement
 <controlStatement> -> <ifStmt> | <whileStmt> | <forStmt>
 */
-void controlStatement() {
-    printf("Enter <controlStatement>\n");
-    switch (nextToken) {
+AstRef controlStatement(Context *ctx) {
+    AstRef node = AST_NONE;
+
+    TRACE_ENTER(ctx, "controlStatement");
+    switch (ctx->nextToken) {
         case IF_CODE:
-            ifStmt();
+            node = ifStmt(ctx);
             break;
         case WHILE_CODE:
-            whileStmt();
+            node = whileStmt(ctx);
             break;
         case FOR_CODE:
-            forStmt();
+            node = forStmt(ctx);
             break;
     }
-    printf("Exit <controlStatement>\n");
+    TRACE_EXIT(ctx, "controlStatement");
+    return node;
 }
 
-/* Function expr
-<expr> -> <term> {("+" | "-") <term>}
-*/
-void expr() {
-    printf("Enter <expr>\n");
-    term();
-    while (nextToken == ADD_OP || nextToken == SUB_OP) {
-        lex();
-        term();
-    }
-    printf("Exit <expr>\n");
+/* Binding power of every infix operator, indexed by token code; 0 for tokens that are not one.
+   Operators of equal power group to the left, except "^", which groups to the right. */
+static const unsigned char bindingPower[UNREGISTERED_SYMBOL + 1] = {
+    [OR_OP] = 1,
+    [AND_OP] = 2,
+    [EQUALITY_OP] = 3, [NOT_EQUALITY_OP] = 3,
+    [LT_OP] = 4, [LE_OP] = 4, [GT_OP] = 4, [GE_OP] = 4,
+    [ADD_OP] = 5, [SUB_OP] = 5,
+    [MULT_OP] = 6, [DIV_OP] = 6, [MOD_OP] = 6,
+    [POWER_OP] = 7,
+};
+
+#define POWER_EQUALITY 3    /* "doğru" and "yanlış" may only stand between operators up to this power */
+#define POWER_RELATIONAL 4  /* ...and may not be followed by one from this power up */
+#define POWER_ARITHMETIC 5  /* lowest power an <expr> takes */
+#define POWER_PREFIX 8      /* "!" binds tighter than every infix operator */
+
+/* infixPower - a function to return the binding power of token as an infix operator, 0 if it is not one */
+static inline int infixPower(int token) {
+    return token >= 0 && token <= UNREGISTERED_SYMBOL ? bindingPower[token] : 0;
 }
 
-/* Function term
-<term> -> <power> {("*" | "/" | "%") <power>}
-*/
-void term() {
-    printf("Enter <term>\n");
-    power();
-    while (nextToken == MULT_OP || nextToken == DIV_OP || nextToken == MOD_OP) {
-        lex();
-        power();
-    }
-    printf("Exit <term>\n");
+/* stackedPower - a function to return how tightly an entry of the operator stack holds its operand; a "(" is AST_NONE */
+static inline int stackedPower(const Context *ctx, AstRef entry) {
+    if (entry == AST_NONE)
+        return 0;
+    return ctx->ast.nodes[entry].kind == AST_NOT ? POWER_PREFIX : bindingPower[ctx->ast.nodes[entry].op];
 }
 
-/* Function power
-<power> -> <factor> "^" <power> | <factor>
-*/
-void power() {
-    printf("Enter <power>\n");
-    factor();
-    if (nextToken == POWER_OP) {
-        lex();
-        power();
+/* pushOperator - a function to put entry at depth on the operator stack, growing it; returns -1 when memory runs out */
+static int pushOperator(Context *ctx, size_t depth, AstRef entry) {
+    if (depth == ctx->exprCap) {
+        size_t cap = ctx->exprCap ? ctx->exprCap * 2 : 64;
+        AstRef *stack = realloc(ctx->exprStack, cap * sizeof(*stack));
+        if (stack == NULL)
+            return -1;
+        ctx->exprStack = stack;
+        ctx->exprCap = cap;
     }
-    printf("Exit <power>\n");
+    ctx->exprStack[depth] = entry;
+    return 0;
 }
 
-/* Function factor
-<factor> -> IDENT | INT_LIT | FP_LIT | "(" <expr> ")"
-*/
-void factor() {
-    printf("Enter <factor>\n");
-    if (nextToken == IDENT || nextToken == INT_LIT || nextToken == FP_LIT) {
-        lex();
-    } else if (nextToken == LEFT_PAREN) {
-        lex();
-        expr();
-        if (nextToken == RIGHT_PAREN) {
-            lex();
-        } else {
-            error(L"Expected a right parenthesis after expression.");
-        }
-    } else {
-        error(L"Invalid arithmetic factor. Expected IDENT, INT_LIT, FP_LIT, or '('");
-    }
-    printf("Exit <factor>\n");
+/* reduce - a function to hand a pending operator its last operand; returns the operator, now a whole subtree */
+static AstRef reduce(Context *ctx, AstRef op, AstRef operand) {
+    AstNode *node = &ctx->ast.nodes[op];
+    node->kids[node->kind == AST_BINARY ? 1 : 0] = operand;
+    return op;
 }
 
-/* Function ifStmt
-<ifStmt> -> "madem" "(" <boolExpr> ")" "{" <statementList> "}" ["şayet" "{" <statementList> "}"]
+/* Function operatorExpr
+Both expression grammars, parsed by precedence climbing over bindingPower instead of one function per level:
+
+<expr>     -> <operand> { <op> <operand> }    with <op> of power 5 and up: "+" "-" "*" "/" "%" "^"
+<operand>  -> IDENT ["[" <expr> "]"] | INT_LIT | FP_LIT | "(" <expr> ")"
+
+<boolExpr> -> <boolOperand> { <op> <boolOperand> }    with <op> any operator in bindingPower
+<boolOperand> -> { "!" } (IDENT ["[" <expr> "]"] | INT_LIT | FP_LIT | "(" <boolExpr> ")")
+                | "doğru" | "yanlış"    (only first or after "||", "&&", "=?", "!?", never before "<" ... "%")
+
+Pending operators, "!" and "(" live on a heap stack in ctx instead of the C stack, so nesting depth is bounded
+by memory only. An operator node is made when its operator is read, holding its left operand; it is popped
+(reduced) with its right operand once one of lower power, or equal power and left grouping, follows; a ")" pops
+back to its "(". The index of an array element is an expression of its own, parsed on the same stack above the
+entries of this one. Returns the root of the expression's tree.
 */
-void ifStmt() {
-    printf("Enter <ifStmt>\n");
-    if (nextToken != IF_CODE) {
-        error(L"Expected \"if\" keyword.");
-    } else {
-        lex();
-        if (nextToken != LEFT_PAREN) {
-            error(L"Expected a left parenthesis after \"if\".");
+static AstRef operatorExpr(Context *ctx, int boolean) {
+    size_t base = ctx->exprDepth, depth = base, open = 0;
+    int lowest = boolean ? 1 : POWER_ARITHMETIC;
+    int truthAllowed = boolean;
+    int power;
+    AstRef value, op;
+
+    for (;;) {
+        /* Prefixes of the operand */
+        while (ctx->nextToken == LEFT_PAREN || (boolean && ctx->nextToken == NOT_OP)) {
+            op = AST_NONE;
+            if (ctx->nextToken == LEFT_PAREN)
+                open++;
+            else if ((op = newNode(ctx, AST_NOT, NOT_OP)) == AST_NONE)
+                return AST_NONE;
+            if (pushOperator(ctx, depth++, op) != 0) {
+                error(ctx, L"Expression is nested too deeply.");
+                return AST_NONE;
+            }
+            truthAllowed = boolean && ctx->nextToken == LEFT_PAREN;
+            lex(ctx);
+        }
+
+        if (ctx->nextToken == IDENT || ctx->nextToken == INT_LIT || ctx->nextToken == FP_LIT) {
+            value = newNode(ctx, ctx->nextToken == IDENT ? AST_NAME : ctx->nextToken == INT_LIT ? AST_INT : AST_FLOAT, 0);
+            lex(ctx);
+            if (ctx->nextToken == LEFT_SQUARE && value != AST_NONE && ctx->ast.nodes[value].kind == AST_NAME) {
+                ctx->exprDepth = depth;
+                value = element(ctx, value);
+                ctx->exprDepth = base;
+            }
+        } else if (truthAllowed && (ctx->nextToken == TRUE_VAL || ctx->nextToken == FALSE_VAL)) {
+            value = newNode(ctx, AST_BOOL, ctx->nextToken);
+            lex(ctx);
+            if (infixPower(ctx->nextToken) >= POWER_RELATIONAL) {
+                error(ctx, L"A boolean value cannot be compared or operated with arithmetic operators.");
+                return AST_NONE;
+            }
         } else {
-            lex();
-            boolExpr();
-            if (nextToken != RIGHT_PAREN) {
-                error(L"Expected a right parenthesis after if condition.");
-            } else {
-                lex();
-                if (nextToken != LEFT_CURLY) {
-                    error(L"Expected a left curly brace after condition in if statement.");
-                } else {
-                    lex();
-                    statementList();
-                    if (nextToken != RIGHT_CURLY) {
-                        error(L"Expected a right curly brace to close \"if\" statement.");
-                    } else {
-                        lex();
-                        if (nextToken == ELSE_CODE) {
-                            lex();
-                            if (nextToken != LEFT_CURLY) {
-                                error(L"Expected a left curly brace after \"else\".");
-                            } else {
-                                lex();
-                                statementList();
-                                if (nextToken != RIGHT_CURLY) {
-                                    error(L"Expected a right curly brace to close else clause.");
-                                } else {
-                                    lex();
-                                }
-                            }
-                        }
-                    }
+            error(ctx, boolean ? L"Invalid boolean arithmetic factor."
+                               : L"Invalid arithmetic factor. Expected IDENT, INT_LIT, FP_LIT, or '('");
+            return AST_NONE;
+        }
+
+        /* Closing parentheses, then the operator joining the next operand */
+        while ((power = infixPower(ctx->nextToken)) < lowest) {
+            if (ctx->nextToken != RIGHT_PAREN || open == 0) {
+                if (open > 0) {
+                    error(ctx, boolean ? L"Expected a right parenthesis after boolean expression."
+                                       : L"Expected a right parenthesis after expression.");
+                    return AST_NONE;
                 }
+                while (depth > base)
+                    value = reduce(ctx, ctx->exprStack[--depth], value);
+                return value;
             }
+            while ((op = ctx->exprStack[--depth]) != AST_NONE)
+                value = reduce(ctx, op, value);
+            open--;
+            lex(ctx);
+        }
+        while (depth > base && (stackedPower(ctx, ctx->exprStack[depth - 1]) > power ||
+                             (stackedPower(ctx, ctx->exprStack[depth - 1]) == power && ctx->nextToken != POWER_OP)))
+            value = reduce(ctx, ctx->exprStack[--depth], value);
+        if ((op = newNode(ctx, AST_BINARY, ctx->nextToken)) == AST_NONE)
+            return AST_NONE;
+        setKid(ctx, op, 0, value);
+        if (pushOperator(ctx, depth++, op) != 0) {
+            error(ctx, L"Expression is nested too deeply.");
+            return AST_NONE;
         }
+        truthAllowed = power <= POWER_EQUALITY;
+        lex(ctx);
     }
-    printf("Exit <ifStmt>\n");
 }
 
-/* Function boolExpr
-<boolExpr> -> <boolOr>
-*/
-void boolExpr() {
-    printf("Enter <boolExpr>\n");
-    boolOr();
-    printf("Exit <boolExpr>\n");
-}
-
-/* Function boolOr
-<boolOr> -> <boolAnd> { "||" <boolAnd> }
+/* Function element
+<element> -> IDENT "[" <expr> "]"
+The name is already read into node; returns the AST_INDEX it becomes.
 */
-void boolOr() {
-    printf("Enter <boolOr>\n");
-    boolAnd();
-    while (nextToken == OR_OP) {
-        lex();
-        boolAnd();
-    }
-    printf("Exit <boolOr>\n");
+static AstRef element(Context *ctx, AstRef node) {
+    TRACE_ENTER(ctx, "element");
+    ctx->ast.nodes[node].kind = AST_INDEX;
+    lex(ctx);
+    setKid(ctx, node, 0, expr(ctx));
+    if (ctx->nextToken != RIGHT_SQUARE)
+        error(ctx, L"Expected a right square bracket after the index of an array element.");
+    else
+        lex(ctx);
+    TRACE_EXIT(ctx, "element");
+    return node;
 }
 
-/* Function boolAnd
-<boolAnd> -> <boolEq> { "&&" <boolEq> }
+/* Function expr
+<expr> -> <operand> { ("+" | "-" | "*" | "/" | "%" | "^") <operand> }, see operatorExpr
 */
-void boolAnd() {
-    printf("Enter <boolAnd>\n");
-    boolEq();
-    while (nextToken == AND_OP) {
-        lex();
-        boolEq();
-    }
-    printf("Exit <boolAnd>\n");
-}
+AstRef expr(Context *ctx) {
+    AstRef node;
 
-/* Function boolEq
-<boolEq> -> <boolRel> { ("=?" | "!?") <boolRel> }
-*/
-void boolEq() {
-    printf("Enter <boolEq>\n");
-    boolRel();
-    while (nextToken == EQUALITY_OP || nextToken == NOT_EQUALITY_OP) {
-        lex();
-        boolRel();
-    }
-    if (nextToken == LT_OP || nextToken == LE_OP || nextToken == GT_OP || nextToken == GE_OP || nextToken == ADD_OP
-        || nextToken == SUB_OP || nextToken == MULT_OP || nextToken == DIV_OP || nextToken == POWER_OP || nextToken == MOD_OP) {
-        error(L"A boolean value cannot be compared or operated with arithmetic operators.");
-    }
-    printf("Exit <boolEq>\n");
+    TRACE_ENTER(ctx, "expr");
+    node = operatorExpr(ctx, 0);
+    TRACE_EXIT(ctx, "expr");
+    return node;
 }
 
-/* Function boolRel
-<boolRel> -> "doğru" | "yanlış" | <boolArithExpr> { ("<" | "<=" | ">" | ">=") <boolArithExpr> }
-*/
-void boolRel() {
-    printf("Enter <boolRel>\n");
-    if (nextToken == TRUE_VAL || nextToken == FALSE_VAL) {
-        lex();
-    } else {
-        boolArithExpr();
-        while (nextToken == LT_OP || nextToken == LE_OP || nextToken == GT_OP || nextToken == GE_OP) {
-            lex();
-            boolArithExpr();
-        }
-    }
-    printf("Exit <boolRel>\n");
-}
-
-/* Function boolArithExpr
-<boolArithExpr> -> <boolArithTerm> { ("+" | "-") <boolArithTerm> }
+/* Function boolExpr
+<boolExpr> -> <boolOperand> { <operator> <boolOperand> }, see operatorExpr
 */
-void boolArithExpr() {
-    printf("Enter <boolArithExpr>\n");
-    boolArithTerm();
-    while (nextToken == ADD_OP || nextToken == SUB_OP) {
-        lex();
-        boolArithTerm();
-    }
-    printf("Exit <boolArithExpr>\n");
-}
+AstRef boolExpr(Context *ctx) {
+    AstRef node;
 
-/* Function boolArithTerm
-<boolArithTerm> -> <boolArithPower> { ("*" | "/" | "%") <boolArithPower> }
-*/
-void boolArithTerm() {
-    printf("Enter <boolArithTerm>\n");
-    boolArithPower();
-    while (nextToken == MULT_OP || nextToken == DIV_OP || nextToken == MOD_OP) {
-        lex();
-        boolArithPower();
-    }
-    printf("Exit <boolArithTerm>\n");
+    TRACE_ENTER(ctx, "boolExpr");
+    node = operatorExpr(ctx, 1);
+    TRACE_EXIT(ctx, "boolExpr");
+    return node;
 }
 
-/* Function boolArithPower
-<boolArithPower> -> <boolArithNot> "^" <boolArithPower> | <boolArithPower>
+/* Function ifStmt
+<ifStmt> -> "madem" "(" <boolExpr> ")" "{" <statementList> "}" ["şayet" "{" <statementList> "}"]
 */
-void boolArithPower() {
-    printf("Enter <boolArithPower>\n");
-    boolArithNot();
-    if (nextToken == POWER_OP) {
-        lex();
-        boolArithPower();
-    }
-    printf("Exit <boolArithPower>\n");
-}
+AstRef ifStmt(Context *ctx) {
+    AstRef node = AST_NONE;
 
-/* Function boolArithNot
-<boolArithNot> -> "!" <boolArithNot> | <boolArithFactor>
-*/
-void boolArithNot() {
-    printf("Enter <boolArithNot>\n");
-    if (nextToken == NOT_OP) {
-        lex();
-        boolArithNot();
+    TRACE_ENTER(ctx, "ifStmt");
+    if (ctx->nextToken != IF_CODE) {
+        error(ctx, L"Expected \"if\" keyword.");
     } else {
-        boolArithFactor();
-    }
-    printf("Exit <boolArithNot>\n");
-}
-
-/* Function boolArithFactor
-<boolArithFactor> -> IDENT | INT_LIT | FP_LIT | "(" <boolExpr> ")"
-*/
-void boolArithFactor() {
-    printf("Enter <boolArithFactor>\n");
-    if (nextToken == IDENT || nextToken == INT_LIT || nextToken == FP_LIT) {
-        lex();
-    } else if (nextToken == LEFT_PAREN) {
-        lex();
-        boolExpr();
-        if (nextToken == RIGHT_PAREN) {
-            lex();
+        node = newNode(ctx, AST_IF, 0);
+        lex(ctx);
+        if (ctx->nextToken != LEFT_PAREN) {
+            error(ctx, L"Expected a left parenthesis after \"if\".");
         } else {
-            error(L"Expected a right parenthesis after boolean expression.");
+            lex(ctx);
+            setKid(ctx, node, 0, boolExpr(ctx));
+            if (ctx->nextToken != RIGHT_PAREN) {
+                error(ctx, L"Expected a right parenthesis after if condition.");
+            } else {
+                lex(ctx);
+                if (ctx->nextToken != LEFT_CURLY) {
+                    error(ctx, L"Expected a left curly brace after condition in if statement.");
+                } else {
+                    lex(ctx);
+                    setKid(ctx, node, 1, statementList(ctx));
+                    if (ctx->nextToken != RIGHT_CURLY) {
+                        error(ctx, L"Expected a right curly brace to close \"if\" statement.");
+                    } else {
+                        lex(ctx);
+                        if (ctx->nextToken == ELSE_CODE) {
+                            lex(ctx);
+                            if (ctx->nextToken != LEFT_CURLY) {
+                                error(ctx, L"Expected a left curly brace after \"else\".");
+                            } else {
+                                lex(ctx);
+                                setKid(ctx, node, 2, statementList(ctx));
+                                if (ctx->nextToken != RIGHT_CURLY) {
+                                    error(ctx, L"Expected a right curly brace to close else clause.");
+                                } else {
+                                    lex(ctx);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
         }
-    } else {
-        error(L"Invalid boolean arithmetic factor.");
     }
-    printf("Exit <boolArithFactor>\n");
+    TRACE_EXIT(ctx, "ifStmt");
+    return node;
 }
 
 /* Function declStmt
-<declStmt> -> "tam" IDENT ["<<<" <expr>]
-                | "küsurat" IDENT ["<<<" <expr>]
-                | "dev" IDENT ["<<<" <expr>]
+<declStmt> -> "tam" IDENT (<arrayLength> | ["<<<" <expr>])
+                | "küsurat" IDENT (<arrayLength> | ["<<<" <expr>])
+                | "dev" IDENT (<arrayLength> | ["<<<" <expr>])
                 | "hane" IDENT ["<<<" <charLit>]
                 | "tümce" IDENT ["<<<" <stringLit>]
-                | "mantık" IDENT ["<<<" <boolExpr>]
+                | "mantık" IDENT (<arrayLength> | ["<<<" <boolExpr>])
 */
-void declStmt() {
-    printf("Enter <declStmt>\n");
-    if (nextToken == TYPE_INT || nextToken == TYPE_FLOAT || nextToken == TYPE_DOUBLE) {
-        lex();
-        if (nextToken != IDENT) {
-            error(L"Expected an identifier after number type declaration.");
+AstRef declStmt(Context *ctx) {
+    AstRef node = AST_NONE;
+    int type = ctx->nextToken;
+
+    TRACE_ENTER(ctx, "declStmt");
+    if (ctx->nextToken == TYPE_INT || ctx->nextToken == TYPE_FLOAT || ctx->nextToken == TYPE_DOUBLE) {
+        lex(ctx);
+        if (ctx->nextToken != IDENT) {
+            error(ctx, L"Expected an identifier after number type declaration.");
         } else {
-            lex();
-            if (nextToken == ASSIGN_OP) {
-                lex();
-                expr();
-            } else if (nextToken != EOS) {
-                error(L"Expected an assignment operator or end of line after variable declaration.");
+            node = newNode(ctx, AST_DECL, type);
+            lex(ctx);
+            if (ctx->nextToken == LEFT_SQUARE) {
+                setKid(ctx, node, 1, arrayLength(ctx));
+            } else if (ctx->nextToken == ASSIGN_OP) {
+                lex(ctx);
+                setKid(ctx, node, 0, expr(ctx));
+            } else if (ctx->nextToken != EOS) {
+                error(ctx, L"Expected an assignment operator or end of line after variable declaration.");
             }
         }
     }
 
-    else if (nextToken == TYPE_CHAR) {
-        lex();
-        if (nextToken != IDENT) {
-            error(L"Expected an identifier after character type declaration.");
+    else if (ctx->nextToken == TYPE_CHAR) {
+        lex(ctx);
+        if (ctx->nextToken != IDENT) {
+            error(ctx, L"Expected an identifier after character type declaration.");
         } else {
-            lex();
-            if (nextToken == ASSIGN_OP) {
-                lex();
-                charLit();
-            } else if (nextToken != EOS) {
-                error(L"Expected an assignment operator or end of line after variable declaration.");
+            node = newNode(ctx, AST_DECL, type);
+            lex(ctx);
+            if (ctx->nextToken == ASSIGN_OP) {
+                lex(ctx);
+                setKid(ctx, node, 0, charLit(ctx));
+            } else if (ctx->nextToken == LEFT_SQUARE) {
+                error(ctx, L"Only tam, küsurat, dev and mantık arrays can be declared.");
+            } else if (ctx->nextToken != EOS) {
+                error(ctx, L"Expected an assignment operator or end of line after variable declaration.");
             }
         }
     }
 
-    else if (nextToken == TYPE_STRING) {
-        lex();
-        if (nextToken != IDENT) {
-            error(L"Expected an identifier after string type declaration.");
+    else if (ctx->nextToken == TYPE_STRING) {
+        lex(ctx);
+        if (ctx->nextToken != IDENT) {
+            error(ctx, L"Expected an identifier after string type declaration.");
         } else {
-            lex();
-            if (nextToken == ASSIGN_OP) {
-                lex();
-                stringLit();
-            } else if (nextToken != EOS) {
-                error(L"Expected an assignment operator or end of line after variable declaration.");
+            node = newNode(ctx, AST_DECL, type);
+            lex(ctx);
+            if (ctx->nextToken == ASSIGN_OP) {
+                lex(ctx);
+                setKid(ctx, node, 0, stringLit(ctx));
+            } else if (ctx->nextToken == LEFT_SQUARE) {
+                error(ctx, L"Only tam, küsurat, dev and mantık arrays can be declared.");
+            } else if (ctx->nextToken != EOS) {
+                error(ctx, L"Expected an assignment operator or end of line after variable declaration.");
             }
         }
     }
 
-    else if (nextToken == TYPE_BOOL) {
-        lex();
-        if (nextToken != IDENT) {
-            error(L"Expected an identifier after bool type declaration.");
+    else if (ctx->nextToken == TYPE_BOOL) {
+        lex(ctx);
+        if (ctx->nextToken != IDENT) {
+            error(ctx, L"Expected an identifier after bool type declaration.");
         } else {
-            lex();
-            if (nextToken == ASSIGN_OP) {
-                lex();
-                boolExpr();
-            } else if (nextToken != EOS) {
-                error(L"Expected an assignment operator or end of line after variable declaration.");
+            node = newNode(ctx, AST_DECL, type);
+            lex(ctx);
+            if (ctx->nextToken == LEFT_SQUARE) {
+                setKid(ctx, node, 1, arrayLength(ctx));
+            } else if (ctx->nextToken == ASSIGN_OP) {
+                lex(ctx);
+                setKid(ctx, node, 0, boolExpr(ctx));
+            } else if (ctx->nextToken != EOS) {
+                error(ctx, L"Expected an assignment operator or end of line after variable declaration.");
             }
         }
     }
 
     else {
-        error(L"Invalid type for type declaration.");
+        error(ctx, L"Invalid type for type declaration.");
+    }
+    TRACE_EXIT(ctx, "declStmt");
+    return node;
+}
+
+/* Function arrayLength
+<arrayLength> -> "[" INT_LIT "]"
+An array is declared with its number of elements and starts out with every one of them zero.
+*/
+AstRef arrayLength(Context *ctx) {
+    AstRef node = AST_NONE;
+
+    TRACE_ENTER(ctx, "arrayLength");
+    lex(ctx);
+    if (ctx->nextToken != INT_LIT) {
+        error(ctx, L"Expected the number of elements of the array after '['.");
+    } else {
+        node = newNode(ctx, AST_INT, 0);
+        lex(ctx);
+        if (ctx->nextToken != RIGHT_SQUARE) {
+            error(ctx, L"Expected a right square bracket after the number of elements of the array.");
+        } else {
+            lex(ctx);
+            if (ctx->nextToken == ASSIGN_OP)
+                error(ctx, L"An array cannot be given a value where it is declared; its elements start at zero.");
+        }
     }
-    printf("Exit <declStmt>\n");
+    TRACE_EXIT(ctx, "arrayLength");
+    return node;
 }
 
 /* Function charLit
 <charLit> -> 'CHAR'
 */
-void charLit() {
-    printf("Enter <charLit>\n");
-    if (nextToken != APOSTROPHE) {
-        error(L"Expected a single quote before character literal.");
+AstRef charLit(Context *ctx) {
+    AstRef node = AST_NONE;
+
+    TRACE_ENTER(ctx, "charLit");
+    if (ctx->nextToken != APOSTROPHE) {
+        error(ctx, L"Expected a single quote before character literal.");
     } else {
-        lex();
-        if (lexLen == 1) {
-            lex();
-            if (nextToken != APOSTROPHE) {
-                error(L"Expected a single quote after character literal.");
+        lex(ctx);
+        if (ctx->lexLen == 1) {
+            node = newNode(ctx, AST_CHAR, 0);
+            lex(ctx);
+            if (ctx->nextToken != APOSTROPHE) {
+                error(ctx, L"Expected a single quote after character literal.");
             } else {
-                lex();
+                lex(ctx);
             }
         } else {
-            error(L"Character literal must be a single character.");
+            error(ctx, L"Character literal must be a single character.");
         }
     }
-    printf("Exit <charLit>\n");
+    TRACE_EXIT(ctx, "charLit");
+    return node;
 }
 
 /* Function stringLit
 <stringLit> -> "STRING"
 */
-void stringLit() {
-    printf("Enter <stringLit>\n");
-    if (nextToken != QUOTE) {
-        error(L"Expected a quote before string literal.");
+AstRef stringLit(Context *ctx) {
+    AstRef node = AST_NONE;
+    size_t start = ctx->tokenOffset + 1;
+
+    TRACE_ENTER(ctx, "stringLit");
+    if (ctx->nextToken != QUOTE) {
+        error(ctx, L"Expected a quote before string literal.");
     } else {
-        lex();
-        while (nextToken != QUOTE && nextToken != EOF) {
-                lex();
+        lex(ctx);
+        while (ctx->nextToken != QUOTE && ctx->nextToken != EOF) {
+                lex(ctx);
         }
-        if (nextToken == EOF) {
-            error(L"Expected to close the string literal with a quote.");
+        if (ctx->nextToken == EOF) {
+            error(ctx, L"Expected to close the string literal with a quote.");
         } else {
+            /* The text is everything between the quotes, blanks included */
+            node = newNode(ctx, AST_STRING, 0);
+            if (node != AST_NONE) {
+                ctx->ast.nodes[node].offset = (uint32_t) start;
+                ctx->ast.nodes[node].length = (uint32_t) (ctx->tokenOffset - start);
+            }
             /* Consume the closing quote */
-            lex();
+            lex(ctx);
         }
     }
-    printf("Exit <stringLit>\n");
+    TRACE_EXIT(ctx, "stringLit");
+    return node;
 }
 
 /* Function assignStmt
-<assignStmt> -> IDENT "<<<" (<expr> | <charLit> | <boolExpr>)
+<assignStmt> -> IDENT ["[" <expr> "]"] "<<<" (<expr> | <charLit> | <boolExpr>)
 */
-void assignStmt() {
-    printf("Enter <assignStmt>\n");
-    if (nextToken != IDENT) {
-        error(L"Expected an identifier for assignment.");
+AstRef assignStmt(Context *ctx) {
+    AstRef node = AST_NONE;
+
+    TRACE_ENTER(ctx, "assignStmt");
+    if (ctx->nextToken != IDENT) {
+        error(ctx, L"Expected an identifier for assignment.");
     } else {
-        lex();
-        if (nextToken != ASSIGN_OP) {
-            error(L"Expected an assignment operator after identifier in assignment statement.");
+        node = newNode(ctx, AST_ASSIGN, 0);
+        lex(ctx);
+        if (ctx->nextToken == LEFT_SQUARE) {
+            lex(ctx);
+            setKid(ctx, node, 1, expr(ctx));
+            if (ctx->nextToken != RIGHT_SQUARE)
+                error(ctx, L"Expected a right square bracket after the index of an array element.");
+            else
+                lex(ctx);
+        }
+        if (ctx->nextToken != ASSIGN_OP) {
+            error(ctx, L"Expected an assignment operator after identifier in assignment statement.");
         } else {
-            lex();
-            if (nextToken == INT_LIT || nextToken == FP_LIT || nextToken == IDENT || nextToken == LEFT_PAREN ||
-                nextToken == TRUE_VAL || nextToken == FALSE_VAL || nextToken == NOT_OP) {
+            lex(ctx);
+            if (ctx->nextToken == INT_LIT || ctx->nextToken == FP_LIT || ctx->nextToken == IDENT || ctx->nextToken == LEFT_PAREN ||
+                ctx->nextToken == TRUE_VAL || ctx->nextToken == FALSE_VAL || ctx->nextToken == NOT_OP) {
                 /* Call boolExpr since it contains both expr and boolExpr on a non-semantic level */
-                boolExpr();
-            } else if (nextToken == APOSTROPHE) {
-                charLit();
+                setKid(ctx, node, 0, boolExpr(ctx));
+            } else if (ctx->nextToken == APOSTROPHE) {
+                setKid(ctx, node, 0, charLit(ctx));
             } else {
-                error(L"Invalid assignment value for assignment statement.");
+                error(ctx, L"Invalid assignment value for assignment statement.");
             }
         }
     }
-    printf("Exit <assignStmt>\n");
+    TRACE_EXIT(ctx, "assignStmt");
+    return node;
 }
 
 /* Function whileStmt
 <whileStmt> -> "iken" "(" <boolExpr> ")" "{" <statementList> "}"
 */
-void whileStmt() {
-    printf("Enter <whileStmt>\n");
-    if (nextToken != WHILE_CODE) {
-        error(L"Expected \"while\" keyword.");
+AstRef whileStmt(Context *ctx) {
+    AstRef node = AST_NONE;
+
+    TRACE_ENTER(ctx, "whileStmt");
+    if (ctx->nextToken != WHILE_CODE) {
+        error(ctx, L"Expected \"while\" keyword.");
     } else {
-        lex();
-        if (nextToken != LEFT_PAREN) {
-            error(L"Expected a left parenthesis after \"while\".");
+        node = newNode(ctx, AST_WHILE, 0);
+        lex(ctx);
+        if (ctx->nextToken != LEFT_PAREN) {
+            error(ctx, L"Expected a left parenthesis after \"while\".");
         } else {
-            lex();
-            boolExpr();
-            if (nextToken != RIGHT_PAREN) {
-                error(L"Expected a right parenthesis after while condition.");
+            lex(ctx);
+            setKid(ctx, node, 0, boolExpr(ctx));
+            if (ctx->nextToken != RIGHT_PAREN) {
+                error(ctx, L"Expected a right parenthesis after while condition.");
             } else {
-                lex();
-                if (nextToken != LEFT_CURLY) {
-                    error(L"Expected a left curly brace after while loop condition.");
+                lex(ctx);
+                if (ctx->nextToken != LEFT_CURLY) {
+                    error(ctx, L"Expected a left curly brace after while loop condition.");
                 } else {
-                    lex();
-                    statementList();
-                    if (nextToken != RIGHT_CURLY) {
-                        error(L"Expected a right curly brace to close \"while\" loop.");
+                    lex(ctx);
+                    setKid(ctx, node, 1, statementList(ctx));
+                    if (ctx->nextToken != RIGHT_CURLY) {
+                        error(ctx, L"Expected a right curly brace to close \"while\" loop.");
                     } else {
-                        lex();
+                        lex(ctx);
                     }
                 }
             }
         }
     }
-    printf("Exit <whileStmt>\n");
+    TRACE_EXIT(ctx, "whileStmt");
+    return node;
 }
 
 /* Function forStmt
 <forStmt> -> "sayaç" "(" <assignStmt> "." <boolExpr> "." <assignStmt> ")" "{" <statementList> "}"
 */
-void forStmt() {
-    printf("Enter <forStmt>\n");
-    if (nextToken != FOR_CODE) {
-        error(L"Expected \"for\" keyword.");
+AstRef forStmt(Context *ctx) {
+    AstRef node = AST_NONE;
+
+    TRACE_ENTER(ctx, "forStmt");
+    if (ctx->nextToken != FOR_CODE) {
+        error(ctx, L"Expected \"for\" keyword.");
     } else {
-        lex();
-        if (nextToken != LEFT_PAREN) {
-            error(L"Expected a left parenthesis after \"for\".");
+        node = newNode(ctx, AST_FOR, 0);
+        lex(ctx);
+        if (ctx->nextToken != LEFT_PAREN) {
+            error(ctx, L"Expected a left parenthesis after \"for\".");
         } else {
-            lex();
-            assignStmt();
-            if (nextToken != EOS) {
-                error(L"Expected '.' after the first assignment in for loop.");
+            lex(ctx);
+            setKid(ctx, node, 0, assignStmt(ctx));
+            if (ctx->nextToken != EOS) {
+                error(ctx, L"Expected '.' after the first assignment in for loop.");
             } else {
-                lex();
-                boolExpr();
-                if (nextToken != EOS) {
-                    error(L"Expected '.' after the boolean expression in for loop.");
+                lex(ctx);
+                setKid(ctx, node, 1, boolExpr(ctx));
+                if (ctx->nextToken != EOS) {
+                    error(ctx, L"Expected '.' after the boolean expression in for loop.");
                 } else {
-                    lex();
-                    assignStmt();
-                    if (nextToken != RIGHT_PAREN) {
-                        error(L"Expected a right parenthesis after for loop condition.");
+                    lex(ctx);
+                    setKid(ctx, node, 2, assignStmt(ctx));
+                    if (ctx->nextToken != RIGHT_PAREN) {
+                        error(ctx, L"Expected a right parenthesis after for loop condition.");
                     } else {
-                        lex();
-                        if (nextToken != LEFT_CURLY) {
-                            error(L"Expected a left curly brace after for loop condition.");
+                        lex(ctx);
+                        if (ctx->nextToken != LEFT_CURLY) {
+                            error(ctx, L"Expected a left curly brace after for loop condition.");
                         } else {
-                            lex();
-                            statementList();
-                            if (nextToken != RIGHT_CURLY) {
-                                error(L"Expected a right curly brace to close \"for\" loop.");
+                            lex(ctx);
+                            setKid(ctx, node, 3, statementList(ctx));
+                            if (ctx->nextToken != RIGHT_CURLY) {
+                                error(ctx, L"Expected a right curly brace to close \"for\" loop.");
                             } else {
-                                lex();
+                                lex(ctx);
                             }
                         }
                     }
@@ -1058,5 +1075,6 @@ void forStmt() {
             }
         }
     }
-    printf("Exit <forStmt>\n");
+    TRACE_EXIT(ctx, "forStmt");
+    return node;
 }
\ No newline at end of file
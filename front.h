@@ -0,0 +1,155 @@
+/* front.h - token codes, analyzer state and entry points of the TR-701 front end */
+#ifndef FRONT_H
+#define FRONT_H
+
+#include <stdio.h>
+#include <wchar.h>
+
+#include "reader.h"
+#include "sink.h"
+#include "tokens.h"
+#include "ring.h"
+#include "ast.h"
+#include "vm.h"
+
+/* Character classes */
+#define DIGIT 0
+#define LETTER 1
+#define UNKNOWN 2
+#define COMMENT 3
+
+/* Flags stored next to the character class in charTable (charclass.h) */
+#define CHAR_CLASS_MASK 0x0F
+#define CHAR_SPACE 0x10     /* skipped by getNonBlank */
+#define CHAR_IDENT 0x20     /* may continue an identifier: letters, digits and '_' */
+
+/* Token codes */
+#define INT_LIT 10
+#define FP_LIT 11
+#define IDENT 12
+#define TYPE_INT 13
+#define TYPE_FLOAT 14
+#define TYPE_DOUBLE 15
+#define TYPE_CHAR 16
+#define TYPE_STRING 17
+#define TYPE_BOOL 18
+#define TRUE_VAL 19
+#define FALSE_VAL 20
+#define ASSIGN_OP 30
+#define EQUALITY_OP 31
+#define NOT_EQUALITY_OP 32
+#define LE_OP 33
+#define GE_OP 34
+#define LT_OP 35
+#define GT_OP 36
+#define NOT_OP 37
+#define AND_OP 38
+#define OR_OP 39
+#define ADD_OP 40
+#define SUB_OP 41
+#define MULT_OP 42
+#define DIV_OP 43
+#define POWER_OP 44
+#define MOD_OP 45
+#define IF_CODE 60
+#define ELSE_CODE 61
+#define WHILE_CODE 62
+#define FOR_CODE 63
+#define BREAK_CODE 64
+#define CONTINUE_CODE 65
+#define LEFT_PAREN 80
+#define RIGHT_PAREN 81
+#define LEFT_CURLY 82
+#define RIGHT_CURLY 83
+#define LEFT_SQUARE 84
+#define RIGHT_SQUARE 85
+#define EOS 90
+#define COMMA 91
+#define APOSTROPHE 92
+#define QUOTE 93
+#define UNDERSCORE 94
+#define COMMENT_SYMB 95
+#define UNREGISTERED_SYMBOL 99
+
+/* Extras */
+#define OPERATOR_MODE 5
+#define KEYWORD_MODE 6
+
+/* Trace levels: each one prints everything the one before it does */
+#define TRACE_SILENT 0      /* nothing but what the caller reports */
+#define TRACE_TOKENS 1      /* every token, then the final verdict */
+#define TRACE_FULL 2        /* also Enter/Exit of every grammar production */
+
+/* How analyzeFile feeds tokens to the parser */
+#define PIPELINE_STREAM 0   /* the parser calls the lexer for one token at a time */
+#define PIPELINE_BUFFERED 1 /* the lexer fills a TokenBuffer with the whole file first, then the parser runs */
+#define PIPELINE_THREADED 2 /* the lexer runs on its own thread, handing tokens over through a TokenRing */
+
+/* What analyzeFile does with an accepted program besides checking it; flags, combined with | */
+#define ANALYZE_DUMP_AST 0x01   /* write the syntax tree to the sink */
+#define ANALYZE_RUN 0x02        /* run the program and write the final value of its variables to the sink */
+#define ANALYZE_OPTIMIZE 0x04   /* rewrite the tree by the passes of opt.c before anything else is done with it */
+#define ANALYZE_DUMP_PASSES 0x08 /* write what each of those passes did to the sink */
+#define ANALYZE_GENERIC 0x10    /* run on the instructions that look at the type of their operands (vm.h), to measure them */
+#define ANALYZE_TRANSLATE 0x20  /* write the program as C11 next to the source (translate.c) */
+#define ANALYZE_CACHE 0x40      /* run from the compiled program kept next to the source while the source is unchanged (cache.h) */
+#define ANALYZE_PROFILE 0x80    /* count and time what the run does, and write where the time went (profile.c) */
+
+/* Results of analyzeFile */
+#define ANALYSIS_OK 0
+#define ANALYSIS_REJECTED 1
+#define ANALYSIS_OPEN_FAILED 2
+#define ANALYSIS_NOT_UTF16 3
+#define ANALYSIS_RUN_FAILED 4   /* accepted, but stopped by an error while running or not translated */
+
+/* Analyzer state for one source file; every lexer and parser function works on one of these */
+typedef struct {
+    int charClass;
+    const uint16_t *lexeme; /* Start of the current lexeme, a slice of in.units */
+    wint_t nextChar;        /* Last code unit read, or WEOF at the end */
+    int lexLen;             /* Code units in the lexeme */
+    int nextToken;
+    uint64_t literal;   /* Value of an INT_LIT (an int64_t) or FP_LIT (a double) nextToken, as bits (literal.h) */
+    Reader in;
+    wchar_t errMsg[256];
+    int errorRaised;    /* Flag to track if an error has already been raised */
+    size_t tokenOffset; /* Code unit index where nextToken starts */
+    TokenBuffer *tokens; /* Tokens lexed ahead of the parser, or NULL to lex on demand */
+    size_t tokenIndex;  /* Next token lex() takes from tokens */
+    size_t valueIndex;  /* Next literal value it takes from them */
+    TokenRing *ring;    /* Tokens from the lexer thread, or NULL */
+    AstRef *exprStack;  /* Operators pending in the expression being parsed, grown on demand */
+    size_t exprCap;     /* Entries exprStack has room for */
+    size_t exprDepth;   /* Entries in use by the expressions around the one being parsed: those inside an index */
+    Ast ast;            /* Syntax tree of the file, built by the parser */
+    AstRef root;        /* Its block of top-level statements */
+    uint32_t variables; /* Variables the checker numbered (AST_VAR) */
+    Sink *out;          /* Sink receiving the token and production trace */
+    int traceLevel;     /* One of the TRACE_ levels */
+} Context;
+
+/* Instruction of each arithmetic and comparison operator token (compile.c) */
+extern const uint8_t operatorCodes[UNREGISTERED_SYMBOL + 1];
+
+/* Functions */
+void initContext(Context *ctx, Sink *out, int traceLevel);
+int analyzeFile(Context *ctx, const char *path, Sink *out, int traceLevel, int pipeline, int actions);
+int tokenize(Context *ctx, TokenBuffer *buf);
+void getChar(Context *ctx);
+void getNonBlank(Context *ctx);
+int lex(Context *ctx);
+int lookup(Context *ctx, int compareMode);
+void error(Context *ctx, const wchar_t *message);
+void program(Context *ctx);
+void checkProgram(Context *ctx);
+Value literalValue(const Context *ctx, const AstNode *node, int want);
+int operandType(const Ast *ast, const AstNode *node);
+void optimizeProgram(Context *ctx, int report);
+int compileProgram(Context *ctx, Bytecode *bc, int generic, wchar_t *message, size_t size);
+int runBytecode(Context *ctx, const Bytecode *bc, const char *profile);
+int runProgram(Context *ctx, int actions, const char *cache, const char *profile);
+int profileProgram(Context *ctx, const Bytecode *bc, Value *slots, uint32_t *where, const char *path);
+char *pathWithExtension(const char *path, const char *extension);
+int translateProgram(Context *ctx, const char *path);
+
+#endif
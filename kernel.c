@@ -0,0 +1,325 @@
+/* kernel.c - scalar, SSE2 and AVX2 kernels for the element loops of OP_ARRAY_LOOP
+ *
+ * A map works through 2 or 4 tam, 4 or 8 küsurat and 2 or 4 dev elements per step (SSE2, AVX2) and
+ * finishes the last few with the scalar kernel. Every element gets the one operation the machine would have
+ * given it, so the result is the same to the bit; tam products have no vector instruction before AVX-512
+ * and stay scalar. A sum of tam wraps around, so its order does not matter and it is vectorized too, but sums
+ * and dot products of küsurat and dev are added in the order the loop would have added them, because
+ * rounding shows the order. The kernel set is picked once, at the first loop, from what the processor
+ * supports. Loads are unaligned: arrays start on VM_ARRAY_ALIGN, but a loop can start at any element.
+ */
+#include <stdatomic.h>
+#include <string.h>
+
+#include "front.h"
+#include "kernel.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+/* The scalar part of a map, from element j on: l and r are the operands of element j, result what goes into it */
+#define MAP_SCALARS(T, result) \
+    for (; j < n; j++) { \
+        T l = x != NULL ? x[j] : a, r = y != NULL ? y[j] : b; \
+        t[j] = (result); \
+    }
+
+static void mapIntScalar(int op, int64_t *t, const int64_t *x, int64_t a, const int64_t *y, int64_t b, size_t n) {
+    size_t j = 0;
+
+    switch (op) {
+        case ADD_OP: MAP_SCALARS(int64_t, (int64_t) ((uint64_t) l + (uint64_t) r)); break;
+        case SUB_OP: MAP_SCALARS(int64_t, (int64_t) ((uint64_t) l - (uint64_t) r)); break;
+        case MULT_OP: MAP_SCALARS(int64_t, (int64_t) ((uint64_t) l * (uint64_t) r)); break;
+    }
+}
+
+static void mapFloatScalar(int op, float *t, const float *x, float a, const float *y, float b, size_t n) {
+    size_t j = 0;
+
+    switch (op) {
+        case ADD_OP: MAP_SCALARS(float, l + r); break;
+        case SUB_OP: MAP_SCALARS(float, l - r); break;
+        case MULT_OP: MAP_SCALARS(float, l * r); break;
+        case DIV_OP: MAP_SCALARS(float, l / r); break;
+    }
+}
+
+static void mapDoubleScalar(int op, double *t, const double *x, double a, const double *y, double b, size_t n) {
+    size_t j = 0;
+
+    switch (op) {
+        case ADD_OP: MAP_SCALARS(double, l + r); break;
+        case SUB_OP: MAP_SCALARS(double, l - r); break;
+        case MULT_OP: MAP_SCALARS(double, l * r); break;
+        case DIV_OP: MAP_SCALARS(double, l / r); break;
+    }
+}
+
+static int64_t sumIntScalar(const int64_t *x, size_t n, int64_t s) {
+    uint64_t total = (uint64_t) s;
+    size_t j;
+
+    for (j = 0; j < n; j++)
+        total += (uint64_t) x[j];
+    return (int64_t) total;
+}
+
+#ifdef KERNEL_X86
+
+/* The vector part of a map: t[j] = x[j] op y[j] width elements at a time, an operand without an array
+   standing in every lane; leaves j at the first element it did not do */
+#define MAP_VECTORS(width, Vec, load, store, set, vop) \
+    do { \
+        Vec lv = set(a), rv = set(b); \
+        for (; j + (width) <= n; j += (width)) \
+            store(t + j, vop(x != NULL ? load(x + j) : lv, y != NULL ? load(y + j) : rv)); \
+    } while (0)
+
+#define LOAD_I128(p) _mm_loadu_si128((const __m128i *) (p))
+#define STORE_I128(p, v) _mm_storeu_si128((__m128i *) (p), (v))
+#define LOAD_I256(p) _mm256_loadu_si256((const __m256i *) (p))
+#define STORE_I256(p, v) _mm256_storeu_si256((__m256i *) (p), (v))
+
+__attribute__((target("sse2")))
+static void mapIntSSE2(int op, int64_t *t, const int64_t *x, int64_t a, const int64_t *y, int64_t b, size_t n) {
+    size_t j = 0;
+
+    if (op == ADD_OP)
+        MAP_VECTORS(2, __m128i, LOAD_I128, STORE_I128, _mm_set1_epi64x, _mm_add_epi64);
+    else if (op == SUB_OP)
+        MAP_VECTORS(2, __m128i, LOAD_I128, STORE_I128, _mm_set1_epi64x, _mm_sub_epi64);
+    mapIntScalar(op, t + j, x != NULL ? x + j : NULL, a, y != NULL ? y + j : NULL, b, n - j);
+}
+
+__attribute__((target("sse2")))
+static void mapFloatSSE2(int op, float *t, const float *x, float a, const float *y, float b, size_t n) {
+    size_t j = 0;
+
+    switch (op) {
+        case ADD_OP: MAP_VECTORS(4, __m128, _mm_loadu_ps, _mm_storeu_ps, _mm_set1_ps, _mm_add_ps); break;
+        case SUB_OP: MAP_VECTORS(4, __m128, _mm_loadu_ps, _mm_storeu_ps, _mm_set1_ps, _mm_sub_ps); break;
+        case MULT_OP: MAP_VECTORS(4, __m128, _mm_loadu_ps, _mm_storeu_ps, _mm_set1_ps, _mm_mul_ps); break;
+        case DIV_OP: MAP_VECTORS(4, __m128, _mm_loadu_ps, _mm_storeu_ps, _mm_set1_ps, _mm_div_ps); break;
+    }
+    mapFloatScalar(op, t + j, x != NULL ? x + j : NULL, a, y != NULL ? y + j : NULL, b, n - j);
+}
+
+__attribute__((target("sse2")))
+static void mapDoubleSSE2(int op, double *t, const double *x, double a, const double *y, double b, size_t n) {
+    size_t j = 0;
+
+    switch (op) {
+        case ADD_OP: MAP_VECTORS(2, __m128d, _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd, _mm_add_pd); break;
+        case SUB_OP: MAP_VECTORS(2, __m128d, _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd, _mm_sub_pd); break;
+        case MULT_OP: MAP_VECTORS(2, __m128d, _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd, _mm_mul_pd); break;
+        case DIV_OP: MAP_VECTORS(2, __m128d, _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd, _mm_div_pd); break;
+    }
+    mapDoubleScalar(op, t + j, x != NULL ? x + j : NULL, a, y != NULL ? y + j : NULL, b, n - j);
+}
+
+__attribute__((target("sse2")))
+static int64_t sumIntSSE2(const int64_t *x, size_t n, int64_t s) {
+    __m128i total = _mm_setzero_si128();
+    int64_t lanes[2];
+    size_t j = 0;
+
+    for (; j + 2 <= n; j += 2)
+        total = _mm_add_epi64(total, LOAD_I128(x + j));
+    STORE_I128(lanes, total);
+    return sumIntScalar(x + j, n - j, (int64_t) ((uint64_t) s + (uint64_t) lanes[0] + (uint64_t) lanes[1]));
+}
+
+__attribute__((target("avx2")))
+static void mapIntAVX2(int op, int64_t *t, const int64_t *x, int64_t a, const int64_t *y, int64_t b, size_t n) {
+    size_t j = 0;
+
+    if (op == ADD_OP)
+        MAP_VECTORS(4, __m256i, LOAD_I256, STORE_I256, _mm256_set1_epi64x, _mm256_add_epi64);
+    else if (op == SUB_OP)
+        MAP_VECTORS(4, __m256i, LOAD_I256, STORE_I256, _mm256_set1_epi64x, _mm256_sub_epi64);
+    mapIntScalar(op, t + j, x != NULL ? x + j : NULL, a, y != NULL ? y + j : NULL, b, n - j);
+}
+
+__attribute__((target("avx2")))
+static void mapFloatAVX2(int op, float *t, const float *x, float a, const float *y, float b, size_t n) {
+    size_t j = 0;
+
+    switch (op) {
+        case ADD_OP: MAP_VECTORS(8, __m256, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_set1_ps, _mm256_add_ps); break;
+        case SUB_OP: MAP_VECTORS(8, __m256, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_set1_ps, _mm256_sub_ps); break;
+        case MULT_OP: MAP_VECTORS(8, __m256, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_set1_ps, _mm256_mul_ps); break;
+        case DIV_OP: MAP_VECTORS(8, __m256, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_set1_ps, _mm256_div_ps); break;
+    }
+    mapFloatScalar(op, t + j, x != NULL ? x + j : NULL, a, y != NULL ? y + j : NULL, b, n - j);
+}
+
+__attribute__((target("avx2")))
+static void mapDoubleAVX2(int op, double *t, const double *x, double a, const double *y, double b, size_t n) {
+    size_t j = 0;
+
+    switch (op) {
+        case ADD_OP: MAP_VECTORS(4, __m256d, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_set1_pd, _mm256_add_pd); break;
+        case SUB_OP: MAP_VECTORS(4, __m256d, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_set1_pd, _mm256_sub_pd); break;
+        case MULT_OP: MAP_VECTORS(4, __m256d, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_set1_pd, _mm256_mul_pd); break;
+        case DIV_OP: MAP_VECTORS(4, __m256d, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_set1_pd, _mm256_div_pd); break;
+    }
+    mapDoubleScalar(op, t + j, x != NULL ? x + j : NULL, a, y != NULL ? y + j : NULL, b, n - j);
+}
+
+__attribute__((target("avx2")))
+static int64_t sumIntAVX2(const int64_t *x, size_t n, int64_t s) {
+    __m256i total = _mm256_setzero_si256();
+    int64_t lanes[4];
+    size_t j = 0;
+
+    for (; j + 4 <= n; j += 4)
+        total = _mm256_add_epi64(total, LOAD_I256(x + j));
+    STORE_I256(lanes, total);
+    s = (int64_t) ((uint64_t) s + (uint64_t) lanes[0] + (uint64_t) lanes[1] + (uint64_t) lanes[2] + (uint64_t) lanes[3]);
+    return sumIntScalar(x + j, n - j, s);
+}
+
+#endif
+
+/* Ordered from the most portable to the fastest */
+static const ElementKernels kernels[] = {
+    {"scalar", mapIntScalar, mapFloatScalar, mapDoubleScalar, sumIntScalar},
+#ifdef KERNEL_X86
+    {"sse2", mapIntSSE2, mapFloatSSE2, mapDoubleSSE2, sumIntSSE2},
+    {"avx2", mapIntAVX2, mapFloatAVX2, mapDoubleAVX2, sumIntAVX2},
+#endif
+};
+
+const ElementKernels *elementKernels(int *count) {
+    int n = 1;
+#ifdef KERNEL_X86
+    if (__builtin_cpu_supports("sse2")) {
+        n = 2;
+        if (__builtin_cpu_supports("avx2"))
+            n = 3;
+    }
+#endif
+    *count = n;
+    return kernels;
+}
+
+/* The chosen kernel set; NULL until the first loop */
+static _Atomic(const ElementKernels *) selected;
+
+/* best - the fastest kernel set this processor supports */
+static const ElementKernels *best() {
+    const ElementKernels *k = atomic_load_explicit(&selected, memory_order_acquire);
+    if (k == NULL) {
+        int count;
+        const ElementKernels *all = elementKernels(&count);
+        k = &all[count - 1];
+        atomic_store_explicit(&selected, k, memory_order_release);
+    }
+    return k;
+}
+
+/* fits - whether an operand that is an array has every element up to to */
+static int fits(const KernelOperand *operand, const Variable *variables, int64_t to) {
+    return operand->kind != KERNEL_ARRAY || (uint64_t) to <= variables[operand->index].count;
+}
+
+int kernelFits(const Kernel *kernel, const Variable *variables, int64_t from, int64_t to) {
+    if (from < 0 || !fits(&kernel->left, variables, to) || !fits(&kernel->right, variables, to))
+        return 0;
+    return kernel->shape != KERNEL_MAP || (uint64_t) to <= variables[kernel->target].count;
+}
+
+/* elementsOf - where the elements of an operand start at index from, or NULL if it is a single value */
+static void *elementsOf(const KernelOperand *operand, Value *slots, size_t from, int type) {
+    if (operand->kind != KERNEL_ARRAY)
+        return NULL;
+    return (char *) slots[operand->index].as.elements + from * vmElementSize(type);
+}
+
+/* valueOf - the value of an operand that is not an array */
+static Value valueOf(const KernelOperand *operand, const Value *slots, const Value *constants) {
+    Value none;
+
+    switch (operand->kind) {
+        case KERNEL_SCALAR: return slots[operand->index];
+        case KERNEL_CONSTANT: return constants[operand->index];
+    }
+    memset(&none, 0, sizeof(none));
+    return none;
+}
+
+/* fill - the copy of a map: every element of t from the array x, or the single value v */
+static void fill(int type, void *t, const void *x, Value v, size_t n) {
+    size_t j;
+
+    if (x != NULL) {
+        /* x is t itself or another array, never part of t */
+        memmove(t, x, n * vmElementSize(type));
+        return;
+    }
+    for (j = 0; j < n; j++)
+        switch (type) {
+            case TYPE_INT: ((int64_t *) t)[j] = v.as.i; break;
+            case TYPE_FLOAT: ((float *) t)[j] = v.as.f; break;
+            case TYPE_DOUBLE: ((double *) t)[j] = v.as.d; break;
+            default: ((int *) t)[j] = v.as.b; break;
+        }
+}
+
+void kernelRun(const Kernel *kernel, Value *slots, const Value *constants, size_t from, size_t to) {
+    const ElementKernels *k = best();
+    void *x = elementsOf(&kernel->left, slots, from, kernel->type);
+    void *y = elementsOf(&kernel->right, slots, from, kernel->type);
+    Value a = valueOf(&kernel->left, slots, constants), b = valueOf(&kernel->right, slots, constants);
+    Value *s = &slots[kernel->target];
+    size_t j, n = to - from;
+
+    if (kernel->shape == KERNEL_MAP) {
+        void *t = (char *) s->as.elements + from * vmElementSize(kernel->type);
+        if (kernel->op == 0)
+            fill(kernel->type, t, x, a, n);
+        else if (kernel->type == TYPE_INT)
+            k->mapInt(kernel->op, t, x, a.as.i, y, b.as.i, n);
+        else if (kernel->type == TYPE_FLOAT)
+            k->mapFloat(kernel->op, t, x, a.as.f, y, b.as.f, n);
+        else
+            k->mapDouble(kernel->op, t, x, a.as.d, y, b.as.d, n);
+        return;
+    }
+    /* A sum or dot product: only tam sums can be regrouped */
+    switch (kernel->type) {
+        case TYPE_INT:
+            if (kernel->shape == KERNEL_SUM) {
+                s->as.i = k->sumInt(x, n, s->as.i);
+            } else {
+                uint64_t total = (uint64_t) s->as.i;
+                for (j = 0; j < n; j++)
+                    total += (uint64_t) ((const int64_t *) x)[j] * (uint64_t) ((const int64_t *) y)[j];
+                s->as.i = (int64_t) total;
+            }
+            break;
+        case TYPE_FLOAT: {
+            const float *xf = x, *yf = y;
+            float total = s->as.f;
+            for (j = 0; j < n; j++) {
+                float term = kernel->shape == KERNEL_SUM ? xf[j] : xf[j] * yf[j];
+                total = total + term;
+            }
+            s->as.f = total;
+            break;
+        }
+        default: {
+            const double *xd = x, *yd = y;
+            double total = s->as.d;
+            for (j = 0; j < n; j++) {
+                double term = kernel->shape == KERNEL_SUM ? xd[j] : xd[j] * yd[j];
+                total = total + term;
+            }
+            s->as.d = total;
+            break;
+        }
+    }
+}
@@ -0,0 +1,31 @@
+/* kernel.h - vectorized element loops behind OP_ARRAY_LOOP (see Kernel in vm.h) */
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vm.h"
+
+/* A set of element kernels; every set leaves exactly what the scalar one does. A map writes
+   t[j] = x[j] op y[j] for j < n, where an operand whose array is NULL is the single value a or b */
+typedef struct {
+    const char *name;
+    void (*mapInt)(int op, int64_t *t, const int64_t *x, int64_t a, const int64_t *y, int64_t b, size_t n);
+    void (*mapFloat)(int op, float *t, const float *x, float a, const float *y, float b, size_t n);
+    void (*mapDouble)(int op, double *t, const double *x, double a, const double *y, double b, size_t n);
+    /* s plus x[0] .. x[n - 1], wrapping around like tam */
+    int64_t (*sumInt)(const int64_t *x, size_t n, int64_t s);
+} ElementKernels;
+
+/* kernelFits - whether every element kernel touches from index from up to to exists in the arrays of variables */
+int kernelFits(const Kernel *kernel, const Variable *variables, int64_t from, int64_t to);
+
+/* kernelRun - run kernel for the indexes from .. to - 1, which kernelFits, on the variables in slots and the
+   constants of its program, with the best kernel set this processor supports */
+void kernelRun(const Kernel *kernel, Value *slots, const Value *constants, size_t from, size_t to);
+
+/* elementKernels - every kernel set usable on this processor, scalar first; the best one is last */
+const ElementKernels *elementKernels(int *count);
+
+#endif
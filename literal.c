@@ -0,0 +1,458 @@
+/* literal.c - the values of number literals, worked out once as the lexer meets them
+ *
+ * Digits are taken eight at a time where there are eight: eight UTF-16 code units are two 64-bit words, checked
+ * for digits and folded into one number with a few multiplies over their 16-bit lanes (SWAR). A tam literal is
+ * added up in 64 bits and stops at the first digit that would overflow it.
+ *
+ * A küsurat literal becomes its first 19 significant digits w and a power of ten. Small enough w and powers
+ * are one exact division or product of doubles. Anything else goes through the Eisel-Lemire algorithm: w
+ * times the first 128 bits of the power (powers.h, from powgen.c) fixes all 53 bits of the result unless the
+ * product sits too close to a halfway point, and when digits past the 19th were dropped, w + 1 must round
+ * the same way. When it cannot tell, the value is settled exactly: every digit, up to the most a halfway
+ * point can have, goes into a big integer, and a close double is moved one step at a time until the literal
+ * lies between the halfway points on either side of it, ties going to even. So the result is the dev nearest
+ * to what was written, with no strtod and nothing that depends on the locale.
+ */
+#include <float.h>
+#include <string.h>
+
+#include "literal.h"
+#include "powers.h"
+
+/* Significant digits w holds; 10^19 - 1 still fits in 64 bits */
+#define W_DIGITS 19
+
+/* Significant digits the exact comparison keeps: a halfway point between two dev values has at most 767,
+   so what follows them can only decide a tie */
+#define EXACT_DIGITS 800
+
+/* 32-bit limbs of its big integers: the kept digits times the largest power of ten or of two one side of
+   the comparison takes on, with room to spare */
+#define EXACT_LIMBS 160
+
+/* Powers of ten a double holds exactly */
+static const double exactPowers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+#define EXACT_POWER_MAX 22
+
+static const uint32_t smallPowers[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+
+#define FRACTION_MASK 0x000FFFFFFFFFFFFFu
+#define INFINITY_BITS 0x7FF0000000000000u
+
+/************************************************************************************/
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define LITERAL_SWAR 1
+#endif
+
+/* The same 16-bit value in all four lanes of a word */
+#define LANES(x) ((uint64_t) (x) * 0x0001000100010001u)
+
+#ifdef LITERAL_SWAR
+/* digitLanes - whether every 16-bit lane of x is '0' .. '9': 0x30 .. 0x3F, and still so with 6 added */
+static inline int digitLanes(uint64_t x) {
+    return (x & LANES(0xFFF0)) == LANES(0x30) && ((x + LANES(6)) & LANES(0xFFF0)) == LANES(0x30);
+}
+
+/* fold4 - the four digit values in the lanes of x, the first in the lowest, as one number */
+static inline uint64_t fold4(uint64_t x) {
+    x = (x * 10 + (x >> 16)) & 0x0000FFFF0000FFFFu;
+    return (x * 100 + (x >> 32)) & 0xFFFFFFFFu;
+}
+#endif
+
+/* allDigits - whether the eight units at p are all digits */
+static inline int allDigits(const uint16_t *p) {
+#ifdef LITERAL_SWAR
+    uint64_t a, b;
+
+    memcpy(&a, p, sizeof(a));
+    memcpy(&b, p + 4, sizeof(b));
+    return digitLanes(a) && digitLanes(b);
+#else
+    int i;
+
+    for (i = 0; i < 8; i++)
+        if ((unsigned) (p[i] - '0') > 9)
+            return 0;
+    return 1;
+#endif
+}
+
+/* digits8 - the eight digits at p as a number */
+static inline uint32_t digits8(const uint16_t *p) {
+#ifdef LITERAL_SWAR
+    uint64_t a, b;
+
+    memcpy(&a, p, sizeof(a));
+    memcpy(&b, p + 4, sizeof(b));
+    return (uint32_t) (fold4(a - LANES('0')) * 10000 + fold4(b - LANES('0')));
+#else
+    uint32_t n = 0;
+    int i;
+
+    for (i = 0; i < 8; i++)
+        n = n * 10 + (uint32_t) (p[i] - '0');
+    return n;
+#endif
+}
+
+/* digitCount - how many digits n has; 0 for 0 */
+static int digitCount(uint64_t n) {
+    int count = 0;
+
+    for (; n != 0; n /= 10)
+        count++;
+    return count;
+}
+
+/************************************************************************************/
+
+int literalInt(const uint16_t *units, size_t len, int64_t *value) {
+    uint64_t n = 0;
+    size_t i = 0;
+
+    for (; i + 8 <= len; i += 8) {
+        uint32_t chunk = digits8(units + i);
+        if (n > (uint64_t) (INT64_MAX - chunk) / 100000000)
+            return -1;
+        n = n * 100000000 + chunk;
+    }
+    for (; i < len; i++) {
+        unsigned d = (unsigned) (units[i] - '0');
+        if (n > (uint64_t) (INT64_MAX - d) / 10)
+            return -1;
+        n = n * 10 + d;
+    }
+    *value = (int64_t) n;
+    return 0;
+}
+
+/************************************************************************************/
+
+/* A küsurat literal as w × 10^exponent, or a little more when digits were dropped */
+typedef struct {
+    uint64_t w;         /* its first W_DIGITS significant digits */
+    int exponent;
+    int digits;         /* significant digits in w */
+    int truncated;      /* a digit other than 0 was dropped */
+} Decimal;
+
+/* takeDigits - add the n digits at p to d, as whole-number digits or, if fraction, as digits after the ',' */
+static void takeDigits(Decimal *d, const uint16_t *p, size_t n, int fraction) {
+    size_t i = 0;
+
+    /* Eight at a time while they fit in w; leading zeros do not count */
+    for (; i + 8 <= n && d->digits <= W_DIGITS - 8; i += 8) {
+        uint32_t chunk = digits8(p + i);
+        d->digits = d->w != 0 ? d->digits + 8 : digitCount(chunk);
+        d->w = d->w * 100000000 + chunk;
+        d->exponent -= fraction ? 8 : 0;
+    }
+    for (; i < n && (d->digits < W_DIGITS || d->w == 0); i++) {
+        d->w = d->w * 10 + (uint64_t) (p[i] - '0');
+        d->digits += d->w != 0;
+        d->exponent -= fraction;
+    }
+    /* The rest are dropped: each one is a power of ten more in the whole part and none in the fraction */
+    if (!fraction)
+        d->exponent += (int) (n - i);
+    for (; i + 8 <= n; i += 8)
+        d->truncated |= digits8(p + i) != 0;
+    for (; i < n; i++)
+        d->truncated |= p[i] != '0';
+}
+
+/* mul128 - the 128-bit product of a and b */
+static inline void mul128(uint64_t a, uint64_t b, uint64_t *hi, uint64_t *lo) {
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 p = (unsigned __int128) a * b;
+    *hi = (uint64_t) (p >> 64);
+    *lo = (uint64_t) p;
+#else
+    uint64_t aLo = (uint32_t) a, aHi = a >> 32, bLo = (uint32_t) b, bHi = b >> 32;
+    uint64_t low = aLo * bLo, middle1 = aHi * bLo, middle2 = aLo * bHi;
+    uint64_t middle = (low >> 32) + (uint32_t) middle1 + (uint32_t) middle2;
+    *lo = middle << 32 | (uint32_t) low;
+    *hi = aHi * bHi + (middle1 >> 32) + (middle2 >> 32) + (middle >> 32);
+#endif
+}
+
+/* leadingZeros - the zero bits above the highest set bit of n, which is not 0 */
+static inline int leadingZeros(uint64_t n) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(n);
+#else
+    int zeros = 0;
+
+    for (; !(n >> 63); n <<= 1)
+        zeros++;
+    return zeros;
+#endif
+}
+
+/* eiselLemire - the bits of the dev nearest to w × 10^e; returns 0, or -1 when the 128 bits of the power are
+   not enough to tell or the result would not be a normal dev */
+static int eiselLemire(uint64_t w, int e, uint64_t *bits) {
+    const uint64_t *power;
+    uint64_t hi, lo, mantissa, exponent;
+    int zeros, top;
+
+    if (w == 0) {
+        *bits = 0;
+        return 0;
+    }
+    if (e < LITERAL_POWER_MIN || e > LITERAL_POWER_MAX)
+        return -1;
+    power = powersOfTen[e - LITERAL_POWER_MIN];
+    zeros = leadingZeros(w);
+    w <<= zeros;
+    /* floor(e × log2 10) from 217706 / 2^16, exact over the table; then the biased exponent of a w of 64 bits */
+    exponent = (uint64_t) ((217706 * e - (e < 0 ? 65535 : 0)) / 65536 + 64 + 1023 - zeros);
+
+    mul128(w, power[0], &hi, &lo);
+    if ((hi & 0x1FF) == 0x1FF && lo + w < w) {
+        /* The low bits may carry into the nine below the result: take the second word of the power too */
+        uint64_t hi2, lo2, mergedHi = hi, mergedLo;
+        mul128(w, power[1], &hi2, &lo2);
+        mergedLo = lo + hi2;
+        if (mergedLo < lo)
+            mergedHi++;
+        if ((mergedHi & 0x1FF) == 0x1FF && mergedLo + 1 == 0 && lo2 + w < w)
+            return -1;
+        hi = mergedHi;
+        lo = mergedLo;
+    }
+
+    /* 54 bits, then round half to even into 53 */
+    top = (int) (hi >> 63);
+    mantissa = hi >> (top + 9);
+    exponent -= (uint64_t) (1 ^ top);
+    if (lo == 0 && (hi & 0x1FF) == 0 && (mantissa & 3) == 1)
+        return -1;
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >> 53 > 0) {
+        mantissa >>= 1;
+        exponent++;
+    }
+    /* Subnormal results and infinity are left to the exact path */
+    if (exponent - 1 >= 0x7FF - 1)
+        return -1;
+    *bits = exponent << 52 | (mantissa & FRACTION_MASK);
+    return 0;
+}
+
+/************************************************************************************/
+
+/* A big unsigned integer for the exact path */
+typedef struct {
+    uint32_t limb[EXACT_LIMBS];  /* least significant first */
+    int count;                   /* limbs in use; the top one is not zero */
+} Big;
+
+static void bigSet(Big *b, uint64_t n) {
+    b->count = 0;
+    for (; n != 0; n >>= 32)
+        b->limb[b->count++] = (uint32_t) n;
+}
+
+/* bigMulAdd - b × m + add */
+static void bigMulAdd(Big *b, uint32_t m, uint32_t add) {
+    uint64_t carry = add;
+    int i;
+
+    for (i = 0; i < b->count; i++) {
+        carry += (uint64_t) b->limb[i] * m;
+        b->limb[i] = (uint32_t) carry;
+        carry >>= 32;
+    }
+    if (carry != 0)
+        b->limb[b->count++] = (uint32_t) carry;
+}
+
+/* bigMulPow10 - b × 10^k */
+static void bigMulPow10(Big *b, int k) {
+    for (; k >= 9; k -= 9)
+        bigMulAdd(b, smallPowers[9], 0);
+    if (k > 0)
+        bigMulAdd(b, smallPowers[k], 0);
+}
+
+/* bigShift - b × 2^k */
+static void bigShift(Big *b, int k) {
+    int words = k / 32, bits = k % 32, i;
+
+    if (b->count == 0)
+        return;
+    if (bits != 0) {
+        uint32_t carry = 0;
+        for (i = 0; i < b->count; i++) {
+            uint32_t limb = b->limb[i];
+            b->limb[i] = limb << bits | carry;
+            carry = limb >> (32 - bits);
+        }
+        if (carry != 0)
+            b->limb[b->count++] = carry;
+    }
+    if (words != 0) {
+        memmove(b->limb + words, b->limb, (size_t) b->count * sizeof(b->limb[0]));
+        memset(b->limb, 0, (size_t) words * sizeof(b->limb[0]));
+        b->count += words;
+    }
+}
+
+static int bigCompare(const Big *a, const Big *b) {
+    int i;
+
+    if (a->count != b->count)
+        return a->count < b->count ? -1 : 1;
+    for (i = a->count - 1; i >= 0; i--)
+        if (a->limb[i] != b->limb[i])
+            return a->limb[i] < b->limb[i] ? -1 : 1;
+    return 0;
+}
+
+/* The literal, exactly: digits × 10^exponent, plus a little more if sticky */
+typedef struct {
+    Big digits;
+    int exponent;
+    int sticky;     /* a digit other than 0 past EXACT_DIGITS */
+} Exact;
+
+/* readExact - every significant digit of the literal at units, up to EXACT_DIGITS of them */
+static void readExact(Exact *x, const uint16_t *units, size_t len) {
+    uint32_t chunk = 0;
+    int chunkDigits = 0, kept = 0, fraction = 0;
+    size_t i;
+
+    bigSet(&x->digits, 0);
+    x->exponent = x->sticky = 0;
+    for (i = 0; i < len; i++) {
+        uint32_t d = (uint32_t) (units[i] - '0');
+        if (units[i] == ',') {
+            fraction = 1;
+        } else if (kept == 0 && d == 0) {
+            x->exponent -= fraction;
+        } else if (kept < EXACT_DIGITS) {
+            chunk = chunk * 10 + d;
+            if (++chunkDigits == 9) {
+                bigMulAdd(&x->digits, smallPowers[9], chunk);
+                chunk = 0;
+                chunkDigits = 0;
+            }
+            kept++;
+            x->exponent -= fraction;
+        } else {
+            x->exponent += !fraction;
+            x->sticky |= d != 0;
+        }
+    }
+    bigMulAdd(&x->digits, smallPowers[chunkDigits], chunk);
+}
+
+/* aboveHalfway - how the literal compares with the halfway point between the dev in bits and the next one
+   up: -1 below it, 0 on it, 1 above it */
+static int aboveHalfway(const Exact *x, uint64_t bits) {
+    Big lhs = x->digits, rhs;
+    uint64_t m = bits & FRACTION_MASK;
+    int k = (int) (bits >> 52), c;
+
+    /* The dev is m × 2^k; the halfway point (2m + 1) × 2^(k - 1) */
+    if (k == 0)
+        k = 1;
+    else
+        m |= (uint64_t) 1 << 52;
+    k -= 1075;
+    bigSet(&rhs, 2 * m + 1);
+    if (x->exponent >= 0)
+        bigMulPow10(&lhs, x->exponent);
+    else
+        bigMulPow10(&rhs, -x->exponent);
+    if (k >= 1)
+        bigShift(&rhs, k - 1);
+    else
+        bigShift(&lhs, 1 - k);
+    c = bigCompare(&lhs, &rhs);
+    return c != 0 ? c : x->sticky;
+}
+
+/* exactDouble - the literal at units rounded exactly, starting from the double nearest to w × 10^e that
+   arithmetic gives; returns 0, or -1 if it rounds to infinity */
+static int exactDouble(const uint16_t *units, size_t len, uint64_t w, int e, double *value) {
+    Exact x;
+    double start = (double) w;
+    uint64_t bits;
+
+    for (; e > EXACT_POWER_MAX; e -= EXACT_POWER_MAX)
+        start *= exactPowers[EXACT_POWER_MAX];
+    for (; e < -EXACT_POWER_MAX; e += EXACT_POWER_MAX)
+        start /= exactPowers[EXACT_POWER_MAX];
+    start = e >= 0 ? start * exactPowers[e] : start / exactPowers[-e];
+    if (!(start <= DBL_MAX))
+        start = DBL_MAX;
+    memcpy(&bits, &start, sizeof(bits));
+
+    readExact(&x, units, len);
+    for (;;) {
+        int c = aboveHalfway(&x, bits);
+        if (c > 0 || (c == 0 && (bits & 1))) {
+            if (++bits == INFINITY_BITS)
+                return -1;
+            continue;
+        }
+        if (bits == 0)
+            break;
+        c = aboveHalfway(&x, bits - 1);
+        if (c < 0 || (c == 0 && !((bits - 1) & 1))) {
+            bits--;
+            continue;
+        }
+        break;
+    }
+    memcpy(value, &bits, sizeof(bits));
+    return 0;
+}
+
+/************************************************************************************/
+
+int literalDouble(const uint16_t *units, size_t len, double *value) {
+    Decimal d = {0, 0, 0, 0};
+    size_t comma = 0;
+    uint64_t bits, upper;
+    int magnitude;
+
+    while (comma + 8 <= len && allDigits(units + comma))
+        comma += 8;
+    while (comma < len && units[comma] != ',')
+        comma++;
+    takeDigits(&d, units, comma, 0);
+    if (comma < len)
+        takeDigits(&d, units + comma + 1, len - comma - 1, 1);
+
+    /* The literal is below 10^magnitude: from 10^310 on it is too large, below 10^-323 it rounds to 0 */
+    magnitude = d.exponent + d.digits;
+    if (d.w == 0 || magnitude < -323) {
+        *value = 0;
+        return 0;
+    }
+    if (magnitude > 310)
+        return -1;
+
+#if FLT_EVAL_METHOD == 0
+    if (!d.truncated && d.w <= (uint64_t) 1 << 53 && d.exponent >= -EXACT_POWER_MAX && d.exponent <= EXACT_POWER_MAX) {
+        /* Both are exact, so one rounding gives the nearest */
+        *value = d.exponent >= 0 ? (double) d.w * exactPowers[d.exponent] : (double) d.w / exactPowers[-d.exponent];
+        return 0;
+    }
+#endif
+    if (eiselLemire(d.w, d.exponent, &bits) == 0 &&
+        (!d.truncated || (eiselLemire(d.w + 1, d.exponent, &upper) == 0 && upper == bits))) {
+        memcpy(value, &bits, sizeof(bits));
+        return 0;
+    }
+    return exactDouble(units, len, d.w, d.exponent, value);
+}
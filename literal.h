@@ -0,0 +1,19 @@
+/* literal.h - values of the INT_LIT and FP_LIT lexemes, worked out once by the lexer */
+#ifndef LITERAL_H
+#define LITERAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Powers of ten in powers.h (powgen.c); a literal that needs one outside them is 0 or too large anyway */
+#define LITERAL_POWER_MIN (-348)
+#define LITERAL_POWER_MAX 347
+
+/* literalInt - the value of len decimal digits; returns 0, or -1 if it does not fit in tam */
+int literalInt(const uint16_t *units, size_t len, int64_t *value);
+
+/* literalDouble - the dev nearest to len decimal digits with at most one ',' among them, ties to even;
+   returns 0, or -1 if it is too large for dev */
+int literalDouble(const uint16_t *units, size_t len, double *value);
+
+#endif
@@ -0,0 +1,485 @@
+/* main.c - command line driver: an interactive prompt, or a batch run over files and directories */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <wchar.h>
+#include <locale.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "cache.h"
+#include "front.h"
+#include "pool.h"
+
+/* Exit statuses of a batch run */
+#define EXIT_ALL_PASSED 0
+#define EXIT_SOME_REJECTED 1
+#define EXIT_SOME_UNREADABLE 2
+
+/* Extension of TR-701 sources picked up when a directory is given */
+#define SOURCE_EXTENSION ".in"
+
+/* A growable list of source paths, in the order they will be analyzed */
+typedef struct {
+    char **paths;
+    size_t count;
+    size_t cap;
+} FileList;
+
+/* One file of a parallel run: its output is kept apart until every earlier file has been printed */
+typedef struct {
+    Sink out;
+    int status;
+    int done;
+} Job;
+
+/* How every file of a run is analyzed and reported, from the command line */
+typedef struct {
+    int traceLevel;     /* One of the TRACE_ levels */
+    int format;         /* One of the SINK_ formats */
+    int pipeline;       /* One of the PIPELINE_ modes */
+    int actions;        /* ANALYZE_ flags */
+} Options;
+
+/* Shared state of a parallel run */
+typedef struct {
+    const FileList *files;
+    const Options *options;
+    Job *jobs;
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+} Batch;
+
+static int interactive();
+static int parseTraceLevel(const char *name);
+static int parseFormat(const char *name);
+static int parsePipeline(const char *name);
+static int parseDump(const char *name);
+static int checkFile(Context *ctx, const char *path, Sink *out, const Options *options);
+static int batch(const FileList *files, const Options *options);
+static int parallelBatch(const FileList *files, int threads, const Options *options);
+static int exitStatus(int format, size_t count, size_t passed, size_t rejected, size_t unreadable);
+static void usage(const char *prog);
+static void addPath(FileList *list, const char *path);
+static void collectDirectory(FileList *list, const char *dir);
+static void freeFileList(FileList *list);
+
+/************************************************************************************/
+
+/* main driver */
+int main(int argc, char **argv) {
+    FileList files = {0};
+    Options options = {TRACE_FULL, SINK_TEXT, PIPELINE_STREAM, 0};
+    int status, i, threads = 1;
+
+    setlocale(LC_ALL, "");
+
+    if (argc < 2)
+        return interactive();
+
+    for (i = 1; i < argc; i++) {
+        struct stat st;
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            usage(argv[0]);
+            freeFileList(&files);
+            return EXIT_ALL_PASSED;
+        } else if (strncmp(argv[i], "-j", 2) == 0) {
+            const char *count = argv[i][2] != '\0' ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+            char *end;
+            long n = strtol(count, &end, 10);
+            if (*count == '\0' || *end != '\0' || n < 0 || n > 4096) {
+                fprintf(stderr, "Invalid thread count for -j: %s\n", count);
+                freeFileList(&files);
+                return EXIT_SOME_UNREADABLE;
+            }
+            threads = n == 0 ? poolDefaultThreads() : (int) n;
+        } else if (strncmp(argv[i], "-t", 2) == 0) {
+            const char *name = argv[i][2] != '\0' ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+            if ((options.traceLevel = parseTraceLevel(name)) < 0) {
+                fprintf(stderr, "Invalid trace level for -t: %s\n", name);
+                freeFileList(&files);
+                return EXIT_SOME_UNREADABLE;
+            }
+        } else if (strncmp(argv[i], "-f", 2) == 0) {
+            const char *name = argv[i][2] != '\0' ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+            if ((options.format = parseFormat(name)) < 0) {
+                fprintf(stderr, "Invalid output format for -f: %s\n", name);
+                freeFileList(&files);
+                return EXIT_SOME_UNREADABLE;
+            }
+        } else if (strncmp(argv[i], "-p", 2) == 0) {
+            const char *name = argv[i][2] != '\0' ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+            if ((options.pipeline = parsePipeline(name)) < 0) {
+                fprintf(stderr, "Invalid pipeline mode for -p: %s\n", name);
+                freeFileList(&files);
+                return EXIT_SOME_UNREADABLE;
+            }
+        } else if (strncmp(argv[i], "-d", 2) == 0) {
+            const char *name = argv[i][2] != '\0' ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+            int dump = parseDump(name);
+            if (dump < 0) {
+                fprintf(stderr, "Invalid dump for -d: %s\n", name);
+                freeFileList(&files);
+                return EXIT_SOME_UNREADABLE;
+            }
+            options.actions |= dump;
+        } else if (strcmp(argv[i], "-r") == 0) {
+            options.actions |= ANALYZE_RUN;
+        } else if (strcmp(argv[i], "-O") == 0) {
+            options.actions |= ANALYZE_OPTIMIZE;
+        } else if (strcmp(argv[i], "-c") == 0) {
+            options.actions |= ANALYZE_TRANSLATE;
+        } else if (strcmp(argv[i], "-b") == 0) {
+            options.actions |= ANALYZE_CACHE | ANALYZE_RUN;
+        } else if (strcmp(argv[i], "-P") == 0) {
+            options.actions |= ANALYZE_PROFILE | ANALYZE_RUN;
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            usage(argv[0]);
+            freeFileList(&files);
+            return EXIT_SOME_UNREADABLE;
+        } else if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+            collectDirectory(&files, argv[i]);
+        } else {
+            addPath(&files, argv[i]);
+        }
+    }
+
+    if (threads > 1 && files.count > 1)
+        status = parallelBatch(&files, threads, &options);
+    else
+        status = batch(&files, &options);
+    freeFileList(&files);
+    return status;
+}
+
+/* interactive - the original prompt: ask for a number and analyze front<number>.in */
+static int interactive() {
+    int fileNumber;
+    char filename[256];  // Buffer to store the constructed filename
+    Context context;
+    Sink out;
+    int status;
+
+    // Get file number from user
+    printf("Enter the file number (between 1 and 4): ");
+    if (scanf("%d", &fileNumber) != 1) {
+        printf("Error reading file number.\n");
+        return 1;
+    }
+
+    // Construct filename based on number
+    snprintf(filename, sizeof(filename), "front%d.in", fileNumber);
+
+    sinkInit(&out, stdout, SINK_TEXT);
+    status = analyzeFile(&context, filename, &out, TRACE_FULL, PIPELINE_STREAM, 0);
+    sinkFlush(&out);
+    sinkFree(&out);
+    switch (status) {
+        case ANALYSIS_OPEN_FAILED:
+            perror("File is not in the executable's directory or cannot be opened");
+            return 1;
+        case ANALYSIS_NOT_UTF16:
+            printf("%s is not in UTF-16LE format.\n", filename);
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* parseTraceLevel - map a -t argument (silent, tokens, full or 0-2) to a TRACE_ level, or -1 */
+static int parseTraceLevel(const char *name) {
+    if (strcmp(name, "silent") == 0 || strcmp(name, "0") == 0)
+        return TRACE_SILENT;
+    if (strcmp(name, "tokens") == 0 || strcmp(name, "1") == 0)
+        return TRACE_TOKENS;
+    if (strcmp(name, "full") == 0 || strcmp(name, "2") == 0)
+        return TRACE_FULL;
+    return -1;
+}
+
+/* parseFormat - map a -f argument (text, json or binary) to a SINK_ format, or -1 */
+static int parseFormat(const char *name) {
+    if (strcmp(name, "text") == 0)
+        return SINK_TEXT;
+    if (strcmp(name, "json") == 0)
+        return SINK_JSON;
+    if (strcmp(name, "binary") == 0)
+        return SINK_BINARY;
+    return -1;
+}
+
+/* parsePipeline - map a -p argument (stream, buffered or threaded) to a PIPELINE_ mode, or -1 */
+static int parsePipeline(const char *name) {
+    if (strcmp(name, "stream") == 0)
+        return PIPELINE_STREAM;
+    if (strcmp(name, "buffered") == 0)
+        return PIPELINE_BUFFERED;
+    if (strcmp(name, "threaded") == 0)
+        return PIPELINE_THREADED;
+    return -1;
+}
+
+/* parseDump - map a -d argument (ast, passes) to the ANALYZE_ flags that dump it, or -1 */
+static int parseDump(const char *name) {
+    if (strcmp(name, "ast") == 0)
+        return ANALYZE_DUMP_AST;
+    if (strcmp(name, "passes") == 0)
+        return ANALYZE_DUMP_PASSES | ANALYZE_OPTIMIZE;
+    return -1;
+}
+
+/* checkFile - analyze one file, writing its trace and then its summary line to out */
+static int checkFile(Context *ctx, const char *path, Sink *out, const Options *options) {
+    const wchar_t *reason = NULL;
+    wchar_t systemReason[128];
+    int status;
+
+    sinkBeginFile(out, path);
+    status = analyzeFile(ctx, path, out, options->traceLevel, options->pipeline, options->actions);
+    switch (status) {
+        case ANALYSIS_REJECTED:
+        case ANALYSIS_RUN_FAILED:
+            reason = wcsstr(ctx->errMsg, L"Reason: ");
+            reason = reason != NULL ? reason + 8 : ctx->errMsg;
+            break;
+        case ANALYSIS_OPEN_FAILED:
+            if (mbstowcs(systemReason, strerror(errno), 127) == (size_t) -1)
+                wcscpy(systemReason, L"cannot be opened");
+            systemReason[127] = L'\0';
+            reason = systemReason;
+            break;
+        case ANALYSIS_NOT_UTF16:
+            reason = L"not in UTF-16LE format";
+            break;
+    }
+    sinkSummary(out, path, status, reason);
+    return status;
+}
+
+/* batch - analyze every file in one process, one after another */
+static int batch(const FileList *files, const Options *options) {
+    Context context;
+    Sink out;
+    size_t i, passed = 0, rejected = 0, unreadable = 0;
+
+    sinkInit(&out, stdout, options->format);
+    for (i = 0; i < files->count; i++) {
+        int status = checkFile(&context, files->paths[i], &out, options);
+        /* One write per file, whatever the trace level */
+        sinkFlush(&out);
+        switch (status) {
+            case ANALYSIS_OK:
+                passed++;
+                break;
+            case ANALYSIS_REJECTED:
+            case ANALYSIS_RUN_FAILED:
+                rejected++;
+                break;
+            default:
+                unreadable++;
+                break;
+        }
+    }
+    sinkFree(&out);
+    return exitStatus(options->format, files->count, passed, rejected, unreadable);
+}
+
+/* runJob - pool task: analyze one file into its own sink and hand it to the printing thread */
+static void runJob(void *arg, size_t index, int worker) {
+    Batch *run = arg;
+    Job *job = &run->jobs[index];
+    Context context;
+    int status;
+
+    (void) worker;
+    sinkInit(&job->out, NULL, run->options->format);
+    status = checkFile(&context, run->files->paths[index], &job->out, run->options);
+
+    pthread_mutex_lock(&run->lock);
+    job->status = status;
+    job->done = 1;
+    pthread_cond_broadcast(&run->finished);
+    pthread_mutex_unlock(&run->lock);
+}
+
+/* parallelBatch - analyze the files on a work-stealing pool, printing each file's output whole and in input order */
+static int parallelBatch(const FileList *files, int threads, const Options *options) {
+    Batch run;
+    Pool *pool;
+    size_t i, passed = 0, rejected = 0, unreadable = 0;
+
+    run.files = files;
+    run.options = options;
+    run.jobs = calloc(files->count, sizeof(*run.jobs));
+    if (run.jobs == NULL) {
+        perror("Out of memory");
+        return EXIT_SOME_UNREADABLE;
+    }
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.finished, NULL);
+
+    if ((pool = poolStart(files->count, threads, runJob, &run)) == NULL) {
+        pthread_cond_destroy(&run.finished);
+        pthread_mutex_destroy(&run.lock);
+        free(run.jobs);
+        return batch(files, options);
+    }
+
+    for (i = 0; i < files->count; i++) {
+        Job *job = &run.jobs[i];
+
+        pthread_mutex_lock(&run.lock);
+        while (!job->done)
+            pthread_cond_wait(&run.finished, &run.lock);
+        pthread_mutex_unlock(&run.lock);
+
+        if (!job->out.failed)
+            fwrite(job->out.data, 1, job->out.len, stdout);
+        else
+            fprintf(stderr, "%s: ERROR - cannot buffer output\n", files->paths[i]);
+        sinkFree(&job->out);
+
+        if (job->status == ANALYSIS_OK)
+            passed++;
+        else if (job->status == ANALYSIS_REJECTED || job->status == ANALYSIS_RUN_FAILED)
+            rejected++;
+        else
+            unreadable++;
+    }
+    poolJoin(pool);
+
+    pthread_cond_destroy(&run.finished);
+    pthread_mutex_destroy(&run.lock);
+    free(run.jobs);
+    return exitStatus(options->format, files->count, passed, rejected, unreadable);
+}
+
+/* exitStatus - print the total line and map the counts to the exit status of the run */
+static int exitStatus(int format, size_t count, size_t passed, size_t rejected, size_t unreadable) {
+    if (format == SINK_JSON)
+        printf("{\"files\":%zu,\"passed\":%zu,\"failed\":%zu,\"unreadable\":%zu}\n", count, passed, rejected, unreadable);
+    else
+        /* The binary stream holds token records only, so its totals go to stderr */
+        fprintf(format == SINK_BINARY ? stderr : stdout, "%zu files: %zu passed, %zu failed, %zu unreadable\n",
+                count, passed, rejected, unreadable);
+    if (unreadable > 0)
+        return EXIT_SOME_UNREADABLE;
+    return rejected > 0 ? EXIT_SOME_REJECTED : EXIT_ALL_PASSED;
+}
+
+/* usage - print the command line synopsis */
+static void usage(const char *prog) {
+    printf("Usage: %s [-j N] [-t LEVEL] [-f FORMAT] [-p MODE] [-d WHAT] [-r] [-O] [-c] [-b] [-P] [FILE | DIRECTORY]...\n"
+           "Check whether each TR-701 source (UTF-16LE) belongs to the language.\n"
+           "  -j N      analyze on N worker threads (0 = one per processor); output stays in input order\n"
+           "  -t LEVEL  silent: summary lines only, tokens: also every token and the verdict,\n"
+           "            full: also every grammar production (the default)\n"
+#ifdef TR_NO_TRACE
+           "            (this build has token and production tracing compiled out)\n"
+#endif
+           "  -f FORMAT text: the lines above (the default), json: one JSON object per line,\n"
+           "            binary: token records as laid out in sink.h (totals go to stderr)\n"
+           "  -p MODE   stream: the parser asks the lexer for one token at a time (the default),\n"
+           "            buffered: lex the whole file into a token buffer first, then parse it,\n"
+           "            threaded: lex on a second thread while the parser runs, for very large files\n"
+           "  -d WHAT   ast: after each accepted file, print its syntax tree, one node per line,\n"
+           "            passes: what each optimization pass did to it (implies -O)\n"
+           "  -r        run each accepted file and print the final value of every variable outside a block;\n"
+           "            a file whose run stops with an error fails\n"
+           "  -O        optimize each accepted file first: fold constants, drop dead branches, compute\n"
+           "            repeated and loop-invariant expressions once\n"
+           "  -c        translate each accepted file into a C11 program, written next to it with the\n"
+           "            extension .c, to build with the system compiler and the math library\n"
+           "  -b        run each file (implies -r) and keep it compiled next to it as FILE" CACHE_EXTENSION ";\n"
+           "            while the source is unchanged, -t silent runs start from there, unlexed and unparsed\n"
+           "  -P        run each file (implies -r) while profiling it: print the instructions run, the lines\n"
+           "            that took the most time and how often each loop and madem went each way, and write\n"
+           "            the time as folded stacks next to it as FILE.folded, for flame graph tools\n"
+           "Directories are searched recursively for *" SOURCE_EXTENSION " files.\n"
+           "Without arguments, prompt for a number N and check frontN.in.\n"
+           "Exit status: %d if every file passed, %d if any file was rejected or stopped, %d if any file could not be read.\n",
+           prog, EXIT_ALL_PASSED, EXIT_SOME_REJECTED, EXIT_SOME_UNREADABLE);
+}
+
+/************************************************************************************/
+
+/* addPath - append a copy of path to the list */
+static void addPath(FileList *list, const char *path) {
+    if (list->count == list->cap) {
+        list->cap = list->cap ? list->cap * 2 : 64;
+        list->paths = realloc(list->paths, list->cap * sizeof(*list->paths));
+        if (list->paths == NULL) {
+            perror("Out of memory");
+            exit(EXIT_SOME_UNREADABLE);
+        }
+    }
+    list->paths[list->count] = malloc(strlen(path) + 1);
+    if (list->paths[list->count] == NULL) {
+        perror("Out of memory");
+        exit(EXIT_SOME_UNREADABLE);
+    }
+    strcpy(list->paths[list->count++], path);
+}
+
+/* compareNames - qsort comparator so directory contents are analyzed in a stable order */
+static int compareNames(const void *a, const void *b) {
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+/* hasSourceExtension - check whether name ends with SOURCE_EXTENSION */
+static int hasSourceExtension(const char *name) {
+    size_t len = strlen(name), extLen = strlen(SOURCE_EXTENSION);
+    return len > extLen && strcmp(name + len - extLen, SOURCE_EXTENSION) == 0;
+}
+
+/* collectDirectory - add every source file below dir, sorted by name at each level; a symbolic link to a
+   directory is not followed, since one that points back up the tree would have it descend forever */
+static void collectDirectory(FileList *list, const char *dir) {
+    FileList entries = {0};
+    struct dirent *entry;
+    DIR *dp;
+    size_t i;
+
+    if ((dp = opendir(dir)) == NULL) {
+        /* Let the analysis report why the path cannot be read */
+        addPath(list, dir);
+        return;
+    }
+    while ((entry = readdir(dp)) != NULL) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+            addPath(&entries, entry->d_name);
+    }
+    closedir(dp);
+    if (entries.count > 0)
+        qsort(entries.paths, entries.count, sizeof(*entries.paths), compareNames);
+
+    for (i = 0; i < entries.count; i++) {
+        struct stat st;
+        size_t len = strlen(dir) + strlen(entries.paths[i]) + 2;
+        char *path = malloc(len);
+        if (path == NULL) {
+            perror("Out of memory");
+            exit(EXIT_SOME_UNREADABLE);
+        }
+        snprintf(path, len, "%s/%s", dir, entries.paths[i]);
+        if (lstat(path, &st) == 0 && S_ISDIR(st.st_mode))
+            collectDirectory(list, path);
+        else if (hasSourceExtension(entries.paths[i]))
+            addPath(list, path);
+        free(path);
+    }
+    freeFileList(&entries);
+}
+
+/* freeFileList - release every path and the list itself */
+static void freeFileList(FileList *list) {
+    size_t i;
+    for (i = 0; i < list->count; i++)
+        free(list->paths[i]);
+    free(list->paths);
+    memset(list, 0, sizeof(*list));
+}
@@ -0,0 +1,1011 @@
+/* opt.c - optimization passes over a checked syntax tree, run between checking and compiling (-O)
+ *
+ * Every pass rewrites the tree in place and leaves a tree compile.c takes like any other:
+ *   fold  an operator whose operands are constants becomes an AST_CONST holding what the machine would have
+ *         computed (vmApply), and "&&" or "||" with a constant side is cut short
+ *   dead  "madem" and the loops with a constant condition keep only what can run, and statements after
+ *         "çık" or "atla" in the same block go
+ *   cse   an expression computed again in the same run of declarations and assignments, with none of its
+ *         variables assigned in between, is computed once into a temporary
+ *   licm  an expression in a loop none of whose variables the loop assigns is computed once before it
+ * Temporaries are variables without a name, numbered after the checker's, each declared by an AST_DECL of
+ * length 0 in front of the statement that first needs it. Only expressions that cannot stop the program are
+ * shared or moved, so a run stops, or does not, just as it would without the passes. When nodes or memory
+ * run out a pass stops where it is, and the tree it leaves is still a correct program.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "front.h"
+#include "vm.h"
+
+/* Operators an expression needs before sharing it through a temporary costs less than computing it again */
+#define CSE_MIN_OPERATORS 2
+
+/* An entry that has no temporary yet, or a temporary that could not be had */
+#define NO_TEMP UINT32_MAX
+
+/* Flags of an expression node, see measure */
+#define NODE_SAFE 0x01      /* nothing in it can stop the program */
+#define NODE_FIXED 0x02     /* no variable in it is assigned in the loop being worked on */
+
+/* What the passes know about one node of the expression being worked on */
+typedef struct {
+    uint32_t hash;      /* equal for expressions equal() takes as the same */
+    uint32_t operators; /* operator nodes in the subtree */
+    uint32_t entry;     /* the CSE entry rooted here, plus one, if it is still of the current run */
+    uint8_t flags;      /* NODE_ flags */
+} NodeInfo;
+
+/* An expression met earlier in the run of statements being scanned for common subexpressions */
+typedef struct {
+    uint32_t hash;
+    AstRef ref;         /* its root; the value of the temporary once it is shared */
+    uint32_t owner;     /* index in owners of the statement computing it, where a temporary goes */
+    uint32_t since;     /* number of that statement: a variable assigned at or after it spoils the entry */
+    uint32_t temp;      /* variable holding its value, or NO_TEMP while it is computed once */
+    uint32_t chain;     /* next entry in the same bucket, plus one */
+} Entry;
+
+/* An expression node on the way down: whether it only runs when an "&&" or "||" lets it */
+typedef struct {
+    AstRef ref;
+    int conditional;
+} Visit;
+
+/* Two nodes compared side by side */
+typedef struct {
+    AstRef a, b;
+} Pair;
+
+typedef struct {
+    Context *ctx;
+    Ast *ast;
+    NodeInfo *info;         /* per node */
+    size_t infoCap;
+    uint32_t *stamps;       /* per variable: last statement assigning it (cse), or the loop assigning it (licm) */
+    AstRef *defs;           /* per variable, for temporaries only: the root of the expression it holds */
+    size_t variableCap;
+    uint32_t first;         /* number of the first temporary */
+    uint32_t variables;     /* variables so far, temporaries included */
+    AstRef *list;           /* nodes of one expression in pre-order, see collect */
+    size_t listCap;
+    AstRef *walk;           /* scratch stacks */
+    size_t walkCap;
+    Visit *visits;
+    size_t visitCap;
+    Pair *pairs;
+    size_t pairCap;
+    Entry *entries;         /* the run's CSE table: entries chained from buckets */
+    size_t entryCount, entryCap;
+    uint32_t *buckets;
+    uint32_t *bucketGens;   /* run a bucket was last used in; other buckets are empty */
+    uint32_t bucketMask;
+    uint32_t gen;
+    AstRef *owners;         /* statements of the run and their temporaries, wherever they have moved */
+    size_t ownerCount, ownerCap;
+    uint32_t statements;    /* statements numbered so far */
+    uint32_t loop;          /* stamp of the loop being worked on */
+    int failed;
+    /* What the passes did, for the report */
+    uint32_t folded, branches, unreachable, reused, temps, hoisted, loops;
+} Optimizer;
+
+static void foldBlock(Optimizer *opt, AstRef block);
+static void cseBlock(Optimizer *opt, AstRef block);
+static void licmBlock(Optimizer *opt, AstRef block);
+
+/* reserve - make room for need elements in a scratch array; stops the optimizer when memory runs out */
+static int reserve(Optimizer *opt, void **items, size_t *cap, size_t need, size_t size) {
+    void *grown;
+    size_t newCap;
+
+    if (need <= *cap)
+        return 0;
+    for (newCap = *cap ? *cap : 64; newCap < need; newCap *= 2)
+        ;
+    if ((grown = realloc(*items, newCap * size)) == NULL) {
+        opt->failed = 1;
+        return -1;
+    }
+    *items = grown;
+    *cap = newCap;
+    return 0;
+}
+
+/* coverNodes - make info as long as the tree, the new entries zero */
+static int coverNodes(Optimizer *opt) {
+    size_t old = opt->infoCap;
+
+    if (reserve(opt, (void **) &opt->info, &opt->infoCap, opt->ast->count, sizeof(NodeInfo)) != 0)
+        return -1;
+    memset(opt->info + old, 0, (opt->infoCap - old) * sizeof(NodeInfo));
+    return 0;
+}
+
+/* newNode - a node for a pass to fill in; AST_NONE, with the optimizer stopped, when there is none */
+static AstRef newNode(Optimizer *opt) {
+    AstRef ref = astNew(opt->ast, AST_BLOCK, 0, 0, 0);
+
+    if (ref == AST_NONE || coverNodes(opt) != 0) {
+        opt->failed = 1;
+        return AST_NONE;
+    }
+    return ref;
+}
+
+/* coverVariables - make stamps and defs long enough for need variables, the new stamps zero */
+static int coverVariables(Optimizer *opt, size_t need) {
+    size_t old = opt->variableCap, cap = old;
+
+    if (need <= old)
+        return 0;
+    if (reserve(opt, (void **) &opt->stamps, &cap, need, sizeof(uint32_t)) != 0)
+        return -1;
+    cap = old;
+    if (reserve(opt, (void **) &opt->defs, &cap, need, sizeof(AstRef)) != 0)
+        return -1;
+    memset(opt->stamps + old, 0, (cap - old) * sizeof(uint32_t));
+    opt->variableCap = cap;
+    return 0;
+}
+
+/* newTemp - number a temporary that will hold the expression at def; returns NO_TEMP if memory ran out */
+static uint32_t newTemp(Optimizer *opt, AstRef def) {
+    if (coverVariables(opt, (size_t) opt->variables + 1) != 0)
+        return NO_TEMP;
+    opt->stamps[opt->variables] = 0;
+    opt->defs[opt->variables] = def;
+    return opt->variables++;
+}
+
+/* isTemp - whether variable var is a temporary of the passes */
+static int isTemp(const Optimizer *opt, uint32_t var) {
+    return var >= opt->first;
+}
+
+/* isConstant - whether a node is a value known before the run; tümce literals are left as they are */
+static int isConstant(const AstNode *node) {
+    return node->kind == AST_INT || node->kind == AST_FLOAT || node->kind == AST_BOOL || node->kind == AST_CHAR ||
+           node->kind == AST_CONST;
+}
+
+/* setConstant - make node an AST_CONST holding v, its unused payload bits zero */
+static void setConstant(AstNode *node, const Value *v) {
+    Value clean;
+    uint64_t bits;
+
+    memset(&clean, 0, sizeof(clean));
+    switch (v->type) {
+        case TYPE_FLOAT: clean.as.f = v->as.f; break;
+        case TYPE_CHAR: clean.as.c = v->as.c; break;
+        case TYPE_BOOL: clean.as.b = v->as.b; break;
+        default: clean.as = v->as; break;
+    }
+    memcpy(&bits, &clean.as, sizeof(bits));
+    astSetBits(node, bits);
+    node->type = v->type;
+}
+
+/* toName - make node read the temporary var instead of computing its expression */
+static void toName(AstNode *node, uint32_t var) {
+    node->kind = AST_NAME;
+    node->op = 0;
+    node->length = 0;
+    node->kids[0] = node->kids[1] = node->kids[2] = AST_NONE;
+    node->kids[AST_VAR] = var;
+}
+
+/* declareBefore - declare the temporary var holding the expression at value in front of the statement at ref,
+   which moves to a new node; returns where it went, or AST_NONE (nothing changed) if there is no node for it */
+static AstRef declareBefore(Optimizer *opt, AstRef ref, uint32_t var, AstRef value) {
+    AstRef moved = newNode(opt);
+    AstNode *node;
+
+    if (moved == AST_NONE)
+        return AST_NONE;
+    opt->ast->nodes[moved] = opt->ast->nodes[ref];
+    node = &opt->ast->nodes[ref];
+    node->kind = AST_DECL;
+    node->op = node->type = opt->ast->nodes[value].type;
+    node->offset = opt->ast->nodes[value].offset;
+    node->length = 0;
+    node->next = moved;
+    node->kids[0] = value;
+    node->kids[1] = node->kids[2] = AST_NONE;
+    node->kids[AST_VAR] = var;
+    return moved;
+}
+
+/* collect - the nodes of the expression under root in pre-order into opt->list, so that walking the list
+   backwards meets every node after its kids; returns how many, 0 if memory ran out */
+static size_t collect(Optimizer *opt, AstRef root) {
+    size_t count = 0, depth = 0;
+
+    if (reserve(opt, (void **) &opt->walk, &opt->walkCap, 1, sizeof(AstRef)) != 0)
+        return 0;
+    opt->walk[depth++] = root;
+    while (depth > 0) {
+        AstRef ref = opt->walk[--depth];
+        const AstNode *node = &opt->ast->nodes[ref];
+
+        if (reserve(opt, (void **) &opt->list, &opt->listCap, count + 1, sizeof(AstRef)) != 0 ||
+            reserve(opt, (void **) &opt->walk, &opt->walkCap, depth + 2, sizeof(AstRef)) != 0)
+            return 0;
+        opt->list[count++] = ref;
+        if (node->kind == AST_BINARY) {
+            opt->walk[depth++] = node->kids[1];
+            opt->walk[depth++] = node->kids[0];
+        } else if (node->kind == AST_NOT || node->kind == AST_INDEX) {
+            opt->walk[depth++] = node->kids[0];
+        }
+    }
+    return count;
+}
+
+/* mix - fold a value into a hash */
+static uint32_t mix(uint32_t hash, uint32_t value) {
+    return hash ^ (value + 0x9E3779B9u + (hash << 6) + (hash >> 2));
+}
+
+/* safeOperator - whether a binary operator can never stop the program: only tam division and remainder by
+   zero and tam zero to a negative power can */
+static int safeOperator(const Optimizer *opt, const AstNode *node) {
+    const AstNode *left = &opt->ast->nodes[node->kids[0]], *right = &opt->ast->nodes[node->kids[1]];
+
+    if (node->type != TYPE_INT)
+        return 1;
+    if (node->op == DIV_OP || node->op == MOD_OP)
+        return isConstant(right) && literalValue(opt->ctx, right, TYPE_INT).as.i != 0;
+    if (node->op == POWER_OP)
+        return (isConstant(left) && literalValue(opt->ctx, left, TYPE_INT).as.i != 0) ||
+               (isConstant(right) && literalValue(opt->ctx, right, TYPE_INT).as.i >= 0);
+    return 1;
+}
+
+/* measure - fill in the NodeInfo of the count nodes collect listed, kids before parents */
+static void measure(Optimizer *opt, size_t count) {
+    while (count-- > 0) {
+        AstRef ref = opt->list[count];
+        const AstNode *node = &opt->ast->nodes[ref];
+        NodeInfo *info = &opt->info[ref];
+        uint32_t hash = mix(mix(node->kind, node->op), node->type), i;
+
+        info->operators = 0;
+        info->flags = NODE_SAFE | NODE_FIXED;
+        switch (node->kind) {
+            case AST_BINARY: {
+                const NodeInfo *left = &opt->info[node->kids[0]], *right = &opt->info[node->kids[1]];
+                hash = mix(mix(hash, left->hash), right->hash);
+                info->operators = left->operators + right->operators + 1;
+                info->flags = left->flags & right->flags;
+                if (!safeOperator(opt, node))
+                    info->flags &= (uint8_t) ~NODE_SAFE;
+                break;
+            }
+            case AST_NOT:
+                hash = mix(hash, opt->info[node->kids[0]].hash);
+                info->operators = opt->info[node->kids[0]].operators + 1;
+                info->flags = opt->info[node->kids[0]].flags;
+                break;
+            case AST_INDEX:
+                /* The index can be out of range */
+                hash = mix(mix(hash, node->kids[AST_VAR]), opt->info[node->kids[0]].hash);
+                info->operators = opt->info[node->kids[0]].operators + 1;
+                info->flags = opt->info[node->kids[0]].flags & (uint8_t) ~NODE_SAFE;
+                if (opt->stamps[node->kids[AST_VAR]] == opt->loop)
+                    info->flags &= (uint8_t) ~NODE_FIXED;
+                break;
+            case AST_NAME:
+                /* A temporary stands for its expression, so both hash alike */
+                if (isTemp(opt, node->kids[AST_VAR]))
+                    hash = opt->info[opt->defs[node->kids[AST_VAR]]].hash;
+                else
+                    hash = mix(hash, node->kids[AST_VAR]);
+                if (opt->stamps[node->kids[AST_VAR]] == opt->loop)
+                    info->flags &= (uint8_t) ~NODE_FIXED;
+                break;
+            case AST_CONST: case AST_INT: case AST_FLOAT:
+                hash = mix(mix(hash, node->kids[0]), node->kids[1]);
+                break;
+            case AST_CHAR: case AST_STRING:
+                for (i = 0; i < node->length; i++)
+                    hash = mix(hash, opt->ctx->in.units[node->offset + i]);
+                break;
+        }
+        info->hash = hash;
+    }
+}
+
+/************************************************************************************/
+/* fold and dead */
+
+/* foldNode - replace an operator by its value if its operands are constants; kids are already folded */
+static void foldNode(Optimizer *opt, AstNode *node) {
+    AstNode *left = &opt->ast->nodes[node->kids[0]], *right = &opt->ast->nodes[node->kids[1]];
+    int operands;
+    Value a, b;
+
+    if (node->kind == AST_NOT) {
+        if (!isConstant(left))
+            return;
+        a = literalValue(opt->ctx, left, TYPE_BOOL);
+        vmApply(OP_NOT, &a, NULL);
+        setConstant(node, &a);
+        opt->folded++;
+        return;
+    }
+    if (node->kind != AST_BINARY)
+        return;
+    if (node->op == AND_OP || node->op == OR_OP) {
+        /* "doğru ||" and "yanlış &&" decide the value alone; "doğru &&" and "yanlış ||" on either side leave
+           it to the other side, which still runs */
+        int decisive = node->op == OR_OP;
+
+        if (isConstant(left)) {
+            a = literalValue(opt->ctx, left, TYPE_BOOL);
+            if (a.as.b == decisive)
+                setConstant(node, &a);
+            else
+                *node = *right;
+            opt->folded++;
+        } else if (isConstant(right) && literalValue(opt->ctx, right, TYPE_BOOL).as.b != decisive) {
+            *node = *left;
+            opt->folded++;
+        }
+        return;
+    }
+    if (!isConstant(left) || !isConstant(right))
+        return;
+    /* The operands are brought to one type as the compiled code would */
+    operands = operandType(opt->ast, node);
+    a = literalValue(opt->ctx, left, operands);
+    b = literalValue(opt->ctx, right, operands);
+    if (a.type != operands)
+        vmWiden(&a, operands);
+    if (b.type != operands)
+        vmWiden(&b, operands);
+    /* An operation that stops the program is left for the run to stop at */
+    if (vmApply(operatorCodes[node->op], &a, &b) != VM_OK)
+        return;
+    setConstant(node, &a);
+    opt->folded++;
+}
+
+/* foldExpr - fold the expression under root from the leaves up */
+static void foldExpr(Optimizer *opt, AstRef root) {
+    size_t count = collect(opt, root);
+
+    while (count-- > 0)
+        foldNode(opt, &opt->ast->nodes[opt->list[count]]);
+}
+
+/* constantCondition - 1 or 0 if the condition at ref is a folded doğru or yanlış, -1 otherwise */
+static int constantCondition(const Optimizer *opt, AstRef ref) {
+    const AstNode *node = &opt->ast->nodes[ref];
+
+    if (!isConstant(node))
+        return -1;
+    return literalValue(opt->ctx, node, TYPE_BOOL).as.b != 0;
+}
+
+/* toBlock - make a statement a block holding the statements from first on */
+static void toBlock(AstNode *node, AstRef first) {
+    node->kind = AST_BLOCK;
+    node->op = 0;
+    node->kids[0] = first;
+    node->kids[1] = node->kids[2] = node->kids[3] = AST_NONE;
+}
+
+/* foldStatement - fold the expressions of one statement and what it holds, then cut the branches that
+   cannot run */
+static void foldStatement(Optimizer *opt, AstRef ref) {
+    AstNode *node = &opt->ast->nodes[ref];
+    int taken;
+
+    switch (node->kind) {
+        case AST_DECL:
+            if (node->kids[0] != AST_NONE)
+                foldExpr(opt, node->kids[0]);
+            break;
+        case AST_ASSIGN:
+            if (node->kids[1] != AST_NONE)
+                foldExpr(opt, node->kids[1]);
+            foldExpr(opt, node->kids[0]);
+            break;
+        case AST_IF:
+            foldExpr(opt, node->kids[0]);
+            foldBlock(opt, node->kids[1]);
+            if (node->kids[2] != AST_NONE)
+                foldBlock(opt, node->kids[2]);
+            if ((taken = constantCondition(opt, node->kids[0])) >= 0) {
+                AstRef branch = node->kids[taken ? 1 : 2];
+                toBlock(node, branch != AST_NONE ? opt->ast->nodes[branch].kids[0] : AST_NONE);
+                opt->branches++;
+            }
+            break;
+        case AST_WHILE:
+            foldExpr(opt, node->kids[0]);
+            foldBlock(opt, node->kids[1]);
+            if (constantCondition(opt, node->kids[0]) == 0) {
+                toBlock(node, AST_NONE);
+                opt->branches++;
+            }
+            break;
+        case AST_FOR:
+            foldStatement(opt, node->kids[0]);
+            foldExpr(opt, node->kids[1]);
+            foldStatement(opt, node->kids[2]);
+            foldBlock(opt, node->kids[3]);
+            if (constantCondition(opt, node->kids[1]) == 0) {
+                /* The first assignment still runs */
+                toBlock(node, node->kids[0]);
+                opt->branches++;
+            }
+            break;
+        case AST_BLOCK:
+            foldBlock(opt, ref);
+            break;
+    }
+}
+
+/* foldBlock - fold every statement of a block and drop those after a "çık" or "atla" */
+static void foldBlock(Optimizer *opt, AstRef block) {
+    AstRef ref, dead;
+
+    for (ref = opt->ast->nodes[block].kids[0]; ref != AST_NONE && !opt->failed; ref = opt->ast->nodes[ref].next) {
+        AstNode *node;
+
+        foldStatement(opt, ref);
+        node = &opt->ast->nodes[ref];
+        if (node->kind == AST_BREAK || node->kind == AST_CONTINUE) {
+            for (dead = node->next; dead != AST_NONE; dead = opt->ast->nodes[dead].next)
+                opt->unreachable++;
+            node->next = AST_NONE;
+        }
+    }
+}
+
+/************************************************************************************/
+/* cse */
+
+/* startRun - forget every expression of the previous run */
+static void startRun(Optimizer *opt) {
+    opt->gen++;
+    opt->entryCount = 0;
+    opt->ownerCount = 0;
+}
+
+/* addOwner - remember where a statement of the run is; returns its index in owners, or UINT32_MAX */
+static uint32_t addOwner(Optimizer *opt, AstRef ref) {
+    if (reserve(opt, (void **) &opt->owners, &opt->ownerCap, opt->ownerCount + 1, sizeof(AstRef)) != 0)
+        return UINT32_MAX;
+    opt->owners[opt->ownerCount] = ref;
+    return (uint32_t) opt->ownerCount++;
+}
+
+/* bucketOf - the bucket of a hash, emptied first if it was left over from an earlier run */
+static uint32_t *bucketOf(Optimizer *opt, uint32_t hash) {
+    uint32_t b = hash & opt->bucketMask;
+
+    if (opt->bucketGens[b] != opt->gen) {
+        opt->bucketGens[b] = opt->gen;
+        opt->buckets[b] = 0;
+    }
+    return &opt->buckets[b];
+}
+
+/* equal - whether the expression at a computes what the one at b does, reading no variable assigned by
+   statement since or later; a temporary on the a side is compared through its expression */
+static int equal(Optimizer *opt, AstRef a, AstRef b, uint32_t since) {
+    size_t depth = 0;
+
+    if (reserve(opt, (void **) &opt->pairs, &opt->pairCap, 1, sizeof(Pair)) != 0)
+        return 0;
+    opt->pairs[depth++] = (Pair) {a, b};
+    while (depth > 0) {
+        Pair p = opt->pairs[--depth];
+        const AstNode *x = &opt->ast->nodes[p.a], *y = &opt->ast->nodes[p.b];
+
+        if (x->kind == AST_NAME && isTemp(opt, x->kids[AST_VAR]) &&
+            !(y->kind == AST_NAME && y->kids[AST_VAR] == x->kids[AST_VAR]))
+            x = &opt->ast->nodes[opt->defs[x->kids[AST_VAR]]];
+        if (x->kind != y->kind || x->type != y->type || (x->kind != AST_NAME && x->op != y->op))
+            return 0;
+        if (reserve(opt, (void **) &opt->pairs, &opt->pairCap, depth + 2, sizeof(Pair)) != 0)
+            return 0;
+        switch (x->kind) {
+            case AST_NAME:
+                if (x->kids[AST_VAR] != y->kids[AST_VAR] ||
+                    (!isTemp(opt, x->kids[AST_VAR]) && opt->stamps[x->kids[AST_VAR]] >= since))
+                    return 0;
+                break;
+            case AST_CONST: case AST_INT: case AST_FLOAT:
+                if (astBits(x) != astBits(y))
+                    return 0;
+                break;
+            case AST_CHAR: case AST_STRING:
+                if (x->length != y->length || memcmp(opt->ctx->in.units + x->offset, opt->ctx->in.units + y->offset,
+                                                     x->length * sizeof(uint16_t)) != 0)
+                    return 0;
+                break;
+            case AST_BINARY:
+                opt->pairs[depth++] = (Pair) {x->kids[1], y->kids[1]};
+                opt->pairs[depth++] = (Pair) {x->kids[0], y->kids[0]};
+                break;
+            case AST_NOT:
+                opt->pairs[depth++] = (Pair) {x->kids[0], y->kids[0]};
+                break;
+            case AST_INDEX:
+                if (x->kids[AST_VAR] != y->kids[AST_VAR] || opt->stamps[x->kids[AST_VAR]] >= since)
+                    return 0;
+                opt->pairs[depth++] = (Pair) {x->kids[0], y->kids[0]};
+                break;
+        }
+    }
+    return 1;
+}
+
+/* findEntry - the entry of the run that computes what the expression at ref does, or UINT32_MAX */
+static uint32_t findEntry(Optimizer *opt, AstRef ref) {
+    uint32_t hash = opt->info[ref].hash, e;
+
+    if (opt->bucketMask == 0)
+        return UINT32_MAX;
+    for (e = *bucketOf(opt, hash); e != 0; e = opt->entries[e - 1].chain) {
+        const Entry *entry = &opt->entries[e - 1];
+        if (entry->hash == hash && equal(opt, entry->ref, ref, entry->since))
+            return e - 1;
+    }
+    return UINT32_MAX;
+}
+
+/* record - add the expression at ref, computed by the statement at owners[owner] numbered since, to the run */
+static void record(Optimizer *opt, AstRef ref, uint32_t owner, uint32_t since) {
+    uint32_t *bucket, i;
+
+    if (opt->bucketMask == 0 || (opt->entryCount + 1) * 2 > (size_t) opt->bucketMask + 1) {
+        /* Keep buckets at least twice the entries: start over with twice as many, all of them fresh */
+        uint32_t count = opt->bucketMask ? (opt->bucketMask + 1) * 2 : 256;
+        size_t cap = 0;
+        uint32_t *buckets = NULL, *gens = NULL;
+
+        if (reserve(opt, (void **) &buckets, &cap, count, sizeof(uint32_t)) != 0)
+            return;
+        cap = 0;
+        if (reserve(opt, (void **) &gens, &cap, count, sizeof(uint32_t)) != 0) {
+            free(buckets);
+            return;
+        }
+        memset(gens, 0, count * sizeof(uint32_t));
+        free(opt->buckets);
+        free(opt->bucketGens);
+        opt->buckets = buckets;
+        opt->bucketGens = gens;
+        opt->bucketMask = count - 1;
+        for (i = 0; i < opt->entryCount; i++) {
+            bucket = bucketOf(opt, opt->entries[i].hash);
+            opt->entries[i].chain = *bucket;
+            *bucket = i + 1;
+        }
+    }
+    if (reserve(opt, (void **) &opt->entries, &opt->entryCap, opt->entryCount + 1, sizeof(Entry)) != 0)
+        return;
+    bucket = bucketOf(opt, opt->info[ref].hash);
+    opt->entries[opt->entryCount] = (Entry) {opt->info[ref].hash, ref, owner, since, NO_TEMP, *bucket};
+    *bucket = (uint32_t) ++opt->entryCount;
+    opt->info[ref].entry = (uint32_t) opt->entryCount;
+}
+
+/* entryAt - the entry of the current run rooted at ref, or UINT32_MAX */
+static uint32_t entryAt(const Optimizer *opt, AstRef ref) {
+    uint32_t e = opt->info[ref].entry;
+
+    return e != 0 && e <= opt->entryCount && opt->entries[e - 1].ref == ref ? e - 1 : UINT32_MAX;
+}
+
+/* share - give entry e a temporary declared in front of the statement computing it, if it has none yet, and
+   make the expression at ref read it */
+static void share(Optimizer *opt, uint32_t e, AstRef ref) {
+    if (opt->entries[e].temp == NO_TEMP) {
+        AstRef def = newNode(opt), at, moved;
+        uint32_t temp, slot;
+        size_t count, i;
+
+        if (def == AST_NONE || (temp = newTemp(opt, def)) == NO_TEMP)
+            return;
+        /* The expression moves to def, which the declaration holds; where it was, the temporary is read */
+        opt->ast->nodes[def] = opt->ast->nodes[opt->entries[e].ref];
+        at = opt->owners[opt->entries[e].owner];
+        if ((moved = declareBefore(opt, at, temp, def)) == AST_NONE) {
+            opt->variables--;
+            return;
+        }
+        toName(&opt->ast->nodes[opt->entries[e].ref], temp);
+        opt->info[def] = opt->info[opt->entries[e].ref];
+        opt->owners[opt->entries[e].owner] = moved;
+        opt->entries[e].ref = def;
+        opt->entries[e].temp = temp;
+        opt->temps++;
+        if ((slot = addOwner(opt, at)) == UINT32_MAX)
+            return;
+        /* Entries inside the expression are now computed by the declaration, so a temporary for one of them
+           has to come before it */
+        count = collect(opt, def);
+        for (i = 1; i < count; i++) {
+            uint32_t inner = entryAt(opt, opt->list[i]);
+            if (inner != UINT32_MAX)
+                opt->entries[inner].owner = slot;
+        }
+    }
+    toName(&opt->ast->nodes[ref], opt->entries[e].temp);
+    opt->reused++;
+}
+
+/* cseStatement - share the expressions of a declaration or assignment with those before it in the run;
+   returns where the statement ended up */
+static AstRef cseStatement(Optimizer *opt, AstRef ref) {
+    uint32_t owner = addOwner(opt, ref), since = ++opt->statements;
+    AstRef root = opt->ast->nodes[ref].kids[0];
+    size_t depth = 0, count;
+
+    if (owner == UINT32_MAX)
+        return ref;
+    if (root != AST_NONE && (count = collect(opt, root)) > 0 &&
+        reserve(opt, (void **) &opt->visits, &opt->visitCap, 1, sizeof(Visit)) == 0) {
+        measure(opt, count);
+        /* Top down, so the largest shared expression is found first */
+        opt->visits[depth++] = (Visit) {root, 0};
+        while (depth > 0 && !opt->failed) {
+            Visit v = opt->visits[--depth];
+            const AstNode *node = &opt->ast->nodes[v.ref];
+            const NodeInfo *info = &opt->info[v.ref];
+
+            if (node->kind != AST_BINARY && node->kind != AST_NOT)
+                continue;
+            if (info->operators >= CSE_MIN_OPERATORS && (info->flags & NODE_SAFE)) {
+                uint32_t e = findEntry(opt, v.ref);
+                if (e != UINT32_MAX) {
+                    share(opt, e, v.ref);
+                    continue;
+                }
+                /* An expression under "&&" or "||" may not run, so nothing may rely on it having run */
+                if (!v.conditional)
+                    record(opt, v.ref, owner, since);
+            }
+            if (reserve(opt, (void **) &opt->visits, &opt->visitCap, depth + 2, sizeof(Visit)) != 0)
+                break;
+            node = &opt->ast->nodes[v.ref];
+            if (node->kind == AST_BINARY) {
+                opt->visits[depth++] = (Visit) {node->kids[1], v.conditional || node->op == AND_OP || node->op == OR_OP};
+                opt->visits[depth++] = (Visit) {node->kids[0], v.conditional};
+            } else {
+                opt->visits[depth++] = (Visit) {node->kids[0], v.conditional};
+            }
+        }
+    }
+    ref = opt->owners[owner];
+    opt->stamps[opt->ast->nodes[ref].kids[AST_VAR]] = since;
+    return ref;
+}
+
+/* cseBlock - look for common subexpressions in every run of declarations and assignments of a block */
+static void cseBlock(Optimizer *opt, AstRef block) {
+    AstRef ref = opt->ast->nodes[block].kids[0];
+    int inRun = 0;
+
+    while (ref != AST_NONE && !opt->failed) {
+        const AstNode *node = &opt->ast->nodes[ref];
+
+        switch (node->kind) {
+            case AST_DECL: case AST_ASSIGN:
+                if (!inRun) {
+                    startRun(opt);
+                    inRun = 1;
+                }
+                ref = cseStatement(opt, ref);
+                break;
+            case AST_IF:
+                inRun = 0;
+                cseBlock(opt, node->kids[1]);
+                if (opt->ast->nodes[ref].kids[2] != AST_NONE)
+                    cseBlock(opt, opt->ast->nodes[ref].kids[2]);
+                break;
+            case AST_WHILE:
+                inRun = 0;
+                cseBlock(opt, node->kids[1]);
+                break;
+            case AST_FOR:
+                inRun = 0;
+                cseBlock(opt, node->kids[3]);
+                break;
+            case AST_BLOCK:
+                inRun = 0;
+                cseBlock(opt, ref);
+                break;
+            default:
+                inRun = 0;
+                break;
+        }
+        ref = opt->ast->nodes[ref].next;
+    }
+}
+
+/************************************************************************************/
+/* licm */
+
+/* isTempDecl - whether the statement at ref declares a temporary of the passes */
+static int isTempDecl(const Optimizer *opt, AstRef ref) {
+    const AstNode *node = &opt->ast->nodes[ref];
+    return node->kind == AST_DECL && node->length == 0 && isTemp(opt, node->kids[AST_VAR]);
+}
+
+static void markBlock(Optimizer *opt, AstRef block, int skipTemps);
+
+/* markStatement - stamp every variable the statement at ref assigns or declares with opt->loop */
+static void markStatement(Optimizer *opt, AstRef ref) {
+    const AstNode *node = &opt->ast->nodes[ref];
+
+    switch (node->kind) {
+        case AST_DECL: case AST_ASSIGN:
+            opt->stamps[node->kids[AST_VAR]] = opt->loop;
+            break;
+        case AST_IF:
+            markBlock(opt, node->kids[1], 0);
+            if (node->kids[2] != AST_NONE)
+                markBlock(opt, node->kids[2], 0);
+            break;
+        case AST_WHILE:
+            markBlock(opt, node->kids[1], 0);
+            break;
+        case AST_FOR:
+            markStatement(opt, node->kids[0]);
+            markStatement(opt, node->kids[2]);
+            markBlock(opt, node->kids[3], 0);
+            break;
+        case AST_BLOCK:
+            markBlock(opt, ref, 0);
+            break;
+    }
+}
+
+/* markBlock - markStatement for every statement of a block, but the temporaries it declares itself if
+   skipTemps, which the loop decides about one at a time */
+static void markBlock(Optimizer *opt, AstRef block, int skipTemps) {
+    AstRef ref;
+
+    for (ref = opt->ast->nodes[block].kids[0]; ref != AST_NONE; ref = opt->ast->nodes[ref].next)
+        if (!skipTemps || !isTempDecl(opt, ref))
+            markStatement(opt, ref);
+}
+
+/* hoistExpr - declare every largest part of the expression under root that the loop at *loop does not change
+   in front of the loop, and read it from there; leaves are not worth it */
+static void hoistExpr(Optimizer *opt, AstRef root, AstRef *loop) {
+    size_t depth = 0, count = collect(opt, root);
+
+    if (count == 0 || reserve(opt, (void **) &opt->visits, &opt->visitCap, 1, sizeof(Visit)) != 0)
+        return;
+    measure(opt, count);
+    opt->visits[depth++] = (Visit) {root, 0};
+    while (depth > 0 && !opt->failed) {
+        AstRef ref = opt->visits[--depth].ref;
+        const AstNode *node = &opt->ast->nodes[ref];
+
+        if (node->kind != AST_BINARY && node->kind != AST_NOT)
+            continue;
+        if ((opt->info[ref].flags & (NODE_SAFE | NODE_FIXED)) == (NODE_SAFE | NODE_FIXED)) {
+            AstRef def = newNode(opt), moved;
+            uint32_t temp;
+
+            if (def == AST_NONE || (temp = newTemp(opt, def)) == NO_TEMP)
+                return;
+            opt->ast->nodes[def] = opt->ast->nodes[ref];
+            if ((moved = declareBefore(opt, *loop, temp, def)) == AST_NONE) {
+                opt->variables--;
+                return;
+            }
+            toName(&opt->ast->nodes[ref], temp);
+            *loop = moved;
+            opt->hoisted++;
+            continue;
+        }
+        if (reserve(opt, (void **) &opt->visits, &opt->visitCap, depth + 2, sizeof(Visit)) != 0)
+            return;
+        node = &opt->ast->nodes[ref];
+        opt->visits[depth++] = (Visit) {node->kids[0], 0};
+        if (node->kind == AST_BINARY)
+            opt->visits[depth++] = (Visit) {node->kids[1], 0};
+    }
+}
+
+static void hoistBlock(Optimizer *opt, AstRef block, AstRef *loop);
+
+/* hoistStatement - hoistExpr for every expression of the statement at ref, nested statements included */
+static void hoistStatement(Optimizer *opt, AstRef ref, AstRef *loop) {
+    const AstNode *node = &opt->ast->nodes[ref];
+    AstRef kids[4];
+
+    memcpy(kids, node->kids, sizeof(kids));
+    switch (node->kind) {
+        case AST_DECL:
+            if (kids[0] != AST_NONE)
+                hoistExpr(opt, kids[0], loop);
+            break;
+        case AST_ASSIGN:
+            if (kids[1] != AST_NONE)
+                hoistExpr(opt, kids[1], loop);
+            hoistExpr(opt, kids[0], loop);
+            break;
+        case AST_IF:
+            hoistExpr(opt, kids[0], loop);
+            hoistBlock(opt, kids[1], loop);
+            if (kids[2] != AST_NONE)
+                hoistBlock(opt, kids[2], loop);
+            break;
+        case AST_WHILE:
+            hoistExpr(opt, kids[0], loop);
+            hoistBlock(opt, kids[1], loop);
+            break;
+        case AST_FOR:
+            hoistStatement(opt, kids[0], loop);
+            hoistExpr(opt, kids[1], loop);
+            hoistStatement(opt, kids[2], loop);
+            hoistBlock(opt, kids[3], loop);
+            break;
+        case AST_BLOCK:
+            hoistBlock(opt, ref, loop);
+            break;
+    }
+}
+
+/* hoistBlock - hoistStatement for every statement of a block */
+static void hoistBlock(Optimizer *opt, AstRef block, AstRef *loop) {
+    AstRef ref;
+
+    for (ref = opt->ast->nodes[block].kids[0]; ref != AST_NONE && !opt->failed; ref = opt->ast->nodes[ref].next)
+        hoistStatement(opt, ref, loop);
+}
+
+/* licmLoop - move what the loop at ref does not change in front of it: first the temporaries its body
+   declares from such values (those of inner loops and of common subexpressions), then every other such
+   expression; returns where the loop ended up */
+static AstRef licmLoop(Optimizer *opt, AstRef ref) {
+    const AstNode *node = &opt->ast->nodes[ref];
+    AstRef body = node->kind == AST_WHILE ? node->kids[1] : node->kids[3], prev = AST_NONE, stmt, next;
+    uint32_t before = opt->hoisted;
+
+    opt->loop++;
+    if (node->kind == AST_FOR) {
+        /* The first assignment runs after anything put in front of the loop */
+        markStatement(opt, node->kids[0]);
+        markStatement(opt, node->kids[2]);
+    }
+    markBlock(opt, body, 1);
+    for (stmt = opt->ast->nodes[body].kids[0]; stmt != AST_NONE && !opt->failed; stmt = next) {
+        const AstNode *decl = &opt->ast->nodes[stmt];
+        size_t count;
+
+        next = decl->next;
+        if (!isTempDecl(opt, stmt)) {
+            prev = stmt;
+            continue;
+        }
+        count = collect(opt, decl->kids[0]);
+        if (count > 0)
+            measure(opt, count);
+        if (count == 0 || (opt->info[decl->kids[0]].flags & (NODE_SAFE | NODE_FIXED)) != (NODE_SAFE | NODE_FIXED)) {
+            /* It stays, and so what reads it changes in the loop */
+            opt->stamps[decl->kids[AST_VAR]] = opt->loop;
+            prev = stmt;
+            continue;
+        }
+        {
+            /* Unlink it and put it in front of the loop, which moves to a new node */
+            AstRef moved = newNode(opt);
+            if (moved == AST_NONE)
+                break;
+            if (prev == AST_NONE)
+                opt->ast->nodes[body].kids[0] = next;
+            else
+                opt->ast->nodes[prev].next = next;
+            opt->ast->nodes[moved] = opt->ast->nodes[ref];
+            opt->ast->nodes[ref] = opt->ast->nodes[stmt];
+            opt->ast->nodes[ref].next = moved;
+            ref = moved;
+            opt->hoisted++;
+        }
+    }
+
+    node = &opt->ast->nodes[ref];
+    if (node->kind == AST_WHILE) {
+        AstRef cond = node->kids[0];
+        hoistExpr(opt, cond, &ref);
+        hoistBlock(opt, opt->ast->nodes[ref].kids[1], &ref);
+    } else {
+        AstRef cond = node->kids[1], step = node->kids[2];
+        hoistExpr(opt, cond, &ref);
+        hoistStatement(opt, step, &ref);
+        hoistBlock(opt, opt->ast->nodes[ref].kids[3], &ref);
+    }
+    if (opt->hoisted > before)
+        opt->loops++;
+    return ref;
+}
+
+/* licmBlock - licmLoop for every loop in a block, inner loops before the loops around them */
+static void licmBlock(Optimizer *opt, AstRef block) {
+    AstRef ref;
+
+    for (ref = opt->ast->nodes[block].kids[0]; ref != AST_NONE && !opt->failed; ref = opt->ast->nodes[ref].next) {
+        const AstNode *node = &opt->ast->nodes[ref];
+
+        switch (node->kind) {
+            case AST_IF:
+                licmBlock(opt, node->kids[1]);
+                if (opt->ast->nodes[ref].kids[2] != AST_NONE)
+                    licmBlock(opt, opt->ast->nodes[ref].kids[2]);
+                break;
+            case AST_WHILE:
+                licmBlock(opt, node->kids[1]);
+                ref = licmLoop(opt, ref);
+                break;
+            case AST_FOR:
+                licmBlock(opt, node->kids[3]);
+                ref = licmLoop(opt, ref);
+                break;
+            case AST_BLOCK:
+                licmBlock(opt, ref);
+                break;
+        }
+    }
+}
+
+/************************************************************************************/
+
+/* optimizeProgram - a function to run the passes over the checked program in ctx->ast, writing what each one
+   did to ctx->out if report is set */
+void optimizeProgram(Context *ctx, int report) {
+    Optimizer opt;
+    char line[160];
+
+    memset(&opt, 0, sizeof(opt));
+    opt.ctx = ctx;
+    opt.ast = &ctx->ast;
+    opt.first = opt.variables = ctx->variables;
+    if (coverNodes(&opt) == 0 && coverVariables(&opt, (size_t) opt.variables + 1) == 0)
+        foldBlock(&opt, ctx->root);
+    if (!opt.failed)
+        cseBlock(&opt, ctx->root);
+    if (!opt.failed) {
+        memset(opt.stamps, 0, opt.variables * sizeof(uint32_t));
+        licmBlock(&opt, ctx->root);
+    }
+
+    if (report) {
+        snprintf(line, sizeof(line), "Pass fold: %u expressions folded to constants", opt.folded);
+        sinkMessage(ctx->out, line);
+        snprintf(line, sizeof(line), "Pass dead: %u branches and %u unreachable statements removed", opt.branches,
+                 opt.unreachable);
+        sinkMessage(ctx->out, line);
+        snprintf(line, sizeof(line), "Pass cse: %u repeated expressions read from %u temporaries", opt.reused,
+                 opt.temps);
+        sinkMessage(ctx->out, line);
+        snprintf(line, sizeof(line), "Pass licm: %u expressions hoisted out of %u loops", opt.hoisted, opt.loops);
+        sinkMessage(ctx->out, line);
+        if (opt.failed)
+            sinkMessage(ctx->out, "Passes stopped early: not enough memory.");
+    }
+    free(opt.info);
+    free(opt.stamps);
+    free(opt.defs);
+    free(opt.list);
+    free(opt.walk);
+    free(opt.visits);
+    free(opt.pairs);
+    free(opt.entries);
+    free(opt.buckets);
+    free(opt.bucketGens);
+    free(opt.owners);
+}
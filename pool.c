@@ -0,0 +1,148 @@
+/* pool.c - a work-stealing thread pool: each worker owns a deque of job indices and steals from the others when it runs dry */
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+/* The jobs a worker still owns: the owner takes from head, thieves take from tail */
+typedef struct {
+    pthread_mutex_t lock;
+    size_t head;
+    size_t tail;
+} Deque;
+
+typedef struct {
+    Pool *pool;
+    int id;
+} Worker;
+
+struct Pool {
+    PoolTask task;
+    void *arg;
+    int threads;        /* workers actually running */
+    int dequeCount;     /* one deque per requested worker */
+    Deque *deques;
+    Worker *workers;
+    pthread_t *handles;
+};
+
+/* takeOwn - pop the oldest job of the worker's own deque, so each worker walks its range in input order */
+static int takeOwn(Deque *dq, size_t *index) {
+    int found = 0;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->head < dq->tail) {
+        *index = dq->head++;
+        found = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+/* steal - move the newer half of a victim's jobs into the thief's empty deque */
+static int steal(Pool *pool, int thief) {
+    int i;
+    for (i = 1; i < pool->dequeCount; i++) {
+        Deque *victim = &pool->deques[(thief + i) % pool->dequeCount];
+        size_t head = 0, tail = 0;
+
+        pthread_mutex_lock(&victim->lock);
+        if (victim->head < victim->tail) {
+            tail = victim->tail;
+            head = victim->head + (victim->tail - victim->head) / 2;
+            victim->tail = head;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (head < tail) {
+            Deque *own = &pool->deques[thief];
+            pthread_mutex_lock(&own->lock);
+            own->head = head;
+            own->tail = tail;
+            pthread_mutex_unlock(&own->lock);
+            return 1;
+        }
+    }
+    /* Jobs are never created while running, so once every deque is empty the worker is done */
+    return 0;
+}
+
+/* workerMain - run own jobs, steal when out of them, stop when nothing is left anywhere */
+static void *workerMain(void *arg) {
+    Worker *self = arg;
+    Pool *pool = self->pool;
+    size_t index;
+
+    do {
+        while (takeOwn(&pool->deques[self->id], &index))
+            pool->task(pool->arg, index, self->id);
+    } while (steal(pool, self->id));
+    return NULL;
+}
+
+Pool *poolStart(size_t jobCount, int threads, PoolTask task, void *arg) {
+    Pool *pool;
+    int i;
+
+    if (threads < 1)
+        threads = 1;
+    if ((pool = calloc(1, sizeof(*pool))) == NULL)
+        return NULL;
+    pool->task = task;
+    pool->arg = arg;
+    pool->threads = threads;
+    pool->dequeCount = threads;
+    pool->deques = calloc((size_t) threads, sizeof(*pool->deques));
+    pool->workers = calloc((size_t) threads, sizeof(*pool->workers));
+    pool->handles = calloc((size_t) threads, sizeof(*pool->handles));
+    if (pool->deques == NULL || pool->workers == NULL || pool->handles == NULL) {
+        free(pool->deques);
+        free(pool->workers);
+        free(pool->handles);
+        free(pool);
+        return NULL;
+    }
+
+    /* Every worker starts with one contiguous block of the jobs */
+    for (i = 0; i < threads; i++) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool->deques[i].head = jobCount * (size_t) i / (size_t) threads;
+        pool->deques[i].tail = jobCount * (size_t) (i + 1) / (size_t) threads;
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i;
+    }
+    for (i = 0; i < threads; i++) {
+        if (pthread_create(&pool->handles[i], NULL, workerMain, &pool->workers[i]) != 0) {
+            /* The workers already running steal the jobs of the ones that never started */
+            pool->threads = i;
+            break;
+        }
+    }
+    if (pool->threads == 0) {
+        for (i = 0; i < threads; i++)
+            pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques);
+        free(pool->workers);
+        free(pool->handles);
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void poolJoin(Pool *pool) {
+    int i;
+    for (i = 0; i < pool->threads; i++)
+        pthread_join(pool->handles[i], NULL);
+    for (i = 0; i < pool->dequeCount; i++)
+        pthread_mutex_destroy(&pool->deques[i].lock);
+    free(pool->deques);
+    free(pool->workers);
+    free(pool->handles);
+    free(pool);
+}
+
+int poolDefaultThreads() {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int) n : 1;
+}
@@ -0,0 +1,21 @@
+/* pool.h - a work-stealing thread pool over a fixed range of job indices */
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+/* A job body: runs job number index on worker number worker */
+typedef void (*PoolTask)(void *arg, size_t index, int worker);
+
+typedef struct Pool Pool;
+
+/* poolStart - start threads workers over jobs 0 .. jobCount-1; returns NULL if the threads cannot be created */
+Pool *poolStart(size_t jobCount, int threads, PoolTask task, void *arg);
+
+/* poolJoin - wait until every job has run, then release the pool */
+void poolJoin(Pool *pool);
+
+/* poolDefaultThreads - the number of online processors, at least 1 */
+int poolDefaultThreads();
+
+#endif
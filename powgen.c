@@ -0,0 +1,111 @@
+/* powgen.c - build-time generator of powers.h, the powers of ten behind literalDouble() (literal.c)
+ *
+ * Every power of ten from 10^LITERAL_POWER_MIN to 10^LITERAL_POWER_MAX gets its first 128 bits, the highest
+ * one set and the rest rounded down, as two 64-bit words. They are worked out with a plain big integer:
+ * a power of ten itself for the positive exponents, 2^n / 10^k divided out one 10 at a time for the others.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "literal.h"
+
+/* Enough 32-bit limbs for 2^n / 10^k with 128 bits of quotient, and for 10^LITERAL_POWER_MAX */
+#define LIMBS 96
+
+typedef struct {
+    uint32_t limb[LIMBS];   /* least significant first */
+    int count;              /* limbs in use; the top one is not zero */
+} Big;
+
+static void bigMulSmall(Big *b, uint32_t m) {
+    uint64_t carry = 0;
+    int i;
+
+    for (i = 0; i < b->count; i++) {
+        carry += (uint64_t) b->limb[i] * m;
+        b->limb[i] = (uint32_t) carry;
+        carry >>= 32;
+    }
+    if (carry != 0)
+        b->limb[b->count++] = (uint32_t) carry;
+}
+
+static void bigDivSmall(Big *b, uint32_t d) {
+    uint64_t rest = 0;
+    int i;
+
+    for (i = b->count - 1; i >= 0; i--) {
+        rest = rest << 32 | b->limb[i];
+        b->limb[i] = (uint32_t) (rest / d);
+        rest %= d;
+    }
+    while (b->count > 0 && b->limb[b->count - 1] == 0)
+        b->count--;
+}
+
+static int bigBits(const Big *b) {
+    int bits = (b->count - 1) * 32;
+    uint32_t top = b->limb[b->count - 1];
+
+    while (top != 0) {
+        bits++;
+        top >>= 1;
+    }
+    return bits;
+}
+
+/* bigBit - bit i of b, 0 below the lowest */
+static unsigned bigBit(const Big *b, int i) {
+    return i < 0 || i / 32 >= b->count ? 0 : b->limb[i / 32] >> (i % 32) & 1;
+}
+
+/* top128 - the first 128 bits of b, rounded down */
+static void top128(const Big *b, uint64_t *hi, uint64_t *lo) {
+    int bits = bigBits(b), i;
+
+    *hi = *lo = 0;
+    for (i = 0; i < 128; i++) {
+        unsigned bit = bigBit(b, bits - 1 - i);
+        if (i < 64)
+            *hi |= (uint64_t) bit << (63 - i);
+        else
+            *lo |= (uint64_t) bit << (127 - i);
+    }
+}
+
+int main(int argc, char **argv) {
+    Big b;
+    int e, k;
+
+    if (argc > 1 && freopen(argv[1], "w", stdout) == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    printf("/* powers.h - generated by powgen; do not edit */\n");
+    printf("#ifndef POWERS_H\n#define POWERS_H\n\n#include <stdint.h>\n\n");
+    printf("/* The first 128 bits of 10^e, high word first, for e from LITERAL_POWER_MIN to LITERAL_POWER_MAX */\n");
+    printf("static const uint64_t powersOfTen[%d][2] = {\n", LITERAL_POWER_MAX - LITERAL_POWER_MIN + 1);
+    for (e = LITERAL_POWER_MIN; e <= LITERAL_POWER_MAX; e++) {
+        uint64_t hi, lo;
+
+        memset(&b, 0, sizeof(b));
+        b.count = 1;
+        if (e >= 0) {
+            b.limb[0] = 1;
+            for (k = 0; k < e; k++)
+                bigMulSmall(&b, 10);
+        } else {
+            /* 2^(32 * LIMBS - 32) leaves over 128 bits once divided by 10^-LITERAL_POWER_MIN */
+            b.count = LIMBS;
+            b.limb[LIMBS - 1] = 1;
+            for (k = 0; k < -e; k++)
+                bigDivSmall(&b, 10);
+        }
+        top128(&b, &hi, &lo);
+        printf("    {0x%016llXu, 0x%016llXu}, /* 1e%d */\n", (unsigned long long) hi, (unsigned long long) lo, e);
+    }
+    printf("};\n\n#endif\n");
+    return fclose(stdout) == 0 ? 0 : 1;
+}
@@ -0,0 +1,314 @@
+/* profile.c - where a run spends its time (-P): a table of the instructions run, the time by source line and
+ * how each loop and madem went, written to the sink, and the same time as folded stacks next to the source
+ *
+ * Counts come from vmProfile and are exact. Time is sampled: every so many instructions vmProfile charges the
+ * time since its last sample to the instruction running, so what runs rarely may show no time at all. An
+ * instruction belongs to the last statement, loop condition or sayaç step whose code starts at or before it
+ * (Bytecode.statements), and to every madem and loop whose code holds it (Bytecode.regions). A line of the
+ * folded file is the regions around a source line, outermost first, then the nanoseconds sampled there, which
+ * is what flame graph tools read:
+ *   program;sayaç line 3;madem line 5;line 6 120000
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "front.h"
+#include "vm.h"
+
+/* Extension of the folded stacks written next to each source, in place of the source's own */
+#define PROFILE_EXTENSION ".folded"
+
+/* Source lines in the time table, the busiest first */
+#define PROFILE_TOP_LINES 20
+
+/* Bytes of operand after each opcode */
+static const uint8_t operandBytes[OPCODE_COUNT] = {
+#define OPCODE(name, operandBytes, stackEffect) [name] = operandBytes,
+#include "opcodes.def"
+#undef OPCODE
+};
+
+/* Name of each opcode, without its OP_ */
+static const char *const opcodeNames[OPCODE_COUNT] = {
+#define OPCODE(name, operandBytes, stackEffect) [name] = #name + 3,
+#include "opcodes.def"
+#undef OPCODE
+};
+
+/* Keyword of each kind of region */
+static const char *const regionKeywords[AST_FOR + 1] = {
+    [AST_IF] = "madem", [AST_WHILE] = "iken", [AST_FOR] = "sayaç",
+};
+
+/* Counts and time of one opcode, source line or region */
+typedef struct {
+    uint32_t key;
+    uint64_t count;
+    uint64_t nanoseconds;
+} Tally;
+
+typedef struct {
+    Context *ctx;
+    const Bytecode *bc;
+    const Profile *profile;
+    LineTable lines;        /* where each source line starts */
+} Profiler;
+
+/* byTime - qsort order of tallies: most time first, then most runs */
+static int byTime(const void *a, const void *b) {
+    const Tally *x = a, *y = b;
+
+    if (x->nanoseconds != y->nanoseconds)
+        return x->nanoseconds < y->nanoseconds ? 1 : -1;
+    if (x->count != y->count)
+        return x->count < y->count ? 1 : -1;
+    return x->key < y->key ? -1 : x->key > y->key;
+}
+
+/* byCount - qsort order of tallies: most runs first */
+static int byCount(const void *a, const void *b) {
+    const Tally *x = a, *y = b;
+
+    if (x->count != y->count)
+        return x->count < y->count ? 1 : -1;
+    return byTime(a, b);
+}
+
+/* nextInstruction - offset of the instruction after the one at at */
+static uint32_t nextInstruction(const Bytecode *bc, uint32_t at) {
+    return at + 1 + operandBytes[bc->code[at]];
+}
+
+/* statementLine - the line of the statement the instruction at at belongs to, moving *statement, which starts
+   at 0, along the statements of bc as at grows; 0 before the first */
+static uint32_t statementLine(const Profiler *pr, uint32_t *statement, uint32_t at) {
+    const Bytecode *bc = pr->bc;
+
+    while (*statement < bc->statementCount && bc->statements[*statement].code <= at)
+        ++*statement;
+    return *statement > 0 ? lineOf(&pr->lines, bc->statements[*statement - 1].source) : 0;
+}
+
+/* milliseconds - nanoseconds as milliseconds, for the tables */
+static double milliseconds(uint64_t nanoseconds) {
+    return (double) nanoseconds / 1e6;
+}
+
+/* share - part of whole as a percentage */
+static double share(uint64_t part, uint64_t whole) {
+    return whole > 0 ? 100.0 * (double) part / (double) whole : 0.0;
+}
+
+/* padding - spaces that fill the UTF-8 text out to width characters, as %-*s would if it counted characters
+   rather than bytes */
+static int padding(const char *text, int width) {
+    for (; *text != '\0'; text++)
+        width -= (*text & 0xC0) != 0x80;
+    return width > 0 ? width : 0;
+}
+
+/* reportOpcodes - every opcode that ran, the most run first; returns the instructions run in all */
+static uint64_t reportOpcodes(const Profiler *pr) {
+    const Bytecode *bc = pr->bc;
+    Tally tallies[OPCODE_COUNT];
+    uint64_t total = 0;
+    char line[160];
+    uint32_t at;
+    int op;
+
+    memset(tallies, 0, sizeof(tallies));
+    for (op = 0; op < OPCODE_COUNT; op++)
+        tallies[op].key = (uint32_t) op;
+    for (at = 0; at < bc->codeLen; at = nextInstruction(bc, at)) {
+        tallies[bc->code[at]].count += pr->profile->counts[at];
+        tallies[bc->code[at]].nanoseconds += pr->profile->nanoseconds[at];
+        total += pr->profile->counts[at];
+    }
+    qsort(tallies, OPCODE_COUNT, sizeof(Tally), byCount);
+
+    snprintf(line, sizeof(line), "Profile: %" PRIu64 " instructions in %.3f ms", total,
+             milliseconds(pr->profile->elapsed));
+    sinkMessage(pr->ctx->out, line);
+    snprintf(line, sizeof(line), "  %-16s %14s %7s %12s", "instruction", "runs", "share", "ms");
+    sinkMessage(pr->ctx->out, line);
+    for (op = 0; op < OPCODE_COUNT && tallies[op].count > 0; op++) {
+        snprintf(line, sizeof(line), "  %-16s %14" PRIu64 " %6.1f%% %12.3f", opcodeNames[tallies[op].key],
+                 tallies[op].count, share(tallies[op].count, total), milliseconds(tallies[op].nanoseconds));
+        sinkMessage(pr->ctx->out, line);
+    }
+    return total;
+}
+
+/* reportLines - the source lines that took the most time; returns -1 when memory runs out */
+static int reportLines(const Profiler *pr, uint64_t total) {
+    const Bytecode *bc = pr->bc;
+    Tally *tallies;
+    uint32_t at, i, statement = 0;
+    uint64_t sampled = 0;
+    char line[160];
+
+    if ((tallies = calloc((size_t) pr->lines.count + 1, sizeof(Tally))) == NULL)
+        return -1;
+    for (i = 0; i <= pr->lines.count; i++)
+        tallies[i].key = i;
+    for (at = 0; at < bc->codeLen; at = nextInstruction(bc, at)) {
+        Tally *tally = &tallies[statementLine(pr, &statement, at)];
+        tally->count += pr->profile->counts[at];
+        tally->nanoseconds += pr->profile->nanoseconds[at];
+        sampled += pr->profile->nanoseconds[at];
+    }
+    qsort(tallies, (size_t) pr->lines.count + 1, sizeof(Tally), byTime);
+
+    snprintf(line, sizeof(line), "  %-16s %14s %7s %12s %7s", "line", "instructions", "share", "ms", "time");
+    sinkMessage(pr->ctx->out, line);
+    for (i = 0; i < PROFILE_TOP_LINES && i <= pr->lines.count && tallies[i].count > 0; i++) {
+        snprintf(line, sizeof(line), "  %-16" PRIu32 " %14" PRIu64 " %6.1f%% %12.3f %6.1f%%", tallies[i].key,
+                 tallies[i].count, share(tallies[i].count, total), milliseconds(tallies[i].nanoseconds),
+                 share(tallies[i].nanoseconds, sampled));
+        sinkMessage(pr->ctx->out, line);
+    }
+    free(tallies);
+    return 0;
+}
+
+/* reportRegions - how often each loop went round and each madem ran its then-block, the slowest first;
+   returns -1 when memory runs out */
+static int reportRegions(const Profiler *pr) {
+    const Bytecode *bc = pr->bc;
+    const Profile *profile = pr->profile;
+    uint64_t *before;
+    Tally *tallies;
+    uint32_t at, i;
+    char line[160];
+
+    if (bc->regionCount == 0)
+        return 0;
+    /* Time sampled before each offset, so that a region's is one subtraction */
+    if ((before = malloc(((size_t) bc->codeLen + 1) * sizeof(*before))) == NULL)
+        return -1;
+    if ((tallies = malloc(bc->regionCount * sizeof(Tally))) == NULL) {
+        free(before);
+        return -1;
+    }
+    before[0] = 0;
+    for (at = 0; at < bc->codeLen; at++)
+        before[at + 1] = before[at] + profile->nanoseconds[at];
+    for (i = 0; i < bc->regionCount; i++) {
+        const Region *region = &bc->regions[i];
+        tallies[i].key = i;
+        tallies[i].count = profile->counts[region->branch];
+        tallies[i].nanoseconds = before[region->end] - before[region->start];
+    }
+    qsort(tallies, bc->regionCount, sizeof(Tally), byTime);
+
+    /* A loop's jump back is taken when it goes round again; a madem's jump past its then-block when the
+       condition does not hold */
+    snprintf(line, sizeof(line), "  %-16s %14s %14s %14s %7s %12s", "loop or madem", "decisions", "taken",
+             "not taken", "taken", "ms");
+    sinkMessage(pr->ctx->out, line);
+    for (i = 0; i < bc->regionCount && tallies[i].count > 0; i++) {
+        const Region *region = &bc->regions[tallies[i].key];
+        uint64_t jumped = profile->taken[region->branch];
+        uint64_t taken = region->kind == AST_IF ? tallies[i].count - jumped : jumped;
+        char name[32];
+
+        snprintf(name, sizeof(name), "%s line %" PRIu32, regionKeywords[region->kind], lineOf(&pr->lines, region->source));
+        snprintf(line, sizeof(line), "  %s%*s %14" PRIu64 " %14" PRIu64 " %14" PRIu64 " %6.1f%% %12.3f", name,
+                 padding(name, 16), "", tallies[i].count, taken, tallies[i].count - taken, share(taken, tallies[i].count),
+                 milliseconds(tallies[i].nanoseconds));
+        sinkMessage(pr->ctx->out, line);
+    }
+    free(tallies);
+    free(before);
+    return 0;
+}
+
+/* writeStack - one line of the folded file: the regions open around line, and the time sampled there */
+static void writeStack(const Profiler *pr, FILE *fp, const uint32_t *open, uint32_t depth, uint32_t line,
+                       uint64_t nanoseconds) {
+    uint32_t i;
+
+    if (nanoseconds == 0)
+        return;
+    fputs("program", fp);
+    for (i = 0; i < depth; i++) {
+        const Region *region = &pr->bc->regions[open[i]];
+        fprintf(fp, ";%s line %" PRIu32, regionKeywords[region->kind], lineOf(&pr->lines, region->source));
+    }
+    fprintf(fp, ";line %" PRIu32 " %" PRIu64 "\n", line, nanoseconds);
+}
+
+/* writeFolded - the time of the run as folded stacks in the file at path; returns -1 if it cannot be
+   written */
+static int writeFolded(const Profiler *pr, const char *path) {
+    const Bytecode *bc = pr->bc;
+    uint32_t *open, depth = 0, next = 0, statement = 0, at, line = 0;
+    uint64_t nanoseconds = 0;
+    FILE *fp;
+    int status;
+
+    if ((open = malloc(((size_t) bc->regionCount + 1) * sizeof(*open))) == NULL)
+        return -1;
+    if ((fp = fopen(path, "w")) == NULL) {
+        free(open);
+        return -1;
+    }
+    /* Regions come outer ones first and nest, so the ones around an instruction are a stack swept along
+       the code; consecutive instructions under the same stack and line make one line of the file */
+    for (at = 0; at < bc->codeLen; at = nextInstruction(bc, at)) {
+        uint32_t current = statementLine(pr, &statement, at);
+        if (current != line || (depth > 0 && bc->regions[open[depth - 1]].end <= at) ||
+            (next < bc->regionCount && bc->regions[next].start <= at)) {
+            writeStack(pr, fp, open, depth, line, nanoseconds);
+            nanoseconds = 0;
+            line = current;
+            while (depth > 0 && bc->regions[open[depth - 1]].end <= at)
+                depth--;
+            while (next < bc->regionCount && bc->regions[next].start <= at)
+                open[depth++] = next++;
+        }
+        nanoseconds += pr->profile->nanoseconds[at];
+    }
+    writeStack(pr, fp, open, depth, line, nanoseconds);
+    status = (ferror(fp) | fclose(fp)) != 0 ? -1 : 0;
+    free(open);
+    return status;
+}
+
+/* profileProgram - a function to run bc as vmRun does, with its variables in slots, while profiling it; writes
+   the tables to ctx->out and the folded stacks next to the source at path, and returns what vmRun would */
+int profileProgram(Context *ctx, const Bytecode *bc, Value *slots, uint32_t *where, const char *path) {
+    Profiler pr = {.ctx = ctx, .bc = bc};
+    Profile profile;
+    char *folded = NULL, line[160];
+    uint64_t total;
+    int status = VM_NO_MEMORY;
+
+    memset(&profile, 0, sizeof(profile));
+    profile.counts = calloc(bc->codeLen, sizeof(uint64_t));
+    profile.taken = calloc(bc->codeLen, sizeof(uint64_t));
+    profile.nanoseconds = calloc(bc->codeLen, sizeof(uint64_t));
+    pr.profile = &profile;
+    if (profile.counts == NULL || profile.taken == NULL || profile.nanoseconds == NULL ||
+        readerLines(&ctx->in, &pr.lines) != 0)
+        goto done;
+
+    status = vmProfile(bc, slots, where, &profile);
+    total = reportOpcodes(&pr);
+    if (reportLines(&pr, total) != 0 || reportRegions(&pr) != 0)
+        sinkMessage(ctx->out, "Profile cut short: not enough memory.");
+    if ((folded = pathWithExtension(path, PROFILE_EXTENSION)) == NULL || writeFolded(&pr, folded) != 0) {
+        snprintf(line, sizeof(line), "Profile: cannot write %s", folded != NULL ? folded : PROFILE_EXTENSION);
+        sinkMessage(ctx->out, line);
+    }
+
+done:
+    free(folded);
+    freeLines(&pr.lines);
+    free(profile.counts);
+    free(profile.taken);
+    free(profile.nanoseconds);
+    return status;
+}
@@ -0,0 +1,162 @@
+/* reader.c - maps a UTF-16LE source file into memory so the lexer never calls stdio per character */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "reader.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define READER_HAVE_MMAP 1
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/* Block size for the read fallback */
+#define READER_BLOCK (1 << 20)
+
+/* isLittleEndian - 1 if code units can be used straight from the file bytes */
+static int isLittleEndian() {
+    const uint16_t probe = 1;
+    return *(const unsigned char *) &probe == 1;
+}
+
+/* readBlocks - read the whole stream into a heap buffer, READER_BLOCK bytes at a time */
+static int readBlocks(Reader *rd, FILE *fp) {
+    size_t cap = READER_BLOCK, size = 0, got;
+    unsigned char *buf = malloc(cap);
+
+    if (buf == NULL)
+        return -1;
+    while ((got = fread(buf + size, 1, cap - size, fp)) > 0) {
+        size += got;
+        if (size == cap) {
+            unsigned char *grown = realloc(buf, cap * 2);
+            if (grown == NULL) {
+                free(buf);
+                return -1;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+    }
+    if (ferror(fp)) {
+        free(buf);
+        errno = EIO;
+        return -1;
+    }
+    rd->base = buf;
+    rd->size = size;
+    rd->mapped = 0;
+    return 0;
+}
+
+#ifdef READER_HAVE_MMAP
+/* mapFile - map a regular file read-only; returns 1 if mapped, 0 if the caller should fall back to reading */
+static int mapFile(Reader *rd, int fd) {
+    struct stat st;
+    void *base;
+
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+        return 0;
+    base = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED)
+        return 0;
+#ifdef MADV_SEQUENTIAL
+    madvise(base, (size_t) st.st_size, MADV_SEQUENTIAL);
+#endif
+    rd->base = base;
+    rd->size = (size_t) st.st_size;
+    rd->mapped = 1;
+    return 1;
+}
+#endif
+
+int readerOpen(Reader *rd, const char *path) {
+    FILE *fp;
+    int status = 0;
+
+    memset(rd, 0, sizeof(*rd));
+    if ((fp = fopen(path, "rb")) == NULL)
+        return -1;
+
+#ifdef READER_HAVE_MMAP
+    if (!isLittleEndian() || !mapFile(rd, fileno(fp)))
+        status = readBlocks(rd, fp);
+#else
+    status = readBlocks(rd, fp);
+#endif
+    fclose(fp);
+    if (status != 0)
+        return -1;
+
+    /* A trailing odd byte is not a complete code unit, exactly as a short fread of 2 bytes was not */
+    rd->len = rd->size / 2;
+    rd->units = rd->base;
+    if (!isLittleEndian()) {
+        uint16_t *units = rd->base;
+        size_t i;
+        for (i = 0; i < rd->len; i++) {
+            const unsigned char *b = (const unsigned char *) &units[i];
+            units[i] = (uint16_t) (b[1] << 8 | b[0]);
+        }
+    }
+    return 0;
+}
+
+void readerClose(Reader *rd) {
+#ifdef READER_HAVE_MMAP
+    if (rd->mapped) {
+        munmap(rd->base, rd->size);
+    } else
+#endif
+    {
+        free(rd->base);
+    }
+    memset(rd, 0, sizeof(*rd));
+}
+
+int readerSkipBOM(Reader *rd) {
+    if (rd->len == 0 || rd->units[0] != READER_BOM)
+        return 0;
+    rd->pos = 1;
+    return 1;
+}
+
+int readerLines(const Reader *rd, LineTable *lines) {
+    size_t i, count = 1;
+
+    memset(lines, 0, sizeof(*lines));
+    if (rd->len > UINT32_MAX)
+        return -1;
+    for (i = 0; i < rd->len; i++)
+        count += rd->units[i] == '\n';
+    if ((lines->starts = malloc(count * sizeof(*lines->starts))) == NULL)
+        return -1;
+    lines->starts[lines->count++] = 0;
+    for (i = 0; i < rd->len; i++)
+        if (rd->units[i] == '\n')
+            lines->starts[lines->count++] = (uint32_t) i + 1;
+    return 0;
+}
+
+uint32_t lineOf(const LineTable *lines, size_t offset) {
+    uint32_t low = 0, high = lines->count;
+
+    /* The last line starting at or before offset */
+    while (high - low > 1) {
+        uint32_t middle = low + (high - low) / 2;
+        if (lines->starts[middle] <= offset)
+            low = middle;
+        else
+            high = middle;
+    }
+    return low + 1;
+}
+
+void freeLines(LineTable *lines) {
+    free(lines->starts);
+    memset(lines, 0, sizeof(*lines));
+}
@@ -0,0 +1,69 @@
+/* reader.h - in-memory UTF-16LE input for the TR-701 lexer */
+#ifndef READER_H
+#define READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+#include "scan.h"
+
+/* Byte order mark of a UTF-16LE file, as read into a code unit */
+#define READER_BOM 0xFEFF
+
+/* A whole source file held in memory as UTF-16 code units */
+typedef struct {
+    const uint16_t *units; /* code units of the file, BOM included */
+    size_t len;            /* number of complete code units */
+    size_t pos;            /* index of the next code unit to hand out */
+    void *base;            /* mapping or heap block backing units */
+    size_t size;           /* size of that mapping or heap block in bytes */
+    int mapped;            /* 1 if base comes from mmap, 0 if from malloc */
+} Reader;
+
+/* Where every line of a Reader's code units starts, for giving a code unit offset its line number */
+typedef struct {
+    uint32_t *starts;      /* offset of the first code unit of each line; starts[0] is 0 */
+    uint32_t count;        /* number of lines, at least 1 */
+} LineTable;
+
+/* readerOpen - map (or read in large blocks) the file at path; returns 0 on success, -1 with errno set */
+int readerOpen(Reader *rd, const char *path);
+
+/* readerClose - release the memory behind the reader */
+void readerClose(Reader *rd);
+
+/* readerSkipBOM - consume a leading UTF-16LE byte order mark; returns 0 if the file does not start with one */
+int readerSkipBOM(Reader *rd);
+
+/* readerLines - note where every line of rd starts, whatever has been read of it; returns 0, or -1 when memory
+   runs out or rd is too long for 32-bit offsets */
+int readerLines(const Reader *rd, LineTable *lines);
+
+/* lineOf - the line, counted from 1, that the code unit at offset is on */
+uint32_t lineOf(const LineTable *lines, size_t offset);
+
+/* freeLines - release a table filled by readerLines */
+void freeLines(LineTable *lines);
+
+/* readerNext - hand out the next code unit, or WEOF at the end of input */
+static inline wint_t readerNext(Reader *rd) {
+    return rd->pos < rd->len ? (wint_t) rd->units[rd->pos++] : WEOF;
+}
+
+/* readerSkipBlanks - move past a run of blanks (see scan.h) without handing them out one by one */
+static inline void readerSkipBlanks(Reader *rd) {
+    rd->pos = scanBlanks(rd->units, rd->pos, rd->len);
+}
+
+/* readerSkipToDollar - move to the next '$', or to the end of input if there is none */
+static inline void readerSkipToDollar(Reader *rd) {
+    rd->pos = scanDollar(rd->units, rd->pos, rd->len);
+}
+
+/* readerStop - make every further read report the end of input */
+static inline void readerStop(Reader *rd) {
+    rd->pos = rd->len;
+}
+
+#endif
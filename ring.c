@@ -0,0 +1,39 @@
+/* ring.c - allocation and back-off of the lexer-to-parser token ring */
+#define _POSIX_C_SOURCE 200809L
+#include <sched.h>
+#include <stdlib.h>
+
+#include "ring.h"
+
+/* Spins before ringWait starts yielding the processor */
+#define RING_SPINS 64
+
+TokenRing *ringCreate() {
+    TokenRing *ring = aligned_alloc(64, (sizeof(TokenRing) + 63) / 64 * 64);
+    if (ring == NULL)
+        return NULL;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->stop, 0);
+    ring->produced = 0;
+    ring->space = RING_SIZE;
+    ring->error = NULL;
+    ring->consumed = 0;
+    ring->ready = 0;
+    ring->drained = 0;
+    return ring;
+}
+
+void ringDestroy(TokenRing *ring) {
+    free(ring);
+}
+
+void ringWait(int *spins) {
+    if (++*spins < RING_SPINS) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    } else {
+        sched_yield();
+    }
+}
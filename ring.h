@@ -0,0 +1,111 @@
+/* ring.h - bounded lock-free single-producer/single-consumer queue of tokens between the lexer and parser threads
+ *
+ * The lexer thread is the only one calling ringPush/ringFlush and the parser thread the only one calling
+ * ringPop, so each index has a single writer and no locks are needed. Both sides work on private copies
+ * of the indexes and publish them in batches, keeping the two cache lines from bouncing on every token.
+ * When the ring is full the lexer waits, so memory stays at RING_SIZE tokens however large the input.
+ */
+#ifndef RING_H
+#define RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+#include "tokens.h"
+
+/* Tokens in flight; a power of two */
+#define RING_SIZE 8192
+/* Tokens either side handles before it publishes its index */
+#define RING_BATCH 256
+
+/* Kind of the token that carries a lexical error (see TokenRing.error) */
+#define TOKEN_KIND_ERROR 0xFE
+
+typedef struct {
+    _Alignas(64) atomic_size_t head;    /* tokens published by the lexer */
+    _Alignas(64) atomic_size_t tail;    /* tokens released by the parser */
+    _Alignas(64) atomic_int stop;       /* set by the parser when it wants no more tokens */
+
+    /* Lexer side only */
+    _Alignas(64) size_t produced;       /* tokens written, published or not */
+    size_t space;                       /* produced may grow up to here without reading tail */
+    const wchar_t *error;               /* message of the TOKEN_KIND_ERROR token, set before it is published */
+
+    /* Parser side only */
+    _Alignas(64) size_t consumed;       /* tokens read, released or not */
+    size_t ready;                       /* consumed may grow up to here without reading head */
+    int drained;                        /* the EOF token has been taken */
+
+    uint8_t kind[RING_SIZE];
+    uint32_t offset[RING_SIZE];
+    uint32_t length[RING_SIZE];
+    uint64_t value[RING_SIZE];          /* of a number literal */
+} TokenRing;
+
+/* ringCreate - an empty ring; NULL when memory runs out */
+TokenRing *ringCreate();
+
+/* ringDestroy - release a ring neither thread uses any more */
+void ringDestroy(TokenRing *ring);
+
+/* ringWait - back off while the other side catches up: spin briefly, then give up the processor */
+void ringWait(int *spins);
+
+/* ringFlush - publish every token pushed so far */
+static inline void ringFlush(TokenRing *ring) {
+    atomic_store_explicit(&ring->head, ring->produced, memory_order_release);
+}
+
+/* ringPush - append one token, with its value if it is a number literal, waiting while the ring is full; returns
+   -1 once the parser has stopped */
+static inline int ringPush(TokenRing *ring, int kind, size_t offset, size_t length, uint64_t value) {
+    size_t i = ring->produced;
+
+    if (i == ring->space) {
+        int spins = 0;
+        ringFlush(ring);
+        while ((ring->space = atomic_load_explicit(&ring->tail, memory_order_acquire) + RING_SIZE) == i) {
+            if (atomic_load_explicit(&ring->stop, memory_order_relaxed))
+                return -1;
+            ringWait(&spins);
+        }
+    }
+    ring->kind[i & (RING_SIZE - 1)] = kind < 0 ? TOKEN_KIND_EOF : (uint8_t) kind;
+    ring->offset[i & (RING_SIZE - 1)] = (uint32_t) offset;
+    ring->length[i & (RING_SIZE - 1)] = (uint32_t) length;
+    ring->value[i & (RING_SIZE - 1)] = value;
+    ring->produced = i + 1;
+    if ((ring->produced & (RING_BATCH - 1)) == 0) {
+        ringFlush(ring);
+        if (atomic_load_explicit(&ring->stop, memory_order_relaxed))
+            return -1;
+    }
+    return 0;
+}
+
+/* ringPop - take the next token, waiting while the ring is empty; returns its slot, valid until the next ringPop */
+static inline size_t ringPop(TokenRing *ring) {
+    size_t i = ring->consumed;
+
+    if (i == ring->ready) {
+        int spins = 0;
+        /* Hand back the slots read so far first, or a lexer waiting for space would never get them */
+        atomic_store_explicit(&ring->tail, i, memory_order_release);
+        while ((ring->ready = atomic_load_explicit(&ring->head, memory_order_acquire)) == i)
+            ringWait(&spins);
+    } else if ((i & (RING_BATCH - 1)) == 0) {
+        /* The caller is done with every slot before i */
+        atomic_store_explicit(&ring->tail, i, memory_order_release);
+    }
+    ring->consumed = i + 1;
+    return i & (RING_SIZE - 1);
+}
+
+/* ringStop - tell the lexer to stop producing */
+static inline void ringStop(TokenRing *ring) {
+    atomic_store_explicit(&ring->stop, 1, memory_order_relaxed);
+}
+
+#endif
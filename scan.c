@@ -0,0 +1,149 @@
+/* scan.c - scalar, SSE2 and AVX2 kernels for skipping blanks and finding the '$' that closes a comment
+ *
+ * The vector kernels look at 8 (SSE2) or 16 (AVX2) code units per step and finish the last few
+ * units with the scalar kernel. The kernel set is picked once, at the first call, from what the
+ * processor supports.
+ */
+#include <stdatomic.h>
+
+#include "scan.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+/* isBlank - the blanks getNonBlank skips: the CHAR_SPACE entries of charTable */
+static inline int isBlank(uint16_t c) {
+    return c == ' ' || (unsigned) (c - '\t') <= '\r' - '\t';
+}
+
+static size_t skipBlanksScalar(const uint16_t *units, size_t pos, size_t len) {
+    while (pos < len && isBlank(units[pos]))
+        pos++;
+    return pos;
+}
+
+static size_t findDollarScalar(const uint16_t *units, size_t pos, size_t len) {
+    while (pos < len && units[pos] != '$')
+        pos++;
+    return pos;
+}
+
+#ifdef SCAN_X86
+
+/* Two bytes of a movemask per code unit, so a bit index halves into a unit index */
+
+__attribute__((target("sse2")))
+static size_t skipBlanksSSE2(const uint16_t *units, size_t pos, size_t len) {
+    const __m128i space = _mm_set1_epi16(' ');
+    const __m128i tab = _mm_set1_epi16('\t');
+    const __m128i span = _mm_set1_epi16('\r' - '\t');
+    const __m128i zero = _mm_setzero_si128();
+
+    while (pos + 8 <= len) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (units + pos));
+        /* (v - '\t') saturated down by 4 is zero exactly for '\t' .. '\r' */
+        __m128i control = _mm_cmpeq_epi16(_mm_subs_epu16(_mm_sub_epi16(v, tab), span), zero);
+        __m128i blank = _mm_or_si128(control, _mm_cmpeq_epi16(v, space));
+        unsigned mask = (unsigned) _mm_movemask_epi8(blank);
+        if (mask != 0xFFFFu)
+            return pos + (size_t) __builtin_ctz(~mask) / 2;
+        pos += 8;
+    }
+    return skipBlanksScalar(units, pos, len);
+}
+
+__attribute__((target("sse2")))
+static size_t findDollarSSE2(const uint16_t *units, size_t pos, size_t len) {
+    const __m128i dollar = _mm_set1_epi16('$');
+
+    while (pos + 8 <= len) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (units + pos));
+        unsigned mask = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi16(v, dollar));
+        if (mask != 0)
+            return pos + (size_t) __builtin_ctz(mask) / 2;
+        pos += 8;
+    }
+    return findDollarScalar(units, pos, len);
+}
+
+__attribute__((target("avx2")))
+static size_t skipBlanksAVX2(const uint16_t *units, size_t pos, size_t len) {
+    const __m256i space = _mm256_set1_epi16(' ');
+    const __m256i tab = _mm256_set1_epi16('\t');
+    const __m256i span = _mm256_set1_epi16('\r' - '\t');
+    const __m256i zero = _mm256_setzero_si256();
+
+    while (pos + 16 <= len) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (units + pos));
+        __m256i control = _mm256_cmpeq_epi16(_mm256_subs_epu16(_mm256_sub_epi16(v, tab), span), zero);
+        __m256i blank = _mm256_or_si256(control, _mm256_cmpeq_epi16(v, space));
+        unsigned mask = (unsigned) _mm256_movemask_epi8(blank);
+        if (mask != 0xFFFFFFFFu)
+            return pos + (size_t) __builtin_ctz(~mask) / 2;
+        pos += 16;
+    }
+    return skipBlanksScalar(units, pos, len);
+}
+
+__attribute__((target("avx2")))
+static size_t findDollarAVX2(const uint16_t *units, size_t pos, size_t len) {
+    const __m256i dollar = _mm256_set1_epi16('$');
+
+    while (pos + 16 <= len) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (units + pos));
+        unsigned mask = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi16(v, dollar));
+        if (mask != 0)
+            return pos + (size_t) __builtin_ctz(mask) / 2;
+        pos += 16;
+    }
+    return findDollarScalar(units, pos, len);
+}
+
+#endif
+
+/* Ordered from the most portable to the fastest */
+static const ScanKernels kernels[] = {
+    {"scalar", skipBlanksScalar, findDollarScalar},
+#ifdef SCAN_X86
+    {"sse2", skipBlanksSSE2, findDollarSSE2},
+    {"avx2", skipBlanksAVX2, findDollarAVX2},
+#endif
+};
+
+const ScanKernels *scanKernels(int *count) {
+    int n = 1;
+#ifdef SCAN_X86
+    if (__builtin_cpu_supports("sse2")) {
+        n = 2;
+        if (__builtin_cpu_supports("avx2"))
+            n = 3;
+    }
+#endif
+    *count = n;
+    return kernels;
+}
+
+/* The chosen kernel set; NULL until the first scan */
+static _Atomic(const ScanKernels *) selected;
+
+/* best - the fastest kernel set this processor supports */
+static const ScanKernels *best() {
+    const ScanKernels *k = atomic_load_explicit(&selected, memory_order_acquire);
+    if (k == NULL) {
+        int count;
+        const ScanKernels *all = scanKernels(&count);
+        k = &all[count - 1];
+        atomic_store_explicit(&selected, k, memory_order_release);
+    }
+    return k;
+}
+
+size_t scanBlanks(const uint16_t *units, size_t pos, size_t len) {
+    return best()->skipBlanks(units, pos, len);
+}
+
+size_t scanDollar(const uint16_t *units, size_t pos, size_t len) {
+    return best()->findDollar(units, pos, len);
+}
@@ -0,0 +1,26 @@
+/* scan.h - vectorized scanning of UTF-16 code units for the lexer's hot loops */
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A set of scanning kernels; every set returns exactly what the scalar one does */
+typedef struct {
+    const char *name;
+    /* index of the first unit in [pos, len) that is not blank (' ', '\t' .. '\r'), or len */
+    size_t (*skipBlanks)(const uint16_t *units, size_t pos, size_t len);
+    /* index of the first '$' in [pos, len), or len */
+    size_t (*findDollar)(const uint16_t *units, size_t pos, size_t len);
+} ScanKernels;
+
+/* scanBlanks - skipBlanks of the best kernel set this processor supports */
+size_t scanBlanks(const uint16_t *units, size_t pos, size_t len);
+
+/* scanDollar - findDollar of the best kernel set this processor supports */
+size_t scanDollar(const uint16_t *units, size_t pos, size_t len);
+
+/* scanKernels - every kernel set usable on this processor, scalar first; the best one is last */
+const ScanKernels *scanKernels(int *count);
+
+#endif
@@ -0,0 +1,367 @@
+/* sink.c - one buffer per analyzed file that the lexer, the tracer and the summary all write through */
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sink.h"
+#include "front.h"
+
+#define SINK_INITIAL_CAP (64 * 1024)
+
+void sinkInit(Sink *sink, FILE *fp, int format) {
+    memset(sink, 0, sizeof(*sink));
+    sink->fp = fp;
+    sink->format = format;
+}
+
+void sinkFree(Sink *sink) {
+    free(sink->data);
+    sink->data = NULL;
+    sink->len = sink->cap = 0;
+}
+
+/* reserve - make room for n more bytes; returns a pointer to them or NULL */
+static char *reserve(Sink *sink, size_t n) {
+    if (sink->len + n > sink->cap) {
+        size_t cap = sink->cap ? sink->cap : SINK_INITIAL_CAP;
+        char *grown;
+        while (cap < sink->len + n)
+            cap *= 2;
+        if ((grown = realloc(sink->data, cap)) == NULL) {
+            sink->failed = 1;
+            return NULL;
+        }
+        sink->data = grown;
+        sink->cap = cap;
+    }
+    return sink->data + sink->len;
+}
+
+static void putBytes(Sink *sink, const void *bytes, size_t n) {
+    char *dst = reserve(sink, n);
+    if (dst != NULL) {
+        memcpy(dst, bytes, n);
+        sink->len += n;
+    }
+}
+
+static void putString(Sink *sink, const char *text) {
+    putBytes(sink, text, strlen(text));
+}
+
+static void putFormat(Sink *sink, const char *format, ...) {
+    char buf[128];
+    va_list args;
+    int n;
+
+    va_start(args, format);
+    n = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (n > 0)
+        putBytes(sink, buf, (size_t) n < sizeof(buf) ? (size_t) n : sizeof(buf) - 1);
+}
+
+static void putU32(Sink *sink, uint32_t v) {
+    unsigned char b[4] = {(unsigned char) v, (unsigned char) (v >> 8), (unsigned char) (v >> 16), (unsigned char) (v >> 24)};
+    putBytes(sink, b, 4);
+}
+
+static void patchU32(Sink *sink, size_t at, uint32_t v) {
+    if (at + 4 <= sink->len) {
+        sink->data[at] = (char) (unsigned char) v;
+        sink->data[at + 1] = (char) (unsigned char) (v >> 8);
+        sink->data[at + 2] = (char) (unsigned char) (v >> 16);
+        sink->data[at + 3] = (char) (unsigned char) (v >> 24);
+    }
+}
+
+/* putUtf8 - encode one code point at dst; returns the number of bytes written */
+static size_t putUtf8(char *dst, uint32_t cp) {
+    if (cp < 0x80) {
+        dst[0] = (char) cp;
+        return 1;
+    } else if (cp < 0x800) {
+        dst[0] = (char) (0xC0 | cp >> 6);
+        dst[1] = (char) (0x80 | (cp & 0x3F));
+        return 2;
+    } else if (cp < 0x10000) {
+        dst[0] = (char) (0xE0 | cp >> 12);
+        dst[1] = (char) (0x80 | (cp >> 6 & 0x3F));
+        dst[2] = (char) (0x80 | (cp & 0x3F));
+        return 3;
+    }
+    dst[0] = (char) (0xF0 | cp >> 18);
+    dst[1] = (char) (0x80 | (cp >> 12 & 0x3F));
+    dst[2] = (char) (0x80 | (cp >> 6 & 0x3F));
+    dst[3] = (char) (0x80 | (cp & 0x3F));
+    return 4;
+}
+
+/* putUnits - write UTF-16 code units as UTF-8, JSON-escaped if asked; stray surrogates become U+FFFD */
+static void putUnits(Sink *sink, const uint16_t *units, size_t n, int json) {
+    /* At most 6 bytes per unit (a \\u escape), so one reservation covers the whole string */
+    char *dst = reserve(sink, n * 6), *start = dst;
+    size_t i;
+
+    if (dst == NULL)
+        return;
+    for (i = 0; i < n; i++) {
+        uint32_t cp = units[i];
+        if (cp >= 0x20 && cp < 0x80 && !(json && (cp == '"' || cp == '\\'))) {
+            *dst++ = (char) cp;
+            continue;
+        }
+        if (cp >= 0xD800 && cp <= 0xDBFF && i + 1 < n && units[i + 1] >= 0xDC00 && units[i + 1] <= 0xDFFF) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + ((uint32_t) units[++i] - 0xDC00);
+        } else if (cp >= 0xD800 && cp <= 0xDFFF) {
+            cp = 0xFFFD;
+        }
+        if (json && (cp == '"' || cp == '\\')) {
+            *dst++ = '\\';
+            *dst++ = (char) cp;
+        } else if (json && cp < 0x20) {
+            static const char hex[] = "0123456789abcdef";
+            memcpy(dst, "\\u00", 4);
+            dst[4] = hex[cp >> 4];
+            dst[5] = hex[cp & 0xF];
+            dst += 6;
+        } else {
+            dst += putUtf8(dst, cp);
+        }
+    }
+    sink->len += (size_t) (dst - start);
+}
+
+/* putWide - write a wide string (messages built with L"...") through putUnits, a chunk at a time */
+static void putWide(Sink *sink, const wchar_t *text, int json) {
+    uint16_t chunk[130];
+    size_t n = 0;
+
+    for (; *text; text++) {
+        uint32_t cp = (uint32_t) *text;
+        if (cp >= 0x10000 && cp <= 0x10FFFF) {
+            chunk[n++] = (uint16_t) (0xD800 + ((cp - 0x10000) >> 10));
+            chunk[n++] = (uint16_t) (0xDC00 + ((cp - 0x10000) & 0x3FF));
+        } else {
+            chunk[n++] = (uint16_t) (cp <= 0xFFFF ? cp : 0xFFFD);
+        }
+        if (n >= 128) {
+            putUnits(sink, chunk, n, json);
+            n = 0;
+        }
+    }
+    putUnits(sink, chunk, n, json);
+}
+
+/* putInt - a decimal integer without going through printf */
+static void putInt(Sink *sink, long long v) {
+    char buf[24], *p = buf + sizeof(buf);
+    unsigned long long u = v < 0 ? 0 - (unsigned long long) v : (unsigned long long) v;
+    do {
+        *--p = (char) ('0' + u % 10);
+        u /= 10;
+    } while (u != 0);
+    if (v < 0)
+        *--p = '-';
+    putBytes(sink, p, (size_t) (buf + sizeof(buf) - p));
+}
+
+/* putJsonString - a quoted JSON string from UTF-8 text */
+static void putJsonString(Sink *sink, const char *text) {
+    const unsigned char *s = (const unsigned char *) text;
+    putBytes(sink, "\"", 1);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            putBytes(sink, "\\", 1);
+            putBytes(sink, s, 1);
+        } else if (*s < 0x20) {
+            putFormat(sink, "\\u%04x", (unsigned) *s);
+        } else {
+            putBytes(sink, s, 1);
+        }
+    }
+    putBytes(sink, "\"", 1);
+}
+
+int sinkFlush(Sink *sink) {
+    int status = 0;
+    if (sink->fp != NULL && sink->len > 0) {
+        if (fwrite(sink->data, 1, sink->len, sink->fp) != sink->len || fflush(sink->fp) != 0)
+            status = -1;
+        sink->len = 0;
+    }
+    if (sink->failed)
+        status = -1;
+    return status;
+}
+
+void sinkBeginFile(Sink *sink, const char *path) {
+    size_t pathBytes = strlen(path);
+    if (sink->format != SINK_BINARY)
+        return;
+    sink->header = sink->len;
+    sink->tokens = 0;
+    putBytes(sink, SINK_BINARY_MAGIC, 4);
+    putU32(sink, SINK_BINARY_VERSION);
+    putU32(sink, 0);    /* status, patched by sinkSummary */
+    putU32(sink, 0);    /* token count, patched by sinkSummary */
+    putU32(sink, (uint32_t) pathBytes);
+    putBytes(sink, path, pathBytes);
+    putBytes(sink, "\0\0\0", (4 - pathBytes % 4) % 4);
+}
+
+void sinkToken(Sink *sink, int token, const uint16_t *lexeme, size_t length, size_t offset) {
+    switch (sink->format) {
+        case SINK_TEXT:
+            putString(sink, "Next token is: ");
+            putInt(sink, token);
+            putString(sink, ", Next lexeme is: ");
+            putUnits(sink, lexeme, length, 0);
+            putBytes(sink, "\n", 1);
+            break;
+        case SINK_JSON:
+            putString(sink, "{\"token\":");
+            putInt(sink, token);
+            putString(sink, ",\"lexeme\":\"");
+            putUnits(sink, lexeme, length, 1);
+            putString(sink, "\",\"offset\":");
+            putInt(sink, (long long) offset);
+            putString(sink, ",\"length\":");
+            putInt(sink, token == EOF ? 0 : (long long) length);
+            putBytes(sink, "}\n", 2);
+            break;
+        case SINK_BINARY:
+            putU32(sink, (uint32_t) token);
+            putU32(sink, (uint32_t) offset);
+            putU32(sink, token == EOF ? 0 : (uint32_t) length);
+            sink->tokens++;
+            break;
+    }
+}
+
+void sinkProduction(Sink *sink, int enter, const char *name) {
+    if (sink->format == SINK_TEXT) {
+        putString(sink, enter ? "Enter <" : "Exit <");
+        putString(sink, name);
+        putBytes(sink, ">\n", 2);
+    } else if (sink->format == SINK_JSON) {
+        putString(sink, enter ? "{\"enter\":" : "{\"exit\":");
+        putJsonString(sink, name);
+        putBytes(sink, "}\n", 2);
+    }
+}
+
+void sinkNode(Sink *sink, int depth, const char *kind, const char *type, const uint16_t *text, size_t length) {
+    if (sink->format == SINK_TEXT) {
+        char *indent = reserve(sink, (size_t) depth * 2);
+        if (indent != NULL) {
+            memset(indent, ' ', (size_t) depth * 2);
+            sink->len += (size_t) depth * 2;
+        }
+        putString(sink, kind);
+        if (type != NULL) {
+            putBytes(sink, " ", 1);
+            putString(sink, type);
+        }
+        if (length > 0) {
+            putBytes(sink, " ", 1);
+            putUnits(sink, text, length, 0);
+        }
+        putBytes(sink, "\n", 1);
+    } else if (sink->format == SINK_JSON) {
+        putString(sink, "{\"node\":");
+        putJsonString(sink, kind);
+        putString(sink, ",\"depth\":");
+        putInt(sink, depth);
+        if (type != NULL) {
+            putString(sink, ",\"type\":");
+            putJsonString(sink, type);
+        }
+        putString(sink, ",\"text\":\"");
+        putUnits(sink, text, length, 1);
+        putBytes(sink, "\"}\n", 3);
+    }
+}
+
+void sinkVariable(Sink *sink, const char *type, const uint16_t *name, size_t nameLength, const uint16_t *value,
+                  size_t valueLength, int quote) {
+    char mark = (char) quote;
+
+    if (sink->format == SINK_TEXT) {
+        /* As the declaration that would give the variable its value */
+        putString(sink, type);
+        putBytes(sink, " ", 1);
+        putUnits(sink, name, nameLength, 0);
+        putString(sink, " <<< ");
+        putBytes(sink, &mark, quote != 0);
+        putUnits(sink, value, valueLength, 0);
+        putBytes(sink, &mark, quote != 0);
+        putBytes(sink, "\n", 1);
+    } else if (sink->format == SINK_JSON) {
+        putString(sink, "{\"variable\":\"");
+        putUnits(sink, name, nameLength, 1);
+        putString(sink, "\",\"type\":");
+        putJsonString(sink, type);
+        putString(sink, ",\"value\":\"");
+        putUnits(sink, value, valueLength, 1);
+        putBytes(sink, "\"}\n", 3);
+    }
+}
+
+void sinkMessage(Sink *sink, const char *text) {
+    if (sink->format == SINK_TEXT) {
+        putString(sink, text);
+        putBytes(sink, "\n", 1);
+    } else if (sink->format == SINK_JSON) {
+        putString(sink, "{\"message\":");
+        putJsonString(sink, text);
+        putBytes(sink, "}\n", 2);
+    }
+}
+
+void sinkVerdict(Sink *sink, const wchar_t *message) {
+    if (sink->format == SINK_TEXT) {
+        putWide(sink, message, 0);
+        putBytes(sink, "\n", 1);
+    } else if (sink->format == SINK_JSON) {
+        putString(sink, "{\"verdict\":\"");
+        putWide(sink, message, 1);
+        putBytes(sink, "\"}\n", 3);
+    }
+}
+
+void sinkSummary(Sink *sink, const char *path, int status, const wchar_t *reason) {
+    static const char *const textStatus[] = {"PASS", "FAIL", "ERROR", "ERROR", "FAIL"};
+    static const char *const jsonStatus[] = {"pass", "fail", "error", "error", "fail"};
+    int known = status >= ANALYSIS_OK && status <= ANALYSIS_RUN_FAILED;
+
+    switch (sink->format) {
+        case SINK_TEXT:
+            putString(sink, path);
+            putString(sink, ": ");
+            putString(sink, known ? textStatus[status] : "ERROR");
+            if (reason != NULL && status != ANALYSIS_OK) {
+                putString(sink, " - ");
+                putWide(sink, reason, 0);
+            }
+            putBytes(sink, "\n", 1);
+            break;
+        case SINK_JSON:
+            putString(sink, "{\"file\":");
+            putJsonString(sink, path);
+            putString(sink, ",\"status\":\"");
+            putString(sink, known ? jsonStatus[status] : "error");
+            putString(sink, "\"");
+            if (reason != NULL && status != ANALYSIS_OK) {
+                putString(sink, ",\"reason\":\"");
+                putWide(sink, reason, 1);
+                putString(sink, "\"");
+            }
+            putBytes(sink, "}\n", 2);
+            break;
+        case SINK_BINARY:
+            patchU32(sink, sink->header + 8, (uint32_t) status);
+            patchU32(sink, sink->header + 12, sink->tokens);
+            break;
+    }
+}
@@ -0,0 +1,74 @@
+/* sink.h - buffered output of the analyzer in text, JSON Lines or binary token format */
+#ifndef SINK_H
+#define SINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <wchar.h>
+
+/* Output formats */
+#define SINK_TEXT 0     /* the human-readable trace and summary lines */
+#define SINK_JSON 1     /* one JSON object per line */
+#define SINK_BINARY 2   /* fixed-size token records behind a per-file header, see below */
+
+/*
+ * Binary format, little-endian and 4-byte aligned so a file of it can be mapped and indexed:
+ *   per analyzed file:  char magic[4] = "TR7T"; uint32 version; uint32 status (ANALYSIS_*);
+ *                       uint32 tokenCount; uint32 pathBytes; char path[pathBytes], zero-padded to 4
+ *   then tokenCount x   int32 tokenCode; uint32 offset; uint32 length
+ * Offsets and lengths count UTF-16 code units from the start of the source file (its BOM is unit 0);
+ * the closing EOF token (code -1) sits at the end of the file with length 0.
+ * Only tokens are recorded; productions, messages, tree dumps and run results exist in the text and JSON formats alone.
+ */
+#define SINK_BINARY_MAGIC "TR7T"
+#define SINK_BINARY_VERSION 1
+
+/* Output of one analysis, kept in memory until it is flushed whole */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    FILE *fp;           /* where sinkFlush writes, or NULL to keep the bytes for the caller */
+    int format;         /* One of the SINK_ formats */
+    size_t header;      /* offset of the current binary file header */
+    uint32_t tokens;    /* token records since that header */
+    int failed;         /* set when memory or the stream ran out */
+} Sink;
+
+/* sinkInit - an empty sink in the given format that flushes to fp (NULL: never written out) */
+void sinkInit(Sink *sink, FILE *fp, int format);
+
+/* sinkFree - release the buffer */
+void sinkFree(Sink *sink);
+
+/* sinkFlush - write everything buffered to fp in one call and empty the buffer; returns 0 on success */
+int sinkFlush(Sink *sink);
+
+/* sinkBeginFile - start the output of one source file (the binary header) */
+void sinkBeginFile(Sink *sink, const char *path);
+
+/* sinkToken - one token: its code, its lexeme (length UTF-16 code units, not terminated) and where it starts in the source */
+void sinkToken(Sink *sink, int token, const uint16_t *lexeme, size_t length, size_t offset);
+
+/* sinkProduction - entering (enter = 1) or leaving a grammar production */
+void sinkProduction(Sink *sink, int enter, const char *name);
+
+/* sinkNode - one node of a syntax tree dump at the given depth: its kind, the declared type or NULL, and its source text */
+void sinkNode(Sink *sink, int depth, const char *kind, const char *type, const uint16_t *text, size_t length);
+
+/* sinkVariable - the value a variable of the given type holds after a run, in UTF-16 code units; quote is the
+   character the text format puts around it ('\'' for hane, '"' for tümce) or 0 */
+void sinkVariable(Sink *sink, const char *type, const uint16_t *name, size_t nameLength, const uint16_t *value,
+                  size_t valueLength, int quote);
+
+/* sinkMessage - a line of diagnostics: from the lexer, or what an optimization pass did */
+void sinkMessage(Sink *sink, const char *text);
+
+/* sinkVerdict - the final message of program() */
+void sinkVerdict(Sink *sink, const wchar_t *message);
+
+/* sinkSummary - the per-file result line; reason explains a failure or an error and may be NULL */
+void sinkSummary(Sink *sink, const char *path, int status, const wchar_t *reason);
+
+#endif
@@ -0,0 +1,68 @@
+# Smoke test of the C translation (-c), run by the smoke target: every sample the analyzer accepts is translated,
+# built with the system compiler at -O2 and run, and what it prints must be what running it on the virtual
+# machine (-r) prints. A sample the analyzer rejects has nothing to translate and is only reported, but at least
+# one must be translated (smoke1.in is written to be accepted) or the test fails.
+#
+# The samples in REJECTS must be rejected instead: each is a mistake the analyzer has to report, not translate.
+#
+# Expects ANALYZER (the TR_Programming_Language executable), COMPILER (a C compiler), MATH_LIBRARY (may be empty),
+# SAMPLES and REJECTS (lists of sources in the working directory).
+
+if (NOT MATH_LIBRARY)
+    # MATH_LIBRARY-NOTFOUND: the C library has the math functions itself
+    set(MATH_LIBRARY "")
+endif ()
+set(failed 0)
+set(translated 0)
+foreach (sample IN LISTS SAMPLES)
+    get_filename_component(stem ${sample} NAME_WE)
+    file(REMOVE ${stem}.c)
+    execute_process(COMMAND ${ANALYZER} -t silent -c -r ${sample}
+            RESULT_VARIABLE ran OUTPUT_VARIABLE expected)
+    if (NOT EXISTS ${stem}.c)
+        if (ran EQUAL 1)
+            message(STATUS "${sample}: rejected by the analyzer, nothing to translate")
+        else ()
+            message(STATUS "${sample}: FAILED, the analyzer exited with ${ran}")
+            set(failed 1)
+        endif ()
+        continue()
+    endif ()
+    math(EXPR translated "${translated} + 1")
+    # The run's report, without the summary lines after it
+    string(REGEX REPLACE "[^\n]*: PASS\n[^\n]*files: [^\n]*\n$" "" expected "${expected}")
+
+    execute_process(COMMAND ${COMPILER} -std=c11 -O2 -o ${stem}_c ${stem}.c ${MATH_LIBRARY}
+            RESULT_VARIABLE status ERROR_VARIABLE errors)
+    if (NOT status EQUAL 0)
+        message(STATUS "${sample}: FAILED, ${stem}.c does not compile:\n${errors}")
+        set(failed 1)
+        continue()
+    endif ()
+    execute_process(COMMAND ./${stem}_c RESULT_VARIABLE status OUTPUT_VARIABLE output ERROR_QUIET)
+    if (ran EQUAL 0 AND status EQUAL 0 AND output STREQUAL expected)
+        message(STATUS "${sample}: translated, built and run as on the virtual machine")
+    elseif (NOT ran EQUAL 0 AND NOT status EQUAL 0)
+        message(STATUS "${sample}: translated, built, and stopped as on the virtual machine")
+    else ()
+        message(STATUS "${sample}: FAILED, the translation printed\n${output}instead of\n${expected}")
+        set(failed 1)
+    endif ()
+endforeach ()
+foreach (sample IN LISTS REJECTS)
+    get_filename_component(stem ${sample} NAME_WE)
+    file(REMOVE ${stem}.c)
+    execute_process(COMMAND ${ANALYZER} -t silent -c ${sample} RESULT_VARIABLE ran OUTPUT_VARIABLE report)
+    string(REGEX MATCH "FAIL - [^\n]*" reason "${report}")
+    if (ran EQUAL 1 AND reason AND NOT EXISTS ${stem}.c)
+        message(STATUS "${sample}: rejected as it should be, ${reason}")
+    else ()
+        message(STATUS "${sample}: FAILED, the analyzer exited with ${ran} instead of rejecting it")
+        set(failed 1)
+    endif ()
+endforeach ()
+if (failed)
+    message(FATAL_ERROR "The C translation smoke test failed")
+elseif (translated EQUAL 0)
+    message(FATAL_ERROR "The C translation smoke test failed: the analyzer rejected every sample")
+endif ()
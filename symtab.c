@@ -0,0 +1,114 @@
+/* symtab.c - identifier interning and block-scoped declarations */
+#include <stdlib.h>
+#include <string.h>
+
+#include "symtab.h"
+
+/* hashUnits - FNV-1a over the code units of an identifier */
+static uint32_t hashUnits(const uint16_t *units, size_t length) {
+    uint32_t h = 2166136261u;
+    size_t i;
+    for (i = 0; i < length; i++) {
+        h ^= units[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* growArray - make room for one more element in a growable array; returns -1 when memory runs out */
+static int growArray(void **items, uint32_t *cap, uint32_t count, size_t size) {
+    void *grown;
+    uint32_t newCap;
+
+    if (count < *cap)
+        return 0;
+    newCap = *cap ? *cap * 2 : 64;
+    if (newCap <= *cap || (grown = realloc(*items, (size_t) newCap * size)) == NULL)
+        return -1;
+    *items = grown;
+    *cap = newCap;
+    return 0;
+}
+
+/* rehash - double the bucket array and put every symbol back; returns -1 when memory runs out */
+static int rehash(SymbolTable *st) {
+    uint32_t mask = st->bucketMask ? st->bucketMask * 2 + 1 : 255;
+    uint32_t *buckets = calloc((size_t) mask + 1, sizeof(*buckets));
+    uint32_t i, slot;
+
+    if (buckets == NULL)
+        return -1;
+    for (i = 0; i < st->symbolCount; i++) {
+        for (slot = st->symbols[i].hash & mask; buckets[slot] != 0; slot = (slot + 1) & mask)
+            ;
+        buckets[slot] = i + 1;
+    }
+    free(st->buckets);
+    st->buckets = buckets;
+    st->bucketMask = mask;
+    return 0;
+}
+
+void symtabInit(SymbolTable *st, const uint16_t *source) {
+    memset(st, 0, sizeof(*st));
+    st->source = source;
+}
+
+void symtabFree(SymbolTable *st) {
+    free(st->symbols);
+    free(st->buckets);
+    free(st->bindings);
+    free(st->visible);
+    free(st->marks);
+    memset(st, 0, sizeof(*st));
+}
+
+uint32_t symtabIntern(SymbolTable *st, size_t offset, size_t length) {
+    const uint16_t *units = st->source + offset;
+    uint32_t hash = hashUnits(units, length);
+    uint32_t slot;
+
+    /* Keep the table at most half full so probes stay short */
+    if ((st->symbolCount + 1) * 2 > st->bucketMask && rehash(st) != 0)
+        return SYMTAB_NONE;
+    for (slot = hash & st->bucketMask; st->buckets[slot] != 0; slot = (slot + 1) & st->bucketMask) {
+        const Symbol *sym = &st->symbols[st->buckets[slot] - 1];
+        if (sym->hash == hash && sym->length == length && memcmp(st->source + sym->offset, units, length * sizeof(*units)) == 0)
+            return st->buckets[slot] - 1;
+    }
+    if (growArray((void **) &st->symbols, &st->symbolCap, st->symbolCount, sizeof(Symbol)) != 0)
+        return SYMTAB_NONE;
+    st->symbols[st->symbolCount] = (Symbol) {(uint32_t) offset, (uint32_t) length, hash, SYMTAB_NONE};
+    st->buckets[slot] = st->symbolCount + 1;
+    return st->symbolCount++;
+}
+
+int symtabEnter(SymbolTable *st) {
+    if (growArray((void **) &st->marks, &st->markCap, st->depth, sizeof(*st->marks)) != 0)
+        return -1;
+    st->marks[st->depth++] = st->visibleCount;
+    return 0;
+}
+
+void symtabLeave(SymbolTable *st) {
+    uint32_t mark = st->marks[--st->depth];
+
+    while (st->visibleCount > mark) {
+        const Binding *b = &st->bindings[st->visible[--st->visibleCount]];
+        st->symbols[b->symbol].binding = b->previous;
+    }
+}
+
+uint32_t symtabDeclare(SymbolTable *st, uint32_t symbol, int type) {
+    uint32_t current = st->symbols[symbol].binding;
+
+    if (current != SYMTAB_NONE && st->bindings[current].scope == st->depth)
+        return SYMTAB_REDECLARED;
+    if (growArray((void **) &st->bindings, &st->bindingCap, st->bindingCount, sizeof(Binding)) != 0 ||
+        growArray((void **) &st->visible, &st->visibleCap, st->visibleCount, sizeof(*st->visible)) != 0)
+        return SYMTAB_NONE;
+    st->bindings[st->bindingCount] = (Binding) {symbol, current, st->depth, type, 0};
+    st->visible[st->visibleCount++] = st->bindingCount;
+    st->symbols[symbol].binding = st->bindingCount;
+    return st->bindingCount++;
+}
@@ -0,0 +1,74 @@
+/* symtab.h - scoped symbol table over interned identifiers
+ *
+ * Every distinct identifier of a file is interned once into a Symbol, found again through an open-addressing
+ * hash table keyed by its code units, so later comparisons are between small integers. Each declaration is a
+ * Binding; a symbol points at its innermost visible binding and each binding at the one it shadows. Leaving a
+ * block pops the bindings it made and restores what they shadowed, so a lookup is one hash probe and one index
+ * however many variables and scopes there are.
+ */
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Returned by symtabIntern and symtabDeclare when memory runs out, and by symtabLookup for an undeclared name */
+#define SYMTAB_NONE UINT32_MAX
+/* Returned by symtabDeclare when the name is already declared in the innermost block */
+#define SYMTAB_REDECLARED (UINT32_MAX - 1)
+
+/* An interned identifier */
+typedef struct {
+    uint32_t offset;    /* its first occurrence in the source */
+    uint32_t length;    /* code units */
+    uint32_t hash;
+    uint32_t binding;   /* innermost visible declaration, or SYMTAB_NONE */
+} Symbol;
+
+/* One declaration; its index numbers the variable for the rest of the file */
+typedef struct {
+    uint32_t symbol;
+    uint32_t previous;  /* declaration of the same symbol it shadows, or SYMTAB_NONE */
+    uint32_t scope;     /* depth of the block it belongs to */
+    int type;           /* TYPE_ token of the declaration */
+    uint32_t length;    /* elements of an array, 0 for a single value */
+} Binding;
+
+typedef struct {
+    const uint16_t *source;
+    Symbol *symbols;
+    uint32_t symbolCount, symbolCap;
+    uint32_t *buckets;      /* symbol index + 1 per slot, 0 for an empty slot */
+    uint32_t bucketMask;
+    Binding *bindings;
+    uint32_t bindingCount, bindingCap;
+    uint32_t *visible;      /* bindings of the open blocks, innermost last */
+    uint32_t visibleCount, visibleCap;
+    uint32_t *marks;        /* visibleCount when each open block was entered */
+    uint32_t depth, markCap;
+} SymbolTable;
+
+/* symtabInit - an empty table over identifiers taken from source */
+void symtabInit(SymbolTable *st, const uint16_t *source);
+
+/* symtabFree - release the table */
+void symtabFree(SymbolTable *st);
+
+/* symtabIntern - the symbol of the identifier at source[offset], length units long, added if new */
+uint32_t symtabIntern(SymbolTable *st, size_t offset, size_t length);
+
+/* symtabEnter - open a block */
+int symtabEnter(SymbolTable *st);
+
+/* symtabLeave - close the innermost block, forgetting its declarations */
+void symtabLeave(SymbolTable *st);
+
+/* symtabDeclare - declare symbol with type in the innermost block, as a single value; returns the new binding */
+uint32_t symtabDeclare(SymbolTable *st, uint32_t symbol, int type);
+
+/* symtabLookup - the binding symbol currently refers to, or SYMTAB_NONE */
+static inline uint32_t symtabLookup(const SymbolTable *st, uint32_t symbol) {
+    return st->symbols[symbol].binding;
+}
+
+#endif
@@ -0,0 +1,59 @@
+/* tokens.c - growable struct-of-arrays token buffer */
+#include <stdlib.h>
+#include <string.h>
+
+#include "tokens.h"
+
+/* grow - reallocate the three arrays to hold cap tokens */
+static int grow(TokenBuffer *buf, size_t cap) {
+    uint8_t *kind = realloc(buf->kind, cap * sizeof(*kind));
+    uint32_t *offset, *length;
+
+    if (kind == NULL)
+        return -1;
+    buf->kind = kind;
+    if ((offset = realloc(buf->offset, cap * sizeof(*offset))) == NULL)
+        return -1;
+    buf->offset = offset;
+    if ((length = realloc(buf->length, cap * sizeof(*length))) == NULL)
+        return -1;
+    buf->length = length;
+    buf->cap = cap;
+    return 0;
+}
+
+int tokenBufferInit(TokenBuffer *buf, size_t expected) {
+    memset(buf, 0, sizeof(*buf));
+    return grow(buf, expected > 16 ? expected : 16);
+}
+
+void tokenBufferFree(TokenBuffer *buf) {
+    free(buf->kind);
+    free(buf->offset);
+    free(buf->length);
+    free(buf->values);
+    memset(buf, 0, sizeof(*buf));
+}
+
+int tokenBufferPush(TokenBuffer *buf, int token, size_t offset, size_t length) {
+    if (buf->count == buf->cap && grow(buf, buf->cap * 2) != 0)
+        return -1;
+    buf->kind[buf->count] = token < 0 ? TOKEN_KIND_EOF : (uint8_t) token;
+    buf->offset[buf->count] = (uint32_t) offset;
+    buf->length[buf->count] = (uint32_t) length;
+    buf->count++;
+    return 0;
+}
+
+int tokenBufferPushValue(TokenBuffer *buf, uint64_t value) {
+    if (buf->valueCount == buf->valueCap) {
+        size_t cap = buf->valueCap > 0 ? buf->valueCap * 2 : 64;
+        uint64_t *values = realloc(buf->values, cap * sizeof(*values));
+        if (values == NULL)
+            return -1;
+        buf->values = values;
+        buf->valueCap = cap;
+    }
+    buf->values[buf->valueCount++] = value;
+    return 0;
+}
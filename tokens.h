@@ -0,0 +1,44 @@
+/* tokens.h - a whole file's tokens in struct-of-arrays form, filled by the lexer before parsing starts */
+#ifndef TOKENS_H
+#define TOKENS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+/* Every token code fits in a byte; EOF (-1) is stored as this kind */
+#define TOKEN_KIND_EOF 0xFF
+
+/* Token i is kind[i] at units[offset[i]] .. units[offset[i] + length[i] - 1] of the source; the number
+   literals among them also have their values, in order, in values */
+typedef struct {
+    uint8_t *kind;
+    uint32_t *offset;
+    uint32_t *length;
+    size_t count;
+    size_t cap;
+    uint64_t *values;
+    size_t valueCount;
+    size_t valueCap;
+    const wchar_t *error;   /* a lexical error met while filling, or NULL */
+    size_t errorAt;         /* index of the token the error belongs to */
+} TokenBuffer;
+
+/* tokenBufferInit - an empty buffer with room for about expected tokens */
+int tokenBufferInit(TokenBuffer *buf, size_t expected);
+
+/* tokenBufferFree - release the arrays */
+void tokenBufferFree(TokenBuffer *buf);
+
+/* tokenBufferPush - append one token; returns 0, or -1 when memory runs out */
+int tokenBufferPush(TokenBuffer *buf, int token, size_t offset, size_t length);
+
+/* tokenBufferPushValue - append the value of the number literal pushed last; returns 0, or -1 when memory runs out */
+int tokenBufferPushValue(TokenBuffer *buf, uint64_t value);
+
+/* tokenCode - the token code stored at index i */
+static inline int tokenCode(const TokenBuffer *buf, size_t i) {
+    return buf->kind[i] == TOKEN_KIND_EOF ? -1 : buf->kind[i];
+}
+
+#endif
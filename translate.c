@@ -0,0 +1,691 @@
+/* translate.c - translation of a checked syntax tree into a C11 program (-c), for the system compiler to build
+ *
+ * The program becomes one main function with a local of the matching C type for every variable, named after
+ * its number (AST_VAR) so that no TR-701 name can clash with C: int64_t for tam, float for küsurat, double for
+ * dev, a 16-bit code unit for hane, int for mantık and a small TrText (code units and their count) for tümce. Like the
+ * slots of the virtual machine they are all there from the start, and a declaration assigns its initial
+ * value where it stands. An array is a static C array of its elements, aligned as the machine aligns them, and
+ * every index goes through trIndex, which stops the program where the machine would. Control flow stays structured, "madem", "iken" and "sayaç" becoming if, while and
+ * for, and "çık" and "atla" break and continue, so the C compiler sees plain loops it can optimize and
+ * vectorize. Everything else the program needs comes from a runtime written at the top of the file: tam
+ * operators that wrap around and stop the program where the machine would, comparing tümce values, and
+ * writing the variables declared outside a block just as a run (-r) reports them.
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "front.h"
+#include "vm.h"
+
+/* Extension of the C file written next to each source, in place of the source's own */
+#define TRANSLATION_EXTENSION ".c"
+
+/* The runtime every translated program starts with */
+static const char runtime[] =
+    "#include <math.h>\n"
+    "#include <stdint.h>\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "\n"
+    "/* A tümce: UTF-16 code units, as the source had them */\n"
+    "typedef struct {\n"
+    "    const uint_least16_t *units;\n"
+    "    uint32_t length;\n"
+    "} TrText;\n"
+    "\n"
+    "static inline void trStop(unsigned line, const char *reason) {\n"
+    "    fprintf(stderr, \"The program stopped.\\nReason: Line %u: %s\\n\", line, reason);\n"
+    "    exit(1);\n"
+    "}\n"
+    "\n"
+    "/* tam wraps around */\n"
+    "static inline int64_t trAdd(int64_t a, int64_t b) { return (int64_t) ((uint64_t) a + (uint64_t) b); }\n"
+    "static inline int64_t trSub(int64_t a, int64_t b) { return (int64_t) ((uint64_t) a - (uint64_t) b); }\n"
+    "static inline int64_t trMul(int64_t a, int64_t b) { return (int64_t) ((uint64_t) a * (uint64_t) b); }\n"
+    "\n"
+    "static inline int64_t trDiv(int64_t a, int64_t b, unsigned line) {\n"
+    "    if (b == 0)\n"
+    "        trStop(line, \"Division by zero.\");\n"
+    "    return b == -1 ? (int64_t) (0 - (uint64_t) a) : a / b;\n"
+    "}\n"
+    "\n"
+    "static inline int64_t trMod(int64_t a, int64_t b, unsigned line) {\n"
+    "    if (b == 0)\n"
+    "        trStop(line, \"Division by zero.\");\n"
+    "    return b == -1 ? 0 : a % b;\n"
+    "}\n"
+    "\n"
+    "static inline size_t trIndex(int64_t index, uint32_t count, unsigned line) {\n"
+    "    if ((uint64_t) index >= count)\n"
+    "        trStop(line, \"Index out of range.\");\n"
+    "    return (size_t) index;\n"
+    "}\n"
+    "\n"
+    "static inline int64_t trPow(int64_t base, int64_t exponent, unsigned line) {\n"
+    "    uint64_t result = 1, b = (uint64_t) base;\n"
+    "\n"
+    "    if (base == 0 && exponent < 0)\n"
+    "        trStop(line, \"Zero cannot be raised to a negative power.\");\n"
+    "    if (exponent < 0)\n"
+    "        return base == 1 ? 1 : base == -1 ? (exponent % 2 == 0 ? 1 : -1) : 0;\n"
+    "    for (; exponent > 0; exponent >>= 1) {\n"
+    "        if (exponent & 1)\n"
+    "            result *= b;\n"
+    "        b *= b;\n"
+    "    }\n"
+    "    return (int64_t) result;\n"
+    "}\n"
+    "\n"
+    "/* Values worked out by the optimizer that C has no literal for */\n"
+    "static inline float trBitsF(uint32_t bits) { float f; memcpy(&f, &bits, sizeof(f)); return f; }\n"
+    "static inline double trBitsD(uint64_t bits) { double d; memcpy(&d, &bits, sizeof(d)); return d; }\n"
+    "\n"
+    "static inline int trCompare(TrText a, TrText b) {\n"
+    "    uint32_t i, n = a.length < b.length ? a.length : b.length;\n"
+    "\n"
+    "    for (i = 0; i < n; i++)\n"
+    "        if (a.units[i] != b.units[i])\n"
+    "            return a.units[i] < b.units[i] ? -1 : 1;\n"
+    "    return a.length < b.length ? -1 : a.length > b.length;\n"
+    "}\n"
+    "\n"
+    "static inline void trPutUnits(const uint_least16_t *units, size_t n) {\n"
+    "    size_t i;\n"
+    "\n"
+    "    for (i = 0; i < n; i++) {\n"
+    "        uint32_t cp = units[i];\n"
+    "        if (cp >= 0xD800 && cp <= 0xDBFF && i + 1 < n && units[i + 1] >= 0xDC00 && units[i + 1] <= 0xDFFF)\n"
+    "            cp = 0x10000 + ((cp - 0xD800) << 10) + ((uint32_t) units[++i] - 0xDC00);\n"
+    "        else if (cp >= 0xD800 && cp <= 0xDFFF)\n"
+    "            cp = 0xFFFD;\n"
+    "        if (cp < 0x80) {\n"
+    "            putchar((int) cp);\n"
+    "        } else if (cp < 0x800) {\n"
+    "            putchar((int) (0xC0 | cp >> 6));\n"
+    "            putchar((int) (0x80 | (cp & 0x3F)));\n"
+    "        } else if (cp < 0x10000) {\n"
+    "            putchar((int) (0xE0 | cp >> 12));\n"
+    "            putchar((int) (0x80 | (cp >> 6 & 0x3F)));\n"
+    "            putchar((int) (0x80 | (cp & 0x3F)));\n"
+    "        } else {\n"
+    "            putchar((int) (0xF0 | cp >> 18));\n"
+    "            putchar((int) (0x80 | (cp >> 12 & 0x3F)));\n"
+    "            putchar((int) (0x80 | (cp >> 6 & 0x3F)));\n"
+    "            putchar((int) (0x80 | (cp & 0x3F)));\n"
+    "        }\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "/* The shortest text that reads back as value, with a decimal comma */\n"
+    "static inline void trPutReal(double value, int single, int digits) {\n"
+    "    char text[40], *end;\n"
+    "    int precision;\n"
+    "\n"
+    "    for (precision = single ? 6 : 15; precision < digits; precision++) {\n"
+    "        snprintf(text, sizeof(text), \"%.*g\", precision, value);\n"
+    "        if (single ? (float) strtod(text, &end) == (float) value : strtod(text, &end) == value)\n"
+    "            break;\n"
+    "    }\n"
+    "    snprintf(text, sizeof(text), \"%.*g\", precision, value);\n"
+    "    for (end = text; *end; end++)\n"
+    "        putchar(*end == '.' ? ',' : *end);\n"
+    "}\n"
+    "\n"
+    "/* Writing a variable as the declaration that would give it its value; head is \"type name <<< \" */\n"
+    "static inline void trReportInt(const char *head, int64_t v) { printf(\"%s%lld\\n\", head, (long long) v); }\n"
+    "static inline void trReportFloat(const char *head, float v) { fputs(head, stdout); trPutReal(v, 1, 9); putchar('\\n'); }\n"
+    "static inline void trReportDouble(const char *head, double v) { fputs(head, stdout); trPutReal(v, 0, 17); putchar('\\n'); }\n"
+    "static inline void trReportBool(const char *head, int v) { printf(\"%s%s\\n\", head, v ? \"do\\304\\237ru\" : \"yanl\\304\\261\\305\\237\"); }\n"
+    "\n"
+    "static inline void trReportChar(const char *head, uint_least16_t v) {\n"
+    "    fputs(head, stdout);\n"
+    "    putchar('\\'');\n"
+    "    trPutUnits(&v, 1);\n"
+    "    fputs(\"'\\n\", stdout);\n"
+    "}\n"
+    "\n"
+    "static inline void trReportText(const char *head, TrText v) {\n"
+    "    fputs(head, stdout);\n"
+    "    putchar('\"');\n"
+    "    trPutUnits(v.units, v.length);\n"
+    "    fputs(\"\\\"\\n\", stdout);\n"
+    "}\n"
+    "\n"
+    "/* Arrays, as \"[1; 2; 3]\": the decimal comma rules out ',' */\n"
+    "static inline void trReportInts(const char *head, const int64_t *v, size_t n) {\n"
+    "    size_t i;\n"
+    "\n"
+    "    fputs(head, stdout);\n"
+    "    for (i = 0; i < n; i++)\n"
+    "        printf(\"%s%lld\", i > 0 ? \"; \" : \"[\", (long long) v[i]);\n"
+    "    puts(\"]\");\n"
+    "}\n"
+    "\n"
+    "static inline void trReportFloats(const char *head, const float *v, size_t n) {\n"
+    "    size_t i;\n"
+    "\n"
+    "    fputs(head, stdout);\n"
+    "    for (i = 0; i < n; i++) {\n"
+    "        fputs(i > 0 ? \"; \" : \"[\", stdout);\n"
+    "        trPutReal(v[i], 1, 9);\n"
+    "    }\n"
+    "    puts(\"]\");\n"
+    "}\n"
+    "\n"
+    "static inline void trReportDoubles(const char *head, const double *v, size_t n) {\n"
+    "    size_t i;\n"
+    "\n"
+    "    fputs(head, stdout);\n"
+    "    for (i = 0; i < n; i++) {\n"
+    "        fputs(i > 0 ? \"; \" : \"[\", stdout);\n"
+    "        trPutReal(v[i], 0, 17);\n"
+    "    }\n"
+    "    puts(\"]\");\n"
+    "}\n"
+    "\n"
+    "static inline void trReportBools(const char *head, const int *v, size_t n) {\n"
+    "    size_t i;\n"
+    "\n"
+    "    fputs(head, stdout);\n"
+    "    for (i = 0; i < n; i++)\n"
+    "        printf(\"%s%s\", i > 0 ? \"; \" : \"[\", v[i] ? \"do\\304\\237ru\" : \"yanl\\304\\261\\305\\237\");\n"
+    "    puts(\"]\");\n"
+    "}\n";
+
+/* C type, zero value and report function of every TR-701 type */
+static const char *const cTypes[UNREGISTERED_SYMBOL + 1] = {
+    [TYPE_INT] = "int64_t", [TYPE_FLOAT] = "float", [TYPE_DOUBLE] = "double", [TYPE_CHAR] = "uint_least16_t",
+    [TYPE_BOOL] = "int", [TYPE_STRING] = "TrText",
+};
+static const char *const zeroValues[UNREGISTERED_SYMBOL + 1] = {
+    [TYPE_INT] = "0", [TYPE_FLOAT] = "0", [TYPE_DOUBLE] = "0", [TYPE_CHAR] = "0", [TYPE_BOOL] = "0",
+    [TYPE_STRING] = "(TrText) {u\"\", 0}",
+};
+static const char *const reporters[UNREGISTERED_SYMBOL + 1] = {
+    [TYPE_INT] = "trReportInt", [TYPE_FLOAT] = "trReportFloat", [TYPE_DOUBLE] = "trReportDouble",
+    [TYPE_CHAR] = "trReportChar", [TYPE_BOOL] = "trReportBool", [TYPE_STRING] = "trReportText",
+};
+static const char *const arrayReporters[UNREGISTERED_SYMBOL + 1] = {
+    [TYPE_INT] = "trReportInts", [TYPE_FLOAT] = "trReportFloats", [TYPE_DOUBLE] = "trReportDoubles",
+    [TYPE_BOOL] = "trReportBools",
+};
+
+/* Name of every type, for the report */
+static const char *const typeSpellings[UNREGISTERED_SYMBOL + 1] = {
+#define KEYWORD(token, spelling) [token] = spelling,
+#include "keywords.def"
+#undef KEYWORD
+};
+
+/* C spelling of the operators that are C operators as they are */
+static const char *const cOperators[UNREGISTERED_SYMBOL + 1] = {
+    [ADD_OP] = " + ", [SUB_OP] = " - ", [MULT_OP] = " * ", [DIV_OP] = " / ", [EQUALITY_OP] = " == ",
+    [NOT_EQUALITY_OP] = " != ", [LT_OP] = " < ", [LE_OP] = " <= ", [GT_OP] = " > ", [GE_OP] = " >= ",
+    [AND_OP] = " && ", [OR_OP] = " || ",
+};
+
+/* What a variable is, from its declaration */
+typedef struct {
+    AstRef decl;        /* its AST_DECL, or AST_NONE for a number no declaration is left with */
+    uint8_t global;     /* declared outside every block, so its value is reported at the end */
+    uint32_t count;     /* elements of an array, 0 for a single value */
+} Slot;
+
+/* An expression node being written: its text so far goes up to stage, and it ends with suffix */
+typedef struct {
+    AstRef ref;
+    uint8_t want;
+    uint8_t stage;
+    const char *suffix;
+} Pending;
+
+typedef struct {
+    Context *ctx;
+    const Ast *ast;
+    FILE *out;
+    Slot *slots;        /* one per variable number */
+    uint32_t slotCount, slotCap;
+    LineTable lines;    /* where every source line starts */
+    Pending *stack;     /* expression walk */
+    size_t stackCap;
+    int blocks;         /* blocks around the statement being written */
+    wchar_t *message;   /* why translating failed */
+    size_t messageSize;
+    int failed;
+} Translator;
+
+static void writeBlock(Translator *tr, AstRef block, int indent);
+
+/* fail - stop translating with a message built from a format */
+static void fail(Translator *tr, const wchar_t *format, ...) {
+    va_list args;
+
+    if (tr->failed)
+        return;
+    tr->failed = 1;
+    va_start(args, format);
+    if (vswprintf(tr->message, tr->messageSize, format, args) < 0)
+        wcsncpy(tr->message, L"The program cannot be translated.", tr->messageSize);
+    va_end(args);
+}
+
+/* writeUtf8 - write UTF-16 code units as the UTF-8 bytes of a C string literal, escaping all but plain ASCII */
+static void writeUtf8(Translator *tr, const uint16_t *units, size_t n) {
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        uint32_t cp = units[i];
+        unsigned char bytes[4];
+        size_t count, j;
+
+        if (cp >= 0xD800 && cp <= 0xDBFF && i + 1 < n && units[i + 1] >= 0xDC00 && units[i + 1] <= 0xDFFF)
+            cp = 0x10000 + ((cp - 0xD800) << 10) + ((uint32_t) units[++i] - 0xDC00);
+        else if (cp >= 0xD800 && cp <= 0xDFFF)
+            cp = 0xFFFD;
+        if (cp < 0x80) {
+            bytes[0] = (unsigned char) cp;
+            count = 1;
+        } else if (cp < 0x800) {
+            bytes[0] = (unsigned char) (0xC0 | cp >> 6);
+            bytes[1] = (unsigned char) (0x80 | (cp & 0x3F));
+            count = 2;
+        } else if (cp < 0x10000) {
+            bytes[0] = (unsigned char) (0xE0 | cp >> 12);
+            bytes[1] = (unsigned char) (0x80 | (cp >> 6 & 0x3F));
+            bytes[2] = (unsigned char) (0x80 | (cp & 0x3F));
+            count = 3;
+        } else {
+            bytes[0] = (unsigned char) (0xF0 | cp >> 18);
+            bytes[1] = (unsigned char) (0x80 | (cp >> 12 & 0x3F));
+            bytes[2] = (unsigned char) (0x80 | (cp >> 6 & 0x3F));
+            bytes[3] = (unsigned char) (0x80 | (cp & 0x3F));
+            count = 4;
+        }
+        for (j = 0; j < count; j++) {
+            /* Octal escapes end after three digits, so whatever follows cannot run into them; '?' could
+               start a trigraph */
+            if (bytes[j] >= 0x20 && bytes[j] < 0x7F && bytes[j] != '"' && bytes[j] != '\\' && bytes[j] != '?')
+                fputc(bytes[j], tr->out);
+            else
+                fprintf(tr->out, "\\%03o", bytes[j]);
+        }
+    }
+}
+
+/* writeConst - a value worked out by the optimizer, exactly: C has no literal for infinities and NaNs, and the
+   sign of a NaN shows when it is written */
+static void writeConst(Translator *tr, const Value *v) {
+    switch (v->type) {
+        case TYPE_INT:
+            if (v->as.i == INT64_MIN)
+                fputs("INT64_MIN", tr->out);
+            else if (v->as.i < INT32_MIN || v->as.i > INT32_MAX)
+                fprintf(tr->out, v->as.i < 0 ? "(INT64_C(%" PRId64 "))" : "INT64_C(%" PRId64 ")", v->as.i);
+            else
+                fprintf(tr->out, v->as.i < 0 ? "(%" PRId64 ")" : "%" PRId64, v->as.i);
+            break;
+        case TYPE_FLOAT:
+            if (isfinite(v->as.f)) {
+                fprintf(tr->out, "((float) %a)", (double) v->as.f);
+            } else {
+                uint32_t bits;
+                memcpy(&bits, &v->as.f, sizeof(bits));
+                fprintf(tr->out, "trBitsF(0x%08" PRIX32 "u)", bits);
+            }
+            break;
+        case TYPE_DOUBLE:
+            if (isfinite(v->as.d)) {
+                fprintf(tr->out, signbit(v->as.d) ? "(%a)" : "%a", v->as.d);
+            } else {
+                uint64_t bits;
+                memcpy(&bits, &v->as.d, sizeof(bits));
+                fprintf(tr->out, "trBitsD(UINT64_C(0x%016" PRIX64 "))", bits);
+            }
+            break;
+        case TYPE_CHAR:
+            fprintf(tr->out, "0x%04" PRIX32, v->as.c);
+            break;
+        case TYPE_BOOL:
+            fputs(v->as.b ? "1" : "0", tr->out);
+            break;
+    }
+}
+
+/* writeLeaf - the value of a name or literal as a want value */
+static void writeLeaf(Translator *tr, const AstNode *node, int want) {
+    const uint16_t *units = tr->ctx->in.units + node->offset;
+    Value v;
+    uint32_t i;
+
+    switch (node->kind) {
+        case AST_NAME:
+            fprintf(tr->out, "v%" PRIu32, node->kids[AST_VAR]);
+            return;
+        case AST_STRING:
+            /* Hex escapes in a UTF-16 literal are code units as they are, lone surrogates too */
+            fputs("(TrText) {u\"", tr->out);
+            for (i = 0; i < node->length; i++)
+                fprintf(tr->out, "\\x%" PRIX16, units[i]);
+            fprintf(tr->out, "\", %" PRIu32 "}", node->length);
+            return;
+    }
+    /* Literals as the lexer read them and worked-out values, written exactly */
+    v = literalValue(tr->ctx, node, want);
+    if (node->kind == AST_CONST && v.type != want)
+        vmWiden(&v, want);
+    writeConst(tr, &v);
+}
+
+/* callOf - the function an operator on two values of type operands is written as, or NULL for a C operator */
+static const char *callOf(int op, int operands) {
+    switch (op) {
+        case ADD_OP: return operands == TYPE_INT ? "trAdd" : NULL;
+        case SUB_OP: return operands == TYPE_INT ? "trSub" : NULL;
+        case MULT_OP: return operands == TYPE_INT ? "trMul" : NULL;
+        case DIV_OP: return operands == TYPE_INT ? "trDiv" : NULL;
+        case MOD_OP: return operands == TYPE_INT ? "trMod" : operands == TYPE_FLOAT ? "fmodf" : "fmod";
+        case POWER_OP: return operands == TYPE_INT ? "trPow" : operands == TYPE_FLOAT ? "powf" : "pow";
+    }
+    return NULL;
+}
+
+/* writeExpr - the expression under root as a want value, without recursion: each node writes what goes before
+   its first operand, between its operands and after the last as it gets to them */
+static void writeExpr(Translator *tr, AstRef root, int want) {
+    size_t depth = 0;
+
+    if (tr->stackCap == 0) {
+        if ((tr->stack = malloc(64 * sizeof(*tr->stack))) == NULL) {
+            fail(tr, L"Not enough memory to translate the program.");
+            return;
+        }
+        tr->stackCap = 64;
+    }
+    tr->stack[depth++] = (Pending) {root, (uint8_t) want, 0, ""};
+    while (depth > 0 && !tr->failed) {
+        Pending *top = &tr->stack[depth - 1];
+        const AstNode *node = &tr->ast->nodes[top->ref];
+
+        if (depth + 1 > tr->stackCap) {
+            Pending *grown = realloc(tr->stack, tr->stackCap * 2 * sizeof(*grown));
+            if (grown == NULL) {
+                fail(tr, L"Not enough memory to translate the program.");
+                return;
+            }
+            tr->stack = grown;
+            tr->stackCap *= 2;
+            top = &tr->stack[depth - 1];
+        }
+        /* A narrower number where a wider one goes; literals and worked-out values come in the wanted type */
+        if (top->stage == 0 && node->type != top->want && node->kind != AST_FLOAT && node->kind != AST_CONST) {
+            fprintf(tr->out, "((%s) ", cTypes[top->want]);
+            top->suffix = ")";
+        }
+        if (node->kind == AST_NOT) {
+            if (top->stage++ == 0) {
+                fputs("!", tr->out);
+                tr->stack[depth++] = (Pending) {node->kids[0], TYPE_BOOL, 0, ""};
+                continue;
+            }
+        } else if (node->kind == AST_INDEX) {
+            if (top->stage++ == 0) {
+                fprintf(tr->out, "v%" PRIu32 "[trIndex(", node->kids[AST_VAR]);
+                tr->stack[depth++] = (Pending) {node->kids[0], TYPE_INT, 0, ""};
+                continue;
+            }
+            fprintf(tr->out, ", %" PRIu32 ", %" PRIu32 ")]", tr->slots[node->kids[AST_VAR]].count,
+                    lineOf(&tr->lines, node->offset));
+        } else if (node->kind == AST_BINARY) {
+            int operands = operandType(tr->ast, node);
+            const char *call = callOf(node->op, operands);
+            if (top->stage < 2) {
+                if (top->stage == 0)
+                    fprintf(tr->out, "%s(%s", call != NULL ? call : "", operands == TYPE_STRING ? "trCompare(" : "");
+                else
+                    fputs(call != NULL || operands == TYPE_STRING ? ", " : cOperators[node->op], tr->out);
+                tr->stack[depth++] = (Pending) {node->kids[top->stage++], (uint8_t) operands, 0, ""};
+                continue;
+            }
+            if (operands == TYPE_INT && (node->op == DIV_OP || node->op == MOD_OP || node->op == POWER_OP))
+                fprintf(tr->out, ", %" PRIu32 ")", lineOf(&tr->lines, node->offset));
+            else if (operands == TYPE_STRING)
+                fprintf(tr->out, ")%s0)", cOperators[node->op]);
+            else
+                fputs(")", tr->out);
+        } else {
+            writeLeaf(tr, node, top->want);
+        }
+        fputs(top->suffix, tr->out);
+        depth--;
+    }
+}
+
+/* writeAssign - a variable or an element of an array taking a new value, without the ';' so that it also fits in
+   a for */
+static void writeAssign(Translator *tr, const AstNode *node) {
+    fprintf(tr->out, "v%" PRIu32, node->kids[AST_VAR]);
+    if (node->kids[1] != AST_NONE) {
+        fputs("[trIndex(", tr->out);
+        writeExpr(tr, node->kids[1], TYPE_INT);
+        fprintf(tr->out, ", %" PRIu32 ", %" PRIu32 ")]", tr->slots[node->kids[AST_VAR]].count,
+                lineOf(&tr->lines, node->offset));
+    }
+    fputs(" = ", tr->out);
+    writeExpr(tr, node->kids[0], node->type);
+}
+
+/* writeStatement - one statement and everything in it, at indent levels */
+static void writeStatement(Translator *tr, AstRef ref, int indent) {
+    const AstNode *node = &tr->ast->nodes[ref];
+
+    if (node->kind == AST_BLOCK) {
+        /* What is left of a statement the optimizer took apart */
+        writeBlock(tr, ref, indent);
+        return;
+    }
+    fprintf(tr->out, "%*s", indent * 4, "");
+    switch (node->kind) {
+        case AST_DECL:
+            if (node->kids[1] != AST_NONE) {
+                /* The elements start out zero, and go back to zero each time a block declaring them runs again */
+                fprintf(tr->out, "memset(v%" PRIu32 ", 0, sizeof(v%" PRIu32 "));\n", node->kids[AST_VAR], node->kids[AST_VAR]);
+                break;
+            }
+            fprintf(tr->out, "v%" PRIu32 " = ", node->kids[AST_VAR]);
+            if (node->kids[0] != AST_NONE)
+                writeExpr(tr, node->kids[0], node->op);
+            else
+                fputs(zeroValues[node->op], tr->out);
+            fputs(";\n", tr->out);
+            break;
+        case AST_ASSIGN:
+            writeAssign(tr, node);
+            fputs(";\n", tr->out);
+            break;
+        case AST_IF:
+            fputs("if (", tr->out);
+            writeExpr(tr, node->kids[0], TYPE_BOOL);
+            fputs(") {\n", tr->out);
+            writeBlock(tr, node->kids[1], indent + 1);
+            if (node->kids[2] != AST_NONE) {
+                fprintf(tr->out, "%*s} else {\n", indent * 4, "");
+                writeBlock(tr, node->kids[2], indent + 1);
+            }
+            fprintf(tr->out, "%*s}\n", indent * 4, "");
+            break;
+        case AST_WHILE:
+            fputs("while (", tr->out);
+            writeExpr(tr, node->kids[0], TYPE_BOOL);
+            fputs(") {\n", tr->out);
+            writeBlock(tr, node->kids[1], indent + 1);
+            fprintf(tr->out, "%*s}\n", indent * 4, "");
+            break;
+        case AST_FOR:
+            fputs("for (", tr->out);
+            writeAssign(tr, &tr->ast->nodes[node->kids[0]]);
+            fputs("; ", tr->out);
+            writeExpr(tr, node->kids[1], TYPE_BOOL);
+            fputs("; ", tr->out);
+            writeAssign(tr, &tr->ast->nodes[node->kids[2]]);
+            fputs(") {\n", tr->out);
+            writeBlock(tr, node->kids[3], indent + 1);
+            fprintf(tr->out, "%*s}\n", indent * 4, "");
+            break;
+        case AST_BREAK:
+            fputs("break;\n", tr->out);
+            break;
+        case AST_CONTINUE:
+            fputs("continue;\n", tr->out);
+            break;
+    }
+}
+
+/* writeBlock - the statements of a block in order */
+static void writeBlock(Translator *tr, AstRef block, int indent) {
+    AstRef stmt;
+
+    tr->blocks++;
+    for (stmt = tr->ast->nodes[block].kids[0]; stmt != AST_NONE && !tr->failed; stmt = tr->ast->nodes[stmt].next)
+        writeStatement(tr, stmt, indent);
+    tr->blocks--;
+}
+
+/* findSlots - every declaration of the block and the blocks in it, by variable number */
+static void findSlots(Translator *tr, AstRef block) {
+    AstRef stmt;
+
+    tr->blocks++;
+    for (stmt = tr->ast->nodes[block].kids[0]; stmt != AST_NONE && !tr->failed; stmt = tr->ast->nodes[stmt].next) {
+        const AstNode *node = &tr->ast->nodes[stmt];
+        uint32_t var = node->kids[AST_VAR];
+        size_t k;
+
+        switch (node->kind) {
+            case AST_DECL:
+                if (var >= tr->slotCap) {
+                    size_t cap = tr->slotCap ? tr->slotCap : 64;
+                    Slot *grown;
+                    while (cap <= var)
+                        cap *= 2;
+                    if ((grown = realloc(tr->slots, cap * sizeof(*grown))) == NULL) {
+                        fail(tr, L"Not enough memory to translate the program.");
+                        return;
+                    }
+                    memset(grown + tr->slotCap, 0, (cap - tr->slotCap) * sizeof(*grown));
+                    tr->slots = grown;
+                    tr->slotCap = (uint32_t) cap;
+                }
+                tr->slots[var].decl = stmt;
+                if (node->kids[1] != AST_NONE) {
+                    /* The checker made sure the length fits */
+                    tr->slots[var].count = (uint32_t) literalValue(tr->ctx, &tr->ast->nodes[node->kids[1]], TYPE_INT).as.i;
+                }
+                /* Temporaries the optimizer adds have no name and are never reported */
+                tr->slots[var].global = tr->blocks == 1 && node->length > 0;
+                if (var >= tr->slotCount)
+                    tr->slotCount = var + 1;
+                break;
+            case AST_IF: case AST_WHILE: case AST_FOR:
+                for (k = 1; k < 4; k++)
+                    if (node->kids[k] != AST_NONE && tr->ast->nodes[node->kids[k]].kind == AST_BLOCK)
+                        findSlots(tr, node->kids[k]);
+                break;
+            case AST_BLOCK:
+                findSlots(tr, stmt);
+                break;
+        }
+    }
+    tr->blocks--;
+}
+
+/* writeProgram - the runtime, then main: the variables, the statements and the report */
+static void writeProgram(Translator *tr) {
+    const char *spelling;
+    uint32_t var;
+
+    fputs("/* Translated from TR-701; build as C11 and link with the math library */\n", tr->out);
+    fputs(runtime, tr->out);
+    fputs("\nint main(void) {\n", tr->out);
+    for (var = 0; var < tr->slotCount; var++) {
+        const AstNode *decl;
+        if (tr->slots[var].decl == AST_NONE)
+            continue;
+        decl = &tr->ast->nodes[tr->slots[var].decl];
+        if (tr->slots[var].count > 0)
+            fprintf(tr->out, "    static _Alignas(%d) %s v%" PRIu32 "[%" PRIu32 "];", VM_ARRAY_ALIGN, cTypes[decl->op], var,
+                    tr->slots[var].count);
+        else
+            fprintf(tr->out, "    %s v%" PRIu32 " = %s;", cTypes[decl->op], var, zeroValues[decl->op]);
+        if (decl->length > 0) {
+            /* Names are letters, digits and '_', so they cannot end the comment */
+            fputs(" /* ", tr->out);
+            writeUtf8(tr, tr->ctx->in.units + decl->offset, decl->length);
+            fputs(" */", tr->out);
+        }
+        fputc('\n', tr->out);
+    }
+    fputc('\n', tr->out);
+    writeBlock(tr, tr->ctx->root, 1);
+    fputc('\n', tr->out);
+    for (var = 0; var < tr->slotCount; var++) {
+        const AstNode *decl;
+        if (tr->slots[var].decl == AST_NONE || !tr->slots[var].global)
+            continue;
+        decl = &tr->ast->nodes[tr->slots[var].decl];
+        fprintf(tr->out, "    %s(\"", tr->slots[var].count > 0 ? arrayReporters[decl->op] : reporters[decl->op]);
+        for (spelling = typeSpellings[decl->op]; *spelling != '\0'; spelling++)
+            fprintf(tr->out, (unsigned char) *spelling < 0x80 ? "%c" : "\\%03o", (unsigned char) *spelling);
+        if (tr->slots[var].count > 0)
+            fprintf(tr->out, "[%" PRIu32 "]", tr->slots[var].count);
+        fputc(' ', tr->out);
+        writeUtf8(tr, tr->ctx->in.units + decl->offset, decl->length);
+        if (tr->slots[var].count > 0)
+            fprintf(tr->out, " <<< \", v%" PRIu32 ", %" PRIu32 ");\n", var, tr->slots[var].count);
+        else
+            fprintf(tr->out, " <<< \", v%" PRIu32 ");\n", var);
+    }
+    fputs("    return 0;\n}\n", tr->out);
+}
+
+/* translateProgram - a function to translate the checked program in ctx into C11, written next to the source
+   at path with its extension replaced by .c; returns 0, or -1 with the reason in ctx->errMsg */
+int translateProgram(Context *ctx, const char *path) {
+    Translator tr = {.ctx = ctx, .ast = &ctx->ast};
+    wchar_t message[200];
+    char *target;
+
+    tr.message = message;
+    tr.messageSize = sizeof(message) / sizeof(message[0]);
+    if ((target = pathWithExtension(path, TRANSLATION_EXTENSION)) == NULL || readerLines(&ctx->in, &tr.lines) != 0) {
+        fail(&tr, L"Not enough memory to translate the program.");
+    } else {
+        findSlots(&tr, ctx->root);
+        if (!tr.failed && (tr.out = fopen(target, "w")) == NULL)
+            fail(&tr, L"%s cannot be written: %s", target, strerror(errno));
+    }
+    if (tr.out != NULL) {
+        writeProgram(&tr);
+        if ((ferror(tr.out) | fclose(tr.out)) != 0)
+            fail(&tr, L"%s cannot be written.", target);
+        if (tr.failed)
+            remove(target);
+    }
+    free(target);
+    freeLines(&tr.lines);
+    free(tr.slots);
+    free(tr.stack);
+    if (tr.failed) {
+        swprintf(ctx->errMsg, sizeof(ctx->errMsg) / sizeof(ctx->errMsg[0]), L"The program was not translated.\nReason: %ls", message);
+        if (ctx->traceLevel > TRACE_SILENT)
+            sinkVerdict(ctx->out, ctx->errMsg);
+        return -1;
+    }
+    return 0;
+}
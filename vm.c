@@ -0,0 +1,391 @@
+/* vm.c - the TR-701 virtual machine */
+#include <float.h>
+#include <locale.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "front.h"
+#include "kernel.h"
+#include "vm.h"
+
+/* Dispatch by jumping from each instruction straight to the next one's code where labels can be taken as
+   values (GCC, Clang), so every instruction ends in an indirect jump of its own that the branch predictor
+   can learn separately; other compilers go round a switch */
+#if defined(__GNUC__) || defined(__clang__)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+static const wchar_t *const messages[] = {
+    [VM_OK] = L"The program ran to its end.",
+    [VM_DIVISION_BY_ZERO] = L"Division by zero.",
+    [VM_ZERO_NEGATIVE_POWER] = L"Zero cannot be raised to a negative power.",
+    [VM_NO_MEMORY] = L"Not enough memory to run the program.",
+    [VM_INDEX_OUT_OF_RANGE] = L"Index out of range.",
+};
+
+void bytecodeFree(Bytecode *bc) {
+    free(bc->code);
+    free(bc->constants);
+    free(bc->text);
+    free(bc->variables);
+    free(bc->sites);
+    free(bc->kernels);
+    free(bc->statements);
+    free(bc->regions);
+    memset(bc, 0, sizeof(*bc));
+}
+
+size_t vmElementSize(int type) {
+    switch (type) {
+        case TYPE_INT: return sizeof(int64_t);
+        case TYPE_FLOAT: return sizeof(float);
+        case TYPE_DOUBLE: return sizeof(double);
+    }
+    return sizeof(int);
+}
+
+Value vmElement(const void *elements, int type, size_t i) {
+    Value v;
+
+    memset(&v, 0, sizeof(v));
+    v.type = (uint8_t) type;
+    switch (type) {
+        case TYPE_INT: v.as.i = ((const int64_t *) elements)[i]; break;
+        case TYPE_FLOAT: v.as.f = ((const float *) elements)[i]; break;
+        case TYPE_DOUBLE: v.as.d = ((const double *) elements)[i]; break;
+        default: v.as.b = ((const int *) elements)[i]; break;
+    }
+    return v;
+}
+
+/* arrayBytes - bytes the elements of an array variable take, rounded up to VM_ARRAY_ALIGN; 0 for a single value
+   or one too big to address */
+static size_t arrayBytes(const Variable *var) {
+    size_t size = vmElementSize(var->type);
+
+    if (var->count == 0 || var->count > (SIZE_MAX - VM_ARRAY_ALIGN) / size)
+        return 0;
+    return ((size_t) var->count * size + VM_ARRAY_ALIGN - 1) / VM_ARRAY_ALIGN * VM_ARRAY_ALIGN;
+}
+
+int vmInitSlots(const Bytecode *bc, Value *slots, void **arrays) {
+    size_t total = 0, bytes;
+    unsigned char *block = NULL;
+    uint32_t i;
+
+    *arrays = NULL;
+    for (i = 0; i < bc->variableCount; i++) {
+        if (bc->variables[i].count == 0)
+            continue;
+        if ((bytes = arrayBytes(&bc->variables[i])) == 0 || bytes > SIZE_MAX - total)
+            return VM_NO_MEMORY;
+        total += bytes;
+    }
+    /* Every array starts at a multiple of VM_ARRAY_ALIGN from the aligned start of the block */
+    if (total > 0 && (block = aligned_alloc(VM_ARRAY_ALIGN, total)) == NULL)
+        return VM_NO_MEMORY;
+    if (block != NULL)
+        memset(block, 0, total);
+    *arrays = block;
+    for (i = 0; i < bc->variableCount; i++) {
+        memset(&slots[i], 0, sizeof(slots[i]));
+        slots[i].type = bc->variables[i].type;
+        if (bc->variables[i].count > 0) {
+            slots[i].as.elements = block;
+            block += arrayBytes(&bc->variables[i]);
+        }
+    }
+    return VM_OK;
+}
+
+const wchar_t *vmMessage(int status) {
+    return status >= VM_OK && status <= VM_INDEX_OUT_OF_RANGE ? messages[status] : L"The program failed.";
+}
+
+/* powInt - base raised to exponent by repeated squaring, wrapping around like the other tam operations */
+static int64_t powInt(int64_t base, int64_t exponent) {
+    uint64_t result = 1, b = (uint64_t) base;
+
+    if (exponent < 0)
+        /* Only 1 and -1 have integer reciprocals; base 0 is refused before this is called */
+        return base == 1 ? 1 : base == -1 ? (exponent % 2 == 0 ? 1 : -1) : 0;
+    while (exponent > 0) {
+        if (exponent & 1)
+            result *= b;
+        b *= b;
+        exponent >>= 1;
+    }
+    return (int64_t) result;
+}
+
+/* compareText - order two tümce values by their code units */
+static int compareText(const Bytecode *bc, const Value *a, const Value *b) {
+    const uint16_t *x = bc->text + a->as.s.start, *y = bc->text + b->as.s.start;
+    uint32_t i, n = a->as.s.length < b->as.s.length ? a->as.s.length : b->as.s.length;
+
+    for (i = 0; i < n; i++)
+        if (x[i] != y[i])
+            return x[i] < y[i] ? -1 : 1;
+    return a->as.s.length < b->as.s.length ? -1 : a->as.s.length > b->as.s.length;
+}
+
+void vmWiden(Value *v, int type) {
+    if (type == TYPE_DOUBLE && v->type != TYPE_DOUBLE)
+        v->as.d = v->type == TYPE_INT ? (double) v->as.i : (double) v->as.f;
+    else if (type == TYPE_FLOAT && v->type == TYPE_INT)
+        v->as.f = (float) v->as.i;
+    v->type = (uint8_t) type;
+}
+
+int vmApply(int op, Value *a, const Value *b) {
+    int result = 0;
+
+    if (op == OP_NOT) {
+        a->as.b = !a->as.b;
+        return VM_OK;
+    }
+    if (op >= OP_ADD && op <= OP_POW) {
+        switch (a->type) {
+            case TYPE_INT: {
+                uint64_t x = (uint64_t) a->as.i, y = (uint64_t) b->as.i;
+                if ((op == OP_DIV || op == OP_MOD) && b->as.i == 0)
+                    return VM_DIVISION_BY_ZERO;
+                if (op == OP_POW && a->as.i == 0 && b->as.i < 0)
+                    return VM_ZERO_NEGATIVE_POWER;
+                switch (op) {
+                    case OP_ADD: a->as.i = (int64_t) (x + y); break;
+                    case OP_SUB: a->as.i = (int64_t) (x - y); break;
+                    case OP_MUL: a->as.i = (int64_t) (x * y); break;
+                    case OP_DIV: a->as.i = b->as.i == -1 ? (int64_t) (0 - x) : a->as.i / b->as.i; break;
+                    case OP_MOD: a->as.i = b->as.i == -1 ? 0 : a->as.i % b->as.i; break;
+                    default: a->as.i = powInt(a->as.i, b->as.i); break;
+                }
+                break;
+            }
+            case TYPE_FLOAT:
+                switch (op) {
+                    case OP_ADD: a->as.f = a->as.f + b->as.f; break;
+                    case OP_SUB: a->as.f = a->as.f - b->as.f; break;
+                    case OP_MUL: a->as.f = a->as.f * b->as.f; break;
+                    case OP_DIV: a->as.f = a->as.f / b->as.f; break;
+                    case OP_MOD: a->as.f = fmodf(a->as.f, b->as.f); break;
+                    default: a->as.f = powf(a->as.f, b->as.f); break;
+                }
+                break;
+            default:
+                switch (op) {
+                    case OP_ADD: a->as.d = a->as.d + b->as.d; break;
+                    case OP_SUB: a->as.d = a->as.d - b->as.d; break;
+                    case OP_MUL: a->as.d = a->as.d * b->as.d; break;
+                    case OP_DIV: a->as.d = a->as.d / b->as.d; break;
+                    case OP_MOD: a->as.d = fmod(a->as.d, b->as.d); break;
+                    default: a->as.d = pow(a->as.d, b->as.d); break;
+                }
+                break;
+        }
+        return VM_OK;
+    }
+    /* A comparison: order the two values as -1, 0 or 1 (2 when either is not a number) */
+    switch (a->type) {
+        case TYPE_INT: result = (a->as.i > b->as.i) - (a->as.i < b->as.i); break;
+        case TYPE_FLOAT: result = a->as.f != a->as.f || b->as.f != b->as.f ? 2 : (a->as.f > b->as.f) - (a->as.f < b->as.f); break;
+        case TYPE_DOUBLE: result = a->as.d != a->as.d || b->as.d != b->as.d ? 2 : (a->as.d > b->as.d) - (a->as.d < b->as.d); break;
+        case TYPE_CHAR: result = (a->as.c > b->as.c) - (a->as.c < b->as.c); break;
+        default: result = (a->as.b > b->as.b) - (a->as.b < b->as.b); break;
+    }
+    switch (op) {
+        case OP_EQ: a->as.b = result == 0; break;
+        case OP_NE: a->as.b = result != 0; break;
+        case OP_LT: a->as.b = result == -1; break;
+        case OP_LE: a->as.b = result == -1 || result == 0; break;
+        case OP_GT: a->as.b = result == 1; break;
+        default: a->as.b = result == 1 || result == 0; break;
+    }
+    a->type = TYPE_BOOL;
+    return VM_OK;
+}
+
+/* How values of mantık are written */
+static const uint16_t trueUnits[] = {'d', 'o', 0x011F, 'r', 'u'};
+static const uint16_t falseUnits[] = {'y', 'a', 'n', 'l', 0x0131, 0x015F};
+
+/* putAscii - copy an ASCII string into code units; returns how many */
+static size_t putAscii(uint16_t *units, const char *text) {
+    size_t n = 0;
+    while (text[n] != '\0') {
+        units[n] = (uint16_t) (unsigned char) text[n];
+        n++;
+    }
+    return n;
+}
+
+/* Longest %.*g of a dev: a sign, DBL_DECIMAL_DIG digits, the point, "e-308" and the terminator */
+#define REAL_TEXT_SIZE (DBL_DECIMAL_DIG + 8)
+
+/* putReal - the shortest text that reads back as value, at most digits significant digits, with the decimal
+   comma of TR-701 */
+static size_t putReal(uint16_t *units, double value, int single, int digits) {
+    char text[REAL_TEXT_SIZE], *end;
+    int precision, length;
+
+    if (digits > DBL_DECIMAL_DIG)
+        digits = DBL_DECIMAL_DIG;
+    for (precision = single ? 6 : 15;; precision++) {
+        length = snprintf(text, sizeof(text), "%.*g", precision, value);
+        if (precision >= digits || (single ? (float) strtod(text, &end) == (float) value : strtod(text, &end) == value))
+            break;
+    }
+    /* Only a precision past DBL_DECIMAL_DIG could overrun text */
+    if (length < 0 || length >= (int) sizeof(text))
+        return putAscii(units, "?");
+    for (end = text; *end; end++)
+        if (*end == localeconv()->decimal_point[0])
+            *end = ',';
+    return putAscii(units, text);
+}
+
+size_t vmFormat(const Value *v, uint16_t *units) {
+    char digits[24];
+
+    switch (v->type) {
+        case TYPE_INT:
+            snprintf(digits, sizeof(digits), "%lld", (long long) v->as.i);
+            return putAscii(units, digits);
+        case TYPE_FLOAT:
+            return putReal(units, v->as.f, 1, 9);
+        case TYPE_DOUBLE:
+            return putReal(units, v->as.d, 0, 17);
+        case TYPE_BOOL:
+            memcpy(units, v->as.b ? trueUnits : falseUnits, v->as.b ? sizeof(trueUnits) : sizeof(falseUnits));
+            return v->as.b ? sizeof(trueUnits) / sizeof(trueUnits[0]) : sizeof(falseUnits) / sizeof(falseUnits[0]);
+        case TYPE_CHAR:
+            units[0] = (uint16_t) v->as.c;
+            return 1;
+    }
+    return 0;
+}
+
+/* findSite - the source position of the instruction at code offset at */
+static uint32_t findSite(const Bytecode *bc, uint32_t at) {
+    uint32_t low = 0, high = bc->siteCount;
+
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (bc->sites[mid].code < at)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low < bc->siteCount && bc->sites[low].code == at ? bc->sites[low].source : 0;
+}
+
+/* Operand of the instruction being run, and moving past it */
+#define OPERAND(type) (memcpy(&operand, pc, 4), pc += 4, (type) operand)
+
+/* Arithmetic on the two values on top of the stack, which the compiler made the same type; tam wraps around */
+#define ARITHMETIC(intResult, realOp) \
+    do { \
+        Value *a = sp - 2, *b = sp - 1; \
+        switch (a->type) { \
+            case TYPE_INT: a->as.i = (intResult); break; \
+            case TYPE_FLOAT: a->as.f = a->as.f realOp b->as.f; break; \
+            default: a->as.d = a->as.d realOp b->as.d; break; \
+        } \
+        sp--; \
+    } while (0)
+
+/* Comparison of the two values on top of the stack, leaving a mantık value */
+#define COMPARE(op) \
+    do { \
+        Value *a = sp - 2, *b = sp - 1; \
+        int result; \
+        switch (a->type) { \
+            case TYPE_INT: result = a->as.i op b->as.i; break; \
+            case TYPE_FLOAT: result = a->as.f op b->as.f; break; \
+            case TYPE_DOUBLE: result = a->as.d op b->as.d; break; \
+            case TYPE_CHAR: result = a->as.c op b->as.c; break; \
+            case TYPE_BOOL: result = a->as.b op b->as.b; break; \
+            default: result = compareText(bc, a, b) op 0; break; \
+        } \
+        a->type = TYPE_BOOL; \
+        a->as.b = result; \
+        sp--; \
+    } while (0)
+
+/* Arithmetic of one type: the result goes where the left operand was, in the same member */
+#define TYPED(member, result) \
+    do { \
+        Value *a = sp - 2, *b = sp - 1; \
+        a->as.member = (result); \
+        sp--; \
+    } while (0)
+
+/* Comparison of one type, leaving a mantık value */
+#define TYPED_COMPARE(member, op) \
+    do { \
+        Value *a = sp - 2, *b = sp - 1; \
+        int result = a->as.member op b->as.member; \
+        a->type = TYPE_BOOL; \
+        a->as.b = result; \
+        sp--; \
+    } while (0)
+
+/* Stop the run with an error blamed on the instruction just started */
+#define STOP(why) \
+    do { \
+        status = (why); \
+        failed = (uint32_t) (pc - 1 - bc->code); \
+        goto done; \
+    } while (0)
+
+/* ... and on one that has read its operand already */
+#define STOP_AFTER_OPERAND(why) \
+    do { \
+        pc -= 4; \
+        STOP(why); \
+    } while (0)
+
+#ifdef VM_COMPUTED_GOTO
+#define TARGET(op) do_##op: case op
+#define DISPATCH() \
+    do { \
+        PROFILE_STEP(); \
+        goto *targets[*pc++]; \
+    } while (0)
+#else
+#define TARGET(op) case op
+#define DISPATCH() continue
+#endif
+
+/* Instructions between two samples of the time in vmProfile: a prime, so that a loop of any length does not
+   have every sample land on the same one of its instructions */
+#define PROFILE_INTERVAL 1021
+
+/* profileClock - a clock in nanoseconds for the samples */
+static uint64_t profileClock(void) {
+    struct timespec now;
+
+    timespec_get(&now, TIME_UTC);
+    return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+}
+
+#define VM_LOOP runPlain
+#include "vmrun.h"
+#undef VM_LOOP
+
+#define VM_PROFILING
+#define VM_LOOP runProfiled
+#include "vmrun.h"
+#undef VM_LOOP
+#undef VM_PROFILING
+
+int vmRun(const Bytecode *bc, Value *slots, uint32_t *where) {
+    return runPlain(bc, slots, where, NULL);
+}
+
+int vmProfile(const Bytecode *bc, Value *slots, uint32_t *where, Profile *profile) {
+    return runProfiled(bc, slots, where, profile);
+}
@@ -0,0 +1,175 @@
+/* vm.h - bytecode of a checked TR-701 program and the virtual machine that runs it
+ *
+ * compile.c turns the syntax tree into one flat run of instructions for a stack machine: an opcode byte,
+ * then its operand if it has one (opcodes.def). Every variable of the program gets a slot of its own,
+ * numbered like its declaration (AST_VAR), and literals go into a constant pool. Values carry the TYPE_
+ * token of what they hold next to the value itself, so one slot or stack entry fits any of the six types.
+ * Numbers are combined by typed instructions (OP_ADD_I and the like) that the compiler picks from the checked
+ * types, so they never look at that token; they still keep it right for the instructions that do, those
+ * comparing hane, mantık and tümce, and for the report of a run. An array's slot points at its elements, kept
+ * as plain C values (int64_t, float, double, and int for mantık) in one block aligned for vector loads; a
+ * sayaç loop that only maps or sums elements runs as one OP_ARRAY_LOOP through a vectorized Kernel (kernel.h).
+ * vmRun dispatches with computed goto where the compiler has it and a switch elsewhere; vmProfile is the same
+ * loop (vmrun.h) counting what it does into a Profile, for -P.
+ */
+#ifndef VM_H
+#define VM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+/* Opcodes */
+enum {
+#define OPCODE(name, operandBytes, stackEffect) name,
+#include "opcodes.def"
+#undef OPCODE
+    OPCODE_COUNT
+};
+
+/* A value of any TR-701 type */
+typedef struct {
+    uint8_t type;       /* TYPE_ token of the member in use */
+    union {
+        int64_t i;      /* tam */
+        float f;        /* küsurat */
+        double d;       /* dev */
+        uint32_t c;     /* hane: one UTF-16 code unit */
+        int b;          /* mantık: 1 or 0 */
+        struct {
+            uint32_t start, length;
+        } s;            /* tümce: code units in Bytecode.text */
+        void *elements; /* an array: its first element */
+    } as;
+} Value;
+
+/* The payload is what an AST_CONST node keeps (ast.h) */
+_Static_assert(sizeof(((Value *) 0)->as) == 8, "a Value payload is 64 bits");
+
+/* A variable: where its name is kept in Bytecode.text and whether it outlives the program's run */
+typedef struct {
+    uint32_t name, length;
+    uint8_t type;       /* declared TYPE_ token */
+    uint8_t global;     /* declared outside every block, so its value is reported after the run */
+    uint32_t count;     /* elements of an array, 0 for a single value */
+} Variable;
+
+/* An instruction that can fail at run time and the source position it was compiled from */
+typedef struct {
+    uint32_t code;
+    uint32_t source;
+} Site;
+
+/* A madem, iken or sayaç statement: the code compiled from it and the jump that decides it, which is the
+   JUMP_FALSE past the then-block of a madem and the jump back to the body at the end of a loop */
+typedef struct {
+    uint32_t start, end;
+    uint32_t branch;
+    uint32_t source;
+    uint8_t kind;       /* AST_IF, AST_WHILE or AST_FOR */
+} Region;
+
+/* Operands of a Kernel */
+#define KERNEL_ARRAY 0      /* the element of the array in slot index at the loop's counter */
+#define KERNEL_SCALAR 1     /* the variable in slot index, of the elements' type */
+#define KERNEL_CONSTANT 2   /* constants[index], of the elements' type */
+
+typedef struct {
+    uint32_t kind;      /* KERNEL_ */
+    uint32_t index;
+} KernelOperand;
+
+/* Shapes of a Kernel, with i running over the loop's range */
+#define KERNEL_MAP 0        /* target[i] = left op right, or target[i] = left when op is 0 */
+#define KERNEL_SUM 1        /* target = target + left[i] */
+#define KERNEL_DOT 2        /* target = target + left[i] * right[i] */
+
+/* A sayaç loop compiled to OP_ARRAY_LOOP: what its one statement does to every element */
+typedef struct {
+    uint8_t shape;      /* KERNEL_ shape */
+    uint8_t op;         /* ADD_OP, SUB_OP, MULT_OP or DIV_OP of a map, 0 for a copy */
+    uint8_t type;       /* TYPE_ token of the elements */
+    uint8_t unused;
+    uint32_t counter;   /* slot of the loop's variable */
+    uint32_t target;    /* slot of the array a map writes, or of the variable a sum adds to */
+    KernelOperand left, right;
+} Kernel;
+
+typedef struct {
+    uint8_t *code;
+    uint32_t codeLen, codeCap;
+    Value *constants;
+    uint32_t constantCount, constantCap;
+    uint16_t *text;         /* string constants and variable names */
+    uint32_t textLen, textCap;
+    Variable *variables;    /* one per slot */
+    uint32_t variableCount, variableCap;
+    Site *sites;            /* in code order */
+    uint32_t siteCount, siteCap;
+    uint32_t maxStack;      /* values on the stack at most */
+    Kernel *kernels;        /* of the OP_ARRAY_LOOP instructions */
+    uint32_t kernelCount, kernelCap;
+    /* For the profiler only, and not kept in the cache (cache.h) */
+    Site *statements;       /* where the code of each statement, loop condition and sayaç step starts, in code order */
+    uint32_t statementCount, statementCap;
+    Region *regions;        /* outer ones before the ones inside them */
+    uint32_t regionCount, regionCap;
+} Bytecode;
+
+/* What vmProfile counts; each array has an entry per byte of code, used at the offset of each instruction, and
+   starts out zeroed */
+typedef struct {
+    uint64_t *counts;       /* times the instruction ran */
+    uint64_t *taken;        /* times the jump there jumped */
+    uint64_t *nanoseconds;  /* time sampled there, every few instructions */
+    uint64_t elapsed;       /* nanoseconds the whole run took */
+} Profile;
+
+/* Results of vmRun */
+#define VM_OK 0
+#define VM_DIVISION_BY_ZERO 1
+#define VM_ZERO_NEGATIVE_POWER 2
+#define VM_NO_MEMORY 3
+#define VM_INDEX_OUT_OF_RANGE 4
+
+/* Alignment of every array's elements, enough for the widest vector load of a Kernel */
+#define VM_ARRAY_ALIGN 32
+
+/* bytecodeFree - release everything a compiled program holds */
+void bytecodeFree(Bytecode *bc);
+
+/* vmRun - run bc with its variables in slots (variableCount of them, set to zero values by vmInitSlots);
+   returns VM_OK or the error that stopped it, with the source offset of the failing instruction in *where */
+int vmRun(const Bytecode *bc, Value *slots, uint32_t *where);
+
+/* vmProfile - vmRun, counting every instruction and taken jump of the run into profile */
+int vmProfile(const Bytecode *bc, Value *slots, uint32_t *where, Profile *profile);
+
+/* vmInitSlots - give every slot the zero value of its variable's type, and every array zeroed elements of its
+   own in one block put in *arrays for the caller to free; returns VM_OK or VM_NO_MEMORY */
+int vmInitSlots(const Bytecode *bc, Value *slots, void **arrays);
+
+/* vmElementSize - bytes an element of an array of type takes */
+size_t vmElementSize(int type);
+
+/* vmElement - element i of an array of type as a Value */
+Value vmElement(const void *elements, int type, size_t i);
+
+/* vmMessage - what a result of vmRun means, as a sentence */
+const wchar_t *vmMessage(int status);
+
+/* vmWiden - convert a tam or küsurat value to the wider numeric type, as OP_WIDEN does */
+void vmWiden(Value *v, int type);
+
+/* vmApply - a = a op b for an arithmetic or comparison instruction, or a = !a for OP_NOT, with the result the
+   machine gives; neither value may be a tümce. Returns VM_OK or the error the instruction stops with */
+int vmApply(int op, Value *a, const Value *b);
+
+/* Code units vmFormat writes at most */
+#define VM_FORMAT_MAX 40
+
+/* vmFormat - a value other than a tümce as TR-701 writes it (decimal comma, doğru/yanlış), without quotes;
+   returns the number of code units */
+size_t vmFormat(const Value *v, uint16_t *units);
+
+#endif
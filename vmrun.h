@@ -0,0 +1,366 @@
+/* vmrun.h - the dispatch loop of the virtual machine, defined as VM_LOOP each time vm.c includes it
+ *
+ * vm.c includes it twice: once as it is, for vmRun, and once with VM_PROFILING defined, for vmProfile. Whatever
+ * the profiler does goes through PROFILE_STEP, at the start of every instruction, PROFILE_TAKEN, in every jump
+ * that jumps, and PROFILE_CHARGE, after an instruction that can run for long; all are empty in the first copy,
+ * so a run without the profiler goes through exactly the loop it did before there was one.
+ */
+
+static int VM_LOOP(const Bytecode *bc, Value *slots, uint32_t *where, Profile *profile) {
+#ifdef VM_COMPUTED_GOTO
+    static void *const targets[OPCODE_COUNT] = {
+#define OPCODE(name, operandBytes, stackEffect) [name] = &&do_##name,
+#include "opcodes.def"
+#undef OPCODE
+    };
+#endif
+    const uint8_t *pc = bc->code;
+    const Value *constants = bc->constants;
+    Value *stack = malloc(((size_t) bc->maxStack + 1) * sizeof(*stack)), *sp = stack;
+    uint32_t operand, failed = 0;
+    int status = VM_OK;
+#ifdef VM_PROFILING
+    uint32_t at = 0, tick = PROFILE_INTERVAL;
+    uint64_t start = profileClock(), last = start;
+#define PROFILE_STEP() \
+    do { \
+        at = (uint32_t) (pc - bc->code); \
+        profile->counts[at]++; \
+        if (--tick == 0) { \
+            uint64_t sampled = profileClock(); \
+            profile->nanoseconds[at] += sampled - last; \
+            last = sampled; \
+            tick = PROFILE_INTERVAL; \
+        } \
+    } while (0)
+#define PROFILE_TAKEN() (profile->taken[at]++)
+#define PROFILE_CHARGE() \
+    do { \
+        uint64_t sampled = profileClock(); \
+        profile->nanoseconds[at] += sampled - last; \
+        last = sampled; \
+    } while (0)
+#else
+#define PROFILE_STEP() ((void) 0)
+#define PROFILE_TAKEN() ((void) 0)
+#define PROFILE_CHARGE() ((void) 0)
+    (void) profile;
+#endif
+
+    if (stack == NULL)
+        return VM_NO_MEMORY;
+    for (;;) {
+        PROFILE_STEP();
+        switch (*pc++) {
+            TARGET(OP_HALT):
+                goto done;
+            TARGET(OP_CONST):
+                *sp++ = constants[OPERAND(uint32_t)];
+                DISPATCH();
+            TARGET(OP_LOAD):
+                *sp++ = slots[OPERAND(uint32_t)];
+                DISPATCH();
+            TARGET(OP_STORE):
+                slots[OPERAND(uint32_t)] = *--sp;
+                DISPATCH();
+            TARGET(OP_WIDEN): {
+                Value *a = sp - 1;
+                int to = OPERAND(int);
+                if (to == TYPE_DOUBLE)
+                    a->as.d = a->type == TYPE_INT ? (double) a->as.i : (double) a->as.f;
+                else
+                    a->as.f = (float) a->as.i;
+                a->type = (uint8_t) to;
+                DISPATCH();
+            }
+            TARGET(OP_ADD):
+                ARITHMETIC((int64_t) ((uint64_t) a->as.i + (uint64_t) b->as.i), +);
+                DISPATCH();
+            TARGET(OP_SUB):
+                ARITHMETIC((int64_t) ((uint64_t) a->as.i - (uint64_t) b->as.i), -);
+                DISPATCH();
+            TARGET(OP_MUL):
+                ARITHMETIC((int64_t) ((uint64_t) a->as.i * (uint64_t) b->as.i), *);
+                DISPATCH();
+            TARGET(OP_DIV):
+                if (sp[-1].type == TYPE_INT && sp[-1].as.i == 0)
+                    STOP(VM_DIVISION_BY_ZERO);
+                /* INT64_MIN / -1 overflows; it wraps around to INT64_MIN like the rest of tam */
+                ARITHMETIC(b->as.i == -1 ? (int64_t) (0 - (uint64_t) a->as.i) : a->as.i / b->as.i, /);
+                DISPATCH();
+            TARGET(OP_MOD): {
+                Value *a = sp - 2, *b = sp - 1;
+                switch (a->type) {
+                    case TYPE_INT:
+                        if (b->as.i == 0)
+                            STOP(VM_DIVISION_BY_ZERO);
+                        a->as.i = b->as.i == -1 ? 0 : a->as.i % b->as.i;
+                        break;
+                    case TYPE_FLOAT: a->as.f = fmodf(a->as.f, b->as.f); break;
+                    default: a->as.d = fmod(a->as.d, b->as.d); break;
+                }
+                sp--;
+                DISPATCH();
+            }
+            TARGET(OP_POW): {
+                Value *a = sp - 2, *b = sp - 1;
+                switch (a->type) {
+                    case TYPE_INT:
+                        if (a->as.i == 0 && b->as.i < 0)
+                            STOP(VM_ZERO_NEGATIVE_POWER);
+                        a->as.i = powInt(a->as.i, b->as.i);
+                        break;
+                    case TYPE_FLOAT: a->as.f = powf(a->as.f, b->as.f); break;
+                    default: a->as.d = pow(a->as.d, b->as.d); break;
+                }
+                sp--;
+                DISPATCH();
+            }
+            TARGET(OP_EQ):
+                COMPARE(==);
+                DISPATCH();
+            TARGET(OP_NE):
+                COMPARE(!=);
+                DISPATCH();
+            TARGET(OP_LT):
+                COMPARE(<);
+                DISPATCH();
+            TARGET(OP_LE):
+                COMPARE(<=);
+                DISPATCH();
+            TARGET(OP_GT):
+                COMPARE(>);
+                DISPATCH();
+            TARGET(OP_GE):
+                COMPARE(>=);
+                DISPATCH();
+            TARGET(OP_NOT):
+                sp[-1].as.b = !sp[-1].as.b;
+                DISPATCH();
+            TARGET(OP_JUMP): {
+                int32_t offset = OPERAND(int32_t);
+                PROFILE_TAKEN();
+                pc += offset;
+                DISPATCH();
+            }
+            TARGET(OP_JUMP_FALSE): {
+                int32_t offset = OPERAND(int32_t);
+                if (!(--sp)->as.b) {
+                    PROFILE_TAKEN();
+                    pc += offset;
+                }
+                DISPATCH();
+            }
+            TARGET(OP_JUMP_TRUE): {
+                int32_t offset = OPERAND(int32_t);
+                if ((--sp)->as.b) {
+                    PROFILE_TAKEN();
+                    pc += offset;
+                }
+                DISPATCH();
+            }
+            TARGET(OP_JUMP_FALSE_OR_POP): {
+                int32_t offset = OPERAND(int32_t);
+                if (!sp[-1].as.b) {
+                    PROFILE_TAKEN();
+                    pc += offset;
+                } else {
+                    sp--;
+                }
+                DISPATCH();
+            }
+            TARGET(OP_JUMP_TRUE_OR_POP): {
+                int32_t offset = OPERAND(int32_t);
+                if (sp[-1].as.b) {
+                    PROFILE_TAKEN();
+                    pc += offset;
+                } else {
+                    sp--;
+                }
+                DISPATCH();
+            }
+            TARGET(OP_ADD_I):
+                TYPED(i, (int64_t) ((uint64_t) a->as.i + (uint64_t) b->as.i));
+                DISPATCH();
+            TARGET(OP_ADD_F):
+                TYPED(f, a->as.f + b->as.f);
+                DISPATCH();
+            TARGET(OP_ADD_D):
+                TYPED(d, a->as.d + b->as.d);
+                DISPATCH();
+            TARGET(OP_SUB_I):
+                TYPED(i, (int64_t) ((uint64_t) a->as.i - (uint64_t) b->as.i));
+                DISPATCH();
+            TARGET(OP_SUB_F):
+                TYPED(f, a->as.f - b->as.f);
+                DISPATCH();
+            TARGET(OP_SUB_D):
+                TYPED(d, a->as.d - b->as.d);
+                DISPATCH();
+            TARGET(OP_MUL_I):
+                TYPED(i, (int64_t) ((uint64_t) a->as.i * (uint64_t) b->as.i));
+                DISPATCH();
+            TARGET(OP_MUL_F):
+                TYPED(f, a->as.f * b->as.f);
+                DISPATCH();
+            TARGET(OP_MUL_D):
+                TYPED(d, a->as.d * b->as.d);
+                DISPATCH();
+            TARGET(OP_DIV_I):
+                if (sp[-1].as.i == 0)
+                    STOP(VM_DIVISION_BY_ZERO);
+                TYPED(i, b->as.i == -1 ? (int64_t) (0 - (uint64_t) a->as.i) : a->as.i / b->as.i);
+                DISPATCH();
+            TARGET(OP_DIV_F):
+                TYPED(f, a->as.f / b->as.f);
+                DISPATCH();
+            TARGET(OP_DIV_D):
+                TYPED(d, a->as.d / b->as.d);
+                DISPATCH();
+            TARGET(OP_MOD_I):
+                if (sp[-1].as.i == 0)
+                    STOP(VM_DIVISION_BY_ZERO);
+                TYPED(i, b->as.i == -1 ? 0 : a->as.i % b->as.i);
+                DISPATCH();
+            TARGET(OP_MOD_F):
+                TYPED(f, fmodf(a->as.f, b->as.f));
+                DISPATCH();
+            TARGET(OP_MOD_D):
+                TYPED(d, fmod(a->as.d, b->as.d));
+                DISPATCH();
+            TARGET(OP_POW_I):
+                if (sp[-2].as.i == 0 && sp[-1].as.i < 0)
+                    STOP(VM_ZERO_NEGATIVE_POWER);
+                TYPED(i, powInt(a->as.i, b->as.i));
+                DISPATCH();
+            TARGET(OP_POW_F):
+                TYPED(f, powf(a->as.f, b->as.f));
+                DISPATCH();
+            TARGET(OP_POW_D):
+                TYPED(d, pow(a->as.d, b->as.d));
+                DISPATCH();
+            TARGET(OP_EQ_I):
+                TYPED_COMPARE(i, ==);
+                DISPATCH();
+            TARGET(OP_EQ_F):
+                TYPED_COMPARE(f, ==);
+                DISPATCH();
+            TARGET(OP_EQ_D):
+                TYPED_COMPARE(d, ==);
+                DISPATCH();
+            TARGET(OP_NE_I):
+                TYPED_COMPARE(i, !=);
+                DISPATCH();
+            TARGET(OP_NE_F):
+                TYPED_COMPARE(f, !=);
+                DISPATCH();
+            TARGET(OP_NE_D):
+                TYPED_COMPARE(d, !=);
+                DISPATCH();
+            TARGET(OP_LT_I):
+                TYPED_COMPARE(i, <);
+                DISPATCH();
+            TARGET(OP_LT_F):
+                TYPED_COMPARE(f, <);
+                DISPATCH();
+            TARGET(OP_LT_D):
+                TYPED_COMPARE(d, <);
+                DISPATCH();
+            TARGET(OP_LE_I):
+                TYPED_COMPARE(i, <=);
+                DISPATCH();
+            TARGET(OP_LE_F):
+                TYPED_COMPARE(f, <=);
+                DISPATCH();
+            TARGET(OP_LE_D):
+                TYPED_COMPARE(d, <=);
+                DISPATCH();
+            TARGET(OP_GT_I):
+                TYPED_COMPARE(i, >);
+                DISPATCH();
+            TARGET(OP_GT_F):
+                TYPED_COMPARE(f, >);
+                DISPATCH();
+            TARGET(OP_GT_D):
+                TYPED_COMPARE(d, >);
+                DISPATCH();
+            TARGET(OP_GE_I):
+                TYPED_COMPARE(i, >=);
+                DISPATCH();
+            TARGET(OP_GE_F):
+                TYPED_COMPARE(f, >=);
+                DISPATCH();
+            TARGET(OP_GE_D):
+                TYPED_COMPARE(d, >=);
+                DISPATCH();
+            TARGET(OP_WIDEN_I_F):
+                sp[-1].as.f = (float) sp[-1].as.i;
+                sp[-1].type = TYPE_FLOAT;
+                DISPATCH();
+            TARGET(OP_WIDEN_I_D):
+                sp[-1].as.d = (double) sp[-1].as.i;
+                sp[-1].type = TYPE_DOUBLE;
+                DISPATCH();
+            TARGET(OP_WIDEN_F_D):
+                sp[-1].as.d = (double) sp[-1].as.f;
+                sp[-1].type = TYPE_DOUBLE;
+                DISPATCH();
+            TARGET(OP_LOAD_ELEMENT): {
+                uint32_t slot = OPERAND(uint32_t);
+                uint64_t index = (uint64_t) sp[-1].as.i;
+                if (index >= bc->variables[slot].count)
+                    STOP_AFTER_OPERAND(VM_INDEX_OUT_OF_RANGE);
+                sp[-1] = vmElement(slots[slot].as.elements, bc->variables[slot].type, (size_t) index);
+                DISPATCH();
+            }
+            TARGET(OP_STORE_ELEMENT): {
+                uint32_t slot = OPERAND(uint32_t);
+                const Value *v = sp - 1;
+                uint64_t index = (uint64_t) sp[-2].as.i;
+                void *elements = slots[slot].as.elements;
+                if (index >= bc->variables[slot].count)
+                    STOP_AFTER_OPERAND(VM_INDEX_OUT_OF_RANGE);
+                switch (bc->variables[slot].type) {
+                    case TYPE_INT: ((int64_t *) elements)[index] = v->as.i; break;
+                    case TYPE_FLOAT: ((float *) elements)[index] = v->as.f; break;
+                    case TYPE_DOUBLE: ((double *) elements)[index] = v->as.d; break;
+                    default: ((int *) elements)[index] = v->as.b; break;
+                }
+                sp -= 2;
+                DISPATCH();
+            }
+            TARGET(OP_CLEAR_ARRAY): {
+                uint32_t slot = OPERAND(uint32_t);
+                memset(slots[slot].as.elements, 0, bc->variables[slot].count * vmElementSize(bc->variables[slot].type));
+                DISPATCH();
+            }
+            TARGET(OP_ARRAY_LOOP): {
+                const Kernel *kernel = &bc->kernels[OPERAND(uint32_t)];
+                int64_t from = slots[kernel->counter].as.i, to = (--sp)->as.i;
+                if (from < to) {
+                    /* Stopping before any element is done leaves nothing to see: a stopped run reports nothing */
+                    if (!kernelFits(kernel, bc->variables, from, to))
+                        STOP_AFTER_OPERAND(VM_INDEX_OUT_OF_RANGE);
+                    kernelRun(kernel, slots, constants, (size_t) from, (size_t) to);
+                    slots[kernel->counter].as.i = to;
+                    PROFILE_CHARGE();
+                }
+                DISPATCH();
+            }
+        }
+    }
+done:
+#ifdef VM_PROFILING
+    /* What ran since the last sample goes to the instruction the run ended on */
+    last = profileClock() - last;
+    profile->nanoseconds[at] += last;
+    profile->elapsed = profileClock() - start;
+#endif
+    free(stack);
+    if (status != VM_OK)
+        *where = findSite(bc, failed);
+    return status;
+#undef PROFILE_STEP
+#undef PROFILE_TAKEN
+#undef PROFILE_CHARGE
+}